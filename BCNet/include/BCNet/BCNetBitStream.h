@@ -0,0 +1,227 @@
+#pragma once
+
+#include <BCNet/Core/Common.h>
+#include <BCNet/BCNetPacket.h>
+
+#include <stdint.h>
+
+namespace BCNet
+{
+	/// <summary>
+	/// Returns how many bits are needed to hold every value from 0 up to and including the provided range.
+	/// </summary>
+	constexpr unsigned int BitsRequired(uint32_t range)
+	{
+		return range == 0 ? 0 : 1 + BitsRequired(range >> 1);
+	}
+
+	// -------------------------- BITSTREAMWRITER
+	/// <summary>
+	/// Utility object, packs values into a packet bit by bit instead of byte by byte.
+	/// Writes go through a byte stream, so the bits end up in either a provided packet or the writer's own growing storage.
+	/// Bits are gathered in a 64 bit scratch word and handed to the byte stream 32 bits at a time,
+	/// so writing a value never loops over it's bits.
+	/// The last partial byte is padded with zeroes on Flush(), after which the byte stream can be written to as usual.
+	/// </summary>
+	class BCNET_API BitStreamWriter
+	{
+	public:
+		/// <summary>
+		/// Initializes the Bit Stream with the byte stream to write to.
+		/// The byte stream must outlive the bit stream.
+		/// </summary>
+		/// <param name="writer">The byte stream to write to.</param>
+		explicit BitStreamWriter(PacketStreamWriter &writer);
+		BitStreamWriter(const BitStreamWriter &) = delete;
+		BitStreamWriter &operator=(const BitStreamWriter &) = delete;
+		~BitStreamWriter(); // Flushes.
+
+		/// <summary>
+		/// Writes the lowest bits of a value into the stream.
+		/// </summary>
+		/// <param name="value">The value to write, bits above the provided amount are ignored.</param>
+		/// <param name="bits">The amount of bits to write, from 1 to 32.</param>
+		bool WriteBits(uint32_t value, unsigned int bits)
+		{
+			if (bits == 0 || bits > 32)
+				return false;
+
+			m_scratch |= (uint64_t)(value & (0xFFFFFFFFu >> (32 - bits))) << m_scratchBits;
+			m_scratchBits += bits;
+			m_bitsWritten += bits;
+
+			if (m_scratchBits >= 32) // Hand a full word over to the byte stream.
+				return FlushWord();
+			return !m_failed;
+		}
+
+		/// <summary>
+		/// Writes a bool as a single bit.
+		/// </summary>
+		bool WriteBool(bool value)
+		{
+			return WriteBits(value ? 1 : 0, 1);
+		}
+
+		/// <summary>
+		/// Writes a value known to be between Min and Max, using only as many bits as the range needs.
+		/// The value is clamped into the range.
+		/// </summary>
+		/// <param name="value">The value to write.</param>
+		template <int32_t Min, int32_t Max>
+		bool WriteRanged(int32_t value)
+		{
+			static_assert(Min < Max, "The range must hold more than one value.");
+			constexpr unsigned int bits = BitsRequired((uint32_t)((int64_t)Max - Min));
+
+			if (value < Min)
+				value = Min;
+			else if (value > Max)
+				value = Max;
+			return WriteBits((uint32_t)((int64_t)value - Min), bits);
+		}
+
+		/// <summary>
+		/// Writes a float as it's 32 raw bits.
+		/// </summary>
+		bool WriteFloat(float value);
+
+		/// <summary>
+		/// Writes whatever bits are left over into the byte stream, padding the last byte with zeroes.
+		/// Called automatically when the bit stream is destroyed.
+		/// </summary>
+		bool Flush();
+
+		/// <summary>
+		/// Returns whether every write so far has succeeded.
+		/// </summary>
+		bool IsStreamGood() const { return !m_failed && m_writer.IsStreamGood(); }
+
+		/// <summary>
+		/// The amount of bits written so far.
+		/// </summary>
+		size_t GetBitsWritten() const { return m_bitsWritten; }
+
+		/// <summary>
+		/// The amount of bytes the bits written so far take up once flushed.
+		/// </summary>
+		size_t GetBytesWritten() const { return (m_bitsWritten + 7) / 8; }
+
+		// Operator overloads.
+		operator bool() const
+		{
+			return IsStreamGood();
+		}
+
+	private:
+		bool FlushWord();
+
+	private:
+		PacketStreamWriter &m_writer;
+
+		uint64_t m_scratch = 0; // Bits waiting to be written, lowest first.
+		unsigned int m_scratchBits = 0;
+		size_t m_bitsWritten = 0;
+		bool m_failed = false;
+
+	};
+
+	// -------------------------- BITSTREAMREADER
+	/// <summary>
+	/// Utility object, reads values packed by a BitStreamWriter.
+	/// Reads come from a byte stream, up to 4 bytes at a time into a 64 bit scratch word.
+	/// Call Align() once done to skip the padding, the byte stream is then left right after the bits and can be read from as usual.
+	/// </summary>
+	class BCNET_API BitStreamReader
+	{
+	public:
+		/// <summary>
+		/// Initializes the Bit Stream with the byte stream to read from.
+		/// The byte stream must outlive the bit stream.
+		/// </summary>
+		/// <param name="reader">The byte stream to read from.</param>
+		explicit BitStreamReader(PacketStreamReader &reader);
+		BitStreamReader(const BitStreamReader &) = delete;
+		BitStreamReader &operator=(const BitStreamReader &) = delete;
+
+		/// <summary>
+		/// Reads bits written by BitStreamWriter::WriteBits.
+		/// Fails if there aren't enough bits left in the packet.
+		/// </summary>
+		/// <param name="value">The value to read to.</param>
+		/// <param name="bits">The amount of bits to read, from 1 to 32.</param>
+		bool ReadBits(uint32_t &value, unsigned int bits)
+		{
+			if (bits == 0 || bits > 32)
+				return false;
+
+			if (m_scratchBits < bits && !Refill(bits)) // Not enough bits left.
+				return false;
+
+			value = (uint32_t)(m_scratch & (0xFFFFFFFFu >> (32 - bits)));
+			m_scratch >>= bits;
+			m_scratchBits -= bits;
+			m_bitsRead += bits;
+			return true;
+		}
+
+		/// <summary>
+		/// Reads a bool written by BitStreamWriter::WriteBool.
+		/// </summary>
+		bool ReadBool(bool &value)
+		{
+			uint32_t bit = 0;
+			if (!ReadBits(bit, 1))
+				return false;
+
+			value = bit != 0;
+			return true;
+		}
+
+		/// <summary>
+		/// Reads a value written by BitStreamWriter::WriteRanged with the same range.
+		/// Fails if the value read is outside of the range.
+		/// </summary>
+		/// <param name="value">The value to read to.</param>
+		template <int32_t Min, int32_t Max>
+		bool ReadRanged(int32_t &value)
+		{
+			static_assert(Min < Max, "The range must hold more than one value.");
+			constexpr unsigned int bits = BitsRequired((uint32_t)((int64_t)Max - Min));
+
+			uint32_t offset = 0;
+			if (!ReadBits(offset, bits) || offset > (uint32_t)((int64_t)Max - Min))
+				return false;
+
+			value = (int32_t)((int64_t)Min + offset);
+			return true;
+		}
+
+		/// <summary>
+		/// Reads a float written by BitStreamWriter::WriteFloat.
+		/// </summary>
+		bool ReadFloat(float &value);
+
+		/// <summary>
+		/// Skips the padding up to the next byte and gives any bytes read ahead back to the byte stream.
+		/// </summary>
+		void Align();
+
+		/// <summary>
+		/// The amount of bits read so far.
+		/// </summary>
+		size_t GetBitsRead() const { return m_bitsRead; }
+
+	private:
+		bool Refill(unsigned int bits);
+
+	private:
+		PacketStreamReader &m_reader;
+
+		uint64_t m_scratch = 0; // Bits read ahead, lowest first.
+		unsigned int m_scratchBits = 0;
+		size_t m_bitsRead = 0;
+
+	};
+
+}
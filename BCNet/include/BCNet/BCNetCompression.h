@@ -0,0 +1,57 @@
+#pragma once
+
+#include <BCNet/Core/Common.h>
+#include <BCNet/BCNetPacket.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define COMPRESSION_DEFAULT_THRESHOLD 128 // Packets smaller than this are rarely worth compressing.
+#define COMPRESSION_MAX_DICTIONARY_SIZE 65535 // Matches can only reach this far back, anything before it in a dictionary goes unused.
+
+namespace BCNet
+{
+	/// <summary>
+	/// Returns the most bytes Compress() can write for the provided amount of input, for input that doesn't compress at all.
+	/// </summary>
+	BCNET_API size_t GetCompressBound(size_t size);
+
+	/// <summary>
+	/// Compresses data with the library's LZ codec, a byte oriented LZ77 variant built for speed over ratio.
+	/// Repeats are found through a hash table of 4 byte sequences and written as offsets into what came before,
+	/// which can include a dictionary of bytes that commonly show up, so short messages have something to match against too.
+	/// </summary>
+	/// <param name="source">The data to compress.</param>
+	/// <param name="size">The size of the data.</param>
+	/// <param name="destination">Where to write the compressed data.</param>
+	/// <param name="capacity">How many bytes can be written, GetCompressBound() is always enough.</param>
+	/// <param name="dictionary">The dictionary to match against, the same one must be used to decompress.</param>
+	/// <returns>The size of the compressed data, 0 if it didn't fit.</returns>
+	BCNET_API size_t Compress(const void *source, size_t size, void *destination, size_t capacity, const Packet &dictionary = Packet());
+
+	/// <summary>
+	/// Decompresses data written by Compress().
+	/// Never reads or writes outside of the provided buffers, even if the data is corrupt.
+	/// </summary>
+	/// <param name="source">The compressed data.</param>
+	/// <param name="size">The size of the compressed data.</param>
+	/// <param name="destination">Where to write the decompressed data.</param>
+	/// <param name="decompressedSize">The exact size of the data before it was compressed.</param>
+	/// <param name="dictionary">The dictionary it was compressed with.</param>
+	/// <returns>Whether the data was valid and decompressed to exactly the expected size.</returns>
+	BCNET_API bool Decompress(const void *source, size_t size, void *destination, size_t decompressedSize, const Packet &dictionary = Packet());
+
+	/// <summary>
+	/// Builds a dictionary out of sample packets, like ones captured from real traffic.
+	/// The samples are split into as many stretches as there are segments in the dictionary, and from each stretch the segment
+	/// made of the byte sequences found in the most samples is picked. The best segments are put last, closest to the data
+	/// being compressed, so the offsets to them are the shortest. Meant to be run offline, the result shipped with both the server and client.
+	/// </summary>
+	/// <param name="samples">The sample packets.</param>
+	/// <param name="count">How many samples there are.</param>
+	/// <param name="dictionary">Where to write the dictionary.</param>
+	/// <param name="capacity">The most bytes the dictionary can take, up to COMPRESSION_MAX_DICTIONARY_SIZE are used.</param>
+	/// <returns>The size of the dictionary.</returns>
+	BCNET_API size_t TrainCompressionDictionary(const Packet *samples, size_t count, void *dictionary, size_t capacity);
+
+}
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <BCNet/Core/Common.h>
+#include <BCNet/BCNetPacket.h>
+#include <BCNet/BCNetSerialize.h>
+
+#include <algorithm>
+#include <array>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <stdint.h>
+
+#define PACKET_DISPATCH_MAX_ID 0xFFFF // Handlers live in an array indexed by packet ID, so IDs have to be at most this.
+
+/// <summary>
+/// Handlers take the dispatcher's arguments followed by the decoded message, a server's dispatcher passes the ClientInfo first:
+///
+///		void OnChatMessage(const BCNet::ClientInfo &client, const ChatMessage &message);
+///
+///		BCNet::ServerPacketDispatcher dispatcher;
+///		dispatcher.RegisterHandler<(uint32_t)PacketID::PACKET_CHAT, &OnChatMessage>(); // Called directly, no indirection for the handler itself.
+///		dispatcher.RegisterHandler<ChatMessage>((uint32_t)PacketID::PACKET_CHAT, [&](const BCNet::ClientInfo &client, const ChatMessage &message) { ... });
+///		server->SetPacketDispatcher(&dispatcher);
+///
+/// Handlers whose last parameter is a PacketStreamReader get the reader after the header instead of a decoded message.
+/// </summary>
+
+namespace BCNet
+{
+	/// <summary>
+	/// Finds the message type a handler function takes, it's last parameter.
+	/// </summary>
+	template <typename Function>
+	struct PacketHandlerTraits;
+
+	template <typename Return, typename... Parameters>
+	struct PacketHandlerTraits<Return(*)(Parameters...)>
+	{
+		static_assert(sizeof...(Parameters) > 0, "A packet handler needs the message as it's last parameter.");
+		using MessageType = std::decay_t<std::tuple_element_t<sizeof...(Parameters) - 1, std::tuple<Parameters...>>>;
+	};
+
+	/// <summary>
+	/// Reads a message and calls a handler with it, handlers taking a PacketStreamReader get the reader as it is.
+	/// Returns false if the message couldn't be read.
+	/// </summary>
+	template <typename Message, typename Handler, typename... Args>
+	bool InvokePacketHandler(Handler &&handler, PacketStreamReader &reader, Args&&... args)
+	{
+		if constexpr (std::is_same<Message, PacketStreamReader>::value)
+		{
+			handler(std::forward<Args>(args)..., reader);
+			return true;
+		}
+		else
+		{
+			Message message{};
+			if (!Deserialize(reader, message))
+				return false;
+
+			handler(std::forward<Args>(args)..., (const Message &)message);
+			return true;
+		}
+	}
+
+	// -------------------------- PACKETHANDLER
+	/// <summary>
+	/// A handler known at compile time, for StaticPacketDispatcher.
+	/// </summary>
+	template <uint32_t ID, auto Function>
+	struct PacketHandler
+	{
+		static_assert(ID <= PACKET_DISPATCH_MAX_ID, "Packet IDs must be at most PACKET_DISPATCH_MAX_ID.");
+
+		static constexpr uint32_t id = ID;
+		using MessageType = typename PacketHandlerTraits<decltype(Function)>::MessageType;
+
+		template <typename... Args>
+		static bool Invoke(PacketStreamReader &reader, Args... args)
+		{
+			return InvokePacketHandler<MessageType>(Function, reader, std::forward<Args>(args)...);
+		}
+	};
+
+	// -------------------------- STATICPACKETDISPATCHER
+	/// <summary>
+	/// A dispatch table built at compile time out of PacketHandlers, an array of function pointers spanning the lowest to the highest ID.
+	/// Dispatching is a range check and an indexed call, with each handler inlined into it's table entry.
+	///
+	///		using Dispatcher = BCNet::StaticPacketDispatcher<
+	///			BCNet::PacketHandler<(uint32_t)PacketID::PACKET_CHAT, &OnChatMessage>,
+	///			BCNet::PacketHandler<(uint32_t)PacketID::PACKET_MOVE, &OnMove>>;
+	///
+	///		Dispatcher::Dispatch(id, packetReader, client);
+	/// </summary>
+	template <typename... Handlers>
+	class StaticPacketDispatcher
+	{
+		static_assert(sizeof...(Handlers) > 0, "A dispatcher needs at least one handler.");
+
+	public:
+		static constexpr uint32_t MIN_ID = std::min({ Handlers::id... });
+		static constexpr uint32_t MAX_ID = std::max({ Handlers::id... });
+
+		/// <summary>
+		/// Calls the handler for the packet ID, the reader should be right after the header.
+		/// Returns false if there's no handler for the ID or the message couldn't be read.
+		/// </summary>
+		template <typename... Args>
+		static bool Dispatch(uint32_t id, PacketStreamReader &reader, Args... args)
+		{
+			if (id < MIN_ID || id > MAX_ID)
+				return false;
+
+			const auto handler = s_table<Args...>[id - MIN_ID];
+			return handler && handler(reader, args...);
+		}
+
+		/// <summary>
+		/// Reads the header and calls the handler for it.
+		/// </summary>
+		template <typename... Args>
+		static bool Dispatch(PacketStreamReader &reader, Args... args)
+		{
+			uint32_t id = 0;
+			return reader.ReadHeader(id) && Dispatch<Args...>(id, reader, args...);
+		}
+
+	private:
+		template <typename... Args>
+		using Entry = bool(*)(PacketStreamReader &, Args...);
+
+		template <typename... Args>
+		static constexpr std::array<Entry<Args...>, MAX_ID - MIN_ID + 1> MakeTable()
+		{
+			std::array<Entry<Args...>, MAX_ID - MIN_ID + 1> table = {};
+			((table[Handlers::id - MIN_ID] = &Handlers::template Invoke<Args...>), ...);
+			return table;
+		}
+
+		template <typename... Args>
+		static constexpr std::array<Entry<Args...>, MAX_ID - MIN_ID + 1> s_table = MakeTable<Args...>();
+
+	};
+
+	// -------------------------- PACKETDISPATCHER
+	/// <summary>
+	/// A dispatch table filled in at runtime, an array of handlers indexed by packet ID.
+	/// Each entry is a plain function pointer, with the handler inlined into it, and a pointer to the handler's captures if it has any,
+	/// so dispatching is a bounds check and an indexed call instead of a switch and a std::function.
+	/// Handlers should all be registered before dispatching starts, registering isn't thread safe but dispatching is.
+	/// </summary>
+	template <typename... Args>
+	class PacketDispatcher
+	{
+	public:
+		PacketDispatcher() = default;
+		PacketDispatcher(const PacketDispatcher &) = delete;
+		PacketDispatcher &operator=(const PacketDispatcher &) = delete;
+
+		~PacketDispatcher()
+		{
+			Clear();
+		}
+
+		/// <summary>
+		/// Registers a function known at compile time, it's called directly from the table.
+		/// The message type is taken from the function's last parameter.
+		/// </summary>
+		template <uint32_t ID, auto Function>
+		void RegisterHandler()
+		{
+			static_assert(ID <= PACKET_DISPATCH_MAX_ID, "Packet IDs must be at most PACKET_DISPATCH_MAX_ID.");
+
+			Entry &entry = GetEntry(ID);
+			entry.call = [](const Entry &, PacketStreamReader &reader, Args... args)
+			{
+				return PacketHandler<ID, Function>::template Invoke<Args...>(reader, std::forward<Args>(args)...);
+			};
+		}
+
+		/// <summary>
+		/// Registers a handler for a message type, any callable taking the dispatcher's arguments followed by the message.
+		/// Replaces any handler already registered for the ID.
+		/// </summary>
+		/// <param name="id">The packet ID, at most PACKET_DISPATCH_MAX_ID.</param>
+		/// <param name="handler">The handler, it's moved into the dispatcher.</param>
+		/// <returns>False if the ID is too big.</returns>
+		template <typename Message, typename Handler>
+		bool RegisterHandler(uint32_t id, Handler &&handler)
+		{
+			if (id > PACKET_DISPATCH_MAX_ID)
+				return false;
+
+			using Stored = std::decay_t<Handler>;
+
+			Entry &entry = GetEntry(id);
+			entry.object = new Stored(std::forward<Handler>(handler));
+			entry.destroy = [](void *object) { delete (Stored*)object; };
+			entry.call = [](const Entry &entry, PacketStreamReader &reader, Args... args)
+			{
+				return InvokePacketHandler<Message>(*(Stored*)entry.object, reader, std::forward<Args>(args)...);
+			};
+			return true;
+		}
+
+		/// <summary>
+		/// Removes the handler for a packet ID.
+		/// </summary>
+		void UnregisterHandler(uint32_t id)
+		{
+			if (id < m_entries.size())
+				Reset(m_entries[id]);
+		}
+
+		/// <summary>
+		/// Returns whether there's a handler for a packet ID.
+		/// </summary>
+		bool HasHandler(uint32_t id) const
+		{
+			return id < m_entries.size() && m_entries[id].call;
+		}
+
+		/// <summary>
+		/// Calls the handler for the packet ID, the reader should be right after the header.
+		/// Returns false if there's no handler for the ID or the message couldn't be read.
+		/// </summary>
+		bool Dispatch(uint32_t id, PacketStreamReader &reader, Args... args) const
+		{
+			if (id >= m_entries.size())
+				return false;
+
+			const Entry &entry = m_entries[id];
+			return entry.call && entry.call(entry, reader, std::forward<Args>(args)...);
+		}
+
+		/// <summary>
+		/// Removes every handler.
+		/// </summary>
+		void Clear()
+		{
+			for (Entry &entry : m_entries)
+				Reset(entry);
+			m_entries.clear();
+		}
+
+	private:
+		struct Entry
+		{
+			bool (*call)(const Entry &, PacketStreamReader &, Args...) = nullptr;
+			void *object = nullptr; // The handler's captures.
+			void (*destroy)(void *) = nullptr;
+		};
+
+		Entry &GetEntry(uint32_t id)
+		{
+			if (id >= m_entries.size())
+				m_entries.resize((size_t)id + 1);
+
+			Entry &entry = m_entries[id];
+			Reset(entry);
+			return entry;
+		}
+
+		static void Reset(Entry &entry)
+		{
+			if (entry.destroy)
+				entry.destroy(entry.object);
+			entry = Entry();
+		}
+
+	private:
+		std::vector<Entry> m_entries;
+
+	};
+
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <BCNet/Core/Common.h>
+#include <BCNet/BCNetPacket.h>
+
+#include <stdint.h>
+
+// Forward Declare.
+struct SteamNetworkingMessage_t;
+
+typedef unsigned int uint32;
+
+namespace BCNet
+{
+	/// <summary>
+	/// A message received from a connection.
+	/// Holds on to the networking library's own message buffer instead of copying it, the buffer
+	/// is only given back once every copy of the message has been destroyed, so a message can be
+	/// kept, parsed later or queued to another thread without copying the payload.
+	/// Copying a message only bumps a reference count, which is thread safe.
+	/// </summary>
+	class BCNET_API ReceivedMessage
+	{
+	public:
+		ReceivedMessage() = default;
+
+		/// <summary>
+		/// Takes ownership of a message returned by GameNetworkingSockets.
+		/// The message is released once the last copy of this object is destroyed.
+		/// </summary>
+		/// <param name="message">The message to take ownership of.</param>
+		explicit ReceivedMessage(SteamNetworkingMessage_t *message);
+
+		ReceivedMessage(const ReceivedMessage &other);
+		ReceivedMessage(ReceivedMessage &&other) noexcept;
+		~ReceivedMessage();
+
+		ReceivedMessage &operator=(const ReceivedMessage &other);
+		ReceivedMessage &operator=(ReceivedMessage &&other) noexcept;
+
+		/// <summary>
+		/// Drops this reference to the message.
+		/// </summary>
+		void Reset();
+
+		/// <summary>
+		/// Returns a packet pointing straight at the message payload.
+		/// The packet is only valid while this message (or a copy of it) is alive.
+		/// </summary>
+		const Packet &GetPacket() const { return m_packet; }
+
+		/// <summary>
+		/// Returns the message payload.
+		/// </summary>
+		const void *GetData() const { return m_packet.data; }
+
+		/// <summary>
+		/// Returns the size of the message payload.
+		/// </summary>
+		size_t GetSize() const { return m_packet.size; }
+
+		/// <summary>
+		/// Returns a message covering part of this one's payload, sharing the received buffer instead of copying it.
+		/// Returns an empty message if the range is outside the payload.
+		/// </summary>
+		/// <param name="offset">Where the part starts in the payload.</param>
+		/// <param name="size">The size of the part.</param>
+		ReceivedMessage Slice(size_t offset, size_t size) const;
+
+		/// <summary>
+		/// Returns the connection the message was received from.
+		/// </summary>
+		uint32 GetConnection() const;
+
+		/// <summary>
+		/// Returns the message number assigned by the sender.
+		/// </summary>
+		int64_t GetMessageNumber() const;
+
+		/// <summary>
+		/// Returns the local timestamp the message was received at, in microseconds.
+		/// </summary>
+		int64_t GetTimeReceived() const;
+
+		/// <summary>
+		/// Returns the user data the connection had when the message was received.
+		/// </summary>
+		int64_t GetConnectionUserData() const;
+
+		// Operator overloads.
+		operator const Packet &() const
+		{
+			return m_packet;
+		}
+
+		operator bool() const
+		{
+			return m_control != nullptr;
+		}
+
+	private:
+		struct Control; // Reference count and the owned message.
+
+		Control *m_control = nullptr;
+		Packet m_packet; // Cached so reading the payload doesn't go through the control block.
+
+	};
+
+}
@@ -1,11 +1,15 @@
 #pragma once
 
 #include <BCNet/Core/Common.h>
+#include <BCNet/Core/Types.h>
 
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <type_traits>
 
 #define DEFAULT_PACKETS_COUNT 100
+#define PACKET_STREAM_INLINE_CAPACITY 256 // Bytes a growing PacketStreamWriter can hold before it needs the packet pool.
 
 namespace BCNet
 {
@@ -16,6 +20,13 @@ namespace BCNet
 	{
 		PACKET_INVALID = 0,
 
+		PACKET_TRANSFER_BEGIN = 90, // Announces a transfer, see BeginTransfer().
+		PACKET_TRANSFER_CHUNK = 91, // One piece of a transfer, with the fragmented flag in the compact encoding.
+		PACKET_TRANSFER_END = 92, // Finishes a transfer, sent by whichever end ended it.
+		PACKET_BATCH = 93, // Several packets sent as one, only in the compact encoding, see PACKET_FLAG_BATCHED.
+		PACKET_SNAPSHOT = 94, // A state snapshot, delta encoded against one the client has acknowledged.
+		PACKET_SNAPSHOT_ACK = 95, // Tells the server which snapshot the client has, or with sequence 0 which baseline it doesn't.
+		PACKET_HANDSHAKE = 96, // Agrees on the packet encoding, always sent with the standard encoding.
 		PACKET_WHOSONLINE = 97, // Who's Online command
 		PACKET_NICKNAME = 98, // Nickname command
 		PACKET_SERVER = 99, // Server Messages
@@ -23,6 +34,27 @@ namespace BCNet
 		PACKET_COUNT = DEFAULT_PACKETS_COUNT
 	};
 
+	/// <summary>
+	/// Flags carried in the header of a compactly encoded packet.
+	/// </summary>
+	enum PacketHeaderFlags : uint8_t
+	{
+		PACKET_FLAG_NONE = 0,
+		PACKET_FLAG_COMPRESSED = 1 << 0, // The payload after the header is compressed.
+		PACKET_FLAG_FRAGMENTED = 1 << 1, // The payload is one piece of a bigger packet.
+		PACKET_FLAG_BATCHED = 1 << 2 // The payload holds several packets.
+	};
+
+	/// <summary>
+	/// The byte order arrays are written in, see PacketStreamWriter::WriteArray.
+	/// </summary>
+	enum class ByteOrder : uint8_t
+	{
+		NATIVE = 0, // Whatever the host uses, arrays are copied straight through.
+		LITTLE, // Lowest byte first, swapped on big endian hosts.
+		BIG // Highest byte first, swapped on little endian hosts.
+	};
+
 	/// <summary>
 	/// An object which contains data that can be sent across a network connection.
 	/// </summary>
@@ -56,29 +88,15 @@ namespace BCNet
 
 		/// <summary>
 		/// Allocates a set amount of data the packet can use.
+		/// The data is taken from the packet pool, see BCNetPacketPool.h.
 		/// </summary>
 		/// <param name="size">The amount of data in bytes that the packet can use, 1024 by default.</param>
-		void Allocate(const size_t size = 1024)
-		{
-			delete[](uint8_t*)data;
-			data = nullptr;
-
-			if (size <= 0)
-				return;
-
-			data = new uint8_t[size];
-			this->size = size;
-		}
+		void Allocate(const size_t size = 1024);
 
 		/// <summary>
-		/// Cleans up the packet, deleting the data and deallocating.
+		/// Cleans up the packet, handing the data back to the packet pool.
 		/// </summary>
-		void Release()
-		{
-			delete[](uint8_t*)data;
-			data = nullptr;
-			size = 0;
-		}
+		void Release();
 
 		/// <summary>
 		/// Clears the data.
@@ -188,27 +206,79 @@ namespace BCNet
 	// -------------------------- PACKETSTREAMWRITER
 	/// <summary>
 	/// Utility object, helps writing different types of data into a single packet.
+	/// The writer can either write into a packet provided by the application, or own it's storage,
+	/// in which case it starts with a small inline buffer and grows into the packet pool as needed.
 	/// </summary>
 	class BCNET_API PacketStreamWriter
 	{
 	public:
+		/// <summary>
+		/// Initializes a Packet Stream which owns it's storage.
+		/// Small packets are written into an inline buffer, bigger ones grow geometrically into the packet pool,
+		/// so the written packet is never cut off and GetPacket() returns exactly what was written.
+		/// </summary>
+		/// <param name="encoding">How headers and sizes are written.</param>
+		explicit PacketStreamWriter(PacketEncoding encoding = PacketEncoding::STANDARD);
+
 		/// <summary>
 		/// Initializes the Packet Stream with the packet to write to.
-		/// The provided packet must be allocated.
+		/// The provided packet must be allocated, writes past the end of it will fail.
 		/// </summary>
 		/// <param name="packet">The packet to write to.</param>
 		/// <param name="position">The position to start writing to.</param>
-		PacketStreamWriter(Packet packet, size_t position = 0);
+		/// <param name="encoding">How headers and sizes are written.</param>
+		PacketStreamWriter(Packet packet, size_t position = 0, PacketEncoding encoding = PacketEncoding::STANDARD);
 		PacketStreamWriter(const PacketStreamWriter &) = delete;
-		virtual ~PacketStreamWriter() = default;
+		PacketStreamWriter &operator=(const PacketStreamWriter &) = delete;
+		virtual ~PacketStreamWriter();
 
 		/// <summary>
 		/// Writes data into the stream.
+		/// Returns false if the data doesn't fit into a provided packet, the stream is then no longer good.
 		/// </summary>
 		/// <param name="data">The data to write.</param>
 		/// <param name="size">The size of the data.</param>
 		bool WriteData(const char *data, size_t size);
 
+		/// <summary>
+		/// Makes sure the stream can hold at least the provided amount of bytes without growing again.
+		/// Only does anything if the writer owns it's storage.
+		/// </summary>
+		/// <param name="capacity">The capacity in bytes.</param>
+		void Reserve(size_t capacity);
+
+		/// <summary>
+		/// Rewinds the stream so it can be reused, keeps whatever storage it already has.
+		/// </summary>
+		void Reset();
+
+		/// <summary>
+		/// Writes the packet header, a 4 byte ID with the standard encoding,
+		/// or a flags byte followed by a 1 or 2 byte varint ID (for IDs below 16384) with the compact encoding.
+		/// The standard encoding has no room for flags, they're dropped.
+		/// </summary>
+		/// <param name="packetID">The packet ID.</param>
+		/// <param name="flags">PacketHeaderFlags describing the payload.</param>
+		bool WriteHeader(uint32_t packetID, uint8_t flags = PACKET_FLAG_NONE);
+
+		/// <summary>
+		/// Writes an unsigned integer as a LEB128 varint, 7 bits a byte so small values take a single byte.
+		/// </summary>
+		/// <param name="value">The value to write.</param>
+		bool WriteVarUInt(uint64_t value);
+
+		/// <summary>
+		/// Writes a signed integer as a zigzag encoded varint, so small negative values stay small too.
+		/// </summary>
+		/// <param name="value">The value to write.</param>
+		bool WriteVarInt(int64_t value);
+
+		/// <summary>
+		/// Writes a size or length, 8 bytes with the standard encoding or a varint with the compact encoding.
+		/// </summary>
+		/// <param name="size">The size to write.</param>
+		bool WriteSize(size_t size);
+
 		/// <summary>
 		/// Writes the contents of another packet into the stream.
 		/// </summary>
@@ -222,6 +292,30 @@ namespace BCNet
 		/// <param name="size">The amount of zeroes to write in bytes.</param>
 		void WriteZero(size_t size);
 
+		/// <summary>
+		/// Writes an array of numbers or enums in one go, in the stream's byte order.
+		/// With the native byte order, or when the host already matches it, this is a single copy,
+		/// otherwise the bytes are swapped with SIMD while they're copied.
+		/// </summary>
+		/// <param name="data">The array to write.</param>
+		/// <param name="count">The amount of elements in the array.</param>
+		template <typename T>
+		bool WriteArray(const T *data, size_t count)
+		{
+			static_assert(std::is_arithmetic_v<T> || std::is_enum_v<T>, "Only arrays of numbers and enums can be written in one go.");
+			return WriteArrayData(data, sizeof(T), count);
+		}
+
+		/// <summary>
+		/// Writes a fixed size array of numbers or enums in one go, in the stream's byte order.
+		/// </summary>
+		/// <param name="data">The array to write.</param>
+		template <typename T, size_t N>
+		bool WriteArray(const T (&data)[N])
+		{
+			return WriteArray<T>(data, N);
+		}
+
 		/// <summary>
 		/// Writes a string into the stream.
 		/// </summary>
@@ -233,22 +327,56 @@ namespace BCNet
 		/// </summary>
 		/// <param name="type">The data to write.</param>
 		template <typename T>
-		void WriteRaw(const T &type)
+		bool WriteRaw(const T &type)
 		{
-			bool success = WriteData((char *)&type, sizeof(T));
-			// TODO: Handle failure.
+			return WriteData((char *)&type, sizeof(T));
 		}
 
 		/// <summary>
-		/// Returns whether the packet has data or not.
+		/// Returns whether the packet has data and every write so far has succeeded.
 		/// </summary>
-		bool IsStreamGood() const { return (bool)m_packet; }
+		bool IsStreamGood() const { return (bool)m_packet && !m_failed; }
+
+		/// <summary>
+		/// Returns whether the writer owns it's storage and grows as needed.
+		/// </summary>
+		bool IsGrowing() const { return m_growing; }
+
+		/// <summary>
+		/// Sets how headers and sizes are written from here on.
+		/// </summary>
+		void SetEncoding(PacketEncoding encoding) { m_encoding = encoding; }
+
+		/// <summary>
+		/// Returns how headers and sizes are written.
+		/// </summary>
+		PacketEncoding GetEncoding() const { return m_encoding; }
+
+		/// <summary>
+		/// Sets the byte order WriteArray uses from here on, Serialize() uses it for single numbers too, WriteRaw never swaps.
+		/// </summary>
+		void SetByteOrder(ByteOrder byteOrder) { m_byteOrder = byteOrder; }
+
+		/// <summary>
+		/// Returns the byte order WriteArray uses.
+		/// </summary>
+		ByteOrder GetByteOrder() const { return m_byteOrder; }
 
 		/// <summary>
 		/// The current position in the stream.
 		/// </summary>
 		size_t GetStreamPosition() { return m_position; }
 
+		/// <summary>
+		/// The exact amount of bytes written so far.
+		/// </summary>
+		size_t GetSize() const { return m_position; }
+
+		/// <summary>
+		/// How many bytes the stream can hold before it has to grow.
+		/// </summary>
+		size_t GetCapacity() const { return m_packet.size; }
+
 		/// <summary>
 		/// Sets the stream position.
 		/// </summary>
@@ -271,10 +399,20 @@ namespace BCNet
 		BCNET_API friend PacketStreamWriter &operator<<(PacketStreamWriter &writer, Packet packet);
 		BCNET_API friend PacketStreamWriter &operator<<(PacketStreamWriter &writer, const std::string &string);
 
+	private:
+		bool Grow(size_t required);
+		bool WriteArrayData(const void *data, size_t elementSize, size_t count);
+
 	private:
 		Packet m_packet;
 		size_t m_position = 0;
 
+		PacketEncoding m_encoding = PacketEncoding::STANDARD;
+		ByteOrder m_byteOrder = ByteOrder::NATIVE;
+		bool m_growing = false; // Whether the writer owns it's storage.
+		bool m_failed = false; // Whether a write has failed.
+		uint8_t m_inlineBuffer[PACKET_STREAM_INLINE_CAPACITY];
+
 	};
 
 	template<typename T>
@@ -297,7 +435,8 @@ namespace BCNet
 		/// </summary>
 		/// <param name="packet">The packet to read from.</param>
 		/// <param name="position">The position to start reading from.</param>
-		PacketStreamReader(Packet packet, size_t position = 0);
+		/// <param name="encoding">How headers and sizes were written.</param>
+		PacketStreamReader(Packet packet, size_t position = 0, PacketEncoding encoding = PacketEncoding::STANDARD);
 		PacketStreamReader(const PacketStreamReader &) = delete;
 		virtual ~PacketStreamReader() = default;
 
@@ -308,6 +447,37 @@ namespace BCNet
 		/// <param name="size">The size of the data to read.</param>
 		bool ReadData(char *dest, size_t size);
 
+		/// <summary>
+		/// Reads the packet header written by PacketStreamWriter::WriteHeader.
+		/// </summary>
+		/// <param name="packetID">The packet ID.</param>
+		/// <param name="flags">PacketHeaderFlags describing the payload, always none with the standard encoding.</param>
+		bool ReadHeader(uint32_t &packetID, uint8_t &flags);
+
+		/// <summary>
+		/// Reads the packet header written by PacketStreamWriter::WriteHeader, ignoring the flags.
+		/// </summary>
+		/// <param name="packetID">The packet ID.</param>
+		bool ReadHeader(uint32_t &packetID);
+
+		/// <summary>
+		/// Reads an unsigned LEB128 varint, fails on varints longer than 10 bytes.
+		/// </summary>
+		/// <param name="value">The value to read to.</param>
+		bool ReadVarUInt(uint64_t &value);
+
+		/// <summary>
+		/// Reads a zigzag encoded signed varint.
+		/// </summary>
+		/// <param name="value">The value to read to.</param>
+		bool ReadVarInt(int64_t &value);
+
+		/// <summary>
+		/// Reads a size or length written by PacketStreamWriter::WriteSize.
+		/// </summary>
+		/// <param name="size">The size to read to.</param>
+		bool ReadSize(size_t &size);
+
 		/// <summary>
 		/// Reads data from a packet to a packet.
 		/// </summary>
@@ -321,6 +491,43 @@ namespace BCNet
 		/// <param name="string">The string to read to.</param>
 		bool ReadString(std::string &string);
 
+		/// <summary>
+		/// Reads a packet without copying it, the view points straight into the packet being read
+		/// and is only valid for as long as that packet's data is.
+		/// </summary>
+		/// <param name="view">The view to read to.</param>
+		/// <param name="size">The size of the packet being read, if 0 the size is read from the stream.</param>
+		bool ReadView(Packet &view, size_t size = 0);
+
+		/// <summary>
+		/// Reads a string without copying it, the view points straight into the packet being read
+		/// and is only valid for as long as that packet's data is.
+		/// </summary>
+		/// <param name="string">The view to read to.</param>
+		bool ReadStringView(std::string_view &string);
+
+		/// <summary>
+		/// Reads an array written by PacketStreamWriter::WriteArray, the stream's byte order has to match the writer's.
+		/// </summary>
+		/// <param name="data">The array to read to.</param>
+		/// <param name="count">The amount of elements to read.</param>
+		template <typename T>
+		bool ReadArray(T *data, size_t count)
+		{
+			static_assert(std::is_arithmetic_v<T> || std::is_enum_v<T>, "Only arrays of numbers and enums can be read in one go.");
+			return ReadArrayData(data, sizeof(T), count);
+		}
+
+		/// <summary>
+		/// Reads a fixed size array written by PacketStreamWriter::WriteArray.
+		/// </summary>
+		/// <param name="data">The array to read to.</param>
+		template <typename T, size_t N>
+		bool ReadArray(T (&data)[N])
+		{
+			return ReadArray<T>(data, N);
+		}
+
 		/// <summary>
 		/// Ignore x amount of data from the packet.
 		/// </summary>
@@ -345,11 +552,36 @@ namespace BCNet
 		/// </summary>
 		bool IsStreamGood() const { return (bool)m_packet; }
 
+		/// <summary>
+		/// Sets how headers and sizes are read from here on.
+		/// </summary>
+		void SetEncoding(PacketEncoding encoding) { m_encoding = encoding; }
+
+		/// <summary>
+		/// Returns how headers and sizes are read.
+		/// </summary>
+		PacketEncoding GetEncoding() const { return m_encoding; }
+
+		/// <summary>
+		/// Sets the byte order ReadArray expects from here on, Deserialize() expects it for single numbers too, ReadRaw never swaps.
+		/// </summary>
+		void SetByteOrder(ByteOrder byteOrder) { m_byteOrder = byteOrder; }
+
+		/// <summary>
+		/// Returns the byte order ReadArray expects.
+		/// </summary>
+		ByteOrder GetByteOrder() const { return m_byteOrder; }
+
 		/// <summary>
 		/// The current position in the stream.
 		/// </summary>
 		size_t GetStreamPosition() { return m_position; }
 
+		/// <summary>
+		/// The amount of bytes left to read.
+		/// </summary>
+		size_t GetRemainingSize() const { return m_position < m_packet.size ? m_packet.size - m_position : 0; }
+
 		/// <summary>
 		/// Sets the stream position.
 		/// </summary>
@@ -372,10 +604,16 @@ namespace BCNet
 		BCNET_API friend PacketStreamReader &operator>>(PacketStreamReader &reader, Packet &packet);
 		BCNET_API friend PacketStreamReader &operator>>(PacketStreamReader &reader, std::string &string);
 
+	private:
+		bool ReadArrayData(void *data, size_t elementSize, size_t count);
+
 	private:
 		Packet m_packet;
 		size_t m_position = 0;
 
+		PacketEncoding m_encoding = PacketEncoding::STANDARD;
+		ByteOrder m_byteOrder = ByteOrder::NATIVE;
+
 	};
 
 	template<typename T>
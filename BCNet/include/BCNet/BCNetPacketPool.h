@@ -0,0 +1,198 @@
+#pragma once
+
+#include <BCNet/Core/Common.h>
+#include <BCNet/BCNetPacket.h>
+
+#include <stdint.h>
+
+#define PACKET_POOL_CLASS_COUNT 11 // 64 bytes up to 64 KiB, doubling each class.
+#define PACKET_POOL_MIN_BLOCK_SIZE 64
+
+namespace BCNet
+{
+	/// <summary>
+	/// Counters for a single size class of the packet pool.
+	/// </summary>
+	struct PacketPoolClassStats
+	{
+		size_t blockSize = 0; // The usable size of every block in this class.
+		uint64_t hits = 0; // Allocations served from a free list.
+		uint64_t misses = 0; // Allocations that had to go to the heap.
+		uint64_t releases = 0; // Blocks handed back to the pool.
+		uint64_t freed = 0; // Blocks given back to the heap because the free lists were full.
+	};
+
+	/// <summary>
+	/// A snapshot of the packet pool counters, can be used to size the pool for a given load.
+	/// </summary>
+	struct PacketPoolStats
+	{
+		PacketPoolClassStats classes[PACKET_POOL_CLASS_COUNT];
+		uint64_t oversized = 0; // Allocations that were too big for any size class.
+	};
+
+	/// <summary>
+	/// Size-classed buffer pool used for packet data.
+	/// Each thread keeps a small cache of free blocks per size class and only touches the shared
+	/// free lists (behind a lock) when that cache runs dry or overflows, so allocating and
+	/// releasing packets on the network thread is normally just a couple of pointer swaps.
+	/// </summary>
+	class BCNET_API PacketPool
+	{
+	public:
+		/// <summary>
+		/// Allocates a block that can hold at least the requested amount of bytes.
+		/// </summary>
+		/// <param name="size">The amount of bytes needed.</param>
+		static void *Allocate(size_t size);
+
+		/// <summary>
+		/// Returns a block to the pool, the block must have been allocated with PacketPool::Allocate().
+		/// </summary>
+		/// <param name="block">The block to release, can be null.</param>
+		static void Free(void *block);
+
+		/// <summary>
+		/// Returns how many bytes can actually be used in a block, this is the size of it's class.
+		/// </summary>
+		/// <param name="block">A block allocated with PacketPool::Allocate().</param>
+		static size_t GetCapacity(const void *block);
+
+		/// <summary>
+		/// Pre-allocates blocks into the shared free lists so the first ticks under load don't miss.
+		/// </summary>
+		/// <param name="size">The size of the blocks to reserve.</param>
+		/// <param name="count">How many blocks to reserve.</param>
+		static void Reserve(size_t size, size_t count);
+
+		/// <summary>
+		/// Sets how many free blocks each size class may keep in the shared free lists before giving them back to the heap.
+		/// The default is 1024.
+		/// </summary>
+		static void SetMaxFreeBlocks(size_t max);
+
+		/// <summary>
+		/// Returns the current pool counters.
+		/// </summary>
+		static PacketPoolStats GetStats();
+
+		/// <summary>
+		/// Resets the pool counters.
+		/// </summary>
+		static void ResetStats();
+
+	};
+
+	/// <summary>
+	/// RAII handle for a packet allocated from the packet pool.
+	/// The block goes back to the pool when the handle is destroyed.
+	/// </summary>
+	class BCNET_API PooledPacket
+	{
+	public:
+		PooledPacket() = default;
+
+		/// <summary>
+		/// Allocates a packet of the provided size from the pool.
+		/// </summary>
+		/// <param name="size">The size of the packet in bytes.</param>
+		explicit PooledPacket(size_t size)
+		{
+			Allocate(size);
+		}
+
+		PooledPacket(const PooledPacket &) = delete;
+		PooledPacket &operator=(const PooledPacket &) = delete;
+
+		PooledPacket(PooledPacket &&other) noexcept
+			: m_packet(other.m_packet)
+		{
+			other.m_packet = Packet();
+		}
+
+		PooledPacket &operator=(PooledPacket &&other) noexcept
+		{
+			if (this != &other)
+			{
+				Release();
+				m_packet = other.m_packet;
+				other.m_packet = Packet();
+			}
+			return *this;
+		}
+
+		~PooledPacket()
+		{
+			Release();
+		}
+
+		/// <summary>
+		/// Allocates a new block for the packet, releasing the old one if there was one.
+		/// </summary>
+		/// <param name="size">The size of the packet in bytes.</param>
+		void Allocate(size_t size)
+		{
+			Release();
+			if (size == 0)
+				return;
+
+			m_packet.data = PacketPool::Allocate(size);
+			m_packet.size = size;
+		}
+
+		/// <summary>
+		/// Gives the block back to the pool.
+		/// </summary>
+		void Release()
+		{
+			PacketPool::Free(m_packet.data);
+			m_packet = Packet();
+		}
+
+		/// <summary>
+		/// Clears the data.
+		/// </summary>
+		void Zero() { m_packet.Zero(); }
+
+		/// <summary>
+		/// Sets the used size of the packet, must fit within the block's capacity.
+		/// </summary>
+		void Resize(size_t size) { m_packet.size = size; }
+
+		/// <summary>
+		/// Returns how many bytes the underlying block can hold.
+		/// </summary>
+		size_t GetCapacity() const { return m_packet.data ? PacketPool::GetCapacity(m_packet.data) : 0; }
+
+		/// <summary>
+		/// Returns the packet, the handle still owns the data.
+		/// </summary>
+		const Packet &GetPacket() const { return m_packet; }
+
+		/// <summary>
+		/// Returns the size of the packet.
+		/// </summary>
+		size_t GetSize() const { return m_packet.size; }
+
+		/// <summary>
+		/// Returns the packet data.
+		/// </summary>
+		void *GetData() const { return m_packet.data; }
+
+		// Operator overloads.
+		operator const Packet &() const
+		{
+			return m_packet;
+		}
+
+		operator bool() const
+		{
+			return m_packet.data;
+		}
+
+	private:
+		Packet m_packet;
+
+	};
+
+}
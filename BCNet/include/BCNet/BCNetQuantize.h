@@ -0,0 +1,235 @@
+#pragma once
+
+#include <BCNet/Core/Common.h>
+#include <BCNet/BCNetPacket.h>
+#include <BCNet/BCNetBitStream.h>
+
+#include <stdint.h>
+
+namespace BCNet
+{
+	// -------------------------- FLOATQUANTIZER
+	/// <summary>
+	/// Packs floats known to be within a range into a fixed amount of bits, evenly spaced across the range.
+	/// Vectors are packed component by component with the same range, any type with x, y (and z) members works,
+	/// like the Vector2 the examples use.
+	/// </summary>
+	class BCNET_API FloatQuantizer
+	{
+	public:
+		/// <summary>
+		/// Initializes the quantizer with a range and bit budget.
+		/// </summary>
+		/// <param name="min">The lowest value, anything lower is clamped.</param>
+		/// <param name="max">The highest value, anything higher is clamped.</param>
+		/// <param name="bits">The amount of bits every value takes, from 1 to 32.</param>
+		FloatQuantizer(float min, float max, unsigned int bits);
+
+		/// <summary>
+		/// Creates a quantizer which uses as few bits as it can while staying within the provided precision.
+		/// </summary>
+		/// <param name="min">The lowest value, anything lower is clamped.</param>
+		/// <param name="max">The highest value, anything higher is clamped.</param>
+		/// <param name="precision">The biggest difference allowed between a value and it's unpacked value.</param>
+		static FloatQuantizer FromPrecision(float min, float max, float precision);
+
+		/// <summary>
+		/// Turns a value into it's packed integer.
+		/// </summary>
+		uint32_t Quantize(float value) const;
+
+		/// <summary>
+		/// Turns a packed integer back into a value.
+		/// </summary>
+		float Dequantize(uint32_t quantized) const;
+
+		/// <summary>
+		/// Writes a value into a bit stream.
+		/// </summary>
+		bool Write(BitStreamWriter &writer, float value) const { return writer.WriteBits(Quantize(value), m_bits); }
+
+		/// <summary>
+		/// Reads a value written by Write().
+		/// </summary>
+		bool Read(BitStreamReader &reader, float &value) const;
+
+		/// <summary>
+		/// Writes a 2D vector into a bit stream.
+		/// </summary>
+		template <typename Vector>
+		bool WriteVector2(BitStreamWriter &writer, const Vector &vector) const
+		{
+			return Write(writer, vector.x) && Write(writer, vector.y);
+		}
+
+		/// <summary>
+		/// Reads a 2D vector written by WriteVector2().
+		/// </summary>
+		template <typename Vector>
+		bool ReadVector2(BitStreamReader &reader, Vector &vector) const
+		{
+			return Read(reader, vector.x) && Read(reader, vector.y);
+		}
+
+		/// <summary>
+		/// Writes a 3D vector into a bit stream.
+		/// </summary>
+		template <typename Vector>
+		bool WriteVector3(BitStreamWriter &writer, const Vector &vector) const
+		{
+			return Write(writer, vector.x) && Write(writer, vector.y) && Write(writer, vector.z);
+		}
+
+		/// <summary>
+		/// Reads a 3D vector written by WriteVector3().
+		/// </summary>
+		template <typename Vector>
+		bool ReadVector3(BitStreamReader &reader, Vector &vector) const
+		{
+			return Read(reader, vector.x) && Read(reader, vector.y) && Read(reader, vector.z);
+		}
+
+		/// <summary>
+		/// The biggest difference between a value within the range and it's unpacked value, including float rounding.
+		/// </summary>
+		float GetMaxError() const { return m_maxError; }
+
+		/// <summary>
+		/// The amount of bits every value takes.
+		/// </summary>
+		unsigned int GetBits() const { return m_bits; }
+
+	private:
+		float m_min;
+		float m_max;
+		float m_step; // The difference between two neighbouring packed values.
+		float m_maxError;
+		unsigned int m_bits;
+		uint32_t m_maxQuantized;
+
+	};
+
+	// -------------------------- QUATERNIONQUANTIZER
+	/// <summary>
+	/// Packs unit quaternions with the smallest three method.
+	/// The largest component is left out and rebuilt from the other three, which can then only be within +-1/sqrt(2),
+	/// so a quaternion takes 2 bits for which component was left out plus 3 packed components.
+	/// Any type with x, y, z and w members works.
+	/// </summary>
+	class BCNET_API QuaternionQuantizer
+	{
+	public:
+		/// <summary>
+		/// Initializes the quantizer with a bit budget.
+		/// </summary>
+		/// <param name="componentBits">The amount of bits each of the three components take, 9 (29 bits a quaternion) is usually plenty for rotations.</param>
+		explicit QuaternionQuantizer(unsigned int componentBits = 9);
+
+		/// <summary>
+		/// Writes a unit quaternion, stored as x, y, z, w, into a bit stream.
+		/// </summary>
+		bool Write(BitStreamWriter &writer, const float (&quaternion)[4]) const;
+
+		/// <summary>
+		/// Reads a quaternion written by Write(), the result is normalized.
+		/// </summary>
+		bool Read(BitStreamReader &reader, float (&quaternion)[4]) const;
+
+		/// <summary>
+		/// Writes a unit quaternion into a bit stream.
+		/// </summary>
+		template <typename Quaternion>
+		bool WriteQuaternion(BitStreamWriter &writer, const Quaternion &quaternion) const
+		{
+			const float components[4] = { quaternion.x, quaternion.y, quaternion.z, quaternion.w };
+			return Write(writer, components);
+		}
+
+		/// <summary>
+		/// Reads a quaternion written by WriteQuaternion().
+		/// </summary>
+		template <typename Quaternion>
+		bool ReadQuaternion(BitStreamReader &reader, Quaternion &quaternion) const
+		{
+			float components[4];
+			if (!Read(reader, components))
+				return false;
+
+			quaternion.x = components[0];
+			quaternion.y = components[1];
+			quaternion.z = components[2];
+			quaternion.w = components[3];
+			return true;
+		}
+
+		/// <summary>
+		/// The biggest difference between a component and it's unpacked component.
+		/// The left out component is rebuilt from the other three, so it can be off by up to three times as much as they are.
+		/// </summary>
+		float GetMaxError() const { return m_component.GetMaxError() * 3.0f; }
+
+		/// <summary>
+		/// The amount of bits every quaternion takes.
+		/// </summary>
+		unsigned int GetBits() const { return 2 + m_component.GetBits() * 3; }
+
+	private:
+		FloatQuantizer m_component;
+
+	};
+
+	// -------------------------- HALF FLOATS
+	/// <summary>
+	/// Converts a float to an IEEE 754 half float, rounding to the nearest.
+	/// Halves hold 3 significant digits and up to +-65504, anything bigger becomes infinity.
+	/// </summary>
+	BCNET_API uint16_t FloatToHalf(float value);
+
+	/// <summary>
+	/// Converts an IEEE 754 half float back to a float.
+	/// </summary>
+	BCNET_API float HalfToFloat(uint16_t half);
+
+	/// <summary>
+	/// Writes a float as a half float into a bit stream.
+	/// </summary>
+	inline bool WriteHalf(BitStreamWriter &writer, float value)
+	{
+		return writer.WriteBits(FloatToHalf(value), 16);
+	}
+
+	/// <summary>
+	/// Reads a half float written by WriteHalf().
+	/// </summary>
+	inline bool ReadHalf(BitStreamReader &reader, float &value)
+	{
+		uint32_t half = 0;
+		if (!reader.ReadBits(half, 16))
+			return false;
+
+		value = HalfToFloat((uint16_t)half);
+		return true;
+	}
+
+	/// <summary>
+	/// Writes a float as a half float into a byte stream.
+	/// </summary>
+	inline bool WriteHalf(PacketStreamWriter &writer, float value)
+	{
+		return writer.WriteRaw<uint16_t>(FloatToHalf(value));
+	}
+
+	/// <summary>
+	/// Reads a half float written by WriteHalf().
+	/// </summary>
+	inline bool ReadHalf(PacketStreamReader &reader, float &value)
+	{
+		uint16_t half = 0;
+		if (!reader.ReadRaw<uint16_t>(half))
+			return false;
+
+		value = HalfToFloat(half);
+		return true;
+	}
+
+}
@@ -0,0 +1,459 @@
+#pragma once
+
+#include <BCNet/Core/Common.h>
+#include <BCNet/BCNetPacket.h>
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include <stdint.h>
+
+/// <summary>
+/// Makes a struct serializable, list the fields in the order they're written in.
+/// Goes inside the struct, the fields can be anything the Serializer handles, including other serializable structs.
+///
+///		struct ChatMessage
+///		{
+///			uint32_t channel;
+///			std::string text;
+///
+///			BCNET_SERIALIZABLE(ChatMessage, channel, text)
+///		};
+///
+///		BCNet::Serialize(packetWriter, message);
+///		BCNet::Deserialize(packetReader, message);
+/// </summary>
+#define BCNET_SERIALIZABLE(Type, ...) \
+	auto BCNetFields() { return std::tie(__VA_ARGS__); } \
+	auto BCNetFields() const { return std::tie(__VA_ARGS__); } \
+	using BCNetSerializableType = Type;
+
+namespace BCNet
+{
+	/// <summary>
+	/// The size of anything that has no upper bound, like vectors and strings.
+	/// </summary>
+	constexpr size_t UNBOUNDED_SIZE = std::numeric_limits<size_t>::max();
+
+	/// <summary>
+	/// Returns how many bytes PacketStreamWriter::WriteSize takes for a size.
+	/// </summary>
+	constexpr size_t GetSizeLength(size_t size, PacketEncoding encoding)
+	{
+		if (encoding == PacketEncoding::STANDARD)
+			return sizeof(size_t);
+
+		size_t length = 1;
+		for (uint64_t value = size; value >= 0x80; value >>= 7)
+			length++;
+		return length;
+	}
+
+	/// <summary>
+	/// Adds two sizes, staying unbounded if either of them is.
+	/// </summary>
+	constexpr size_t AddSizes(size_t a, size_t b)
+	{
+		return a == UNBOUNDED_SIZE || b == UNBOUNDED_SIZE ? UNBOUNDED_SIZE : a + b;
+	}
+
+	/// <summary>
+	/// Multiplies a size, staying unbounded if it is.
+	/// </summary>
+	constexpr size_t MultiplySize(size_t size, size_t count)
+	{
+		return size == UNBOUNDED_SIZE ? UNBOUNDED_SIZE : size * count;
+	}
+
+	/// <summary>
+	/// Writes, reads and sizes a type.
+	/// Specialize it to make a type from another library serializable, every specialization provides:
+	///		MAX_SIZE, the most bytes a value can take or UNBOUNDED_SIZE.
+	///		FIXED_SIZE, whether every value takes exactly MAX_SIZE bytes.
+	///		MEMCPYABLE, whether the value is a number written as it's raw bytes, so contiguous runs of them can go through WriteArray in one go.
+	///		bool Write(PacketStreamWriter &writer, const T &value)
+	///		bool Read(PacketStreamReader &reader, T &value)
+	///		size_t GetSize(const T &value, PacketEncoding encoding), the exact amount of bytes Write() takes.
+	/// </summary>
+	template <typename T, typename Enable = void>
+	struct Serializer
+	{
+		static_assert(sizeof(T) == 0, "Type isn't serializable, use BCNET_SERIALIZABLE or specialize BCNet::Serializer.");
+	};
+
+	// Numbers and enums, written as their raw bytes in the stream's byte order, the same as when they're in an array or vector.
+	template <typename T>
+	struct Serializer<T, std::enable_if_t<std::is_arithmetic_v<T> || std::is_enum_v<T>>>
+	{
+		static constexpr size_t MAX_SIZE = sizeof(T);
+		static constexpr bool FIXED_SIZE = true;
+		static constexpr bool MEMCPYABLE = true;
+
+		static bool Write(PacketStreamWriter &writer, const T &value)
+		{
+			if (writer.GetByteOrder() == ByteOrder::NATIVE || sizeof(T) == 1) // Skip the array path when there's nothing to swap.
+				return writer.WriteRaw<T>(value);
+			return writer.WriteArray<T>(&value, 1);
+		}
+
+		static bool Read(PacketStreamReader &reader, T &value)
+		{
+			if (reader.GetByteOrder() == ByteOrder::NATIVE || sizeof(T) == 1)
+				return reader.ReadRaw<T>(value);
+			return reader.ReadArray<T>(&value, 1);
+		}
+
+		static constexpr size_t GetSize(const T &, PacketEncoding) { return sizeof(T); }
+	};
+
+	// Strings, the same layout as PacketStreamWriter::WriteString.
+	template <>
+	struct Serializer<std::string>
+	{
+		static constexpr size_t MAX_SIZE = UNBOUNDED_SIZE;
+		static constexpr bool FIXED_SIZE = false;
+		static constexpr bool MEMCPYABLE = false;
+
+		static bool Write(PacketStreamWriter &writer, const std::string &value)
+		{
+			writer.WriteString(value);
+			return writer.IsStreamGood();
+		}
+
+		static bool Read(PacketStreamReader &reader, std::string &value) { return reader.ReadString(value); }
+
+		static size_t GetSize(const std::string &value, PacketEncoding encoding)
+		{
+			return GetSizeLength(value.size(), encoding) + value.size();
+		}
+	};
+
+	// Fixed size arrays, copied in one go if the elements allow it.
+	template <typename T, size_t N>
+	struct Serializer<std::array<T, N>>
+	{
+		static constexpr size_t MAX_SIZE = MultiplySize(Serializer<T>::MAX_SIZE, N);
+		static constexpr bool FIXED_SIZE = Serializer<T>::FIXED_SIZE;
+		static constexpr bool MEMCPYABLE = false; // Copied in one go through WriteArray, but not as part of a bigger array.
+
+		static bool Write(PacketStreamWriter &writer, const std::array<T, N> &value)
+		{
+			if constexpr (Serializer<T>::MEMCPYABLE)
+			{
+				return writer.WriteArray<T>(value.data(), N);
+			}
+			else
+			{
+				for (const T &element : value)
+				{
+					if (!Serializer<T>::Write(writer, element))
+						return false;
+				}
+				return true;
+			}
+		}
+
+		static bool Read(PacketStreamReader &reader, std::array<T, N> &value)
+		{
+			if constexpr (Serializer<T>::MEMCPYABLE)
+			{
+				return reader.ReadArray<T>(value.data(), N);
+			}
+			else
+			{
+				for (T &element : value)
+				{
+					if (!Serializer<T>::Read(reader, element))
+						return false;
+				}
+				return true;
+			}
+		}
+
+		static size_t GetSize(const std::array<T, N> &value, PacketEncoding encoding)
+		{
+			if constexpr (Serializer<T>::FIXED_SIZE)
+			{
+				return MAX_SIZE;
+			}
+			else
+			{
+				size_t size = 0;
+				for (const T &element : value)
+					size += Serializer<T>::GetSize(element, encoding);
+				return size;
+			}
+		}
+	};
+
+	// Vectors, a size followed by the elements, copied in one go if the elements allow it.
+	template <typename T, typename Allocator>
+	struct Serializer<std::vector<T, Allocator>>
+	{
+		static constexpr size_t MAX_SIZE = UNBOUNDED_SIZE;
+		static constexpr bool FIXED_SIZE = false;
+		static constexpr bool MEMCPYABLE = false;
+
+	private:
+		static constexpr bool CONTIGUOUS = Serializer<T>::MEMCPYABLE && !std::is_same_v<T, bool>; // Vectors of bools are packed, there's no array to copy.
+
+	public:
+		static bool Write(PacketStreamWriter &writer, const std::vector<T, Allocator> &value)
+		{
+			if (!writer.WriteSize(value.size()))
+				return false;
+
+			if constexpr (CONTIGUOUS)
+			{
+				return writer.WriteArray<T>(value.data(), value.size());
+			}
+			else
+			{
+				for (const auto &element : value)
+				{
+					if (!Serializer<T>::Write(writer, element))
+						return false;
+				}
+				return true;
+			}
+		}
+
+		static bool Read(PacketStreamReader &reader, std::vector<T, Allocator> &value)
+		{
+			size_t count = 0;
+			if (!reader.ReadSize(count) || count > reader.GetRemainingSize()) // Every element takes at least a byte, don't let a bad size allocate a huge vector.
+				return false;
+
+			value.resize(count);
+			if constexpr (CONTIGUOUS)
+			{
+				return reader.ReadArray<T>(value.data(), count);
+			}
+			else if constexpr (std::is_same_v<T, bool>)
+			{
+				for (size_t i = 0; i < count; i++)
+				{
+					bool element = false;
+					if (!Serializer<bool>::Read(reader, element))
+						return false;
+					value[i] = element;
+				}
+				return true;
+			}
+			else
+			{
+				for (T &element : value)
+				{
+					if (!Serializer<T>::Read(reader, element))
+						return false;
+				}
+				return true;
+			}
+		}
+
+		static size_t GetSize(const std::vector<T, Allocator> &value, PacketEncoding encoding)
+		{
+			size_t size = GetSizeLength(value.size(), encoding);
+			if constexpr (Serializer<T>::FIXED_SIZE)
+			{
+				size += Serializer<T>::MAX_SIZE * value.size();
+			}
+			else
+			{
+				for (const T &element : value)
+					size += Serializer<T>::GetSize(element, encoding);
+			}
+			return size;
+		}
+	};
+
+	// Optionals, a byte saying whether there's a value followed by the value.
+	template <typename T>
+	struct Serializer<std::optional<T>>
+	{
+		static constexpr size_t MAX_SIZE = AddSizes(1, Serializer<T>::MAX_SIZE);
+		static constexpr bool FIXED_SIZE = false;
+		static constexpr bool MEMCPYABLE = false;
+
+		static bool Write(PacketStreamWriter &writer, const std::optional<T> &value)
+		{
+			if (!writer.WriteRaw<uint8_t>(value.has_value() ? 1 : 0))
+				return false;
+			return !value.has_value() || Serializer<T>::Write(writer, *value);
+		}
+
+		static bool Read(PacketStreamReader &reader, std::optional<T> &value)
+		{
+			uint8_t hasValue = 0;
+			if (!reader.ReadRaw<uint8_t>(hasValue))
+				return false;
+
+			if (!hasValue)
+			{
+				value.reset();
+				return true;
+			}
+			return Serializer<T>::Read(reader, value.emplace());
+		}
+
+		static size_t GetSize(const std::optional<T> &value, PacketEncoding encoding)
+		{
+			return 1 + (value.has_value() ? Serializer<T>::GetSize(*value, encoding) : 0);
+		}
+	};
+
+	// Variants, a byte with the alternative's index followed by the alternative.
+	template <typename... Types>
+	struct Serializer<std::variant<Types...>>
+	{
+		static_assert(sizeof...(Types) <= 255, "Variants are limited to 255 alternatives.");
+
+		static constexpr size_t MAX_SIZE = AddSizes(1, std::max({ Serializer<Types>::MAX_SIZE... }));
+		static constexpr bool FIXED_SIZE = false;
+		static constexpr bool MEMCPYABLE = false;
+
+		static bool Write(PacketStreamWriter &writer, const std::variant<Types...> &value)
+		{
+			if (value.valueless_by_exception() || !writer.WriteRaw<uint8_t>((uint8_t)value.index()))
+				return false;
+
+			return std::visit([&writer](const auto &alternative)
+			{
+				return Serializer<std::decay_t<decltype(alternative)>>::Write(writer, alternative);
+			}, value);
+		}
+
+		static bool Read(PacketStreamReader &reader, std::variant<Types...> &value)
+		{
+			uint8_t index = 0;
+			if (!reader.ReadRaw<uint8_t>(index) || index >= sizeof...(Types))
+				return false;
+
+			return ReadAlternative(reader, value, index, std::index_sequence_for<Types...>());
+		}
+
+		static size_t GetSize(const std::variant<Types...> &value, PacketEncoding encoding)
+		{
+			return 1 + std::visit([encoding](const auto &alternative)
+			{
+				return Serializer<std::decay_t<decltype(alternative)>>::GetSize(alternative, encoding);
+			}, value);
+		}
+
+	private:
+		template <size_t... Indices>
+		static bool ReadAlternative(PacketStreamReader &reader, std::variant<Types...> &value, uint8_t index, std::index_sequence<Indices...>)
+		{
+			// Only the alternative matching the index is read.
+			bool success = false;
+			((Indices == index ? (success = Serializer<std::variant_alternative_t<Indices, std::variant<Types...>>>::Read(reader, value.template emplace<Indices>()), true) : false) || ...);
+			return success;
+		}
+	};
+
+	// Structs made serializable with BCNET_SERIALIZABLE, their fields one after another.
+	template <typename T>
+	struct Serializer<T, std::enable_if_t<std::is_same_v<typename T::BCNetSerializableType, T>>>
+	{
+	private:
+		using Fields = decltype(std::declval<T&>().BCNetFields());
+
+		template <size_t... Indices>
+		static constexpr size_t SumMaxSizes(std::index_sequence<Indices...>)
+		{
+			size_t size = 0;
+			((size = AddSizes(size, Serializer<std::decay_t<std::tuple_element_t<Indices, Fields>>>::MAX_SIZE)), ...);
+			return size;
+		}
+
+		template <size_t... Indices>
+		static constexpr bool AllFixedSize(std::index_sequence<Indices...>)
+		{
+			return (Serializer<std::decay_t<std::tuple_element_t<Indices, Fields>>>::FIXED_SIZE && ...);
+		}
+
+		using FieldIndices = std::make_index_sequence<std::tuple_size_v<Fields>>;
+
+	public:
+		static constexpr size_t MAX_SIZE = SumMaxSizes(FieldIndices());
+		static constexpr bool FIXED_SIZE = AllFixedSize(FieldIndices());
+		static constexpr bool MEMCPYABLE = false; // Padding between fields means the layout isn't the same.
+
+		static bool Write(PacketStreamWriter &writer, const T &value)
+		{
+			return std::apply([&writer](const auto &... fields)
+			{
+				return (Serializer<std::decay_t<decltype(fields)>>::Write(writer, fields) && ...);
+			}, value.BCNetFields());
+		}
+
+		static bool Read(PacketStreamReader &reader, T &value)
+		{
+			return std::apply([&reader](auto &... fields)
+			{
+				return (Serializer<std::decay_t<decltype(fields)>>::Read(reader, fields) && ...);
+			}, value.BCNetFields());
+		}
+
+		static size_t GetSize(const T &value, PacketEncoding encoding)
+		{
+			if constexpr (FIXED_SIZE)
+			{
+				return MAX_SIZE;
+			}
+			else
+			{
+				return std::apply([encoding](const auto &... fields)
+				{
+					return (size_t(0) + ... + Serializer<std::decay_t<decltype(fields)>>::GetSize(fields, encoding));
+				}, value.BCNetFields());
+			}
+		}
+	};
+
+	/// <summary>
+	/// The most bytes a value of the type can take, UNBOUNDED_SIZE if there's no limit.
+	/// Known at compile time, so fixed size messages can live in fixed size buffers.
+	/// </summary>
+	template <typename T>
+	constexpr size_t MAX_SERIALIZED_SIZE = Serializer<T>::MAX_SIZE;
+
+	/// <summary>
+	/// Returns the exact amount of bytes Serialize() writes for a value.
+	/// </summary>
+	template <typename T>
+	size_t GetSerializedSize(const T &value, PacketEncoding encoding = PacketEncoding::STANDARD)
+	{
+		return Serializer<T>::GetSize(value, encoding);
+	}
+
+	/// <summary>
+	/// Writes a value into a stream, a growing stream is sized up front so it never has to grow part way through.
+	/// </summary>
+	template <typename T>
+	bool Serialize(PacketStreamWriter &writer, const T &value)
+	{
+		if (writer.IsGrowing())
+			writer.Reserve(writer.GetSize() + GetSerializedSize(value, writer.GetEncoding()));
+
+		return Serializer<T>::Write(writer, value);
+	}
+
+	/// <summary>
+	/// Reads a value written by Serialize().
+	/// </summary>
+	template <typename T>
+	bool Deserialize(PacketStreamReader &reader, T &value)
+	{
+		return Serializer<T>::Read(reader, value);
+	}
+
+}
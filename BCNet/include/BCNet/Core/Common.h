@@ -3,6 +3,7 @@
 // Shouldn't be included directly by the application, but needs to be here so the application can import the symbols from the DLL.
 
 #define DEFAULT_SERVER_PORT 5456
+#define LOOPBACK_SERVER_ADDRESS "loopback" // Connects to a server in the same process without any sockets, by it's port.
 
 #ifdef BCNET_API_STATIC // Static linking
 #define BCNET_API 
@@ -0,0 +1,101 @@
+#pragma once
+
+// Types shared by both the client and server interfaces.
+
+#include <stdint.h>
+
+namespace BCNet
+{
+	/// <summary>
+	/// How the network thread waits in between iterations of it's loop.
+	/// </summary>
+	enum class NetworkScheduleMode
+	{
+		FIXED_TICK = 0, // Runs at a fixed tick rate, sleeping in between, can spin the end of each wait for evenly paced ticks, see SetNetworkSchedule().
+		ADAPTIVE, // Spins for a moment after any activity, then backs off into longer sleeps, up to one tick.
+		BUSY_POLL // Never sleeps, lowest latency but keeps a core busy.
+	};
+
+	/// <summary>
+	/// How packet headers, sizes and lengths are laid out on the wire, agreed on per connection.
+	/// </summary>
+	enum class PacketEncoding : unsigned char
+	{
+		STANDARD = 0, // 4 byte packet IDs and 8 byte sizes, what every peer understands.
+		COMPACT // A flags byte and varint packet ID for the header, varint sizes.
+	};
+
+	/// <summary>
+	/// Per packet overrides for how it's sent, for urgent packets that shouldn't wait for the rest of the tick.
+	/// </summary>
+	enum SendFlags : uint8_t
+	{
+		SEND_FLAG_NONE = 0,
+		SEND_FLAG_NO_NAGLE = 1 << 0, // Goes out straight away along with anything sent before it, instead of being batched or waiting on Nagle's timer.
+		SEND_FLAG_NO_DELAY = 1 << 1 // Like NO_NAGLE, but an unreliable packet is dropped instead of queued if it can't go out right away.
+	};
+
+	/// <summary>
+	/// How a transfer ended, see BeginTransfer().
+	/// </summary>
+	enum class TransferResult : unsigned char
+	{
+		COMPLETED = 0, // Every byte arrived.
+		CANCELLED, // Either end cancelled it.
+		REFUSED, // The receiver turned it down when it started.
+		FAILED // The connection closed, or the receiver had nowhere to put it.
+	};
+
+	/// <summary>
+	/// Where a transfer is up to, passed to each of the transfer callbacks.
+	/// </summary>
+	struct TransferInfo
+	{
+		uint32_t id = 0; // Picked by the sender, the receiver sees the same ID.
+		uint32_t tag = 0; // Whatever the sender wants it to be, like what kind of payload it is.
+		uint64_t size = 0; // The whole payload.
+		uint64_t transferred = 0; // Bytes handed to the connection by the sender, or received by the receiver.
+		bool incoming = false; // Whether this end is the one receiving it.
+	};
+
+	/// <summary>
+	/// The health of a connection, sampled from GameNetworkingSockets once per network tick.
+	/// </summary>
+	struct ConnectionStats
+	{
+		int ping = -1; // Round trip in milliseconds, -1 if it isn't known yet.
+		float localQuality = -1.0f; // Fraction of packets from them that arrived intact and in order, 0 to 1, -1 if it isn't known yet.
+		float remoteQuality = -1.0f; // The same, as seen from their end.
+		float outPacketsPerSecond = 0.0f;
+		float outBytesPerSecond = 0.0f;
+		float inPacketsPerSecond = 0.0f;
+		float inBytesPerSecond = 0.0f;
+		int sendRateBytesPerSecond = 0; // How fast the connection thinks it can send.
+		int pendingReliableBytes = 0; // Queued but not sent yet.
+		int pendingUnreliableBytes = 0;
+		int sentUnackedReliableBytes = 0; // Sent but not acknowledged, could still need resending.
+		int64_t queueTimeMicroseconds = 0; // Roughly how long a packet sent now would wait before going on the wire.
+	};
+
+	/// <summary>
+	/// Counters for packet compression, either for one packet ID or every packet.
+	/// Sizes are of the payload after the header, compressed packets also carry their original size.
+	/// </summary>
+	struct CompressionStats
+	{
+		uint64_t compressedPackets = 0; // Packets sent compressed.
+		uint64_t skippedPackets = 0; // Packets over the threshold that didn't get any smaller, sent as they were.
+		uint64_t uncompressedBytes = 0; // What the compressed packets would have taken.
+		uint64_t compressedBytes = 0; // What they took compressed.
+		uint64_t compressNanoseconds = 0; // Time spent compressing, including packets that were skipped.
+
+		uint64_t decompressedPackets = 0; // Compressed packets received.
+		uint64_t decompressNanoseconds = 0; // Time spent decompressing.
+
+		/// <summary>
+		/// The compressed size as a fraction of the original size, lower is better.
+		/// </summary>
+		double GetRatio() const { return uncompressedBytes > 0 ? (double)compressedBytes / (double)uncompressedBytes : 1.0; }
+	};
+
+}
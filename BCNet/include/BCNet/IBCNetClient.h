@@ -1,6 +1,7 @@
 #pragma once
 
 #include <BCNet/Core/Common.h>
+#include <BCNet/Core/Types.h>
 
 #include <string>
 #include <functional>
@@ -10,6 +11,13 @@
 #define BIND_CLIENT_CONNECTED_CALLBACK(fn) std::bind(&fn, this)
 #define BIND_CLIENT_DISCONNECTED_CALLBACK(fn) std::bind(&fn, this)
 #define BIND_CLIENT_PACKET_RECEIVED_CALLBACK(fn) std::bind(&fn, this, std::placeholders::_1)
+#define BIND_CLIENT_MESSAGE_RECEIVED_CALLBACK(fn) std::bind(&fn, this, std::placeholders::_1)
+#define BIND_CLIENT_PACKET_BATCH_RECEIVED_CALLBACK(fn) std::bind(&fn, this, std::placeholders::_1, std::placeholders::_2)
+#define BIND_CLIENT_SNAPSHOT_RECEIVED_CALLBACK(fn) std::bind(&fn, this, std::placeholders::_1, std::placeholders::_2)
+#define BIND_CLIENT_TRANSFER_STARTED_CALLBACK(fn) std::bind(&fn, this, std::placeholders::_1, std::placeholders::_2)
+#define BIND_CLIENT_TRANSFER_CHUNK_CALLBACK(fn) std::bind(&fn, this, std::placeholders::_1, std::placeholders::_2)
+#define BIND_CLIENT_TRANSFER_PROGRESS_CALLBACK(fn) std::bind(&fn, this, std::placeholders::_1)
+#define BIND_CLIENT_TRANSFER_COMPLETED_CALLBACK(fn) std::bind(&fn, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3)
 #define BIND_CLIENT_OUTPUT_LOG_CALLBACK(fn) std::bind(&fn, this)
 
 typedef unsigned int uint32;
@@ -17,12 +25,22 @@ typedef unsigned int uint32;
 namespace BCNet
 {
 	struct Packet; // Forward Declare.
+	class ReceivedMessage; // Forward Declare.
+	template <typename... Args> class PacketDispatcher; // Forward Declare, see BCNetDispatch.h.
 	
 	using ClientCommandCallback = std::function<void(const std::string)>;
 	using ClientOutputLogCallback = std::function<void()>;
 	using ClientConnectedCallback = std::function<void()>;
 	using ClientDisconnectedCallback = std::function<void()>;
 	using ClientPacketReceivedCallback = std::function<void(const Packet)>;
+	using ClientMessageReceivedCallback = std::function<void(const ReceivedMessage &)>;
+	using ClientPacketBatchReceivedCallback = std::function<void(const ReceivedMessage *, size_t)>;
+	using ClientSnapshotReceivedCallback = std::function<void(uint32, const Packet)>;
+	using ClientTransferStartedCallback = std::function<bool(const TransferInfo &, Packet &)>;
+	using ClientTransferChunkCallback = std::function<void(const TransferInfo &, const Packet)>;
+	using ClientTransferProgressCallback = std::function<void(const TransferInfo &)>;
+	using ClientTransferCompletedCallback = std::function<void(const TransferInfo &, TransferResult, const Packet)>;
+	using ClientPacketDispatcher = PacketDispatcher<>;
 
 	/// <summary>
 	/// Client Interface.
@@ -54,8 +72,15 @@ namespace BCNet
 		/// </summary>
 		virtual void Stop() = 0;
 
+		/// <summary>
+		/// Sets whether Start reads commands from the standard input, the default is true.
+		/// Turn it off when the application runs several clients or servers in one process, or has no console.
+		/// </summary>
+		virtual void SetConsoleInput(bool enabled) = 0;
+
 		/// <summary>
 		/// Connects to a server using the provided address. The default port is 5456.
+		/// LOOPBACK_SERVER_ADDRESS connects to the server started on the port in this process, through an in-memory socket pair.
 		/// </summary>
 		/// <param name="ipAddress">The address of the server to connect to.</param>
 		/// <param name="port">The port the server is listening to.</param>
@@ -76,6 +101,72 @@ namespace BCNet
 		/// </summary>
 		virtual bool IsConnected() = 0;
 
+		/// <summary>
+		/// Sets how the network thread waits in between iterations.
+		/// The default is a fixed tick at 100 ticks per second, commands pushed from another thread wake the network thread early.
+		/// </summary>
+		/// <param name="mode">The scheduling mode.</param>
+		/// <param name="tickRate">Ticks per second for the fixed tick mode, and the longest the adaptive mode will sleep for.</param>
+		/// <param name="spinMicroseconds">How long before the end of each wait to stop sleeping and spin, for tighter pacing than the OS sleeps give.
+		/// The default of 0 sleeps all the way, anything else keeps a core busy for that long every wait, up to 2000.</param>
+		virtual void SetNetworkSchedule(NetworkScheduleMode mode, unsigned int tickRate = 100, unsigned int spinMicroseconds = 0) = 0;
+
+		/// <summary>
+		/// Sets the encoding the client asks the server for when it connects, see PacketEncoding.
+		/// The default is the standard encoding. Asking for the compact encoding holds off on the connected callback until the server answers,
+		/// servers that don't answer within a second get the standard encoding.
+		/// Takes effect on the next connection.
+		/// </summary>
+		virtual void SetPacketEncoding(PacketEncoding encoding) = 0;
+
+		/// <summary>
+		/// Returns the encoding agreed on with the server, packets to and from the server should use it.
+		/// </summary>
+		virtual PacketEncoding GetPacketEncoding() = 0;
+
+		/// <summary>
+		/// Asks the server to compress packets, which is agreed on along with the compact encoding, as compressed packets are marked
+		/// by a flag in the compact header. Packets smaller than the threshold, or that don't get any smaller, are sent as they are.
+		/// Compression is off by default, the server has to have it on too. Takes effect on the next connection.
+		/// </summary>
+		/// <param name="enabled">Whether to compress packets.</param>
+		/// <param name="threshold">The size in bytes a packet has to be to try compressing it.</param>
+		virtual void SetCompression(bool enabled, unsigned int threshold = 128) = 0;
+
+		/// <summary>
+		/// Turns on batching the small packets sent to the server during a tick, packing them into as few packets as fit in a datagram,
+		/// which are sent at the end of the tick. The server unpacks them before they reach any callbacks, so it's invisible to the application.
+		/// Only works with the compact encoding, packets are sent as they are otherwise.
+		/// Packets sent from outside the network thread wait for the next tick instead of waking it, use FlushMessages() to send them straight away.
+		/// Batching is off by default.
+		/// </summary>
+		/// <param name="enabled">Whether to batch packets.</param>
+		/// <param name="maxSize">The most bytes a batch can take, bigger packets are sent on their own.</param>
+		virtual void SetMessageBatching(bool enabled, unsigned int maxSize = 1200) = 0;
+
+		/// <summary>
+		/// Sends everything waiting to go to the server straight away, rather than at the end of the tick.
+		/// Can be called from any thread, like after sending everything for a game tick.
+		/// </summary>
+		virtual void FlushMessages() = 0;
+
+		/// <summary>
+		/// Sets a dictionary for compression, see TrainCompressionDictionary().
+		/// The server has to have the same dictionary, otherwise packets aren't compressed. Should be set before connecting.
+		/// </summary>
+		/// <param name="dictionary">The dictionary, it's copied. An empty packet means no dictionary.</param>
+		virtual void SetCompressionDictionary(const Packet &dictionary) = 0;
+
+		/// <summary>
+		/// Returns the compression counters for every packet.
+		/// </summary>
+		virtual CompressionStats GetCompressionStats() = 0;
+
+		/// <summary>
+		/// Returns the compression counters for one packet ID, IDs of 255 and up share theirs.
+		/// </summary>
+		virtual CompressionStats GetCompressionStats(uint32 packetID) = 0;
+
 		/// <summary>
 		/// This callback is called when the client successfully connects to the server.
 		/// </summary>
@@ -92,6 +183,127 @@ namespace BCNet
 		/// </summary>
 		virtual void SetPacketReceivedCallback(const ClientPacketReceivedCallback &callback) = 0;
 
+		/// <summary>
+		/// This callback is called whenever the client receives a packet, like the packet received callback,
+		/// but the message keeps the received buffer alive so it can be kept or queued to another thread without copying it.
+		/// Both this and the packet received callback are called if both are set, but neither is with a batch callback set, see SetPacketBatchReceivedCallback().
+		/// The callback function should have a reference to the ReceivedMessage as a parameter.
+		/// </summary>
+		virtual void SetMessageReceivedCallback(const ClientMessageReceivedCallback &callback) = 0;
+
+		/// <summary>
+		/// This callback is called with every batch of packets the client receives.
+		/// The callback function should have a pointer to the received messages and how many there are as parameters,
+		/// the messages are contiguous and in the order they arrived.
+		/// While it's set it takes over from the packet and message callbacks, they aren't called for anything it's handed.
+		/// Packets with a handler in the dispatcher still go to their handler, and are left out of the batch.
+		/// </summary>
+		virtual void SetPacketBatchReceivedCallback(const ClientPacketBatchReceivedCallback &callback) = 0;
+
+		/// <summary>
+		/// Sets the table the client looks packet handlers up in, see BCNetDispatch.h. Pass nullptr to stop using one.
+		/// Packets with a handler are decoded and handed to it instead of going through the packet and message callbacks,
+		/// or the batch callback. Handlers run on the network thread, like the callbacks.
+		/// The dispatcher has to outlive the client, or be unset first, and shouldn't have handlers registered while it's in use.
+		/// </summary>
+		virtual void SetPacketDispatcher(ClientPacketDispatcher *dispatcher) = 0;
+
+		/// <summary>
+		/// This callback is called whenever the client receives a snapshot sent with the server's SendSnapshot().
+		/// The callback function should have the snapshot's sequence number and a copy of the rebuilt snapshot as parameters,
+		/// the snapshot is only valid during the callback. Snapshots arriving after a newer one are dropped.
+		/// Snapshots don't go through the packet, message or batch callbacks.
+		/// </summary>
+		virtual void SetSnapshotReceivedCallback(const ClientSnapshotReceivedCallback &callback) = 0;
+
+		/// <summary>
+		/// Sets how many received snapshots the client keeps to decode deltas against.
+		/// Should be at least as many as the server keeps, see IBCNetServer::SetSnapshotHistory(). The default is 32.
+		/// With fewer, a delta against a snapshot the client has already dropped is thrown away and the server is asked to send the next one in full.
+		/// </summary>
+		virtual void SetSnapshotHistory(unsigned int count) = 0;
+
+		/// <summary>
+		/// This callback is called whenever the server starts a transfer to the client, see IBCNetServer::BeginTransfer().
+		/// The callback function should have a reference to the TransferInfo and a reference to the destination as parameters,
+		/// and return false to refuse the transfer. The destination can be pointed at a buffer of at least the transfer's size for it to be
+		/// reassembled into, which has to stay valid until the transfer completes, otherwise one is allocated for it.
+		/// Without this callback transfers are accepted as long as there's a completed callback to hand them to.
+		/// Transfers over the limits set with SetMaxTransferSize() are refused before this is called.
+		/// All the transfer callbacks run on the network thread.
+		/// </summary>
+		virtual void SetTransferStartedCallback(const ClientTransferStartedCallback &callback) = 0;
+
+		/// <summary>
+		/// This callback is called whenever a piece of a transfer from the server arrives, after it's been copied into the destination.
+		/// The callback function should have a reference to the TransferInfo and a copy of the chunk as parameters,
+		/// the chunk ends where the TransferInfo's transferred count is up to.
+		/// </summary>
+		virtual void SetTransferChunkCallback(const ClientTransferChunkCallback &callback) = 0;
+
+		/// <summary>
+		/// This callback is called whenever a transfer going either way moves along, once chunks are handed to the connection or taken in from it.
+		/// The callback function should have a reference to the TransferInfo as a parameter.
+		/// </summary>
+		virtual void SetTransferProgressCallback(const ClientTransferProgressCallback &callback) = 0;
+
+		/// <summary>
+		/// This callback is called whenever a transfer going either way ends, successfully or not.
+		/// The callback function should have a reference to the TransferInfo, the result and a copy of the payload as parameters.
+		/// The payload is only there for completed incoming transfers, if it was allocated for the transfer it's only valid during the callback.
+		/// An outgoing transfer only completes once the server has all of it.
+		/// </summary>
+		virtual void SetTransferCompletedCallback(const ClientTransferCompletedCallback &callback) = 0;
+
+		/// <summary>
+		/// Sets how transfers are split up and paced, see IBCNetServer::SetTransferPacing().
+		/// The defaults are 64KB chunks and a 256KB window.
+		/// </summary>
+		/// <param name="chunkSize">The most bytes sent in one chunk, up to 448KB.</param>
+		/// <param name="window">The most bytes allowed to be waiting to be sent before transfers hold off.</param>
+		virtual void SetTransferPacing(unsigned int chunkSize = 64 * 1024, unsigned int window = 256 * 1024) = 0;
+
+		/// <summary>
+		/// Sets how big the transfers the server starts can be, see IBCNetServer::SetMaxTransferSize().
+		/// The defaults are 64MB for one transfer and 256MB for all the incoming transfers together.
+		/// </summary>
+		/// <param name="maxSize">The most bytes one transfer can be.</param>
+		/// <param name="maxIncoming">The most bytes the incoming transfers can add up to at once.</param>
+		virtual void SetMaxTransferSize(uint64_t maxSize = 64ull * 1024 * 1024, uint64_t maxIncoming = 256ull * 1024 * 1024) = 0;
+
+		/// <summary>
+		/// Starts sending a payload of any size to the server, split into chunks which are paced to what the connection can take.
+		/// Transfers are sent one after another, in the order they were started. Transfers still going when the connection closes fail.
+		/// Can be called from any thread.
+		/// </summary>
+		/// <param name="data">The payload, it isn't copied, so it has to stay valid until the transfer completes.</param>
+		/// <param name="tag">Passed along to the server, like to say what the payload is.</param>
+		/// <returns>The transfer's ID, or 0 if the client isn't connected.</returns>
+		virtual uint32 BeginTransfer(const Packet &data, uint32 tag = 0) = 0;
+
+		/// <summary>
+		/// Starts sending a file to the server, like BeginTransfer() with a payload. The file is mapped into memory rather than read in,
+		/// so only the chunks being sent are ever loaded. It shouldn't be changed until the transfer completes.
+		/// </summary>
+		/// <param name="filePath">The file to send.</param>
+		/// <param name="tag">Passed along to the server, like to say what the file is.</param>
+		/// <returns>The transfer's ID, or 0 if the client isn't connected or the file couldn't be opened.</returns>
+		virtual uint32 BeginTransfer(const std::string &filePath, uint32 tag = 0) = 0;
+
+		/// <summary>
+		/// Cancels a transfer to or from the server, both ends get the completed callback with the cancelled result.
+		/// Can be called from any thread.
+		/// </summary>
+		/// <param name="transferID">The transfer's ID.</param>
+		/// <param name="incoming">Whether the server is sending it, IDs are only unique to whoever's sending.</param>
+		virtual void CancelTransfer(uint32 transferID, bool incoming = false) = 0;
+
+		/// <summary>
+		/// Sets the maximum amount of messages the client takes from the networking library at once.
+		/// The default is 256.
+		/// </summary>
+		virtual void SetReceiveBatchSize(unsigned int size) = 0;
+
 		/// <summary>
 		/// This callback is called whenever the client logs a message.
 		/// </summary>
@@ -128,16 +340,60 @@ namespace BCNet
 
 		/// <summary>
 		/// Sends a packet to the server.
+		/// Can be called from any thread, calls from outside the network thread are queued and carried out on it's next iteration.
 		/// </summary>
 		/// <param name="packet">The packet to send.</param>
 		/// <param name="reliable">Whether the connection is reliable or not.</param>
-		virtual void SendPacketToServer(const Packet &packet, bool reliable = true) = 0;
+		/// <param name="sendFlags">SendFlags for urgent packets.</param>
+		virtual void SendPacketToServer(const Packet &packet, bool reliable = true, uint8_t sendFlags = SEND_FLAG_NONE) = 0;
 
 		/// <summary>
 		/// Returns the current connection status.
 		/// </summary>
 		virtual ConnectionStatus &GetConnectionStatus() = 0;
 
+		/// <summary>
+		/// Gets the connection's stats, as of the end of the last network tick. Safe to call from any thread, it doesn't lock.
+		/// </summary>
+		/// <param name="stats">Filled in with the stats.</param>
+		/// <returns>False if it isn't connected, or hasn't been sampled yet.</returns>
+		virtual bool GetStats(ConnectionStats &stats) = 0;
+
+		/// <summary>
+		/// Starts recording how long the network threads spend in each part of their tick, sending and in callbacks.
+		/// Every BCNet thread in the process is recorded, not just this client's. Only one trace can be recording at a time.
+		/// </summary>
+		/// <returns>False if a trace is already recording, or tracing was compiled out with BCNET_TRACING=0.</returns>
+		virtual bool StartTrace() = 0;
+
+		/// <summary>
+		/// Stops recording and writes the trace as Chrome trace JSON, which chrome://tracing and Perfetto can open.
+		/// Each thread keeps it's last 65536 events, anything older is dropped from the trace.
+		/// </summary>
+		/// <param name="filePath">Where to write the trace, it's overwritten.</param>
+		/// <returns>False if no trace was recording, or the file couldn't be written.</returns>
+		virtual bool StopTrace(const std::string &filePath) = 0;
+
+		/// <summary>
+		/// Turns per packet ID metrics on or off: packets and bytes sent and received, packet sizes, how long handling took and the latency.
+		/// Sizes are before batching and compression. Latency is estimated as half the round trip plus the time the packet waited here before being handled.
+		/// Metrics are kept while they're off, turning them back on carries on from where they were.
+		/// </summary>
+		/// <param name="enabled">Whether packets are measured, they cost nothing while it's off.</param>
+		/// <param name="filePath">If set, the metrics are written here in Prometheus text format every interval, for a node exporter's textfile collector or similar.</param>
+		/// <param name="intervalSeconds">How often the file is written.</param>
+		virtual void SetMetrics(bool enabled, const std::string &filePath = "", unsigned int intervalSeconds = 10) = 0;
+
+		/// <summary>
+		/// Names a packet ID in the metrics, the default packets are already named. IDs from 255 up share one set of metrics and can't be named.
+		/// </summary>
+		virtual void SetMetricsPacketName(uint32 packetID, const std::string &name) = 0;
+
+		/// <summary>
+		/// Gets the metrics in Prometheus text format.
+		/// </summary>
+		virtual std::string GetMetrics() = 0;
+
 		/// <summary>
 		/// Logs and outputs a message.
 		/// Use this if you want to be able to retrieve the message from GetLatestOutput()
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <BCNet/Core/Common.h>
+#include <BCNet/Core/Types.h>
 
 #include <string>
 #include <functional>
@@ -10,6 +11,12 @@
 #define BIND_SERVER_CONNECTED_CALLBACK(fn) std::bind(&fn, this, std::placeholders::_1)
 #define BIND_SERVER_DISCONNECTED_CALLBACK(fn) std::bind(&fn, this, std::placeholders::_1)
 #define BIND_SERVER_PACKET_RECEIVED_CALLBACK(fn) std::bind(&fn, this, std::placeholders::_1, std::placeholders::_2)
+#define BIND_SERVER_MESSAGE_RECEIVED_CALLBACK(fn) std::bind(&fn, this, std::placeholders::_1, std::placeholders::_2)
+#define BIND_SERVER_PACKET_BATCH_RECEIVED_CALLBACK(fn) std::bind(&fn, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3)
+#define BIND_SERVER_TRANSFER_STARTED_CALLBACK(fn) std::bind(&fn, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3)
+#define BIND_SERVER_TRANSFER_CHUNK_CALLBACK(fn) std::bind(&fn, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3)
+#define BIND_SERVER_TRANSFER_PROGRESS_CALLBACK(fn) std::bind(&fn, this, std::placeholders::_1, std::placeholders::_2)
+#define BIND_SERVER_TRANSFER_COMPLETED_CALLBACK(fn) std::bind(&fn, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4)
 #define BIND_SERVER_OUTPUT_LOG_CALLBACK(fn) std::bind(&fn, this)
 
 typedef unsigned int uint32;
@@ -17,11 +24,25 @@ typedef unsigned int uint32;
 namespace BCNet
 {
 	struct Packet; // Forward Declare.
+	class ReceivedMessage; // Forward Declare.
+	template <typename... Args> class PacketDispatcher; // Forward Declare, see BCNetDispatch.h.
 
 	struct ClientInfo
 	{
 		uint32 id; // Their connection ID.
 		std::string nickName;
+		PacketEncoding encoding = PacketEncoding::STANDARD; // How their packets are laid out, read theirs and write to them with it.
+		bool compression = false; // Whether packets to and from them can be compressed, agreed on along with the encoding.
+		bool batching = false; // Whether they can unpack batched packets, agreed on along with the encoding.
+	};
+
+	/// <summary>
+	/// How new connections are spread across the server's shards.
+	/// </summary>
+	enum class ShardAssignment
+	{
+		ROUND_ROBIN = 0, // Each new connection goes to the next shard in turn.
+		LEAST_LOADED // Each new connection goes to the shard with the fewest clients.
 	};
 
 	using ServerCommandCallback = std::function<void(const std::string)>;
@@ -29,6 +50,13 @@ namespace BCNet
 	using ServerConnectedCallback = std::function<void(const ClientInfo &)>;
 	using ServerDisconnectedCallback = std::function<void(const ClientInfo &)>;
 	using ServerPacketReceivedCallback = std::function<void(const ClientInfo &, const Packet)>;
+	using ServerMessageReceivedCallback = std::function<void(const ClientInfo &, const ReceivedMessage &)>;
+	using ServerPacketBatchReceivedCallback = std::function<void(const ClientInfo &, const ReceivedMessage *, size_t)>;
+	using ServerTransferStartedCallback = std::function<bool(const ClientInfo &, const TransferInfo &, Packet &)>;
+	using ServerTransferChunkCallback = std::function<void(const ClientInfo &, const TransferInfo &, const Packet)>;
+	using ServerTransferProgressCallback = std::function<void(const ClientInfo &, const TransferInfo &)>;
+	using ServerTransferCompletedCallback = std::function<void(const ClientInfo &, const TransferInfo &, TransferResult, const Packet)>;
+	using ServerPacketDispatcher = PacketDispatcher<const ClientInfo &>;
 	
 	/// <summary>
 	/// Server Interface.
@@ -52,6 +80,20 @@ namespace BCNet
 		/// </summary>
 		virtual void Stop() = 0;
 
+		/// <summary>
+		/// Sets whether Start reads commands from the standard input, the default is true.
+		/// Turn it off when the application runs several clients or servers in one process, or has no console.
+		/// </summary>
+		virtual void SetConsoleInput(bool enabled) = 0;
+
+		/// <summary>
+		/// Sets whether the server only takes clients from the same process, without opening a socket. The default is false.
+		/// Either way, clients in the same process can connect with ConnectToServer(LOOPBACK_SERVER_ADDRESS, port) using the port passed to Start,
+		/// through an in-memory socket pair that never touches the network. Only one server per port, and per process, can take them.
+		/// Takes effect on the next Start.
+		/// </summary>
+		virtual void SetLoopbackOnly(bool enabled) = 0;
+
 		/// <summary>
 		/// Is the network thread running?
 		/// </summary>
@@ -62,6 +104,16 @@ namespace BCNet
 		/// </summary>
 		virtual bool IsConnected() = 0;
 
+		/// <summary>
+		/// Sets how the network thread waits in between iterations.
+		/// The default is a fixed tick at 100 ticks per second, commands pushed from another thread wake the network thread early.
+		/// </summary>
+		/// <param name="mode">The scheduling mode.</param>
+		/// <param name="tickRate">Ticks per second for the fixed tick mode, and the longest the adaptive mode will sleep for.</param>
+		/// <param name="spinMicroseconds">How long before the end of each wait to stop sleeping and spin, for tighter pacing than the OS sleeps give.
+		/// The default of 0 sleeps all the way, anything else keeps a core busy for that long every wait, up to 2000.</param>
+		virtual void SetNetworkSchedule(NetworkScheduleMode mode, unsigned int tickRate = 100, unsigned int spinMicroseconds = 0) = 0;
+
 		/// <summary>
 		/// Sets the maximum amount of clients that can connect to the server.
 		/// The default is 12.
@@ -73,6 +125,14 @@ namespace BCNet
 		/// </summary>
 		virtual unsigned int GetConnectedCount() = 0;
 
+		/// <summary>
+		/// Gets a client's connection stats, as of the end of their shard's last tick. Safe to call from any thread, it doesn't lock.
+		/// </summary>
+		/// <param name="clientID">The client's ID.</param>
+		/// <param name="stats">Filled in with their stats.</param>
+		/// <returns>False if there's no client with that ID, or they haven't been sampled yet.</returns>
+		virtual bool GetClientStats(uint32 clientID, ConnectionStats &stats) = 0;
+
 		/// <summary>
 		/// This callback is called whenever a client successfully connects to the server.
 		/// The callback function should have a reference to the ClientInfo as a parameter.
@@ -96,6 +156,194 @@ namespace BCNet
 		/// </summary>
 		virtual void SetPacketReceivedCallback(const ServerPacketReceivedCallback &callback) = 0;
 
+		/// <summary>
+		/// This callback is called whenever the server receives a packet, like the packet received callback,
+		/// but the message keeps the received buffer alive so it can be kept or queued to another thread without copying it.
+		/// Both this and the packet received callback are called if both are set, but neither is with a batch callback set, see SetPacketBatchReceivedCallback().
+		/// The callback function should have a reference to the ClientInfo as a parameter, as well as a reference to the ReceivedMessage.
+		/// </summary>
+		virtual void SetMessageReceivedCallback(const ServerMessageReceivedCallback &callback) = 0;
+
+		/// <summary>
+		/// This callback is called with every batch of packets the server receives, once for each client that sent something.
+		/// The callback function should have a reference to the ClientInfo as a parameter, as well as a pointer to the client's
+		/// received messages and how many there are, the messages are contiguous and in the order they arrived.
+		/// While it's set it takes over from the packet and message callbacks, they aren't called for anything it's handed.
+		/// Packets with a handler in the dispatcher still go to their handler, and are left out of the batch.
+		/// </summary>
+		virtual void SetPacketBatchReceivedCallback(const ServerPacketBatchReceivedCallback &callback) = 0;
+
+		/// <summary>
+		/// Sets the table the server looks packet handlers up in, see BCNetDispatch.h. Pass nullptr to stop using one.
+		/// Packets with a handler are decoded and handed to it instead of going through the packet and message callbacks,
+		/// or the batch callback. Handlers run wherever the callbacks would, on a shard or a worker thread.
+		/// The dispatcher has to outlive the server, or be unset first, and shouldn't have handlers registered while it's in use.
+		/// </summary>
+		virtual void SetPacketDispatcher(ServerPacketDispatcher *dispatcher) = 0;
+
+		/// <summary>
+		/// Sets the maximum amount of messages the server takes from the networking library at once.
+		/// The default is 256.
+		/// </summary>
+		virtual void SetReceiveBatchSize(unsigned int size) = 0;
+
+		/// <summary>
+		/// Sets how many worker threads run the packet, message, batch, connected and disconnected callbacks.
+		/// The default is 0, which runs them on the network thread. With workers each client's callbacks still run
+		/// one at a time and in order, but different clients are handled in parallel, so callbacks must be thread safe.
+		/// Takes effect the next time the server starts, callbacks should be set before then too.
+		/// </summary>
+		virtual void SetHandlerThreads(unsigned int threadCount) = 0;
+
+		/// <summary>
+		/// Splits the server into shards, each with it's own poll group, client table and network thread, so receiving and
+		/// sending scale across cores. Shard 0 runs on the main network thread, which also accepts connections and runs commands.
+		/// The default is 1 shard. Without handler threads callbacks run on the thread of the shard that owns the client,
+		/// so with more than one shard they must be thread safe.
+		/// Takes effect the next time the server starts.
+		/// </summary>
+		/// <param name="count">How many shards to run.</param>
+		/// <param name="assignment">How new connections are spread across the shards.</param>
+		/// <param name="rebalance">Whether clients are moved between shards when some have noticeably more than others.</param>
+		virtual void SetShardCount(unsigned int count, ShardAssignment assignment = ShardAssignment::ROUND_ROBIN, bool rebalance = true) = 0;
+
+		/// <summary>
+		/// Sets the encoding the server agrees to when a client asks for it, see PacketEncoding.
+		/// The default is the standard encoding. Clients that never ask, like older ones, always get the standard encoding.
+		/// The agreed encoding is in each client's ClientInfo, packets from and to them should use it.
+		/// </summary>
+		virtual void SetPacketEncoding(PacketEncoding encoding) = 0;
+
+		/// <summary>
+		/// Turns on compressing packets to and from clients that ask for it, which is agreed on along with the compact encoding,
+		/// as compressed packets are marked by a flag in the compact header. Packets smaller than the threshold, or that don't
+		/// get any smaller, are sent as they are. Compression is off by default, the server and client both have to turn it on.
+		/// Takes effect for clients that connect afterwards.
+		/// </summary>
+		/// <param name="enabled">Whether to compress packets.</param>
+		/// <param name="threshold">The size in bytes a packet has to be to try compressing it.</param>
+		virtual void SetCompression(bool enabled, unsigned int threshold = 128) = 0;
+
+		/// <summary>
+		/// Turns on batching the small packets sent to each client during a tick, packing them into as few packets as fit in a datagram,
+		/// which are sent at the end of the tick. Clients unpack them before they reach any callbacks, so it's invisible to the application.
+		/// Only clients using the compact encoding take batched packets, everyone else gets their packets as they're sent.
+		/// Packets sent from outside the network threads wait for the next tick instead of waking them, use FlushMessages() to send them straight away.
+		/// Batching is off by default.
+		/// </summary>
+		/// <param name="enabled">Whether to batch packets.</param>
+		/// <param name="maxSize">The most bytes a batch can take, bigger packets are sent on their own.</param>
+		virtual void SetMessageBatching(bool enabled, unsigned int maxSize = 1200) = 0;
+
+		/// <summary>
+		/// Sends everything waiting to go to a client straight away, rather than at the end of the tick.
+		/// Can be called from any thread.
+		/// </summary>
+		/// <param name="clientID">The ID of the client.</param>
+		virtual void FlushMessagesOnConnection(uint32 clientID) = 0;
+
+		/// <summary>
+		/// Sends everything waiting to go to every client straight away, rather than at the end of the tick.
+		/// Can be called from any thread, like after sending everything for a game tick.
+		/// </summary>
+		virtual void FlushMessages() = 0;
+
+		/// <summary>
+		/// Sets a dictionary for compression, see TrainCompressionDictionary().
+		/// Clients have to have the same dictionary to get compressed packets. Should be set before the server starts.
+		/// </summary>
+		/// <param name="dictionary">The dictionary, it's copied. An empty packet means no dictionary.</param>
+		virtual void SetCompressionDictionary(const Packet &dictionary) = 0;
+
+		/// <summary>
+		/// Returns the compression counters for every packet.
+		/// </summary>
+		virtual CompressionStats GetCompressionStats() = 0;
+
+		/// <summary>
+		/// Returns the compression counters for one packet ID, IDs of 255 and up share theirs.
+		/// </summary>
+		virtual CompressionStats GetCompressionStats(uint32 packetID) = 0;
+
+		/// <summary>
+		/// This callback is called whenever a client starts a transfer to the server, see BeginTransfer().
+		/// The callback function should have a reference to the ClientInfo, a reference to the TransferInfo and a reference to the destination as parameters,
+		/// and return false to refuse the transfer. The destination can be pointed at a buffer of at least the transfer's size for it to be
+		/// reassembled into, which has to stay valid until the transfer completes, otherwise one is allocated for it.
+		/// Without this callback transfers are accepted as long as there's a completed callback to hand them to.
+		/// Transfers over the limits set with SetMaxTransferSize() are refused before this is called.
+		/// All the transfer callbacks run on the network thread of the shard that owns the client, even with handler threads.
+		/// </summary>
+		virtual void SetTransferStartedCallback(const ServerTransferStartedCallback &callback) = 0;
+
+		/// <summary>
+		/// This callback is called whenever a piece of a transfer from a client arrives, after it's been copied into the destination.
+		/// The callback function should have a reference to the ClientInfo, a reference to the TransferInfo and a copy of the chunk as parameters,
+		/// the chunk ends where the TransferInfo's transferred count is up to.
+		/// </summary>
+		virtual void SetTransferChunkCallback(const ServerTransferChunkCallback &callback) = 0;
+
+		/// <summary>
+		/// This callback is called whenever a transfer going either way moves along, once chunks are handed to the connection or taken in from it.
+		/// The callback function should have a reference to the ClientInfo and a reference to the TransferInfo as parameters.
+		/// </summary>
+		virtual void SetTransferProgressCallback(const ServerTransferProgressCallback &callback) = 0;
+
+		/// <summary>
+		/// This callback is called whenever a transfer going either way ends, successfully or not.
+		/// The callback function should have a reference to the ClientInfo, a reference to the TransferInfo, the result and a copy of the payload as parameters.
+		/// The payload is only there for completed incoming transfers, if it was allocated for the transfer it's only valid during the callback.
+		/// An outgoing transfer only completes once the client has all of it.
+		/// </summary>
+		virtual void SetTransferCompletedCallback(const ServerTransferCompletedCallback &callback) = 0;
+
+		/// <summary>
+		/// Sets how transfers are split up and paced. Each tick chunks are only added to a client's connection while it has fewer than
+		/// the window's worth of bytes waiting to be sent, so a transfer never floods the connection and everything else keeps flowing alongside it.
+		/// The defaults are 64KB chunks and a 256KB window, the window should stay well under the connection's send buffer, which is 512KB by default.
+		/// </summary>
+		/// <param name="chunkSize">The most bytes sent in one chunk, up to 448KB.</param>
+		/// <param name="window">The most bytes allowed to be waiting to be sent before transfers hold off.</param>
+		virtual void SetTransferPacing(unsigned int chunkSize = 64 * 1024, unsigned int window = 256 * 1024) = 0;
+
+		/// <summary>
+		/// Sets how big the transfers clients start can be, anything bigger is refused before the started callback and before anything is allocated for it.
+		/// The defaults are 64MB for one transfer and 256MB for all of a client's incoming transfers together.
+		/// </summary>
+		/// <param name="maxSize">The most bytes one transfer can be.</param>
+		/// <param name="maxIncoming">The most bytes a client's incoming transfers can add up to at once.</param>
+		virtual void SetMaxTransferSize(uint64_t maxSize = 64ull * 1024 * 1024, uint64_t maxIncoming = 256ull * 1024 * 1024) = 0;
+
+		/// <summary>
+		/// Starts sending a payload of any size to a client, split into chunks which are paced to what the connection can take.
+		/// Transfers to the same client are sent one after another, in the order they were started.
+		/// Can be called from any thread.
+		/// </summary>
+		/// <param name="clientID">The ID of the client who will receive the payload.</param>
+		/// <param name="data">The payload, it isn't copied, so it has to stay valid until the transfer completes.</param>
+		/// <param name="tag">Passed along to the client, like to say what the payload is.</param>
+		/// <returns>The transfer's ID, or 0 if the client isn't connected.</returns>
+		virtual uint32 BeginTransfer(uint32 clientID, const Packet &data, uint32 tag = 0) = 0;
+
+		/// <summary>
+		/// Starts sending a file to a client, like BeginTransfer() with a payload. The file is mapped into memory rather than read in,
+		/// so only the chunks being sent are ever loaded. It shouldn't be changed until the transfer completes.
+		/// </summary>
+		/// <param name="clientID">The ID of the client who will receive the file.</param>
+		/// <param name="filePath">The file to send.</param>
+		/// <param name="tag">Passed along to the client, like to say what the file is.</param>
+		/// <returns>The transfer's ID, or 0 if the client isn't connected or the file couldn't be opened.</returns>
+		virtual uint32 BeginTransfer(uint32 clientID, const std::string &filePath, uint32 tag = 0) = 0;
+
+		/// <summary>
+		/// Cancels a transfer to or from a client, both ends get the completed callback with the cancelled result.
+		/// Can be called from any thread.
+		/// </summary>
+		/// <param name="clientID">The ID of the client on the other end.</param>
+		/// <param name="transferID">The transfer's ID.</param>
+		/// <param name="incoming">Whether the client is sending it, IDs are only unique to whoever's sending.</param>
+		virtual void CancelTransfer(uint32 clientID, uint32 transferID, bool incoming = false) = 0;
+
 		/// <summary>
 		/// Returns a string describing all the commands the user can use to interact with the server.
 		/// </summary>
@@ -119,6 +367,41 @@ namespace BCNet
 		/// </summary>
 		virtual std::string PrintConnectedUsers() = 0;
 
+		/// <summary>
+		/// Starts recording how long the network threads spend in each part of their tick, sending and in callbacks.
+		/// Every BCNet thread in the process is recorded, not just this server's. Only one trace can be recording at a time.
+		/// </summary>
+		/// <returns>False if a trace is already recording, or tracing was compiled out with BCNET_TRACING=0.</returns>
+		virtual bool StartTrace() = 0;
+
+		/// <summary>
+		/// Stops recording and writes the trace as Chrome trace JSON, which chrome://tracing and Perfetto can open.
+		/// Each thread keeps it's last 65536 events, anything older is dropped from the trace.
+		/// </summary>
+		/// <param name="filePath">Where to write the trace, it's overwritten.</param>
+		/// <returns>False if no trace was recording, or the file couldn't be written.</returns>
+		virtual bool StopTrace(const std::string &filePath) = 0;
+
+		/// <summary>
+		/// Turns per packet ID metrics on or off: packets and bytes sent and received, packet sizes, how long handling took and the latency.
+		/// Packets sent to several clients count once per client they go to. Sizes are before batching and compression. Latency is estimated as half the round trip plus the time the packet waited here before being handled.
+		/// Metrics are kept while they're off, turning them back on carries on from where they were.
+		/// </summary>
+		/// <param name="enabled">Whether packets are measured, they cost nothing while it's off.</param>
+		/// <param name="filePath">If set, the metrics are written here in Prometheus text format every interval, for a node exporter's textfile collector or similar.</param>
+		/// <param name="intervalSeconds">How often the file is written.</param>
+		virtual void SetMetrics(bool enabled, const std::string &filePath = "", unsigned int intervalSeconds = 10) = 0;
+
+		/// <summary>
+		/// Names a packet ID in the metrics, the default packets are already named. IDs from 255 up share one set of metrics and can't be named.
+		/// </summary>
+		virtual void SetMetricsPacketName(uint32 packetID, const std::string &name) = 0;
+
+		/// <summary>
+		/// Gets the metrics in Prometheus text format.
+		/// </summary>
+		virtual std::string GetMetrics() = 0;
+
 		/// <summary>
 		/// Sets a clients nickname.
 		/// </summary>
@@ -152,28 +435,64 @@ namespace BCNet
 
 		/// <summary>
 		/// Sends a packet to the specified client.
+		/// Can be called from any thread, calls from outside the network thread are queued and carried out on it's next iteration.
 		/// </summary>
 		/// <param name="clientID">The ID of the client who will receive the packet.</param>
 		/// <param name="packet">The packet to send.</param>
 		/// <param name="reliable">Whether the connection is reliable or not.</param>
-		virtual void SendPacketToClient(uint32 clientID, const Packet &packet, bool reliable = true) = 0;
+		/// <param name="sendFlags">SendFlags for urgent packets.</param>
+		virtual void SendPacketToClient(uint32 clientID, const Packet &packet, bool reliable = true, uint8_t sendFlags = SEND_FLAG_NONE) = 0;
+
+		/// <summary>
+		/// Sends a packet to all connected clients, except excluded, picking the copy that matches each client's encoding.
+		/// Can be called from any thread, calls from outside the network thread are queued and carried out on it's next iteration.
+		/// </summary>
+		/// <param name="standardPacket">The packet written with the standard encoding.</param>
+		/// <param name="compactPacket">The same packet written with the compact encoding.</param>
+		/// <param name="excludeID">The ID of whoever shouldn't recieve the packet.</param>
+		/// <param name="reliable">Whether the connection is reliable or not.</param>
+		/// <param name="sendFlags">SendFlags for urgent packets.</param>
+		virtual void SendEncodedPacketToAllClients(const Packet &standardPacket, const Packet &compactPacket, uint32 excludeID = 0, bool reliable = true, uint8_t sendFlags = SEND_FLAG_NONE) = 0;
 
 		/// <summary>
 		/// Sends a packet to all connected clients, except excluded.
+		/// Can be called from any thread, calls from outside the network thread are queued and carried out on it's next iteration.
 		/// </summary>
 		/// <param name="packet">The packet to send.</param>
 		/// <param name="excludeID">The ID of whoever shouldn't recieve the packet.</param>
 		/// <param name="reliable">Whether the connection is reliable or not.</param>
-		virtual void SendPacketToAllClients(const Packet &packet, uint32 excludeID = 0, bool reliable = true) = 0;
+		/// <param name="sendFlags">SendFlags for urgent packets.</param>
+		virtual void SendPacketToAllClients(const Packet &packet, uint32 excludeID = 0, bool reliable = true, uint8_t sendFlags = SEND_FLAG_NONE) = 0;
+
+		/// <summary>
+		/// Sends a snapshot of the game state to all connected clients, received through the client's snapshot received callback.
+		/// Each client gets it delta encoded against the last snapshot they acknowledged, so only the bytes that changed since go over
+		/// the wire, or in full if they haven't acknowledged one that's still in the history. Snapshots work best when they keep the
+		/// same layout from one to the next, with values that didn't change in the same place.
+		/// Snapshots can be up to 512KB, the most GameNetworkingSockets sends in one message, clients won't take anything bigger.
+		/// Can be called from any thread, calls from outside the network thread are queued and carried out on it's next iteration.
+		/// </summary>
+		/// <param name="snapshot">The snapshot to send.</param>
+		/// <param name="reliable">Whether the connection is reliable or not, lost snapshots are simply replaced by the next one.</param>
+		virtual void SendSnapshot(const Packet &snapshot, bool reliable = false) = 0;
+
+		/// <summary>
+		/// Sets how many snapshots the server keeps to encode deltas against, see SendSnapshot().
+		/// Clients that fall further behind than this get full snapshots until they catch up. The default is 32.
+		/// Clears the snapshots sent so far.
+		/// </summary>
+		virtual void SetSnapshotHistory(unsigned int count) = 0;
 
 		/// <summary>
 		/// Kicks a connected client, severing their connection.
+		/// Can be called from any thread, calls from outside the network thread are queued and carried out on it's next iteration.
 		/// </summary>
 		/// <param name="clientID">The ID of the client to kick.</param>
 		virtual void KickClient(uint32 clientID) = 0;
 
 		/// <summary>
 		/// Kicks a connected client, severing their connection.
+		/// Can be called from any thread, calls from outside the network thread are queued and carried out on it's next iteration.
 		/// </summary>
 		/// <param name="nickName">The nickname of the client to kick.</param>
 		virtual void KickClient(const std::string &nickName) = 0;
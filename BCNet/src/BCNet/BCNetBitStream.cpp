@@ -0,0 +1,95 @@
+#include <BCNet/BCNetBitStream.h>
+
+#include <string.h>
+
+using namespace BCNet;
+
+// ------------ BITSTREAMWRITER
+BitStreamWriter::BitStreamWriter(PacketStreamWriter &writer)
+	: m_writer(writer)
+{ }
+
+BitStreamWriter::~BitStreamWriter()
+{
+	Flush();
+}
+
+bool BitStreamWriter::WriteFloat(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return WriteBits(bits, 32);
+}
+
+bool BitStreamWriter::Flush()
+{
+	if (m_scratchBits > 0)
+	{
+		uint8_t bytes[4];
+		const unsigned int count = (m_scratchBits + 7) / 8;
+		for (unsigned int i = 0; i < count; i++) // Lowest byte first, so the layout doesn't depend on the platform.
+			bytes[i] = (uint8_t)(m_scratch >> (i * 8));
+
+		if (!m_writer.WriteData((const char*)bytes, count))
+			m_failed = true;
+
+		m_scratch = 0;
+		m_scratchBits = 0;
+	}
+	return !m_failed;
+}
+
+bool BitStreamWriter::FlushWord()
+{
+	const uint8_t bytes[4] = { (uint8_t)m_scratch, (uint8_t)(m_scratch >> 8), (uint8_t)(m_scratch >> 16), (uint8_t)(m_scratch >> 24) };
+	if (!m_writer.WriteData((const char*)bytes, sizeof(bytes)))
+		m_failed = true;
+
+	m_scratch >>= 32;
+	m_scratchBits -= 32;
+	return !m_failed;
+}
+
+// ------------ BITSTREAMREADER
+BitStreamReader::BitStreamReader(PacketStreamReader &reader)
+	: m_reader(reader)
+{ }
+
+bool BitStreamReader::ReadFloat(float &value)
+{
+	uint32_t bits = 0;
+	if (!ReadBits(bits, 32))
+		return false;
+
+	memcpy(&value, &bits, sizeof(value));
+	return true;
+}
+
+void BitStreamReader::Align()
+{
+	const unsigned int padding = m_scratchBits % 8; // What's left of the current byte.
+	const unsigned int readAhead = m_scratchBits / 8; // Whole bytes that belong to whatever comes after the bits.
+
+	m_scratch = 0;
+	m_scratchBits = 0;
+	m_bitsRead += padding;
+	m_reader.SetStreamPosition(m_reader.GetStreamPosition() - readAhead);
+}
+
+bool BitStreamReader::Refill(unsigned int bits)
+{
+	// Read up to 4 bytes, the scratch word always has room for them since it never holds 32 bits or more here.
+	size_t count = m_reader.GetRemainingSize();
+	if (count > 4)
+		count = 4;
+
+	uint8_t bytes[4];
+	if (count == 0 || !m_reader.ReadData((char*)bytes, count))
+		return false;
+
+	for (size_t i = 0; i < count; i++)
+		m_scratch |= (uint64_t)bytes[i] << (m_scratchBits + i * 8);
+	m_scratchBits += (unsigned int)count * 8;
+
+	return m_scratchBits >= bits;
+}
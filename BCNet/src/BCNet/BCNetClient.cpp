@@ -1,12 +1,16 @@
 #include "BCNetClient.h"
 
 #include <BCNet/BCNetUtil.h>
+#include <BCNet/BCNetDispatch.h>
 #include "Misc/Utility.h"
+#include "Misc/DeltaCodec.h"
+#include "Misc/Loopback.h"
 
 #include <iostream>
 #include <sstream>
 #include <chrono>
 #include <random>
+#include <algorithm>
 
 #include <stdio.h>
 #include <string.h>
@@ -16,6 +20,12 @@
 #include <steam/steamnetworkingsockets.h>
 #include <steam/isteamnetworkingutils.h>
 
+namespace
+{
+	// How long the client waits on the server to answer the handshake before settling on the standard encoding.
+	constexpr std::chrono::seconds HANDSHAKE_TIMEOUT(1);
+}
+
 using namespace BCNet;
 
 BCNetClient *BCNetClient::s_callbackInstance = nullptr;
@@ -27,6 +37,7 @@ BCNetClient::~BCNetClient()
 {
 	m_shouldQuit = true;
 	m_networking = false;
+	m_scheduler.Wake(); // Don't wait out the rest of the tick.
 
 	if (m_networkThread.joinable())
 		m_networkThread.join(); // Wait for the thread to finish execution.
@@ -50,11 +61,63 @@ void BCNetClient::SetPacketReceivedCallback(const ClientPacketReceivedCallback &
 	m_packetReceivedCallback = callback;
 }
 
+void BCNetClient::SetMessageReceivedCallback(const ClientMessageReceivedCallback &callback)
+{
+	m_messageReceivedCallback = callback;
+}
+
+void BCNetClient::SetPacketBatchReceivedCallback(const ClientPacketBatchReceivedCallback &callback)
+{
+	m_packetBatchReceivedCallback = callback;
+}
+
+void BCNetClient::SetSnapshotReceivedCallback(const ClientSnapshotReceivedCallback &callback)
+{
+	m_snapshotReceivedCallback = callback;
+}
+
+void BCNetClient::SetPacketDispatcher(ClientPacketDispatcher *dispatcher)
+{
+	m_packetDispatcher = dispatcher;
+}
+
 void BCNetClient::SetOutputLogCallback(const ClientOutputLogCallback &callback)
 {
 	m_outputLogCallback = callback;
 }
 
+void BCNetClient::SetTransferStartedCallback(const ClientTransferStartedCallback &callback)
+{
+	m_transferStartedCallback = callback;
+}
+
+void BCNetClient::SetTransferChunkCallback(const ClientTransferChunkCallback &callback)
+{
+	m_transferChunkCallback = callback;
+}
+
+void BCNetClient::SetTransferProgressCallback(const ClientTransferProgressCallback &callback)
+{
+	m_transferProgressCallback = callback;
+}
+
+void BCNetClient::SetTransferCompletedCallback(const ClientTransferCompletedCallback &callback)
+{
+	m_transferCompletedCallback = callback;
+}
+
+void BCNetClient::SetTransferPacing(unsigned int chunkSize, unsigned int window)
+{
+	m_transferChunkSize = chunkSize > 0 ? (chunkSize < TRANSFER_MAX_CHUNK_SIZE ? chunkSize : TRANSFER_MAX_CHUNK_SIZE) : TRANSFER_DEFAULT_CHUNK_SIZE;
+	m_transferWindow = window > 0 ? window : TRANSFER_DEFAULT_WINDOW;
+}
+
+void BCNetClient::SetMaxTransferSize(uint64_t maxSize, uint64_t maxIncoming)
+{
+	m_maxTransferSize = maxSize;
+	m_maxIncomingTransfers = maxIncoming;
+}
+
 void BCNetClient::Start()
 {
 	if (m_networking)
@@ -64,31 +127,37 @@ void BCNetClient::Start()
 
 	if (m_networkThread.joinable())
 		m_networkThread.join(); // Wait for the thread to finish execution.
+	m_shouldQuit = false;
 	m_networkThread = std::thread([this]() { DoNetworking(); });
 
 	if (m_commandThread.joinable())
 		m_commandThread.join(); // Wait for the thread to finish execution.
-	m_commandThread = std::thread([this]()
+	if (m_consoleInput)
 	{
-		// Just gets whatever the user has put into the standard input handle then pushes it into the command queue.
-		while (!m_shouldQuit)
+		m_commandThread = std::thread([this]()
 		{
-			char szLine[4000];
-			if (!fgets(szLine, sizeof(szLine), stdin))
+			// Just gets whatever the user has put into the standard input handle then pushes it into the command queue.
+			while (!m_shouldQuit)
 			{
-				if (m_shouldQuit)
-					return;
-				m_shouldQuit = true;
-				std::cout << "Error: Failed to read command on stdin." << std::endl;
+				char szLine[4000];
+				if (!fgets(szLine, sizeof(szLine), stdin))
+				{
+					if (m_shouldQuit)
+						return;
+					m_shouldQuit = true;
+					std::cout << "Error: Failed to read command on stdin." << std::endl;
 
-				break;
-			}
+					break;
+				}
 
-			m_mutexCommandQueue.lock();
-			m_commandQueue.push(std::string(szLine));
-			m_mutexCommandQueue.unlock();
-		}
-	});
+				m_mutexCommandQueue.lock();
+				m_commandQueue.push(std::string(szLine));
+				m_mutexCommandQueue.unlock();
+
+				m_scheduler.Wake(); // Handle it now rather than next tick.
+			}
+		});
+	}
 
 	// Setup Default Commands.
 	m_commandCallbacks["/quit"] = BIND_COMMAND(BCNetClient::DoQuitCommand);
@@ -100,6 +169,8 @@ void BCNetClient::Start()
 	m_commandCallbacks["/nickname"] = BIND_COMMAND(BCNetClient::DoNickNameCommand);
 	m_commandCallbacks["/whosonline"] = BIND_COMMAND(BCNetClient::DoWhosOnlineCommand);
 	m_commandCallbacks["/online"] = BIND_COMMAND(BCNetClient::DoWhosOnlineCommand);
+	m_commandCallbacks["/stats"] = BIND_COMMAND(BCNetClient::DoStatsCommand);
+	m_commandCallbacks["/trace"] = BIND_COMMAND(BCNetClient::DoTraceCommand);
 	std::cout << PrintCommandList() << std::endl;
 }
 
@@ -109,6 +180,7 @@ void BCNetClient::Stop()
 		return;
 
 	m_shouldQuit = true;
+	m_scheduler.Wake(); // Don't wait out the rest of the tick.
 
 	if (m_networking)
 	{
@@ -133,6 +205,12 @@ void BCNetClient::ConnectToServer(const std::string &ipAddress, const int port)
 	if (port <= 0) // Port is invalid, use default.
 		usedPort = DEFAULT_SERVER_PORT;
 
+	if (ipAddress == LOOPBACK_SERVER_ADDRESS) // A server in this process.
+	{
+		ConnectToLoopback(usedPort);
+		return;
+	}
+
 	SteamNetworkingIPAddr addrServer;
 	addrServer.Clear();
 
@@ -158,10 +236,11 @@ void BCNetClient::ConnectToServer(const std::string &ipAddress, const int port)
 
 	m_networking = true;
 
-	SteamNetworkingConfigValue_t options;
-	options.SetPtr(k_ESteamNetworkingConfig_Callback_ConnectionStatusChanged, (void *)BCNetClient::SteamNetConnectionStatusChangedCallback);
+	SteamNetworkingConfigValue_t options[2];
+	options[0].SetPtr(k_ESteamNetworkingConfig_Callback_ConnectionStatusChanged, (void *)BCNetClient::SteamNetConnectionStatusChangedCallback);
+	options[1].SetInt64(k_ESteamNetworkingConfig_ConnectionUserData, (int64)(intptr_t)this); // Whose callbacks they are, set before there can be any.
 
-	m_connection = m_interface->ConnectByIPAddress(addrServer, 1, &options);
+	m_connection = m_interface->ConnectByIPAddress(addrServer, 2, options);
 	if (m_connection == k_HSteamNetConnection_Invalid)
 	{
 		Log("Error: Failed to connect to server.");
@@ -171,20 +250,68 @@ void BCNetClient::ConnectToServer(const std::string &ipAddress, const int port)
 	}
 }
 
+void BCNetClient::ConnectToLoopback(int port)
+{
+	m_connectionStatus = ConnectionStatus::CONNECTING;
+	Log("Connecting to loopback server on port " + std::to_string(port));
+
+	const HSteamNetConnection connection = LoopbackRegistry::Connect(port, BCNetClient::SteamNetConnectionStatusChangedCallback, (int64)(intptr_t)this);
+	if (connection == k_HSteamNetConnection_Invalid)
+	{
+		Log("Error: No server in this process is listening on port " + std::to_string(port) + ".");
+		m_connectionStatus = ConnectionStatus::FAILED;
+		return;
+	}
+	m_connection = connection;
+	m_networking = true; // Only once there's a connection to poll.
+
+	// Socket pairs start out connected without a callback, so it's made up.
+	SteamNetConnectionStatusChangedCallback_t change;
+	memset(&change, 0, sizeof(change));
+	change.m_hConn = connection;
+	SteamNetworkingSockets()->GetConnectionInfo(connection, &change.m_info);
+	change.m_eOldState = k_ESteamNetworkingConnectionState_Connecting;
+	change.m_info.m_eState = k_ESteamNetworkingConnectionState_Connected;
+	QueueStatusChange(change);
+}
+
 void BCNetClient::CloseConnection()
 {
 	if (m_networking == false) // Shouldn't disconnect if it's already disconnected.
 		return;
 
+	if (IsNetworkThread())
+		FlushBatches(); // Anything batched goes out before it closes.
+
 	m_networking = false;
+	m_negotiating = false;
 
 	m_interface->CloseConnection(m_connection, 0, "Closed by Client", true);
 	m_connection = k_HSteamNetConnection_Invalid;
+	m_snapshots.Clear();
 	m_connectionStatus = ConnectionStatus::DISCONNECTED;
+	if (IsNetworkThread()) // Otherwise the network thread fails them once it sees the connection's gone.
+		FailTransfers();
 	if (m_disconnectedCallback)
 		m_disconnectedCallback();
 }
 
+bool BCNetClient::GetStats(ConnectionStats &stats)
+{
+	const ConnectionStatsEntry entry = m_stats.Load();
+	if (entry.connection == 0) // Not connected, or not sampled yet.
+		return false;
+
+	stats = entry.stats;
+	return true;
+}
+
+void BCNetClient::SetMetrics(bool enabled, const std::string &filePath, unsigned int intervalSeconds)
+{
+	m_metrics.SetExport(filePath, intervalSeconds);
+	m_metrics.SetEnabled(enabled);
+}
+
 std::string BCNetClient::GetLatestOutput()
 {
 	// TODO: Fix bug that gives garabage output?
@@ -209,9 +336,10 @@ void BCNetClient::Log(std::string message)
 void BCNetClient::DoNetworking()
 {
 	s_callbackInstance = this;
+	m_networkThreadID = std::this_thread::get_id();
+	Tracer::SetThreadName("Client Network");
 
-	SteamDatagramErrMsg msg;
-	if (!GameNetworkingSockets_Init(nullptr, msg)) // Initialize networking library.
+	if (!InitNetworkingSockets()) // Initialize networking library.
 	{
 		std::cout << "Error: Failed to initialize GameNetworkingSockets" << std::endl;
 		return;
@@ -223,29 +351,58 @@ void BCNetClient::DoNetworking()
 	// Loop.
 	while (!m_shouldQuit)
 	{
+		BCNET_TRACE_SCOPE("Tick");
+		bool activity = false;
 		if (m_networking)
 		{
-			PollNetworkMessages();
+			activity = DrainOutboundRequests();
+			activity |= PollNetworkMessages();
 			PollConnectionStateChanges();
+
+			if (m_negotiating && std::chrono::steady_clock::now() >= m_negotiationDeadline) // Probably an older server, it won't ever answer.
+			{
+				Log("Server didn't answer the handshake, using the standard encoding.");
+				FinishConnecting(PacketEncoding::STANDARD);
+			}
+
+			if (!m_negotiating)
+				activity |= PumpTransfers();
+			FlushBatches(); // End of the tick.
+		}
+		else if (!m_transfers.IsEmpty()) // Disconnected from another thread.
+		{
+			FailTransfers();
 		}
+		SampleStats();
 		HandleUserCommands();
+		UpdateTrace(false);
+		m_metrics.Update("client");
 		m_networking = !m_shouldQuit;
-		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		m_scheduler.Wait(activity); // Sleep, spin or carry on depending on the schedule.
 	}
 
 	// Quit.
+	UpdateTrace(true); // Whatever was recorded before quitting.
+	m_metrics.Update("client", true); // Everything up to quitting.
 	CloseConnection();
 
-	GameNetworkingSockets_Kill();
+	{
+		std::lock_guard<std::mutex> lock(m_mutexStatusChanges);
+		m_statusChanges.clear(); // For a connection that's gone now.
+	}
+	KillNetworkingSockets();
 }
 
-void BCNetClient::PollNetworkMessages()
+bool BCNetClient::PollNetworkMessages()
 {
+	BCNET_TRACE_SCOPE("PollNetworkMessages");
+	const bool batching = (bool)m_packetBatchReceivedCallback;
+	bool received = false;
+	m_receiveMessages.resize(m_receiveBatchSize);
+
 	while (m_networking)
 	{
-		ISteamNetworkingMessage *msg = nullptr;
-
-		int numMsgs = m_interface->ReceiveMessagesOnConnection(m_connection, &msg, 1); // Get incoming packets.
+		int numMsgs = m_interface->ReceiveMessagesOnConnection(m_connection, m_receiveMessages.data(), (int)m_receiveMessages.size()); // Get incoming packets.
 		if (numMsgs == 0)
 		{
 			break; // Break because no packets.
@@ -254,27 +411,371 @@ void BCNetClient::PollNetworkMessages()
 		{
 			//std::cout << "Error whilst polling incoming messages" << std::endl;
 			m_networking = false;
-			return;
+			return received;
+		}
+		received = true;
+
+		for (int i = 0; i < numMsgs; i++)
+		{
+			ReceivedMessage message(m_receiveMessages[i]); // Releases the message once nothing references it anymore.
+
+			if (!message.GetSize()) // Packet isn't valid.
+				continue;
+
+			if (m_negotiating && HandleHandshake(message.GetPacket())) // Not for the application.
+				continue;
+
+			if (!m_serverBatching || !MessageBatcher::IsBatch(message.GetPacket()))
+			{
+				HandleMessage(message, batching);
+				continue;
+			}
+
+			if (m_compressing && PacketCompressor::IsCompressed(message.GetPacket()) && !m_compressor.Decompress(message)) // The whole batch was compressed.
+			{
+				Log("Dropped a corrupt compressed packet from the server.");
+				continue;
+			}
+
+			if (!MessageBatcher::Unpack(message, m_unbatchedMessages))
+			{
+				Log("Dropped a malformed batch from the server.");
+				continue;
+			}
+
+			for (ReceivedMessage &unbatched : m_unbatchedMessages) // Each one as if it came on it's own.
+				HandleMessage(unbatched, batching);
+			m_unbatchedMessages.clear();
 		}
-		assert(numMsgs == 1 && msg);
 
-		if (msg->m_cbSize) // Packet is valid.
+		if (!m_receiveBatch.empty())
 		{
-			if (m_packetReceivedCallback)
-				m_packetReceivedCallback(Packet(msg->m_pData, (size_t)msg->m_cbSize)); // Do callback.
+			m_packetBatchReceivedCallback(m_receiveBatch.data(), m_receiveBatch.size()); // Do callback.
+			m_receiveBatch.clear();
 		}
 
-		msg->Release(); // No longer needed.
+		if ((size_t)numMsgs < m_receiveMessages.size()) // Drained everything that was waiting.
+			break;
 	}
+
+	return received;
+}
+
+bool BCNetClient::HandleHandshake(const Packet &packet)
+{
+	uint32_t id = 0;
+	PacketStreamReader packetReader(packet, 0, PacketEncoding::STANDARD); // The answer is always in the standard encoding.
+	if (!packetReader.ReadHeader(id) || id != (uint32_t)DefaultPacketID::PACKET_HANDSHAKE)
+		return false;
+
+	uint8_t agreed = (uint8_t)PacketEncoding::STANDARD;
+	packetReader.ReadRaw<uint8_t>(agreed);
+
+	uint8_t compression = 0; // Older servers stop after the encoding, or the compression.
+	uint8_t batching = 0;
+	packetReader.ReadRaw<uint8_t>(compression);
+	packetReader.ReadRaw<uint8_t>(batching);
+	m_compressing = agreed == (uint8_t)PacketEncoding::COMPACT && compression != 0;
+	m_serverBatching = agreed == (uint8_t)PacketEncoding::COMPACT && batching != 0;
+
+	FinishConnecting(agreed == (uint8_t)PacketEncoding::COMPACT ? PacketEncoding::COMPACT : PacketEncoding::STANDARD);
+	return true;
+}
+
+bool BCNetClient::HandleSnapshot(const Packet &packet)
+{
+	const PacketEncoding encoding = m_encoding.load(std::memory_order_relaxed);
+
+	uint32_t id = 0;
+	PacketStreamReader packetReader(packet, 0, encoding);
+	if (!packetReader.ReadHeader(id) || id != (uint32_t)DefaultPacketID::PACKET_SNAPSHOT)
+		return false;
+
+	uint32_t sequence = 0, baselineSequence = 0;
+	if (!packetReader.ReadRaw<uint32_t>(sequence) || !packetReader.ReadRaw<uint32_t>(baselineSequence) || sequence == 0)
+		return true;
+
+	const uint32_t latest = m_snapshots.GetLatestSequence();
+	if (latest != 0 && !IsNewerSnapshot(sequence, latest)) // Arrived after a newer one.
+		return true;
+
+	std::shared_ptr<const Snapshot> baseline;
+	if (baselineSequence != 0)
+	{
+		baseline = m_snapshots.Get(baselineSequence);
+		if (!baseline) // Can't rebuild it, ask for the next one in full instead of waiting for the server to stop using that baseline.
+		{
+			PacketStreamWriter packetWriter(encoding);
+			packetWriter.WriteHeader((uint32_t)DefaultPacketID::PACKET_SNAPSHOT_ACK);
+			packetWriter.WriteRaw<uint32_t>(0);
+			packetWriter.WriteRaw<uint32_t>(baselineSequence);
+			SendPacketToServer(packetWriter.GetPacket(), false); // Sent again with the next one if it's lost.
+			return true;
+		}
+	}
+
+	PooledPacket snapshot;
+	if (!ReadDelta(packetReader, baseline ? baseline->data.GetPacket() : Packet(), snapshot))
+	{
+		Log("Dropped a snapshot that couldn't be decoded.");
+		return true;
+	}
+
+	m_snapshots.Insert(sequence, std::move(snapshot));
+	const std::shared_ptr<const Snapshot> rebuilt = m_snapshots.Get(sequence); // Kept alive through the callback.
+
+	PacketStreamWriter packetWriter(encoding);
+	packetWriter.WriteHeader((uint32_t)DefaultPacketID::PACKET_SNAPSHOT_ACK);
+	packetWriter.WriteRaw<uint32_t>(sequence);
+	SendPacketToServer(packetWriter.GetPacket(), false); // The next snapshot is only a few ticks away, losing one just means a bigger delta.
+
+	if (m_snapshotReceivedCallback && rebuilt)
+		m_snapshotReceivedCallback(sequence, rebuilt->data.GetPacket()); // Do callback.
+	return true;
+}
+
+void BCNetClient::HandleMessage(ReceivedMessage &message, bool batching)
+{
+	BCNET_TRACE_SCOPE("Callbacks");
+	if (m_compressing && PacketCompressor::IsCompressed(message.GetPacket()) && !m_compressor.Decompress(message)) // Swapped for the decompressed copy.
+	{
+		Log("Dropped a corrupt compressed packet from the server.");
+		return;
+	}
+
+	uint32_t id = 0;
+	const bool measuring = m_metrics.IsEnabled();
+	if (measuring) // The header's only read here when it's needed.
+	{
+		PacketStreamReader packetReader(message.GetPacket(), 0, m_encoding.load(std::memory_order_relaxed));
+		packetReader.ReadHeader(id);
+		m_metrics.RecordReceived(id, message.GetSize());
+	}
+	HandlerTimer timer(m_metrics, id, message, measuring ? m_stats.Load().stats.ping : 0);
+
+	if (HandleSnapshot(message.GetPacket())) // Goes through the snapshot callback instead.
+		return;
+
+	if (HandleTransfer(message.GetPacket())) // Goes through the transfer callbacks instead.
+		return;
+
+	if (DispatchPacket(message.GetPacket()))
+		return;
+
+	if (batching) // The batch callback takes it instead.
+	{
+		m_receiveBatch.push_back(std::move(message));
+		return;
+	}
+
+	if (m_packetReceivedCallback)
+		m_packetReceivedCallback(message.GetPacket()); // Do callback.
+	if (m_messageReceivedCallback)
+		m_messageReceivedCallback(message); // Do callback.
+}
+
+bool BCNetClient::HandleTransfer(const Packet &packet)
+{
+	const PacketEncoding encoding = m_encoding.load(std::memory_order_relaxed);
+
+	uint32_t id = 0;
+	PacketStreamReader packetReader(packet, 0, encoding);
+	if (!packetReader.ReadHeader(id) || !TransferManager::IsTransferPacket(id))
+		return false;
+
+	ServerTransfers connection(*this);
+	if (!m_transfers.HandlePacket(connection, id, packetReader, encoding))
+		Log("Dropped a malformed transfer packet from the server.");
+	return true;
+}
+
+uint32 BCNetClient::BeginTransfer(const Packet &data, uint32 tag)
+{
+	OutgoingTransfer transfer;
+	transfer.info.tag = tag;
+	transfer.info.size = data.size;
+	transfer.data = (const uint8_t*)data.data;
+	return StartTransfer(std::move(transfer));
+}
+
+uint32 BCNetClient::BeginTransfer(const std::string &filePath, uint32 tag)
+{
+	std::unique_ptr<MappedFile> file = std::make_unique<MappedFile>();
+	if (!file->Open(filePath))
+	{
+		Log("Error: Could not open " + filePath + " to transfer it!");
+		return 0;
+	}
+
+	OutgoingTransfer transfer;
+	transfer.info.tag = tag;
+	transfer.info.size = file->GetSize();
+	transfer.data = file->GetData();
+	transfer.file = std::move(file);
+	return StartTransfer(std::move(transfer));
+}
+
+void BCNetClient::CancelTransfer(uint32 transferID, bool incoming)
+{
+	OutboundRequest request;
+	request.type = OutboundRequest::Type::CANCEL_TRANSFER;
+	request.transferID = transferID;
+	request.incoming = incoming;
+
+	if (IsNetworkThread())
+		HandleOutboundRequest(request);
+	else
+		PushOutboundRequest(std::move(request), true);
+}
+
+uint32 BCNetClient::StartTransfer(OutgoingTransfer &&transfer)
+{
+	if (m_connectionStatus != ConnectionStatus::CONNECTED)
+		return 0;
+
+	uint32 id = m_nextTransferID++;
+	if (id == 0) // Wrapped around, 0 means it didn't start.
+		id = m_nextTransferID++;
+	transfer.info.id = id;
+
+	if (IsNetworkThread()) // Sent from the next pump.
+	{
+		m_transfers.Add(std::move(transfer));
+		return id;
+	}
+
+	OutboundRequest request;
+	request.type = OutboundRequest::Type::TRANSFER;
+	request.transfers = std::make_unique<TransferManager>();
+	request.transfers->Add(std::move(transfer));
+	PushOutboundRequest(std::move(request), true);
+	return id;
+}
+
+bool BCNetClient::PumpTransfers()
+{
+	BCNET_TRACE_SCOPE("PumpTransfers");
+	if (!m_transfers.HasOutgoing())
+		return false;
+
+	// Only top up what's waiting to go out, the rest waits for GameNetworkingSockets to drain it at the connection's send rate.
+	SteamNetConnectionRealTimeStatus_t status;
+	if (m_interface->GetConnectionRealTimeStatus(m_connection, &status, 0, nullptr) != k_EResultOK)
+		return false;
+
+	const size_t pending = (size_t)status.m_cbPendingReliable + (size_t)status.m_cbPendingUnreliable;
+	if (pending >= m_transferWindow)
+		return false;
+
+	ServerTransfers connection(*this);
+	return m_transfers.Pump(connection, m_encoding.load(std::memory_order_relaxed), m_transferWindow - pending, m_transferChunkSize);
+}
+
+void BCNetClient::FailTransfers()
+{
+	ServerTransfers connection(*this);
+	m_transfers.Fail(connection);
+}
+
+void BCNetClient::SampleStats()
+{
+	BCNET_TRACE_SCOPE("SampleStats");
+	ConnectionStatsEntry entry;
+	SteamNetConnectionRealTimeStatus_t status;
+	if (m_connection != k_HSteamNetConnection_Invalid && m_interface->GetConnectionRealTimeStatus(m_connection, &status, 0, nullptr) == k_EResultOK)
+	{
+		entry.connection = m_connection;
+		entry.stats = MakeConnectionStats(status);
+	}
+	else if (m_stats.Load().connection == 0) // Already cleared.
+	{
+		return;
+	}
+
+	m_stats.Store(entry);
+}
+
+void BCNetClient::ServerTransfers::SendTransferPacket(const Packet &packet)
+{
+	m_client.SendPacketToServer(packet, true);
+}
+
+bool BCNetClient::ServerTransfers::OnTransferStarted(const TransferInfo &info, Packet &destination)
+{
+	if (m_client.m_transferStartedCallback)
+		return m_client.m_transferStartedCallback(info, destination); // Do callback.
+
+	return (bool)m_client.m_transferCompletedCallback; // Someone has to take it.
+}
+
+void BCNetClient::ServerTransfers::OnTransferChunk(const TransferInfo &info, const Packet &chunk)
+{
+	if (m_client.m_transferChunkCallback)
+		m_client.m_transferChunkCallback(info, chunk); // Do callback.
+}
+
+void BCNetClient::ServerTransfers::OnTransferProgress(const TransferInfo &info)
+{
+	if (m_client.m_transferProgressCallback)
+		m_client.m_transferProgressCallback(info); // Do callback.
+}
+
+void BCNetClient::ServerTransfers::OnTransferCompleted(const TransferInfo &info, TransferResult result, const Packet &data)
+{
+	if (m_client.m_transferCompletedCallback)
+		m_client.m_transferCompletedCallback(info, result, data); // Do callback.
+}
+
+// Hands a packet to the handler registered for it, returns true if there was one, even if the packet couldn't be decoded.
+bool BCNetClient::DispatchPacket(const Packet &packet)
+{
+	ClientPacketDispatcher *dispatcher = m_packetDispatcher;
+	if (!dispatcher)
+		return false;
+
+	uint32_t id = 0;
+	PacketStreamReader packetReader(packet, 0, m_encoding.load(std::memory_order_relaxed));
+	if (!packetReader.ReadHeader(id) || !dispatcher->HasHandler(id))
+		return false;
+
+	if (!dispatcher->Dispatch(id, packetReader))
+		Log("Dropped a malformed packet (" + std::to_string(id) + ") from the server.");
+
+	return true;
+}
+
+void BCNetClient::FinishConnecting(PacketEncoding encoding)
+{
+	m_encoding.store(encoding, std::memory_order_relaxed);
+	m_negotiating = false;
+
+	Log("Connected to server");
+	m_connectionStatus = ConnectionStatus::CONNECTED;
+
+	if (m_connectedCallback)
+		m_connectedCallback(); // Do callback.
 }
 
 void BCNetClient::PollConnectionStateChanges()
 {
+	BCNET_TRACE_SCOPE("RunCallbacks");
 	m_interface->RunCallbacks();
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutexStatusChanges);
+		m_handledStatusChanges.swap(m_statusChanges);
+	}
+	for (SteamNetConnectionStatusChangedCallback_t &change : m_handledStatusChanges) // In the order GameNetworkingSockets posted them.
+	{
+		if (change.m_hConn == m_connection) // Not one that's been closed since.
+			OnSteamNetConnectionStatusChanged(&change);
+	}
+	m_handledStatusChanges.clear();
 }
 
 void BCNetClient::HandleUserCommands()
 {
+	BCNET_TRACE_SCOPE("HandleUserCommands");
 	std::string input;
 	while (!m_shouldQuit && GetNextCommand(input))
 	{
@@ -373,6 +874,8 @@ void BCNetClient::PushInputAsCommand(std::string input)
 	m_mutexCommandQueue.lock();
 	m_commandQueue.push(input);
 	m_mutexCommandQueue.unlock();
+
+	m_scheduler.Wake(); // Handle it now rather than next tick.
 }
 
 // Gathers all the commands into a string.
@@ -390,9 +893,151 @@ std::string BCNetClient::PrintCommandList()
 	return ss.str();
 }
 
-void BCNetClient::SendPacketToServer(const Packet &packet, bool reliable)
+void BCNetClient::SendPacketToServer(const Packet &packet, bool reliable, uint8_t sendFlags)
 {
-	EResult result = m_interface->SendMessageToConnection(m_connection, packet.data, (uint32_t)packet.size, reliable ? k_nSteamNetworkingSend_Reliable : k_nSteamNetworkingSend_Unreliable, nullptr);
+	BCNET_TRACE_SCOPE("SendPacketToServer");
+	if (!IsNetworkThread()) // Let the network thread send it.
+	{
+		OutboundRequest request;
+		request.reliable = reliable;
+		request.sendFlags = sendFlags;
+		if (packet.size > 0) // Copy the packet, the caller is free to release theirs as soon as this returns.
+		{
+			request.payload.Allocate(packet.size);
+			memcpy(request.payload.GetData(), packet.data, packet.size);
+		}
+		PushOutboundRequest(std::move(request), m_batchSize == 0 || sendFlags != SEND_FLAG_NONE); // Batched packets can wait for the tick.
+		return;
+	}
+
+	if (m_metrics.IsEnabled())
+		m_metrics.RecordSent(packet, m_encoding.load(std::memory_order_relaxed));
+
+	if (m_serverBatching && m_batchSize > 0)
+	{
+		if (sendFlags == SEND_FLAG_NONE)
+		{
+			if (m_batcher.Add(packet, reliable, m_batchSize)) // Goes out with the rest at the end of the tick.
+				return;
+
+			SendBatch(reliable); // Full, start another one.
+			if (m_batcher.Add(packet, reliable, m_batchSize))
+				return;
+		}
+		else
+		{
+			SendBatch(reliable); // Urgent, send what came before it first so it doesn't get overtaken.
+		}
+	}
+
+	PooledPacket compressed;
+	if (m_compressing)
+		m_compressor.Compress(packet, compressed);
+
+	const Packet &sent = compressed ? compressed.GetPacket() : packet;
+	EResult result = m_interface->SendMessageToConnection(m_connection, sent.data, (uint32_t)sent.size, GetSendFlags(reliable, sendFlags), nullptr);
+}
+
+void BCNetClient::SendBatch(bool reliable)
+{
+	BCNET_TRACE_SCOPE("SendBatch");
+	PooledPacket batch;
+	if (!m_batcher.Build(reliable, batch))
+		return;
+
+	PooledPacket compressed; // Compressed as a whole, small packets compress better together.
+	if (m_compressing)
+		m_compressor.Compress(batch.GetPacket(), compressed);
+
+	const Packet &sent = compressed ? compressed.GetPacket() : batch.GetPacket();
+	EResult result = m_interface->SendMessageToConnection(m_connection, sent.data, (uint32_t)sent.size, GetSendFlags(reliable, SEND_FLAG_NONE), nullptr);
+}
+
+void BCNetClient::FlushBatches()
+{
+	BCNET_TRACE_SCOPE("FlushBatches");
+	if (m_batcher.IsEmpty())
+		return;
+
+	SendBatch(true);
+	SendBatch(false);
+	m_interface->FlushMessagesOnConnection(m_connection); // Don't let Nagle's timer hold the tick back.
+}
+
+void BCNetClient::FlushMessages()
+{
+	if (!IsNetworkThread()) // Sends queued before this go out on it's next iteration, which ends by flushing.
+	{
+		m_scheduler.Wake();
+		return;
+	}
+
+	FlushBatches();
+	m_interface->FlushMessagesOnConnection(m_connection);
+}
+
+void BCNetClient::PushOutboundRequest(OutboundRequest &&request, bool wake)
+{
+	while (!m_outboundQueue.TryPush(std::move(request))) // Queue is full, wait for the network thread to catch up.
+	{
+		if (m_shouldQuit)
+			return;
+
+		m_scheduler.Wake();
+		std::this_thread::yield();
+	}
+
+	if (wake)
+		m_scheduler.Wake(); // Send it now rather than next tick.
+}
+
+bool BCNetClient::DrainOutboundRequests()
+{
+	BCNET_TRACE_SCOPE("DrainOutboundRequests");
+	bool drained = false;
+
+	OutboundRequest request;
+	while (m_outboundQueue.TryPop(request))
+	{
+		drained = true;
+
+		HandleOutboundRequest(request);
+		request.payload.Release();
+		request.transfers.reset();
+	}
+
+	return drained;
+}
+
+void BCNetClient::HandleOutboundRequest(OutboundRequest &request)
+{
+	switch (request.type)
+	{
+		case OutboundRequest::Type::SEND:
+		{
+			SendPacketToServer(request.payload, request.reliable, request.sendFlags);
+		} break;
+		case OutboundRequest::Type::TRANSFER:
+		{
+			if (!request.transfers)
+				break;
+
+			if (m_connectionStatus == ConnectionStatus::CONNECTED)
+			{
+				m_transfers.Merge(*request.transfers); // Sent from the next pump.
+				break;
+			}
+
+			ServerTransfers connection(*this); // The connection closed before it could start.
+			request.transfers->Fail(connection);
+		} break;
+		case OutboundRequest::Type::CANCEL_TRANSFER:
+		{
+			ServerTransfers connection(*this);
+			if (!m_transfers.Cancel(connection, request.transferID, request.incoming, m_encoding.load(std::memory_order_relaxed)))
+				Log("Error: Could not cancel transfer [" + std::to_string(request.transferID) + "] because it isn't running!");
+		} break;
+	}
 }
 
 void BCNetClient::OnSteamNetConnectionStatusChanged(SteamNetConnectionStatusChangedCallback_t *pInfo)
@@ -408,6 +1053,7 @@ void BCNetClient::OnSteamNetConnectionStatusChanged(SteamNetConnectionStatusChan
 		case k_ESteamNetworkingConnectionState_ProblemDetectedLocally:
 		{
 			m_networking = false;
+			m_negotiating = false;
 			m_connectionStatus = ConnectionStatus::FAILED;
 
 			// Handle client disconnection or connection error.
@@ -427,6 +1073,8 @@ void BCNetClient::OnSteamNetConnectionStatusChanged(SteamNetConnectionStatusChan
 			m_interface->CloseConnection(m_connection, 0, nullptr, false);
 			m_connection = k_HSteamNetConnection_Invalid;
 			m_connectionStatus = ConnectionStatus::DISCONNECTED;
+			m_snapshots.Clear();
+			FailTransfers();
 
 			if (m_disconnectedCallback)
 				m_disconnectedCallback(); // Do callback.
@@ -438,11 +1086,29 @@ void BCNetClient::OnSteamNetConnectionStatusChanged(SteamNetConnectionStatusChan
 		case k_ESteamNetworkingConnectionState_Connected:
 		{
 			// Handle on connected.
-			Log("Connected to server");
-			m_connectionStatus = ConnectionStatus::CONNECTED;
+			m_encoding.store(PacketEncoding::STANDARD, std::memory_order_relaxed); // Until the server agrees to something else.
+			m_compressing = false;
+			m_serverBatching = false;
+			m_batcher.Clear(); // Whatever was left from the last connection.
+			if (!m_transfers.IsEmpty())
+				FailTransfers();
+			if (m_preferredEncoding == PacketEncoding::STANDARD) // Nothing to agree on.
+			{
+				FinishConnecting(PacketEncoding::STANDARD);
+				break;
+			}
 
-			if (m_connectedCallback)
-				m_connectedCallback(); // Do callback.
+			// Ask for the encoding, the connected callback waits for the answer.
+			PacketStreamWriter packetWriter(PacketEncoding::STANDARD);
+			packetWriter.WriteHeader((uint32_t)DefaultPacketID::PACKET_HANDSHAKE);
+			packetWriter.WriteRaw<uint8_t>((uint8_t)m_preferredEncoding);
+			packetWriter.WriteRaw<uint8_t>(m_compressor.IsEnabled() ? 1 : 0);
+			packetWriter.WriteRaw<uint32_t>(m_compressor.GetDictionaryID()); // Compression needs the same dictionary on both ends.
+			packetWriter.WriteRaw<uint8_t>(1); // We can unpack batched packets.
+			SendPacketToServer(packetWriter.GetPacket());
+
+			m_negotiating = true;
+			m_negotiationDeadline = std::chrono::steady_clock::now() + HANDSHAKE_TIMEOUT;
 		} break;
 		default:
 		{
@@ -452,7 +1118,18 @@ void BCNetClient::OnSteamNetConnectionStatusChanged(SteamNetConnectionStatusChan
 
 void BCNetClient::SteamNetConnectionStatusChangedCallback(SteamNetConnectionStatusChangedCallback_t *pInfo)
 {
-	s_callbackInstance->OnSteamNetConnectionStatusChanged(pInfo); // Handle callbacks.
+	// The connection's user data says whose it is, any client or server in the process could be running the callbacks.
+	BCNetClient *client = pInfo->m_info.m_nUserData > 0 ? (BCNetClient*)(intptr_t)pInfo->m_info.m_nUserData : s_callbackInstance;
+	client->QueueStatusChange(*pInfo); // Handled by it's network thread.
+}
+
+void BCNetClient::QueueStatusChange(const SteamNetConnectionStatusChangedCallback_t &change)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutexStatusChanges);
+		m_statusChanges.push_back(change);
+	}
+	m_scheduler.Wake();
 }
 
 // Default commands.
@@ -504,15 +1181,11 @@ void BCNetClient::DoNickNameCommand(const std::string parameters)
 
 	std::string nickname = params[0];
 
-	Packet packet;
-	packet.Allocate(1024);
-
-	PacketStreamWriter packetWriter(packet);
-	packetWriter.WriteRaw<DefaultPacketID>(DefaultPacketID::PACKET_NICKNAME);
+	PacketStreamWriter packetWriter(GetPacketEncoding());
+	packetWriter.WriteHeader((uint32_t)DefaultPacketID::PACKET_NICKNAME);
 	packetWriter.WriteString(nickname);
 
 	SendPacketToServer(packetWriter.GetPacket());
-	packet.Release();
 }
 
 void BCNetClient::DoWhosOnlineCommand(const std::string parameters)
@@ -528,14 +1201,105 @@ void BCNetClient::DoWhosOnlineCommand(const std::string parameters)
 		std::cout << "Warning: Ignoring parameters." << std::endl;
 	}
 	
-	Packet packet;
-	packet.Allocate(1024);
-
-	PacketStreamWriter packetWriter(packet);
-	packetWriter.WriteRaw<DefaultPacketID>(DefaultPacketID::PACKET_WHOSONLINE);
+	PacketStreamWriter packetWriter(GetPacketEncoding());
+	packetWriter.WriteHeader((uint32_t)DefaultPacketID::PACKET_WHOSONLINE);
 
 	SendPacketToServer(packetWriter.GetPacket());
-	packet.Release();
+}
+
+void BCNetClient::DoStatsCommand(const std::string parameters) // /stats {-detailed}
+{
+	ConnectionStats stats;
+	if (m_connectionStatus != ConnectionStatus::CONNECTED || !GetStats(stats))
+	{
+		Log("Warning: Client is not connected to a server.");
+		return;
+	}
+
+	Log("Connection Stats: " + FormatConnectionStats(stats));
+
+	if (parameters.empty())
+		return;
+
+	int count;
+	char *params[128];
+	ParseCommandParameters(parameters, &count, params); // Get individual parameters.
+
+	for (int i = 0; i < count; i++)
+	{
+		if (strcmp(params[i], "-detailed") == 0) // Everything GameNetworkingSockets knows about the connection.
+		{
+			std::string details(4096, '\0');
+			int result = m_interface->GetDetailedConnectionStatus(m_connection, &details[0], (int)details.size());
+			if (result > 0) // Too small, it says how much it needs.
+			{
+				details.assign((size_t)result, '\0');
+				result = m_interface->GetDetailedConnectionStatus(m_connection, &details[0], (int)details.size());
+			}
+			if (result == 0)
+			{
+				details.resize(strlen(details.c_str()));
+				Log(details);
+			}
+			continue;
+		}
+
+		Log("Warning: Unknown parameter specified \"" + std::string(params[i]) + "\"");
+	}
+}
+
+void BCNetClient::DoTraceCommand(const std::string parameters) // /trace {Duration} {-file [Path]}
+{
+	unsigned int milliseconds = 5000;
+	std::string path = "bcnet_trace_" + std::to_string((long long)time(nullptr)) + ".json";
+
+	int count;
+	char *params[128];
+	ParseCommandParameters(parameters, &count, params); // Get individual parameters.
+
+	for (int i = 0; i < count; i++)
+	{
+		if (strcmp(params[i], "-file") == 0)
+		{
+			i++;
+			if (i >= count)
+				continue;
+
+			path = params[i];
+			continue;
+		}
+		else if (ParseDuration(params[i], &milliseconds))
+		{
+			continue;
+		}
+
+		Log("Command usage: ");
+		Log("\t/trace [Duration, like 5s or 500ms] -file [Path]");
+		return;
+	}
+
+	if (m_tracing || !Tracer::Start())
+	{
+		Log("Error: Could not start tracing, a trace is already recording or tracing was compiled out.");
+		return;
+	}
+
+	m_tracing = true;
+	m_traceDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+	m_tracePath = path;
+	Log("Tracing for " + std::to_string(milliseconds) + "ms..");
+}
+
+void BCNetClient::UpdateTrace(bool finish)
+{
+	if (!m_tracing || (!finish && std::chrono::steady_clock::now() < m_traceDeadline))
+		return;
+
+	m_tracing = false;
+	if (Tracer::Stop(m_tracePath))
+		Log("Trace written to " + m_tracePath);
+	else
+		Log("Error: Could not write the trace to " + m_tracePath + ", or it was already stopped.");
 }
 
 void BCNetClient::DoConnectCommand(const std::string parameters) // /connect [IP] [Port], /join [IP] [Port]
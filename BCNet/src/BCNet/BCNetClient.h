@@ -4,17 +4,34 @@
 
 #include <BCNet/IBCNetClient.h>
 #include <BCNet/BCNetPacket.h>
+#include <BCNet/BCNetMessage.h>
+#include <BCNet/BCNetPacketPool.h>
+
+#include "Misc/NetworkScheduler.h"
+#include "Misc/MPSCQueue.h"
+#include "Misc/SnapshotHistory.h"
+#include "Misc/PacketCompressor.h"
+#include "Misc/MessageBatcher.h"
+#include "Misc/TransferManager.h"
+#include "Misc/StatsTable.h"
+#include "Misc/Tracer.h"
+#include "Misc/PacketMetrics.h"
 
 #include <string>
 #include <map>
 #include <queue>
+#include <vector>
 #include <thread>
 #include <mutex>
+#include <atomic>
 #include <functional>
 #include <utility>
+#include <chrono>
+#include <memory>
 
 // Forward Declare.
 struct SteamNetConnectionStatusChangedCallback_t;
+struct SteamNetworkingMessage_t;
 struct SteamNetworkingIPAddr;
 class ISteamNetworkingSockets;
 
@@ -33,15 +50,48 @@ namespace BCNet
 		virtual void Start() override;
 		virtual void Stop() override;
 
+		virtual void SetConsoleInput(bool enabled) override { m_consoleInput = enabled; }
+
 		virtual void ConnectToServer(const std::string &ipAddress, const int port = -1) override;
 		virtual void CloseConnection() override;
 
 		virtual bool IsRunning() override { return !m_shouldQuit; }
 		virtual bool IsConnected() override { return m_networking; }
 
+		virtual void SetNetworkSchedule(NetworkScheduleMode mode, unsigned int tickRate = 100, unsigned int spinMicroseconds = 0) override { m_scheduler.SetMode(mode, tickRate, spinMicroseconds); }
+
+		virtual void SetPacketEncoding(PacketEncoding encoding) override { m_preferredEncoding = encoding; }
+		virtual PacketEncoding GetPacketEncoding() override { return m_encoding.load(std::memory_order_relaxed); }
+
+		virtual void SetCompression(bool enabled, unsigned int threshold = 128) override { m_compressor.SetEnabled(enabled, threshold); }
+		virtual void SetCompressionDictionary(const Packet &dictionary) override { m_compressor.SetDictionary(dictionary); }
+		virtual CompressionStats GetCompressionStats() override { return m_compressor.GetTotalStats(); }
+		virtual CompressionStats GetCompressionStats(uint32 packetID) override { return m_compressor.GetStats(packetID); }
+
+		virtual void SetMessageBatching(bool enabled, unsigned int maxSize = 1200) override { m_batchSize = enabled ? maxSize : 0; }
+		virtual void FlushMessages() override;
+
 		virtual void SetConnectedCallback(const ClientConnectedCallback &callback) override;
 		virtual void SetDisconnectedCallback(const ClientDisconnectedCallback &callback) override;
 		virtual void SetPacketReceivedCallback(const ClientPacketReceivedCallback &callback) override;
+		virtual void SetMessageReceivedCallback(const ClientMessageReceivedCallback &callback) override;
+		virtual void SetPacketBatchReceivedCallback(const ClientPacketBatchReceivedCallback &callback) override;
+		virtual void SetPacketDispatcher(ClientPacketDispatcher *dispatcher) override;
+		virtual void SetSnapshotReceivedCallback(const ClientSnapshotReceivedCallback &callback) override;
+
+		virtual void SetSnapshotHistory(unsigned int count) override { m_snapshots.SetCapacity(count); }
+
+		virtual void SetTransferStartedCallback(const ClientTransferStartedCallback &callback) override;
+		virtual void SetTransferChunkCallback(const ClientTransferChunkCallback &callback) override;
+		virtual void SetTransferProgressCallback(const ClientTransferProgressCallback &callback) override;
+		virtual void SetTransferCompletedCallback(const ClientTransferCompletedCallback &callback) override;
+		virtual void SetTransferPacing(unsigned int chunkSize = 64 * 1024, unsigned int window = 256 * 1024) override;
+		virtual void SetMaxTransferSize(uint64_t maxSize = 64ull * 1024 * 1024, uint64_t maxIncoming = 256ull * 1024 * 1024) override;
+		virtual uint32 BeginTransfer(const Packet &data, uint32 tag = 0) override;
+		virtual uint32 BeginTransfer(const std::string &filePath, uint32 tag = 0) override;
+		virtual void CancelTransfer(uint32 transferID, bool incoming = false) override;
+
+		virtual void SetReceiveBatchSize(unsigned int size) override { m_receiveBatchSize = size > 0 ? size : 1; }
 		virtual void SetOutputLogCallback(const ClientOutputLogCallback &callback) override;
 
 		virtual std::string PrintCommandList() override;
@@ -49,9 +99,17 @@ namespace BCNet
 
 		virtual void PushInputAsCommand(std::string input) override;
 
-		virtual void SendPacketToServer(const Packet &packet, bool reliable = true) override;
+		virtual void SendPacketToServer(const Packet &packet, bool reliable = true, uint8_t sendFlags = SEND_FLAG_NONE) override;
 
 		virtual ConnectionStatus &GetConnectionStatus() override { return m_connectionStatus; }
+		virtual bool GetStats(ConnectionStats &stats) override;
+
+		virtual bool StartTrace() override { return Tracer::Start(); }
+		virtual bool StopTrace(const std::string &filePath) override { return Tracer::Stop(filePath); }
+
+		virtual void SetMetrics(bool enabled, const std::string &filePath = "", unsigned int intervalSeconds = 10) override;
+		virtual void SetMetricsPacketName(uint32 packetID, const std::string &name) override { m_metrics.SetPacketName(packetID, name); }
+		virtual std::string GetMetrics() override { return m_metrics.Export("client"); }
 
 		virtual void Log(std::string message) override;
 
@@ -59,13 +117,69 @@ namespace BCNet
 
 		virtual std::string GetLatestOutput() override;
 
+	private:
+		// A send from another thread, waiting for the network thread to carry it out.
+		struct OutboundRequest
+		{
+			enum class Type : unsigned char
+			{
+				SEND = 0,
+				TRANSFER, // Starts sending the transfers.
+				CANCEL_TRANSFER
+			};
+
+			Type type = Type::SEND;
+			bool reliable = true;
+			uint8_t sendFlags = SEND_FLAG_NONE;
+			bool incoming = false; // Which way the transfer being cancelled is going.
+			uint32 transferID = 0; // The transfer to cancel.
+			PooledPacket payload; // A copy of the packet.
+			std::unique_ptr<TransferManager> transfers; // Transfers being started.
+		};
+
+		// Runs the client's transfers through it's transfer callbacks.
+		class ServerTransfers : public TransferConnection
+		{
+		public:
+			ServerTransfers(BCNetClient &client) : m_client(client) {}
+
+			virtual void SendTransferPacket(const Packet &packet) override;
+			virtual bool OnTransferStarted(const TransferInfo &info, Packet &destination) override;
+			virtual void OnTransferChunk(const TransferInfo &info, const Packet &chunk) override;
+			virtual void OnTransferProgress(const TransferInfo &info) override;
+			virtual void OnTransferCompleted(const TransferInfo &info, TransferResult result, const Packet &data) override;
+			virtual uint64_t GetMaxTransferSize() override { return m_client.m_maxTransferSize; }
+			virtual uint64_t GetMaxIncomingSize() override { return m_client.m_maxIncomingTransfers; }
+
+		private:
+			BCNetClient &m_client;
+		};
+
 	private:
 		void DoNetworking(); // The main network thread function.
 
-		void PollNetworkMessages(); // Handles incoming messages/packets.
+		bool IsNetworkThread() const { return std::this_thread::get_id() == m_networkThreadID.load(std::memory_order_relaxed); }
+		void PushOutboundRequest(OutboundRequest &&request, bool wake); // Queues a send from another thread.
+		bool DrainOutboundRequests(); // Carries out queued sends, returns whether there were any.
+		void HandleOutboundRequest(OutboundRequest &request);
+
+		bool PollNetworkMessages(); // Handles incoming messages/packets, returns whether anything was received.
+		bool HandleHandshake(const Packet &packet); // Picks up the server's answer while negotiating, returns whether the packet was it.
+		void FinishConnecting(PacketEncoding encoding); // Settles on an encoding and lets the application know it's connected.
+		bool HandleSnapshot(const Packet &packet); // Rebuilds and acknowledges a snapshot, returns whether the packet was one.
+		bool HandleTransfer(const Packet &packet); // Hands a transfer packet to the transfers, returns whether the packet was one.
+		uint32 StartTransfer(OutgoingTransfer &&transfer); // Hands it to the network thread, returns it's ID.
+		bool PumpTransfers(); // Sends as many chunks as the connection has room for, returns whether any were sent.
+		void FailTransfers(); // The connection's closed, everything going either way fails.
+		void SampleStats(); // Takes a snapshot of the connection's stats, or clears it once there's no connection.
+		bool DispatchPacket(const Packet &packet); // Hands a packet to it's handler, returns whether there was one.
+		void HandleMessage(ReceivedMessage &message, bool batching); // Runs the callbacks for one message.
+		void SendBatch(bool reliable);
+		void FlushBatches(); // Sends everything batched this tick.
 		void PollConnectionStateChanges(); // Handles connection state.
 
 		void HandleUserCommands(); // Handles incoming commands.
+		void UpdateTrace(bool finish); // Writes out the trace /trace started once it's time is up, or straight away when finishing.
 		bool GetNextCommand(std::string &result);
 		// TODO: Should move into the utility header since it's the same in both the server and client classes.
 		void ParseCommand(const std::string &command, std::string *outCommand, std::string *outParams); // Utility.
@@ -73,6 +187,8 @@ namespace BCNet
 		// GameNetworkingSockets Callbacks.
 		void OnSteamNetConnectionStatusChanged(SteamNetConnectionStatusChangedCallback_t *pInfo); // Handles connection status.
 		static void SteamNetConnectionStatusChangedCallback(SteamNetConnectionStatusChangedCallback_t *pInfo);
+		void QueueStatusChange(const SteamNetConnectionStatusChangedCallback_t &change); // For the network thread, from whichever thread ran the callbacks.
+		void ConnectToLoopback(int port);
 
 		// Default command implementations.
 		void DoQuitCommand(const std::string parameters);
@@ -80,6 +196,8 @@ namespace BCNet
 		void DoDisconnectCommand(const std::string parameters);
 		void DoNickNameCommand(const std::string parameters);
 		void DoWhosOnlineCommand(const std::string parameters);
+		void DoStatsCommand(const std::string parameters);
+		void DoTraceCommand(const std::string parameters);
 
 	private:
 		std::map<std::string, ClientCommandCallback> m_commandCallbacks;
@@ -92,22 +210,76 @@ namespace BCNet
 		std::thread m_networkThread; // Does networking stuff.
 		std::thread m_commandThread; // Does command stuff.
 
+		NetworkScheduler m_scheduler; // Paces the network thread.
+		std::atomic<std::thread::id> m_networkThreadID;
+
+		MPSCQueue<OutboundRequest> m_outboundQueue; // Sends from other threads.
+
 		ISteamNetworkingSockets *m_interface; // GameNetworkingSockets
 		uint32 m_connection; // HSteamNetConnection
 
 		ConnectionStatus m_connectionStatus = ConnectionStatus::DISCONNECTED;
 
+		PacketEncoding m_preferredEncoding = PacketEncoding::STANDARD; // What to ask the server for.
+		std::atomic<PacketEncoding> m_encoding{ PacketEncoding::STANDARD }; // What was agreed on.
+		bool m_negotiating = false; // Whether the handshake is waiting on the server.
+		std::chrono::steady_clock::time_point m_negotiationDeadline; // When to give up on the server answering.
+
+		PacketCompressor m_compressor;
+		bool m_compressing = false; // Whether the server agreed to compression, only touched by the network thread.
+
+		MessageBatcher m_batcher; // Only touched by the network thread.
+		unsigned int m_batchSize = 0; // The most bytes a batch can take, 0 when batching is off.
+		bool m_serverBatching = false; // Whether the server can unpack batched packets, only touched by the network thread.
+		std::vector<ReceivedMessage> m_unbatchedMessages; // Reused when unpacking batches.
+
+		TransferManager m_transfers; // Only touched by the network thread.
+		unsigned int m_transferChunkSize = TRANSFER_DEFAULT_CHUNK_SIZE;
+		unsigned int m_transferWindow = TRANSFER_DEFAULT_WINDOW; // The most bytes transfers let wait in the connection's send buffer.
+		uint64_t m_maxTransferSize = TRANSFER_DEFAULT_MAX_SIZE; // Incoming transfers bigger than this are refused.
+		uint64_t m_maxIncomingTransfers = TRANSFER_DEFAULT_MAX_INCOMING; // The most the transfers coming from the server can add up to.
+		std::atomic<uint32> m_nextTransferID{ 1 };
+
 		ClientConnectedCallback m_connectedCallback;
 		ClientDisconnectedCallback m_disconnectedCallback;
 		ClientPacketReceivedCallback m_packetReceivedCallback;
+		ClientMessageReceivedCallback m_messageReceivedCallback;
+		ClientPacketBatchReceivedCallback m_packetBatchReceivedCallback;
+		ClientSnapshotReceivedCallback m_snapshotReceivedCallback;
+		ClientPacketDispatcher *m_packetDispatcher = nullptr;
+		ClientTransferStartedCallback m_transferStartedCallback;
+		ClientTransferChunkCallback m_transferChunkCallback;
+		ClientTransferProgressCallback m_transferProgressCallback;
+		ClientTransferCompletedCallback m_transferCompletedCallback;
 		ClientOutputLogCallback m_outputLogCallback;
 
 		unsigned int m_maxOutputLog = 12;
 
+		unsigned int m_receiveBatchSize = 256;
+		std::vector<SteamNetworkingMessage_t *> m_receiveMessages; // Reused between polls.
+		std::vector<ReceivedMessage> m_receiveBatch; // Messages waiting for the batch callback.
+
+		SnapshotHistory m_snapshots; // Snapshots the server may encode the next ones against.
+
+		SeqLock<ConnectionStatsEntry> m_stats; // Written by the network thread at the end of every tick, read from any thread.
+
+		bool m_tracing = false; // Whether /trace is recording, only touched by the network thread.
+		std::chrono::steady_clock::time_point m_traceDeadline;
+		std::string m_tracePath;
+
+		PacketMetrics m_metrics;
+
+		bool m_consoleInput = true; // Whether commands are read from the standard input.
+
+		// Every client and server in the process shares GameNetworkingSockets' callbacks, so they can run on any of their threads.
+		std::mutex m_mutexStatusChanges;
+		std::vector<SteamNetConnectionStatusChangedCallback_t> m_statusChanges;
+		std::vector<SteamNetConnectionStatusChangedCallback_t> m_handledStatusChanges; // Swapped with the queue, only touched by the network thread.
+
 		bool m_shouldQuit = false; // Whether the network thread is running.
 		bool m_networking = false; // Whether the client is connected.
 
-		static BCNetClient *s_callbackInstance;
+		static BCNetClient *s_callbackInstance; // The last one started, for connections without one in their user data.
 
 	};
 
@@ -0,0 +1,421 @@
+#include <BCNet/BCNetCompression.h>
+
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+
+#include <string.h>
+
+using namespace BCNet;
+
+namespace
+{
+	// Every sequence is a token byte, the literal length in the high 4 bits and the match length (less MIN_MATCH) in the low 4,
+	// then the rest of the literal length if it didn't fit, the literals, a 2 byte offset and the rest of the match length.
+	// Lengths that don't fit in their 4 bits carry on in bytes of 255 until a smaller one.
+	// The last sequence is only literals, it ends once the output is the expected size.
+	constexpr size_t MIN_MATCH = 4;
+	constexpr size_t MAX_OFFSET = COMPRESSION_MAX_DICTIONARY_SIZE;
+	constexpr size_t LENGTH_NIBBLE = 15;
+
+	constexpr unsigned int HASH_BITS = 12;
+	constexpr size_t HASH_SIZE = 1 << HASH_BITS;
+	constexpr uint32_t EMPTY_SLOT = 0xFFFFFFFF;
+	constexpr unsigned int SKIP_SHIFT = 5; // Starts skipping ahead after 32 misses in a row, incompressible data goes by quicker.
+
+	// Dictionary training.
+	constexpr size_t KMER_SIZE = 6; // The byte sequences counted across the samples.
+	constexpr size_t SEGMENT_SIZE = 48; // The dictionary is built out of segments this long.
+
+	inline uint32_t Read32(const uint8_t *data)
+	{
+		uint32_t value;
+		memcpy(&value, data, sizeof(value));
+		return value;
+	}
+
+	inline uint32_t Hash(uint32_t sequence)
+	{
+		return (sequence * 2654435761u) >> (32 - HASH_BITS); // Knuth's multiplicative hash, the top bits mix the most.
+	}
+
+	// A hash table primed with a dictionary, kept per thread so the dictionary is only hashed again when it changes.
+	// Every candidate is checked against the actual bytes, so a stale table only costs matches, never correctness.
+	struct PrimedTable
+	{
+		const void *dictionary = nullptr;
+		size_t size = 0;
+		uint32_t table[HASH_SIZE];
+	};
+
+	thread_local PrimedTable s_primed;
+	thread_local uint32_t s_table[HASH_SIZE];
+
+	// Writes the compressed output, stops writing once it's full.
+	struct Output
+	{
+		uint8_t *position;
+		uint8_t *end;
+		bool failed = false;
+
+		void Put(uint8_t byte)
+		{
+			if (position < end)
+				*position++ = byte;
+			else
+				failed = true;
+		}
+
+		void PutLength(size_t length) // What's left of a length after it's nibble.
+		{
+			while (length >= 255)
+			{
+				Put(255);
+				length -= 255;
+			}
+			Put((uint8_t)length);
+		}
+
+		void PutBytes(const uint8_t *bytes, size_t count)
+		{
+			if ((size_t)(end - position) < count)
+			{
+				failed = true;
+				return;
+			}
+
+			memcpy(position, bytes, count);
+			position += count;
+		}
+	};
+
+	void WriteSequence(Output &output, const uint8_t *literals, size_t literalLength, size_t offset, size_t matchLength)
+	{
+		const size_t match = matchLength - MIN_MATCH;
+		output.Put((uint8_t)((std::min(literalLength, LENGTH_NIBBLE) << 4) | std::min(match, LENGTH_NIBBLE)));
+		if (literalLength >= LENGTH_NIBBLE)
+			output.PutLength(literalLength - LENGTH_NIBBLE);
+		output.PutBytes(literals, literalLength);
+
+		output.Put((uint8_t)offset);
+		output.Put((uint8_t)(offset >> 8));
+		if (match >= LENGTH_NIBBLE)
+			output.PutLength(match - LENGTH_NIBBLE);
+	}
+
+	bool ReadLength(const uint8_t *&input, const uint8_t *end, size_t &length)
+	{
+		uint8_t byte;
+		do
+		{
+			if (input >= end || length > ((size_t)-1 >> 1)) // Ran out, or a length nothing could hold.
+				return false;
+
+			byte = *input++;
+			length += byte;
+		} while (byte == 255);
+
+		return true;
+	}
+
+	const uint32_t *GetPrimedTable(const uint8_t *dictionary, size_t size)
+	{
+		if (s_primed.dictionary != dictionary || s_primed.size != size)
+		{
+			std::fill(s_primed.table, s_primed.table + HASH_SIZE, EMPTY_SLOT);
+			for (size_t i = 0; i + MIN_MATCH <= size; i++)
+				s_primed.table[Hash(Read32(dictionary + i))] = (uint32_t)i;
+
+			s_primed.dictionary = dictionary;
+			s_primed.size = size;
+		}
+		return s_primed.table;
+	}
+
+	uint64_t ReadKmer(const uint8_t *data)
+	{
+		uint64_t kmer = 0;
+		memcpy(&kmer, data, KMER_SIZE);
+		return kmer;
+	}
+
+	struct Segment
+	{
+		const uint8_t *data;
+		size_t size;
+		uint64_t score;
+	};
+}
+
+size_t BCNet::GetCompressBound(size_t size)
+{
+	return size + size / 255 + 16;
+}
+
+size_t BCNet::Compress(const void *source, size_t size, void *destination, size_t capacity, const Packet &dictionary)
+{
+	const uint8_t *input = (const uint8_t*)source;
+	Output output = { (uint8_t*)destination, (uint8_t*)destination + capacity };
+
+	// Positions count from the start of the dictionary, the input carries on right after it.
+	const uint8_t *dictionaryData = dictionary.As<const uint8_t>();
+	size_t dictionarySize = dictionary.size;
+	if (dictionarySize > MAX_OFFSET) // Only the end can be reached.
+	{
+		dictionaryData += dictionarySize - MAX_OFFSET;
+		dictionarySize = MAX_OFFSET;
+	}
+
+	uint32_t *table = s_table;
+	if (dictionarySize >= MIN_MATCH)
+		memcpy(table, GetPrimedTable(dictionaryData, dictionarySize), sizeof(s_table));
+	else
+		std::fill(table, table + HASH_SIZE, EMPTY_SLOT);
+
+	size_t position = 0;
+	size_t anchor = 0; // Where the literals waiting to be written start.
+	unsigned int misses = 0;
+	while (position + MIN_MATCH <= size)
+	{
+		const uint32_t sequence = Read32(input + position);
+		const uint32_t hash = Hash(sequence);
+		const uint32_t candidate = table[hash];
+		const uint32_t current = (uint32_t)(dictionarySize + position);
+		table[hash] = current;
+
+		if (candidate != EMPTY_SLOT && current - candidate <= MAX_OFFSET)
+		{
+			const uint8_t *reference;
+			size_t limit = size - position;
+			if (candidate < dictionarySize) // Matches in the dictionary stop at it's end.
+			{
+				reference = dictionaryData + candidate;
+				limit = std::min(limit, dictionarySize - candidate);
+			}
+			else
+			{
+				reference = input + (candidate - dictionarySize);
+			}
+
+			if (limit >= MIN_MATCH && Read32(reference) == sequence)
+			{
+				size_t length = MIN_MATCH;
+				while (length < limit && reference[length] == input[position + length])
+					length++;
+
+				WriteSequence(output, input + anchor, position - anchor, current - candidate, length);
+				if (output.failed)
+					return 0;
+
+				position += length;
+				anchor = position;
+				misses = 0;
+				continue;
+			}
+		}
+
+		position += 1 + (misses++ >> SKIP_SHIFT);
+	}
+
+	// The rest goes out as literals.
+	const size_t literalLength = size - anchor;
+	output.Put((uint8_t)(std::min(literalLength, LENGTH_NIBBLE) << 4));
+	if (literalLength >= LENGTH_NIBBLE)
+		output.PutLength(literalLength - LENGTH_NIBBLE);
+	output.PutBytes(input + anchor, literalLength);
+
+	return output.failed ? 0 : (size_t)(output.position - (uint8_t*)destination);
+}
+
+bool BCNet::Decompress(const void *source, size_t size, void *destination, size_t decompressedSize, const Packet &dictionary)
+{
+	const uint8_t *input = (const uint8_t*)source;
+	const uint8_t *inputEnd = input + size;
+	uint8_t *start = (uint8_t*)destination;
+	uint8_t *output = start;
+	uint8_t *outputEnd = start + decompressedSize;
+
+	const uint8_t *dictionaryData = dictionary.As<const uint8_t>();
+	const size_t dictionarySize = dictionary.size;
+
+	while (true)
+	{
+		if (input >= inputEnd)
+			return false;
+
+		const uint8_t token = *input++;
+
+		size_t literalLength = token >> 4;
+		if (literalLength == LENGTH_NIBBLE && !ReadLength(input, inputEnd, literalLength))
+			return false;
+		if (literalLength > (size_t)(inputEnd - input) || literalLength > (size_t)(outputEnd - output))
+			return false;
+
+		memcpy(output, input, literalLength);
+		output += literalLength;
+		input += literalLength;
+
+		if (output == outputEnd) // Only the last sequence ends the output.
+			return input == inputEnd;
+
+		if (inputEnd - input < 2)
+			return false;
+		const size_t offset = (size_t)input[0] | ((size_t)input[1] << 8);
+		input += 2;
+
+		size_t matchLength = token & LENGTH_NIBBLE;
+		if (matchLength == LENGTH_NIBBLE && !ReadLength(input, inputEnd, matchLength))
+			return false;
+		matchLength += MIN_MATCH;
+
+		const size_t written = (size_t)(output - start);
+		if (offset == 0 || matchLength > (size_t)(outputEnd - output) || offset > written + dictionarySize)
+			return false;
+
+		const uint8_t *reference;
+		if (offset > written) // Starts in the dictionary.
+		{
+			const size_t back = offset - written;
+			const size_t fromDictionary = std::min(back, matchLength);
+			memcpy(output, dictionaryData + dictionarySize - back, fromDictionary);
+			output += fromDictionary;
+			matchLength -= fromDictionary;
+			reference = start;
+		}
+		else
+		{
+			reference = output - offset;
+		}
+
+		// An overlapping match repeats the bytes between the reference and the output, so it's copied in chunks
+		// that double each time instead of a byte at a time.
+		while (matchLength > 0)
+		{
+			const size_t chunk = std::min((size_t)(output - reference), matchLength);
+			memcpy(output, reference, chunk);
+			output += chunk;
+			matchLength -= chunk;
+		}
+	}
+}
+
+size_t BCNet::TrainCompressionDictionary(const Packet *samples, size_t count, void *dictionary, size_t capacity)
+{
+	capacity = std::min(capacity, (size_t)COMPRESSION_MAX_DICTIONARY_SIZE);
+	uint8_t *output = (uint8_t*)dictionary;
+
+	size_t total = 0;
+	for (size_t i = 0; i < count; i++)
+		total += samples[i].size;
+
+	if (total <= capacity) // Everything fits, no need to choose.
+	{
+		size_t written = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			if (samples[i].size > 0)
+				memcpy(output + written, samples[i].data, samples[i].size);
+			written += samples[i].size;
+		}
+		return written;
+	}
+
+	// Count how many samples each sequence shows up in, sequences that are only common within one sample don't help the rest.
+	std::unordered_map<uint64_t, uint32_t> frequencies;
+	{
+		std::unordered_set<uint64_t> seen;
+		for (size_t i = 0; i < count; i++)
+		{
+			const uint8_t *data = samples[i].As<const uint8_t>();
+			seen.clear();
+			for (size_t position = 0; position + KMER_SIZE <= samples[i].size; position++)
+			{
+				const uint64_t kmer = ReadKmer(data + position);
+				if (seen.insert(kmer).second)
+					frequencies[kmer]++;
+			}
+		}
+	}
+
+	auto GetScore = [&](const uint8_t *data) -> uint64_t
+	{
+		auto it = frequencies.find(ReadKmer(data));
+		return it != frequencies.end() && it->second > 1 ? it->second : 0; // Only in one sample, not worth a spot.
+	};
+
+	// Split the samples into one stretch per segment and take the best scoring segment out of each.
+	const size_t segmentCount = (capacity + SEGMENT_SIZE - 1) / SEGMENT_SIZE;
+	const size_t stretch = (total + segmentCount - 1) / segmentCount;
+
+	std::vector<Segment> segments;
+	segments.reserve(segmentCount);
+
+	size_t sample = 0, sampleOffset = 0;
+	for (size_t s = 0; s < segmentCount && sample < count; s++)
+	{
+		Segment best = { nullptr, 0, 0 };
+		for (size_t remaining = stretch; remaining > 0 && sample < count; )
+		{
+			const uint8_t *data = samples[sample].As<const uint8_t>();
+			const size_t sampleSize = samples[sample].size;
+			const size_t end = std::min(sampleSize, sampleOffset + remaining);
+
+			// Slide a window the size of a segment over this part of the sample, scoring the sequences in it.
+			const size_t window = std::min(SEGMENT_SIZE, sampleSize);
+			const size_t lastStart = sampleSize - window; // The last spot a whole window fits.
+			if (window >= KMER_SIZE && sampleOffset <= lastStart)
+			{
+				const size_t kmers = window - KMER_SIZE + 1;
+				const size_t stop = std::min(end - 1, lastStart);
+
+				size_t first = sampleOffset;
+				uint64_t score = 0;
+				for (size_t k = 0; k < kmers; k++)
+					score += GetScore(data + first + k);
+
+				while (true)
+				{
+					if (score > best.score)
+						best = { data + first, window, score };
+
+					if (first >= stop)
+						break;
+
+					score -= GetScore(data + first);
+					score += GetScore(data + first + kmers);
+					first++;
+				}
+			}
+
+			remaining -= end - sampleOffset;
+			sampleOffset = end;
+			if (sampleOffset >= sampleSize)
+			{
+				sample++;
+				sampleOffset = 0;
+			}
+		}
+
+		if (best.score == 0)
+			continue;
+
+		for (size_t k = 0; k + KMER_SIZE <= best.size; k++) // Already in the dictionary, the other segments shouldn't repeat them.
+			frequencies.erase(ReadKmer(best.data + k));
+		segments.push_back(best);
+	}
+
+	// The best segments go last, they'll be the closest to what's being compressed.
+	std::stable_sort(segments.begin(), segments.end(), [](const Segment &a, const Segment &b) { return a.score < b.score; });
+
+	size_t written = 0;
+	for (const Segment &segment : segments)
+	{
+		const size_t size = std::min(segment.size, capacity - written);
+		memcpy(output + written, segment.data, size);
+		written += size;
+		if (written == capacity)
+			break;
+	}
+	return written;
+}
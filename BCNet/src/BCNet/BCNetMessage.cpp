@@ -0,0 +1,119 @@
+#include <BCNet/BCNetMessage.h>
+#include <BCNet/BCNetPacketPool.h>
+
+#include <atomic>
+#include <new>
+
+#include <steam/steamnetworkingsockets.h>
+
+using namespace BCNet;
+
+struct ReceivedMessage::Control
+{
+	std::atomic<int> references;
+	SteamNetworkingMessage_t *message;
+};
+
+ReceivedMessage::ReceivedMessage(SteamNetworkingMessage_t *message)
+{
+	if (message == nullptr)
+		return;
+
+	m_control = new (PacketPool::Allocate(sizeof(Control))) Control(); // Control blocks come from the pool too.
+	m_control->references.store(1, std::memory_order_relaxed);
+	m_control->message = message;
+
+	m_packet = Packet(message->m_pData, (size_t)message->m_cbSize);
+}
+
+ReceivedMessage::ReceivedMessage(const ReceivedMessage &other)
+	: m_control(other.m_control)
+	, m_packet(other.m_packet)
+{
+	if (m_control)
+		m_control->references.fetch_add(1, std::memory_order_relaxed);
+}
+
+ReceivedMessage::ReceivedMessage(ReceivedMessage &&other) noexcept
+	: m_control(other.m_control)
+	, m_packet(other.m_packet)
+{
+	other.m_control = nullptr;
+	other.m_packet = Packet();
+}
+
+ReceivedMessage::~ReceivedMessage()
+{
+	Reset();
+}
+
+ReceivedMessage &ReceivedMessage::operator=(const ReceivedMessage &other)
+{
+	if (m_control != other.m_control)
+	{
+		if (other.m_control)
+			other.m_control->references.fetch_add(1, std::memory_order_relaxed);
+
+		Reset();
+		m_control = other.m_control;
+	}
+	m_packet = other.m_packet;
+	return *this;
+}
+
+ReceivedMessage &ReceivedMessage::operator=(ReceivedMessage &&other) noexcept
+{
+	if (this != &other)
+	{
+		Reset();
+		m_control = other.m_control;
+		m_packet = other.m_packet;
+
+		other.m_control = nullptr;
+		other.m_packet = Packet();
+	}
+	return *this;
+}
+
+void ReceivedMessage::Reset()
+{
+	if (m_control && m_control->references.fetch_sub(1, std::memory_order_acq_rel) == 1) // Last reference, give the message back.
+	{
+		m_control->message->Release();
+		m_control->~Control();
+		PacketPool::Free(m_control);
+	}
+
+	m_control = nullptr;
+	m_packet = Packet();
+}
+
+ReceivedMessage ReceivedMessage::Slice(size_t offset, size_t size) const
+{
+	if (offset > m_packet.size || size > m_packet.size - offset)
+		return ReceivedMessage();
+
+	ReceivedMessage slice(*this);
+	slice.m_packet = Packet(m_packet.As<uint8_t>() + offset, size);
+	return slice;
+}
+
+uint32 ReceivedMessage::GetConnection() const
+{
+	return m_control ? m_control->message->m_conn : k_HSteamNetConnection_Invalid;
+}
+
+int64_t ReceivedMessage::GetMessageNumber() const
+{
+	return m_control ? m_control->message->m_nMessageNumber : 0;
+}
+
+int64_t ReceivedMessage::GetTimeReceived() const
+{
+	return m_control ? m_control->message->m_usecTimeReceived : 0;
+}
+
+int64_t ReceivedMessage::GetConnectionUserData() const
+{
+	return m_control ? m_control->message->m_nConnUserData : -1;
+}
@@ -1,17 +1,75 @@
 #include <BCNet/BCNetPacket.h>
+#include <BCNet/BCNetPacketPool.h>
+
+#include "Misc/ByteSwap.h"
+
+#include <string.h>
+#include <stdint.h>
 
 using namespace BCNet;
 
+namespace
+{
+	// Whether arrays in the byte order have to be swapped on this host.
+	bool NeedsByteSwap(ByteOrder byteOrder)
+	{
+		if (byteOrder == ByteOrder::NATIVE)
+			return false;
+		return (byteOrder == ByteOrder::LITTLE) != IsLittleEndianHost();
+	}
+
+	// Whether there are size bytes left to read, written so neither a bad size nor a position past the end can wrap around.
+	bool HasRemaining(size_t position, size_t size, size_t packetSize)
+	{
+		return position <= packetSize && size <= packetSize - position;
+	}
+}
+
+// ------------ PACKET
+void Packet::Allocate(const size_t size)
+{
+	PacketPool::Free(data);
+	data = nullptr;
+	this->size = 0;
+
+	if (size <= 0)
+		return;
+
+	data = PacketPool::Allocate(size);
+	this->size = size;
+}
+
+void Packet::Release()
+{
+	PacketPool::Free(data);
+	data = nullptr;
+	size = 0;
+}
+
 // ------------ PACKETSTREAMWRITER
-PacketStreamWriter::PacketStreamWriter(Packet packet, size_t position)
+PacketStreamWriter::PacketStreamWriter(PacketEncoding encoding)
+	: m_packet(m_inlineBuffer, PACKET_STREAM_INLINE_CAPACITY)
+	, m_position(0)
+	, m_encoding(encoding)
+	, m_growing(true)
+{ }
+
+PacketStreamWriter::PacketStreamWriter(Packet packet, size_t position, PacketEncoding encoding)
 	: m_packet(packet)
 	, m_position(position)
+	, m_encoding(encoding)
 { }
 
+PacketStreamWriter::~PacketStreamWriter()
+{
+	if (m_growing && m_packet.data != m_inlineBuffer) // Hand grown storage back to the pool.
+		PacketPool::Free(m_packet.data);
+}
+
 bool PacketStreamWriter::WriteData(const char *data, size_t size)
 {
 	bool valid = m_position + size <= m_packet.size; // Is it outside the range?
-	if (!valid)
+	if (!valid && !Grow(m_position + size))
 		return false;
 
 	memcpy(m_packet.As<uint8_t>() + m_position, data, size); // Write into position.
@@ -20,24 +78,124 @@ bool PacketStreamWriter::WriteData(const char *data, size_t size)
 	return true;
 }
 
+void PacketStreamWriter::Reserve(size_t capacity)
+{
+	if (capacity > m_packet.size)
+		Grow(capacity);
+}
+
+void PacketStreamWriter::Reset()
+{
+	m_position = 0;
+	m_failed = false;
+}
+
+bool PacketStreamWriter::Grow(size_t required)
+{
+	if (!m_growing) // Can't grow a packet the application provided.
+	{
+		m_failed = true;
+		return false;
+	}
+
+	size_t capacity = m_packet.size * 2; // Grow geometrically so big packets only reallocate a few times.
+	if (capacity < required)
+		capacity = required;
+	if (capacity < m_position) // Reserving less than the position.
+		capacity = m_position;
+
+	void *data = PacketPool::Allocate(capacity);
+	const size_t written = m_position < m_packet.size ? m_position : m_packet.size; // The position can be set past the end, there's nothing there to copy.
+	memcpy(data, m_packet.data, written);
+	memset((uint8_t*)data + written, 0, m_position - written); // Skipped over, so nothing old leaks into the packet.
+
+	if (m_packet.data != m_inlineBuffer)
+		PacketPool::Free(m_packet.data);
+
+	m_packet.data = data;
+	m_packet.size = PacketPool::GetCapacity(data); // Use the whole block.
+
+	return true;
+}
+
+bool PacketStreamWriter::WriteHeader(uint32_t packetID, uint8_t flags)
+{
+	if (m_encoding == PacketEncoding::STANDARD)
+		return WriteRaw<int>((int)packetID);
+
+	return WriteRaw<uint8_t>(flags) && WriteVarUInt(packetID);
+}
+
+bool PacketStreamWriter::WriteVarUInt(uint64_t value)
+{
+	uint8_t bytes[10]; // Enough for any 64 bit value.
+	size_t count = 0;
+	while (value >= 0x80) // Low 7 bits first, the top bit says more bytes follow.
+	{
+		bytes[count++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	bytes[count++] = (uint8_t)value;
+
+	return WriteData((char*)bytes, count); // One write instead of one a byte.
+}
+
+bool PacketStreamWriter::WriteVarInt(int64_t value)
+{
+	return WriteVarUInt(((uint64_t)value << 1) ^ (uint64_t)(value >> 63)); // Zigzag, 0, -1, 1, -2... become 0, 1, 2, 3...
+}
+
+bool PacketStreamWriter::WriteSize(size_t size)
+{
+	if (m_encoding == PacketEncoding::STANDARD)
+		return WriteData((char*)&size, sizeof(size_t));
+	return WriteVarUInt(size);
+}
+
 void PacketStreamWriter::WritePacket(Packet packet, bool writeSize)
 {
 	if (writeSize)
-		WriteData((char*)&packet.size, sizeof(size_t));
+		WriteSize(packet.size);
 	WriteData((char*)packet.data, packet.size);
 }
 
 void PacketStreamWriter::WriteZero(size_t size)
 {
-	char zero = 0;
-	for (size_t i = 0; i < size; i++) // Write a bunch of zeroes.
-		WriteData(&zero, 1);
+	bool valid = m_position + size <= m_packet.size; // Is it outside the range?
+	if (!valid && !Grow(m_position + size))
+		return;
+
+	memset(m_packet.As<uint8_t>() + m_position, 0, size); // Write a bunch of zeroes.
+	m_position += size;
+}
+
+bool PacketStreamWriter::WriteArrayData(const void *data, size_t elementSize, size_t count)
+{
+	if (elementSize > 0 && count > SIZE_MAX / elementSize) // Would overflow.
+	{
+		m_failed = true;
+		return false;
+	}
+
+	const size_t size = elementSize * count;
+	if (size == 0)
+		return true;
+	if (!NeedsByteSwap(m_byteOrder) || elementSize == 1) // Bytes are already in the right order.
+		return WriteData((const char*)data, size);
+
+	bool valid = m_position + size <= m_packet.size; // Is it outside the range?
+	if (!valid && !Grow(m_position + size))
+		return false;
+
+	SwapBytes(m_packet.As<uint8_t>() + m_position, data, elementSize, count); // Swap while copying into position.
+	m_position += size;
+
+	return true;
 }
 
 void PacketStreamWriter::WriteString(const std::string &string)
 {
-	size_t size = string.size();
-	WriteData((char*)&size, sizeof(size_t));
+	WriteSize(string.size());
 	WriteData((char*)string.data(), sizeof(char) * string.size());
 }
 
@@ -54,14 +212,15 @@ PacketStreamWriter &BCNet::operator<<(PacketStreamWriter &writer, const std::str
 }
 
 // ------------ PACKETSTREAMREADER
-PacketStreamReader::PacketStreamReader(Packet packet, size_t position)
+PacketStreamReader::PacketStreamReader(Packet packet, size_t position, PacketEncoding encoding)
 	: m_packet(packet)
 	, m_position(position)
+	, m_encoding(encoding)
 { }
 
 bool PacketStreamReader::ReadData(char *dest, size_t size)
 {
-	bool valid = m_position + size <= m_packet.size; // Is it outside the range?
+	bool valid = HasRemaining(m_position, size, m_packet.size); // Is it outside the range?
 	if (!valid)
 		return false;
 
@@ -71,34 +230,160 @@ bool PacketStreamReader::ReadData(char *dest, size_t size)
 	return true;
 }
 
+bool PacketStreamReader::ReadArrayData(void *data, size_t elementSize, size_t count)
+{
+	if (elementSize > 0 && count > SIZE_MAX / elementSize) // Would overflow.
+		return false;
+
+	const size_t size = elementSize * count;
+	if (size == 0)
+		return true;
+	if (!NeedsByteSwap(m_byteOrder) || elementSize == 1) // Bytes are already in the right order.
+		return ReadData((char*)data, size);
+
+	bool valid = HasRemaining(m_position, size, m_packet.size); // Is it outside the range?
+	if (!valid)
+		return false;
+
+	SwapBytes(data, m_packet.As<uint8_t>() + m_position, elementSize, count); // Swap while copying into destination.
+	m_position += size;
+
+	return true;
+}
+
+bool PacketStreamReader::ReadHeader(uint32_t &packetID, uint8_t &flags)
+{
+	if (m_encoding == PacketEncoding::STANDARD)
+	{
+		int id;
+		if (!ReadRaw<int>(id))
+			return false;
+
+		packetID = (uint32_t)id;
+		flags = PACKET_FLAG_NONE;
+		return true;
+	}
+
+	uint64_t id;
+	if (!ReadRaw<uint8_t>(flags) || !ReadVarUInt(id) || id > 0xFFFFFFFF)
+		return false;
+
+	packetID = (uint32_t)id;
+	return true;
+}
+
+bool PacketStreamReader::ReadHeader(uint32_t &packetID)
+{
+	uint8_t flags;
+	return ReadHeader(packetID, flags);
+}
+
+bool PacketStreamReader::ReadVarUInt(uint64_t &value)
+{
+	const uint8_t *data = m_packet.As<const uint8_t>();
+
+	uint64_t result = 0;
+	for (int shift = 0, i = 0; i < 10; shift += 7, i++)
+	{
+		if (m_position >= m_packet.size) // Ran out of packet half way through.
+			return false;
+
+		const uint8_t byte = data[m_position++];
+		result |= (uint64_t)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+		{
+			value = result;
+			return true;
+		}
+	}
+
+	return false; // Too long to be a 64 bit value.
+}
+
+bool PacketStreamReader::ReadVarInt(int64_t &value)
+{
+	uint64_t zigzag;
+	if (!ReadVarUInt(zigzag))
+		return false;
+
+	value = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+	return true;
+}
+
+bool PacketStreamReader::ReadSize(size_t &size)
+{
+	if (m_encoding == PacketEncoding::STANDARD)
+		return ReadData((char*)&size, sizeof(size_t));
+
+	uint64_t value;
+	if (!ReadVarUInt(value) || value > (uint64_t)SIZE_MAX)
+		return false;
+
+	size = (size_t)value;
+	return true;
+}
+
 bool PacketStreamReader::ReadPacket(Packet &packet, size_t size)
 {
-	packet.size = size;
 	if (size <= 0) // Get packet size if it has been written.
 	{
-		if (!ReadData((char*)&packet.size, sizeof(size_t)))
+		if (!ReadSize(size))
 		{
 			return false;
 		}
 	}
 
-	packet.Allocate(packet.size);
-	return ReadData((char*)packet.data, packet.size);
+	if (!HasRemaining(m_position, size, m_packet.size)) // Don't trust a size bigger than what's left.
+		return false;
+
+	packet.Allocate(size);
+	return ReadData((char*)packet.data, size);
 }
 
 bool PacketStreamReader::ReadString(std::string &string)
 {
 	size_t size;
-	if (!ReadData((char*)&size, sizeof(size_t))) // Get string size if it has been written.
+	if (!ReadSize(size)) // Get string size if it has been written.
+		return false;
+
+	if (!HasRemaining(m_position, size, m_packet.size)) // Don't trust a size bigger than what's left.
 		return false;
 
 	string.resize(size);
 	return ReadData((char*)string.data(), sizeof(char) * size);
 }
 
+bool PacketStreamReader::ReadView(Packet &view, size_t size)
+{
+	if (size <= 0) // Get packet size if it has been written.
+	{
+		if (!ReadSize(size))
+			return false;
+	}
+
+	bool valid = HasRemaining(m_position, size, m_packet.size); // Is it outside the range?
+	if (!valid)
+		return false;
+
+	view = Packet(m_packet.As<uint8_t>() + m_position, size); // Point into the packet instead of copying.
+	m_position += size;
+
+	return true;
+}
+
+bool PacketStreamReader::ReadStringView(std::string_view &string)
+{
+	Packet view;
+	if (!ReadView(view, 0))
+		return false;
+
+	string = std::string_view(view.As<const char>(), view.size);
+	return true;
+}
+
 bool BCNet::PacketStreamReader::Ignore(size_t size)
 {
-	bool valid = m_position + size <= m_packet.size; // Is it outside the range?
+	bool valid = HasRemaining(m_position, size, m_packet.size); // Is it outside the range?
 	if (!valid)
 		return false;
 
@@ -0,0 +1,287 @@
+#include <BCNet/BCNetPacketPool.h>
+
+#include <atomic>
+#include <mutex>
+#include <new>
+
+#include <assert.h>
+
+using namespace BCNet;
+
+namespace
+{
+	// Sits right in front of every block handed out by the pool.
+	struct BlockHeader
+	{
+		union
+		{
+			BlockHeader *next; // Free list link, only used while the block is free.
+			size_t size; // The size of an oversized block.
+		};
+		uint32_t sizeClass; // Which size class the block belongs to.
+		uint32_t magic; // Used to catch blocks that weren't allocated by the pool.
+	};
+	static_assert(sizeof(BlockHeader) == 16, "BlockHeader must keep blocks 16 byte aligned.");
+
+	constexpr uint32_t OVERSIZED_CLASS = 0xFFFFFFFF;
+	constexpr uint32_t BLOCK_MAGIC = 0xBC4E7B10;
+	constexpr size_t THREAD_CACHE_SIZE = 32; // Blocks each thread keeps per size class.
+
+	struct ClassCounters
+	{
+		std::atomic<uint64_t> hits{ 0 };
+		std::atomic<uint64_t> misses{ 0 };
+		std::atomic<uint64_t> releases{ 0 };
+		std::atomic<uint64_t> freed{ 0 };
+	};
+
+	struct SharedFreeList
+	{
+		std::mutex mutex;
+		BlockHeader *head = nullptr;
+		size_t count = 0;
+	};
+
+	struct PoolState
+	{
+		SharedFreeList freeLists[PACKET_POOL_CLASS_COUNT];
+		ClassCounters counters[PACKET_POOL_CLASS_COUNT];
+		std::atomic<uint64_t> oversized{ 0 };
+		std::atomic<size_t> maxFreeBlocks{ 1024 };
+	};
+
+	PoolState &GetState()
+	{
+		// Intentionally never destroyed, thread caches flush back into it when their threads exit.
+		static PoolState *s_state = new PoolState();
+		return *s_state;
+	}
+
+	inline size_t GetClassBlockSize(uint32_t sizeClass)
+	{
+		return (size_t)PACKET_POOL_MIN_BLOCK_SIZE << sizeClass;
+	}
+
+	inline uint32_t GetSizeClass(size_t size)
+	{
+		uint32_t sizeClass = 0;
+		size_t blockSize = PACKET_POOL_MIN_BLOCK_SIZE;
+		while (blockSize < size)
+		{
+			blockSize <<= 1;
+			if (++sizeClass >= PACKET_POOL_CLASS_COUNT)
+				return OVERSIZED_CLASS;
+		}
+		return sizeClass;
+	}
+
+	BlockHeader *NewBlock(uint32_t sizeClass)
+	{
+		BlockHeader *header = (BlockHeader*)::operator new(sizeof(BlockHeader) + GetClassBlockSize(sizeClass));
+		header->next = nullptr;
+		header->sizeClass = sizeClass;
+		header->magic = BLOCK_MAGIC;
+		return header;
+	}
+
+	// Gives blocks to the shared free list, or back to the heap if that list is full.
+	void PushShared(uint32_t sizeClass, BlockHeader **blocks, size_t count)
+	{
+		PoolState &state = GetState();
+		SharedFreeList &list = state.freeLists[sizeClass];
+		const size_t max = state.maxFreeBlocks.load(std::memory_order_relaxed);
+
+		size_t freed = 0;
+		{
+			std::lock_guard<std::mutex> lock(list.mutex);
+			for (size_t i = 0; i < count; i++)
+			{
+				if (list.count >= max)
+				{
+					::operator delete(blocks[i]);
+					freed++;
+					continue;
+				}
+
+				blocks[i]->next = list.head;
+				list.head = blocks[i];
+				list.count++;
+			}
+		}
+
+		if (freed)
+			state.counters[sizeClass].freed.fetch_add(freed, std::memory_order_relaxed);
+	}
+
+	// Per thread cache of free blocks, avoids taking the shared lock on every allocation.
+	struct ThreadCache
+	{
+		BlockHeader *blocks[PACKET_POOL_CLASS_COUNT][THREAD_CACHE_SIZE];
+		size_t counts[PACKET_POOL_CLASS_COUNT] = { };
+
+		~ThreadCache()
+		{
+			for (uint32_t i = 0; i < PACKET_POOL_CLASS_COUNT; i++) // Hand everything back when the thread exits.
+				PushShared(i, blocks[i], counts[i]);
+		}
+
+		// Takes up to half a cache worth of blocks from the shared free list.
+		void Refill(uint32_t sizeClass)
+		{
+			SharedFreeList &list = GetState().freeLists[sizeClass];
+
+			std::lock_guard<std::mutex> lock(list.mutex);
+			while (list.head && counts[sizeClass] < THREAD_CACHE_SIZE / 2)
+			{
+				BlockHeader *header = list.head;
+				list.head = header->next;
+				list.count--;
+
+				blocks[sizeClass][counts[sizeClass]++] = header;
+			}
+		}
+
+		// Moves the older half of the cache into the shared free list.
+		void Flush(uint32_t sizeClass)
+		{
+			const size_t count = counts[sizeClass] / 2;
+			PushShared(sizeClass, blocks[sizeClass], count);
+
+			for (size_t i = count; i < counts[sizeClass]; i++)
+				blocks[sizeClass][i - count] = blocks[sizeClass][i];
+			counts[sizeClass] -= count;
+		}
+	};
+
+	thread_local ThreadCache t_cache;
+
+}
+
+void *PacketPool::Allocate(size_t size)
+{
+	PoolState &state = GetState();
+
+	uint32_t sizeClass = GetSizeClass(size);
+	if (sizeClass == OVERSIZED_CLASS) // Too big to pool, goes straight to the heap.
+	{
+		state.oversized.fetch_add(1, std::memory_order_relaxed);
+
+		BlockHeader *header = (BlockHeader*)::operator new(sizeof(BlockHeader) + size);
+		header->size = size;
+		header->sizeClass = OVERSIZED_CLASS;
+		header->magic = BLOCK_MAGIC;
+		return header + 1;
+	}
+
+	ThreadCache &cache = t_cache;
+	if (cache.counts[sizeClass] == 0)
+		cache.Refill(sizeClass);
+
+	BlockHeader *header;
+	if (cache.counts[sizeClass] > 0)
+	{
+		state.counters[sizeClass].hits.fetch_add(1, std::memory_order_relaxed);
+		header = cache.blocks[sizeClass][--cache.counts[sizeClass]];
+	}
+	else
+	{
+		state.counters[sizeClass].misses.fetch_add(1, std::memory_order_relaxed);
+		header = NewBlock(sizeClass);
+	}
+
+	header->next = nullptr;
+	return header + 1;
+}
+
+void PacketPool::Free(void *block)
+{
+	if (block == nullptr)
+		return;
+
+	BlockHeader *header = (BlockHeader*)block - 1;
+	assert(header->magic == BLOCK_MAGIC && "Block was not allocated by the packet pool.");
+
+	if (header->sizeClass == OVERSIZED_CLASS)
+	{
+		header->magic = 0;
+		::operator delete(header);
+		return;
+	}
+
+	const uint32_t sizeClass = header->sizeClass;
+	GetState().counters[sizeClass].releases.fetch_add(1, std::memory_order_relaxed);
+
+	ThreadCache &cache = t_cache;
+	if (cache.counts[sizeClass] >= THREAD_CACHE_SIZE)
+		cache.Flush(sizeClass);
+	cache.blocks[sizeClass][cache.counts[sizeClass]++] = header;
+}
+
+size_t PacketPool::GetCapacity(const void *block)
+{
+	if (block == nullptr)
+		return 0;
+
+	const BlockHeader *header = (const BlockHeader*)block - 1;
+	assert(header->magic == BLOCK_MAGIC && "Block was not allocated by the packet pool.");
+
+	if (header->sizeClass == OVERSIZED_CLASS)
+		return header->size;
+	return GetClassBlockSize(header->sizeClass);
+}
+
+void PacketPool::Reserve(size_t size, size_t count)
+{
+	uint32_t sizeClass = GetSizeClass(size);
+	if (sizeClass == OVERSIZED_CLASS) // Oversized blocks aren't pooled.
+		return;
+
+	SharedFreeList &list = GetState().freeLists[sizeClass];
+
+	std::lock_guard<std::mutex> lock(list.mutex);
+	for (size_t i = 0; i < count; i++)
+	{
+		BlockHeader *header = NewBlock(sizeClass);
+		header->next = list.head;
+		list.head = header;
+		list.count++;
+	}
+}
+
+void PacketPool::SetMaxFreeBlocks(size_t max)
+{
+	GetState().maxFreeBlocks.store(max, std::memory_order_relaxed);
+}
+
+PacketPoolStats PacketPool::GetStats()
+{
+	PoolState &state = GetState();
+
+	PacketPoolStats stats;
+	for (uint32_t i = 0; i < PACKET_POOL_CLASS_COUNT; i++)
+	{
+		PacketPoolClassStats &classStats = stats.classes[i];
+		classStats.blockSize = GetClassBlockSize(i);
+		classStats.hits = state.counters[i].hits.load(std::memory_order_relaxed);
+		classStats.misses = state.counters[i].misses.load(std::memory_order_relaxed);
+		classStats.releases = state.counters[i].releases.load(std::memory_order_relaxed);
+		classStats.freed = state.counters[i].freed.load(std::memory_order_relaxed);
+	}
+	stats.oversized = state.oversized.load(std::memory_order_relaxed);
+
+	return stats;
+}
+
+void PacketPool::ResetStats()
+{
+	PoolState &state = GetState();
+
+	for (uint32_t i = 0; i < PACKET_POOL_CLASS_COUNT; i++)
+	{
+		state.counters[i].hits.store(0, std::memory_order_relaxed);
+		state.counters[i].misses.store(0, std::memory_order_relaxed);
+		state.counters[i].releases.store(0, std::memory_order_relaxed);
+		state.counters[i].freed.store(0, std::memory_order_relaxed);
+	}
+	state.oversized.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,185 @@
+#include <BCNet/BCNetQuantize.h>
+
+#include <math.h>
+#include <float.h>
+#include <string.h>
+
+using namespace BCNet;
+
+namespace
+{
+	// The smallest three components of a unit quaternion are always within this.
+	constexpr float QUATERNION_COMPONENT_RANGE = 0.707106781f; // 1/sqrt(2)
+}
+
+// ------------ FLOATQUANTIZER
+FloatQuantizer::FloatQuantizer(float min, float max, unsigned int bits)
+	: m_min(min)
+	, m_max(max > min ? max : min)
+	, m_bits(bits < 1 ? 1 : (bits > 32 ? 32 : bits))
+{
+	m_maxQuantized = 0xFFFFFFFFu >> (32 - m_bits);
+	m_step = (float)(((double)m_max - m_min) / m_maxQuantized);
+
+	// Half a step from rounding to the nearest, plus half a float ulp from turning it back into a float.
+	m_maxError = m_step * 0.5f + fmaxf(fabsf(m_min), fabsf(m_max)) * FLT_EPSILON * 0.5f;
+}
+
+FloatQuantizer FloatQuantizer::FromPrecision(float min, float max, float precision)
+{
+	if (!(precision > 0.0f) || !(max > min)) // Can't do better than every bit.
+		return FloatQuantizer(min, max, 32);
+
+	// Values are rounded to the nearest step, so steps can be twice the precision apart.
+	const double steps = ceil(((double)max - min) / (precision * 2.0));
+	if (steps >= 4294967295.0)
+		return FloatQuantizer(min, max, 32);
+
+	return FloatQuantizer(min, max, BitsRequired((uint32_t)steps));
+}
+
+uint32_t FloatQuantizer::Quantize(float value) const
+{
+	if (!(value > m_min)) // Also catches NaN.
+		return 0;
+	if (value >= m_max)
+		return m_maxQuantized;
+
+	return (uint32_t)(((double)value - m_min) / ((double)m_max - m_min) * m_maxQuantized + 0.5);
+}
+
+float FloatQuantizer::Dequantize(uint32_t quantized) const
+{
+	if (quantized >= m_maxQuantized) // Land exactly on the end of the range.
+		return m_max;
+
+	return (float)(m_min + (double)quantized * ((double)m_max - m_min) / m_maxQuantized);
+}
+
+bool FloatQuantizer::Read(BitStreamReader &reader, float &value) const
+{
+	uint32_t quantized = 0;
+	if (!reader.ReadBits(quantized, m_bits))
+		return false;
+
+	value = Dequantize(quantized);
+	return true;
+}
+
+// ------------ QUATERNIONQUANTIZER
+QuaternionQuantizer::QuaternionQuantizer(unsigned int componentBits)
+	: m_component(-QUATERNION_COMPONENT_RANGE, QUATERNION_COMPONENT_RANGE, componentBits)
+{ }
+
+bool QuaternionQuantizer::Write(BitStreamWriter &writer, const float (&quaternion)[4]) const
+{
+	// Leave out the largest component.
+	uint32_t largest = 0;
+	for (uint32_t i = 1; i < 4; i++)
+	{
+		if (fabsf(quaternion[i]) > fabsf(quaternion[largest]))
+			largest = i;
+	}
+
+	// q and -q are the same rotation, flip it so the left out component is positive and it's sign doesn't need sending.
+	const float sign = quaternion[largest] < 0.0f ? -1.0f : 1.0f;
+
+	bool success = writer.WriteBits(largest, 2);
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		if (i != largest)
+			success &= m_component.Write(writer, quaternion[i] * sign);
+	}
+	return success;
+}
+
+bool QuaternionQuantizer::Read(BitStreamReader &reader, float (&quaternion)[4]) const
+{
+	uint32_t largest = 0;
+	if (!reader.ReadBits(largest, 2))
+		return false;
+
+	float sum = 0.0f;
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		if (i == largest)
+			continue;
+
+		if (!m_component.Read(reader, quaternion[i]))
+			return false;
+		sum += quaternion[i] * quaternion[i];
+	}
+
+	// Rebuild the left out component from the quaternion being unit length.
+	quaternion[largest] = sum < 1.0f ? sqrtf(1.0f - sum) : 0.0f;
+
+	const float length = sqrtf(sum + quaternion[largest] * quaternion[largest]); // Packing error can leave it slightly off.
+	if (length > 0.0f)
+	{
+		const float inverseLength = 1.0f / length;
+		for (uint32_t i = 0; i < 4; i++)
+			quaternion[i] *= inverseLength;
+	}
+	return true;
+}
+
+// ------------ HALF FLOATS
+uint16_t BCNet::FloatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	const uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+	const uint32_t magnitude = bits & 0x7FFFFFFF;
+
+	if (magnitude >= 0x7F800000) // Infinity or NaN, keep NaNs quiet.
+		return sign | 0x7C00 | (magnitude > 0x7F800000 ? 0x0200 : 0);
+	if (magnitude >= 0x477FF000) // Rounds past the biggest half, 65520.
+		return sign | 0x7C00;
+
+	if (magnitude < 0x38800000) // Too small for a normal half, 2^-14.
+	{
+		if (magnitude < 0x33000000) // Rounds to zero, 2^-25.
+			return sign;
+
+		// Denormal half, shift the mantissa (with it's implicit bit) into place and round to nearest even.
+		const uint32_t mantissa = (magnitude & 0x007FFFFF) | 0x00800000;
+		const uint32_t shift = 126 - (magnitude >> 23);
+		uint32_t half = mantissa >> shift;
+		const uint32_t remainder = mantissa & ((1u << shift) - 1);
+		const uint32_t halfway = 1u << (shift - 1);
+		if (remainder > halfway || (remainder == halfway && (half & 1)))
+			half++;
+		return sign | (uint16_t)half;
+	}
+
+	// Normal half, rebias the exponent from 127 to 15 and round the mantissa to nearest even.
+	return sign | (uint16_t)((magnitude - 0x38000000 + 0x0FFF + ((magnitude >> 13) & 1)) >> 13);
+}
+
+float BCNet::HalfToFloat(uint16_t half)
+{
+	const uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+	const uint32_t exponent = (half >> 10) & 0x1F;
+	const uint32_t mantissa = half & 0x03FF;
+
+	uint32_t bits;
+	if (exponent == 0)
+	{
+		const float magnitude = (float)mantissa * 5.9604644775390625e-8f; // Denormal, mantissa * 2^-24.
+		memcpy(&bits, &magnitude, sizeof(bits));
+		bits |= sign;
+	}
+	else if (exponent == 0x1F) // Infinity or NaN.
+	{
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	}
+	else
+	{
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	}
+
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
@@ -1,12 +1,20 @@
 #include "BCNetServer.h"
 
 #include <BCNet/BCNetUtil.h>
+#include <BCNet/BCNetPacketPool.h>
+#include <BCNet/BCNetDispatch.h>
 #include "Misc/Utility.h"
+#include "Misc/DeltaCodec.h"
+#include "Misc/Loopback.h"
 
 #include <iostream>
 #include <sstream>
 #include <chrono>
 #include <random>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <iterator>
 
 #include <stdio.h>
 #include <string.h>
@@ -20,7 +28,36 @@ using namespace BCNet;
 
 int g_port;
 
+namespace
+{
+	// How often the main network thread checks whether the shards need evening out.
+	constexpr std::chrono::seconds REBALANCE_INTERVAL(1);
+
+	// A connection's user data holds the shard that owns it and it's slot handle there:
+	// the slot index in the low 32 bits, the generation in the next 16 and the shard above that.
+	constexpr int USER_DATA_GENERATION_SHIFT = 32;
+	constexpr int USER_DATA_SHARD_SHIFT = 48;
+	constexpr unsigned int MAX_SHARDS = 0x7FFF; // Keeps the user data positive, -1 means no connection.
+
+	// Sits in front of a broadcast payload, every message of the broadcast points at the same payload.
+	struct alignas(16) BroadcastBuffer
+	{
+		std::atomic<int> references;
+	};
+
+	void FreeBroadcastBuffer(SteamNetworkingMessage_t *message) // Called by GameNetworkingSockets for every message once it's done with it.
+	{
+		BroadcastBuffer *buffer = (BroadcastBuffer*)(intptr_t)message->m_nUserData;
+		if (buffer->references.fetch_sub(1, std::memory_order_acq_rel) == 1) // Last recipient, give the buffer back.
+		{
+			buffer->~BroadcastBuffer();
+			PacketPool::Free(buffer);
+		}
+	}
+}
+
 BCNetServer *BCNetServer::s_callbackInstance = nullptr;
+thread_local BCNetServer::ServerShard *BCNetServer::s_currentShard = nullptr;
 BCNetServer::BCNetServer()
 {
 	srand((unsigned int)time(nullptr)); // Seed RNG.
@@ -52,11 +89,76 @@ void BCNetServer::SetPacketReceivedCallback(const ServerPacketReceivedCallback &
 	m_packetReceivedCallback = callback;
 }
 
+void BCNetServer::SetMessageReceivedCallback(const ServerMessageReceivedCallback &callback)
+{
+	m_messageReceivedCallback = callback;
+}
+
+void BCNetServer::SetPacketBatchReceivedCallback(const ServerPacketBatchReceivedCallback &callback)
+{
+	m_packetBatchReceivedCallback = callback;
+}
+
+void BCNetServer::SetPacketDispatcher(ServerPacketDispatcher *dispatcher)
+{
+	m_packetDispatcher = dispatcher;
+}
+
 void BCNetServer::SetOutputLogCallback(const ServerOutputLogCallback &callback)
 {
 	m_outputLogCallback = callback;
 }
 
+void BCNetServer::SetTransferStartedCallback(const ServerTransferStartedCallback &callback)
+{
+	m_transferStartedCallback = callback;
+}
+
+void BCNetServer::SetTransferChunkCallback(const ServerTransferChunkCallback &callback)
+{
+	m_transferChunkCallback = callback;
+}
+
+void BCNetServer::SetTransferProgressCallback(const ServerTransferProgressCallback &callback)
+{
+	m_transferProgressCallback = callback;
+}
+
+void BCNetServer::SetTransferCompletedCallback(const ServerTransferCompletedCallback &callback)
+{
+	m_transferCompletedCallback = callback;
+}
+
+void BCNetServer::SetTransferPacing(unsigned int chunkSize, unsigned int window)
+{
+	m_transferChunkSize = chunkSize > 0 ? (chunkSize < TRANSFER_MAX_CHUNK_SIZE ? chunkSize : TRANSFER_MAX_CHUNK_SIZE) : TRANSFER_DEFAULT_CHUNK_SIZE;
+	m_transferWindow = window > 0 ? window : TRANSFER_DEFAULT_WINDOW;
+}
+
+void BCNetServer::SetMaxTransferSize(uint64_t maxSize, uint64_t maxIncoming)
+{
+	m_maxTransferSize = maxSize;
+	m_maxIncomingTransfers = maxIncoming;
+}
+
+void BCNetServer::SetNetworkSchedule(NetworkScheduleMode mode, unsigned int tickRate, unsigned int spinMicroseconds)
+{
+	m_scheduleMode = mode;
+	m_scheduleTickRate = tickRate;
+	m_scheduleSpin = spinMicroseconds;
+
+	m_scheduler.SetMode(mode, tickRate, spinMicroseconds);
+	for (auto &shard : m_shards)
+		shard->ownScheduler.SetMode(mode, tickRate, spinMicroseconds);
+}
+
+void BCNetServer::SetShardCount(unsigned int count, ShardAssignment assignment, bool rebalance)
+{
+	m_shardCount = count > 0 ? (count < MAX_SHARDS ? count : MAX_SHARDS) : 1;
+	m_shardAssignment = assignment;
+	m_shardRebalance = rebalance;
+}
+
 void BCNetServer::Start(const int port)
 {
 	if (m_networking)
@@ -71,36 +173,57 @@ void BCNetServer::Start(const int port)
 
 	if (m_networkThread.joinable())
 		m_networkThread.join(); // Wait for the thread to finish execution.
+	m_shouldQuit = false;
+
+	// Shards are set up here so they exist before anything can send to them.
+	m_shards.clear();
+	m_nextShard = 0;
+	for (unsigned int i = 0; i < m_shardCount; i++)
+	{
+		auto shard = std::make_unique<ServerShard>();
+		shard->owner = this;
+		shard->index = i;
+		shard->scheduler = i == 0 ? &m_scheduler : &shard->ownScheduler;
+		shard->ownScheduler.SetMode(m_scheduleMode, m_scheduleTickRate, m_scheduleSpin);
+		m_shards.push_back(std::move(shard));
+	}
 	m_networkThread = std::thread([this]() { DoNetworking(); });
 
 	if (m_commandThread.joinable())
 		m_commandThread.join(); // Wait for the thread to finish execution.
-	m_commandThread = std::thread([this]()
+	if (m_consoleInput)
 	{
-		// Just gets whatever the user has put into the standard input handle then pushes it into the command queue.
-		while (!m_shouldQuit)
+		m_commandThread = std::thread([this]()
 		{
-			char szLine[4000];
-			if (!fgets(szLine, sizeof(szLine), stdin))
+			// Just gets whatever the user has put into the standard input handle then pushes it into the command queue.
+			while (!m_shouldQuit)
 			{
-				if (m_shouldQuit)
-					return;
-				m_shouldQuit = true;
-				std::cout << "Error: Failed to read command on stdin." << std::endl;
+				char szLine[4000];
+				if (!fgets(szLine, sizeof(szLine), stdin))
+				{
+					if (m_shouldQuit)
+						return;
+					m_shouldQuit = true;
+					std::cout << "Error: Failed to read command on stdin." << std::endl;
 
-				break;
-			}
+					break;
+				}
 
-			m_mutexCommandQueue.lock();
-			m_commandQueue.push(std::string(szLine));
-			m_mutexCommandQueue.unlock();
-		}
-	});
+				m_mutexCommandQueue.lock();
+				m_commandQueue.push(std::string(szLine));
+				m_mutexCommandQueue.unlock();
+
+				m_scheduler.Wake(); // Handle it now rather than next tick.
+			}
+		});
+	}
 
 	// Setup default commands.
 	m_commandCallbacks["/quit"] = BIND_COMMAND(BCNetServer::DoQuitCommand);
 	m_commandCallbacks["/exit"] = BIND_COMMAND(BCNetServer::DoQuitCommand);
 	m_commandCallbacks["/kick"] = BIND_COMMAND(BCNetServer::DoKickCommand);
+	m_commandCallbacks["/stats"] = BIND_COMMAND(BCNetServer::DoStatsCommand);
+	m_commandCallbacks["/trace"] = BIND_COMMAND(BCNetServer::DoTraceCommand);
 	std::cout << PrintCommandList() << std::endl;
 }
 
@@ -121,6 +244,8 @@ void BCNetServer::Stop()
 
 std::string BCNetServer::GetLatestOutput()
 {
+	std::lock_guard<std::mutex> lock(m_mutexOutputLog);
+
 	// TODO: Fix bug that gives garabage output?
 	if (m_outputLog.back().empty())
 		return "\0";
@@ -131,184 +256,1397 @@ std::string BCNetServer::GetLatestOutput()
 void BCNetServer::DoNetworking()
 {
 	s_callbackInstance = this;
+	s_currentShard = m_shards[0].get();
+	Tracer::SetThreadName("Server Network");
 
-	SteamDatagramErrMsg msg;
-	if (!GameNetworkingSockets_Init(nullptr, msg)) // Initialize networking library.
+	if (!InitNetworkingSockets()) // Initialize networking library.
 	{
 		std::cout << "Error: Failed to initialize GameNetworkingSockets" << std::endl;
 		return;
 	}
 
-	// Setup listening socket and poll group.
+	// Setup listening socket and poll groups.
 	m_interface = SteamNetworkingSockets();
 
 	SteamNetworkingIPAddr localAddr;
 	localAddr.Clear();
 	localAddr.m_port = g_port;
 
-	SteamNetworkingConfigValue_t options;
-	options.SetPtr(k_ESteamNetworkingConfig_Callback_ConnectionStatusChanged, (void *)BCNetServer::SteamNetConnectionStatusChangedCallback);
+	SteamNetworkingConfigValue_t options;
+	options.SetPtr(k_ESteamNetworkingConfig_Callback_ConnectionStatusChanged, (void *)BCNetServer::SteamNetConnectionStatusChangedCallback);
+
+	m_listenSocket = m_loopbackOnly ? k_HSteamListenSocket_Invalid : m_interface->CreateListenSocketIP(localAddr, 1, &options);
+	if (m_listenSocket == k_HSteamListenSocket_Invalid && !m_loopbackOnly)
+	{
+		std::cout << "Failed to listen on port " << localAddr.m_port << std::endl;
+		std::cout << "Error: Invalid Listen Socket" << std::endl;
+		KillNetworkingSockets();
+		return;
+	}
+
+	for (auto &shard : m_shards)
+	{
+		shard->pollGroup = m_interface->CreatePollGroup();
+		if (shard->pollGroup == k_HSteamNetPollGroup_Invalid)
+		{
+			std::cout << "Failed to listen on port " << localAddr.m_port << std::endl;
+			std::cout << "Error: Invalid Poll Group" << std::endl;
+			KillNetworkingSockets();
+			return;
+		}
+	}
+
+	if (!LoopbackRegistry::Listen(g_port, this, [this](HSteamNetConnection connection) { AcceptLoopbackClient(connection); }))
+	{
+		std::cout << "Failed to listen on port " << localAddr.m_port << std::endl;
+		std::cout << "Error: Another server in this process is taking loopback clients on it" << std::endl;
+		m_interface->CloseListenSocket(m_listenSocket);
+		KillNetworkingSockets();
+		return;
+	}
+
+	Log("Server started..");
+
+	m_handlerExecutor.Start(m_handlerThreadCount);
+
+	// Loop.
+	m_networking = true;
+	m_nextRebalance = std::chrono::steady_clock::now() + REBALANCE_INTERVAL;
+	for (size_t i = 1; i < m_shards.size(); i++)
+	{
+		ServerShard *shard = m_shards[i].get();
+		shard->thread = std::thread([this, shard]() { DoShardNetworking(*shard); });
+	}
+
+	ServerShard &shard = *m_shards[0];
+	while (!m_shouldQuit)
+	{
+		BCNET_TRACE_SCOPE("Tick");
+		bool activity = false;
+		if (m_networking)
+		{
+			activity = DrainShardRequests(shard);
+			activity |= PollNetworkMessages(shard);
+			PollConnectionStateChanges();
+			RebalanceShards();
+			activity |= PumpTransfers(shard);
+			FlushBatches(shard); // End of the tick.
+			SampleStats(shard);
+		}
+		HandleUserCommands();
+		UpdateTrace(false);
+		m_metrics.Update("server");
+		m_networking = !m_shouldQuit;
+		m_scheduler.Wait(activity); // Sleep, spin or carry on depending on the schedule.
+	}
+
+	// Quit.
+	UpdateTrace(true); // Whatever was recorded before quitting.
+	LoopbackRegistry::Close(g_port, this); // No one new.
+	for (size_t i = 1; i < m_shards.size(); i++)
+	{
+		m_shards[i]->scheduler->Wake(); // Don't wait out the rest of the tick.
+		if (m_shards[i]->thread.joinable())
+			m_shards[i]->thread.join(); // Wait for the thread to finish execution.
+	}
+
+	m_handlerExecutor.Stop(); // Let the workers finish what they were given first.
+	for (auto &other : m_shards) // Anything they sent on the way out.
+	{
+		s_currentShard = other.get();
+		DrainShardRequests(*other);
+		FlushBatches(*other);
+	}
+	s_currentShard = &shard;
+	m_metrics.Update("server", true); // Everything up to quitting.
+
+	Log("Closing all connections...");
+	for (auto &other : m_shards)
+	{
+		s_currentShard = other.get();
+		while (!other->transfers.empty()) // Whatever's still going on fails, before anyone's gone.
+		{
+			const ClientInfo *found = FindClient(*other, other->transfers.begin()->first);
+			ClientInfo client;
+			client.id = other->transfers.begin()->first;
+			FailTransfers(*other, found ? *found : client);
+		}
+		other->closedTransfers.clear();
+
+		for (size_t i = 0; i < other->clients.GetSize(); i++)
+		{
+			m_interface->CloseConnection(other->clients.begin()[i].id, 0, "Server Shutdown", true);
+			other->stats.Clear(other->clients.GetHandle(i).index);
+		}
+		other->clients.Clear();
+		other->revision++;
+		other->load = 0;
+
+		m_interface->DestroyPollGroup(other->pollGroup);
+		other->pollGroup = k_HSteamNetPollGroup_Invalid;
+	}
+	s_currentShard = &shard;
+	m_clientCount = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutexNickNames);
+		m_nickNames.clear();
+	}
+
+	m_interface->CloseListenSocket(m_listenSocket);
+	m_listenSocket = k_HSteamListenSocket_Invalid;
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(500)); // Wait a bit for all connections to close.
+	{
+		std::lock_guard<std::mutex> lock(m_mutexStatusChanges);
+		m_statusChanges.clear(); // For connections that are gone now.
+	}
+	KillNetworkingSockets();
+
+	Log("Server Shutting down..");
+}
+
+// Network thread function for every shard but the first, which the main network thread looks after.
+void BCNetServer::DoShardNetworking(ServerShard &shard)
+{
+	s_currentShard = &shard;
+	Tracer::SetThreadName("Server Shard " + std::to_string(shard.index));
+
+	while (!m_shouldQuit)
+	{
+		BCNET_TRACE_SCOPE("Tick");
+		bool activity = DrainShardRequests(shard);
+		if (m_networking)
+			activity |= PollNetworkMessages(shard);
+		if (m_networking)
+			activity |= PumpTransfers(shard);
+		FlushBatches(shard); // End of the tick.
+		if (m_networking)
+			SampleStats(shard);
+		shard.scheduler->Wait(activity); // Sleep, spin or carry on depending on the schedule.
+	}
+}
+
+unsigned int BCNetServer::GetClientShard(uint32 clientID)
+{
+	int64 userData = m_interface->GetConnectionUserData(clientID); // Set when the client is assigned, -1 if the connection doesn't exist.
+	if (userData < 0)
+		return (unsigned int)m_shards.size();
+
+	const unsigned int shard = (unsigned int)(userData >> USER_DATA_SHARD_SHIFT);
+	return shard < m_shards.size() ? shard : (unsigned int)m_shards.size();
+}
+
+SlotHandle BCNetServer::GetClientHandle(ServerShard &shard, uint32 clientID, int64_t userData)
+{
+	if (userData < 0 || (unsigned int)(userData >> USER_DATA_SHARD_SHIFT) != shard.index)
+		return SlotHandle();
+
+	SlotHandle handle;
+	handle.index = (uint32_t)userData;
+	handle.generation = (uint16_t)(userData >> USER_DATA_GENERATION_SHIFT);
+
+	const ClientInfo *client = shard.clients.Get(handle);
+	if (!client || client->id != clientID)
+		return SlotHandle();
+	return handle;
+}
+
+ClientInfo *BCNetServer::FindClient(ServerShard &shard, uint32 clientID)
+{
+	return shard.clients.Get(GetClientHandle(shard, clientID, m_interface->GetConnectionUserData(clientID)));
+}
+
+void BCNetServer::SetClientUserData(unsigned int shard, uint32 clientID, SlotHandle handle)
+{
+	const int64 userData = ((int64)shard << USER_DATA_SHARD_SHIFT) | ((int64)handle.generation << USER_DATA_GENERATION_SHIFT) | (int64)handle.index;
+	m_interface->SetConnectionUserData(clientID, userData);
+}
+
+unsigned int BCNetServer::ChooseShard()
+{
+	if (m_shardAssignment == ShardAssignment::LEAST_LOADED)
+	{
+		unsigned int best = 0;
+		for (unsigned int i = 1; i < (unsigned int)m_shards.size(); i++)
+		{
+			if (m_shards[i]->load.load() < m_shards[best]->load.load())
+				best = i;
+		}
+		return best;
+	}
+
+	return m_nextShard++ % (unsigned int)m_shards.size();
+}
+
+// Runs on the main network thread, evens out how many clients each shard has.
+void BCNetServer::RebalanceShards()
+{
+	BCNET_TRACE_SCOPE("RebalanceShards");
+	if (!m_shardRebalance || m_shards.size() < 2)
+		return;
+
+	const auto now = std::chrono::steady_clock::now();
+	if (now < m_nextRebalance)
+		return;
+	m_nextRebalance = now + REBALANCE_INTERVAL;
+
+	unsigned int busiest = 0, quietest = 0;
+	unsigned int busiestLoad = m_shards[0]->load.load(), quietestLoad = busiestLoad;
+	for (unsigned int i = 1; i < (unsigned int)m_shards.size(); i++)
+	{
+		const unsigned int load = m_shards[i]->load.load();
+		if (load > busiestLoad)
+		{
+			busiest = i;
+			busiestLoad = load;
+		}
+		if (load < quietestLoad)
+		{
+			quietest = i;
+			quietestLoad = load;
+		}
+	}
+
+	const unsigned int difference = busiestLoad - quietestLoad;
+	if (difference < 2) // As even as it gets.
+		return;
+
+	for (unsigned int i = 0; i < difference / 2; i++) // The busy shard picks who to hand over.
+	{
+		ShardRequest request = MakeShardRequest(ShardRequest::Type::MIGRATE_CLIENT, 0);
+		request.shard = quietest;
+		RouteShardRequest(*m_shards[busiest], std::move(request));
+	}
+}
+
+BCNetServer::ShardRequest BCNetServer::MakeShardRequest(ShardRequest::Type type, uint32 clientID, const Packet &payload, bool reliable)
+{
+	ShardRequest request;
+	request.type = type;
+	request.reliable = reliable;
+	request.clientID = clientID;
+	if (payload.size > 0) // Copy the packet, the caller is free to release theirs as soon as this returns.
+	{
+		request.payload.Allocate(payload.size);
+		memcpy(request.payload.GetData(), payload.data, payload.size);
+	}
+	return request;
+}
+
+BCNetServer::ShardRequest BCNetServer::MakeBroadcastRequest(ShardRequest::Type type, const Packet &standardPacket, const Packet &compactPacket, uint32 excludeID, bool reliable)
+{
+	if (standardPacket.data == compactPacket.data && standardPacket.size == compactPacket.size) // One copy does for everyone.
+		return MakeShardRequest(type, excludeID, standardPacket, reliable);
+
+	// Both copies back to back in one payload, the compact one starts where the standard one ends.
+	ShardRequest request = MakeShardRequest(type, excludeID, Packet(), reliable);
+	request.payload.Allocate(standardPacket.size + compactPacket.size);
+	memcpy(request.payload.GetData(), standardPacket.data, standardPacket.size);
+	memcpy((uint8_t*)request.payload.GetData() + standardPacket.size, compactPacket.data, compactPacket.size);
+	request.compactOffset = standardPacket.size;
+	return request;
+}
+
+void BCNetServer::RouteShardRequest(ServerShard &shard, ShardRequest &&request)
+{
+	if (GetCurrentShard() == &shard) // Already on the right thread.
+	{
+		HandleShardRequest(shard, request);
+		return;
+	}
+
+	PushShardRequest(shard, std::move(request));
+}
+
+void BCNetServer::PushShardRequest(ServerShard &shard, ShardRequest &&request, bool wake)
+{
+	while (!shard.requests.TryPush(std::move(request))) // Queue is full, wait for the shard to catch up.
+	{
+		if (m_shouldQuit)
+			return;
+
+		shard.scheduler->Wake();
+		std::this_thread::yield();
+	}
+
+	if (wake)
+		shard.scheduler->Wake(); // Handle it now rather than next tick.
+}
+
+bool BCNetServer::ForwardToOwner(ServerShard &shard, ShardRequest &request)
+{
+	const int64 userData = m_interface->GetConnectionUserData(request.clientID);
+	const unsigned int owner = GetClientShard(request.clientID);
+	if (owner >= m_shards.size())
+		return false;
+
+	if (owner == shard.index)
+	{
+		if ((uint32_t)userData != SlotHandle::INVALID_INDEX) // They're ours but they're not here, they've gone.
+			return false;
+
+		shard.arrivingRequests[request.clientID].push_back(std::move(request)); // Still on their way over, handled in order once the hand over is.
+		return true;
+	}
+
+	PushShardRequest(*m_shards[owner], std::move(request));
+	return true;
+}
+
+bool BCNetServer::DrainShardRequests(ServerShard &shard)
+{
+	BCNET_TRACE_SCOPE("DrainShardRequests");
+	bool drained = false;
+
+	ShardRequest request;
+	while (shard.requests.TryPop(request))
+	{
+		drained = true;
+
+		HandleShardRequest(shard, request);
+		request.payload.Release();
+	}
+
+	return drained;
+}
+
+void BCNetServer::HandleShardRequest(ServerShard &shard, ShardRequest &request)
+{
+	switch (request.type)
+	{
+		case ShardRequest::Type::SEND:
+		{
+			if (!shard.arrivingRequests.empty() && shard.arrivingRequests.count(request.clientID)) // Can't overtake what's being held for them.
+			{
+				shard.arrivingRequests[request.clientID].push_back(std::move(request));
+				break;
+			}
+
+			SendPacketToClient(request.clientID, request.payload, request.reliable, request.sendFlags);
+		} break;
+		case ShardRequest::Type::BROADCAST:
+		{
+			const Packet payload = request.payload;
+			const size_t offset = request.compactOffset;
+			if (offset > 0) // Two copies back to back.
+				SendEncodedPacketToAllClients(Packet(payload, offset), Packet(payload.As<uint8_t>() + offset, payload.size - offset), request.clientID, request.reliable, request.sendFlags);
+			else
+				SendPacketToAllClients(payload, request.clientID, request.reliable, request.sendFlags);
+		} break;
+		case ShardRequest::Type::SHARD_BROADCAST:
+		{
+			const Packet payload = request.payload;
+			const size_t offset = request.compactOffset;
+			if (offset > 0) // Two copies back to back.
+				BroadcastOnShard(shard, Packet(payload, offset), Packet(payload.As<uint8_t>() + offset, payload.size - offset), request.clientID, request.reliable, request.sendFlags);
+			else
+				BroadcastOnShard(shard, payload, payload, request.clientID, request.reliable, request.sendFlags);
+		} break;
+		case ShardRequest::Type::KICK:
+		{
+			KickClient(request.clientID);
+		} break;
+		case ShardRequest::Type::KICK_NICKNAME:
+		{
+			KickClient(std::string((const char*)request.payload.GetData(), request.payload.GetSize()));
+		} break;
+		case ShardRequest::Type::RENAME:
+		{
+			SetClientNickname(request.clientID, std::string((const char*)request.payload.GetData(), request.payload.GetSize()));
+		} break;
+		case ShardRequest::Type::WELCOME:
+		{
+			const ClientInfo *client = FindClient(shard, request.clientID);
+			if (!client)
+			{
+				ForwardToOwner(shard, request);
+				break;
+			}
+
+			// Relay connection info.
+			std::string userList = PrintConnectedUsers();
+			Log(userList);
+
+			SendServerMessage(*client, userList); // Send who's currently connected to client.
+			BroadcastServerMessage(client->nickName + " has connected!", client->id); // Update peers on the new connection.
+		} break;
+		case ShardRequest::Type::ADD_CLIENT:
+		{
+			ClientInfo client;
+			client.id = request.clientID;
+			client.nickName.assign((const char*)request.payload.GetData(), request.payload.GetSize());
+			client.encoding = request.encoding;
+			client.compression = request.compression;
+			client.batching = request.batching;
+			if (request.sequence != 0) // Carry on encoding their snapshots against the same baseline.
+				shard.snapshotAcks[client.id] = request.sequence;
+			if (request.transfers) // Carry on where the last shard left off.
+				GetTransfers(shard, client.id).Merge(*request.transfers);
+
+			SetClientUserData(shard.index, client.id, shard.clients.Insert(std::move(client)));
+			shard.revision++;
+
+			auto it = shard.arrivingRequests.find(request.clientID);
+			if (it == shard.arrivingRequests.end())
+				break;
+
+			std::vector<ShardRequest> arriving = std::move(it->second);
+			shard.arrivingRequests.erase(it);
+			for (ShardRequest &held : arriving) // In the order they were queued, ahead of anything still in the queue.
+				HandleShardRequest(shard, held);
+		} break;
+		case ShardRequest::Type::REMOVE_CLIENT:
+		{
+			const ClientInfo *found = FindClient(shard, request.clientID);
+			if (!found)
+			{
+				if (!ForwardToOwner(shard, request)) // Never made it to a shard.
+					m_interface->CloseConnection(request.clientID, 0, nullptr, false);
+				break;
+			}
+
+			const ClientInfo client = *found;
+			RemoveClient(shard, request.clientID);
+			m_interface->CloseConnection(request.clientID, 0, nullptr, false);
+
+			if (request.announce)
+			{
+				BroadcastServerMessage(client.nickName + " has left.", client.id); // Tell other clients that they have left.
+
+				if (m_disconnectedCallback) // Queued behind any of their packets still being handled.
+					m_handlerExecutor.Post(client.id, [this, client]() { m_disconnectedCallback(client); }); // Do callback.
+			}
+		} break;
+		case ShardRequest::Type::MIGRATE_CLIENT:
+		{
+			if (request.shard < m_shards.size() && request.shard != shard.index)
+				MigrateClient(shard, *m_shards[request.shard]);
+		} break;
+		case ShardRequest::Type::SNAPSHOT:
+		{
+			SendSnapshotOnShard(shard, request.sequence, request.reliable);
+		} break;
+		case ShardRequest::Type::FLUSH:
+		{
+			if (request.clientID == 0) // Everyone on the shard.
+				FlushBatches(shard);
+			else if (FindClient(shard, request.clientID))
+				FlushConnection(shard, request.clientID);
+			else
+				ForwardToOwner(shard, request);
+		} break;
+		case ShardRequest::Type::TRANSFER:
+		{
+			if (!request.transfers)
+				break;
+
+			if (FindClient(shard, request.clientID))
+			{
+				GetTransfers(shard, request.clientID).Merge(*request.transfers); // Sent from the next pump.
+				break;
+			}
+
+			if (!ForwardToOwner(shard, request)) // They left before it could start.
+			{
+				ClientInfo client;
+				client.id = request.clientID;
+				ClientTransfers connection(*this, client);
+				request.transfers->Fail(connection);
+			}
+		} break;
+		case ShardRequest::Type::CANCEL_TRANSFER:
+		{
+			const ClientInfo *client = FindClient(shard, request.clientID);
+			if (!client)
+			{
+				ForwardToOwner(shard, request);
+				break;
+			}
+
+			auto it = shard.transfers.find(request.clientID);
+			if (it == shard.transfers.end())
+				break;
+
+			ClientTransfers connection(*this, *client);
+			if (!it->second->Cancel(connection, request.sequence, request.incoming, client->encoding))
+				Log("Error: Could not cancel transfer [" + std::to_string(request.sequence) + "] because it isn't running!");
+		} break;
+	}
+}
+
+void BCNetServer::BroadcastOnShard(ServerShard &shard, const Packet &standardPacket, const Packet &compactPacket, uint32 excludeID, bool reliable, uint8_t sendFlags)
+{
+	BCNET_TRACE_SCOPE("BroadcastOnShard");
+	// Copy each payload once into a shared buffer, then point a message for every client at the one in their encoding
+	// and hand them all to GameNetworkingSockets in one go instead of copying it for every client.
+	// Clients taking compressed packets share a third copy, compressed once. Clients taking batched packets get it added to their batch.
+	const bool shared = standardPacket.data == compactPacket.data && standardPacket.size == compactPacket.size;
+	Packet packets[3] = { standardPacket, compactPacket, Packet() };
+	BroadcastBuffer *buffers[3] = { nullptr, nullptr, nullptr }; // Only made once someone needs them.
+	int references[3] = { 0, 0, 0 };
+
+	PooledPacket compressed;
+	bool compressionTried = !m_compressor.ShouldCompress(compactPacket);
+
+	const int flags = GetSendFlags(reliable, sendFlags);
+	ISteamNetworkingUtils *utils = SteamNetworkingUtils();
+
+	uint64_t recipients[2] = { 0, 0 }; // For the metrics, per encoded copy.
+	PacketEncoding encodings[2] = { PacketEncoding::STANDARD, PacketEncoding::COMPACT };
+
+	shard.broadcastMessages.clear();
+	for (const ClientInfo &client : shard.clients) // Packed together, so this is a straight walk through memory.
+	{
+		if (client.id == excludeID)
+			continue;
+
+		int copy = !shared && client.encoding == PacketEncoding::COMPACT ? 1 : 0;
+		recipients[copy]++;
+		encodings[copy] = client.encoding; // A shared copy is read in whichever encoding it's sent in.
+		if (m_batchSize > 0 && client.batching && BatchPacket(shard, client, packets[copy], reliable, sendFlags))
+			continue;
+
+		if (client.compression)
+		{
+			if (!compressionTried)
+			{
+				compressionTried = true;
+				if (m_compressor.Compress(packets[copy], compressed))
+					packets[2] = compressed.GetPacket();
+			}
+
+			if (packets[2].size > 0)
+				copy = 2;
+		}
+
+		const Packet &packet = packets[copy];
+		if (!buffers[copy])
+		{
+			buffers[copy] = new (PacketPool::Allocate(sizeof(BroadcastBuffer) + packet.size)) BroadcastBuffer();
+			memcpy((void*)(buffers[copy] + 1), packet.data, packet.size);
+		}
+		references[copy]++;
+
+		SteamNetworkingMessage_t *message = utils->AllocateMessage(0); // Just the message, the payload is shared.
+		message->m_pData = buffers[copy] + 1;
+		message->m_cbSize = (int)packet.size;
+		message->m_conn = client.id;
+		message->m_nFlags = flags;
+		message->m_nUserData = (int64)(intptr_t)buffers[copy];
+		message->m_pfnFreeData = FreeBroadcastBuffer;
+		shard.broadcastMessages.push_back(message);
+	}
+
+	if (m_metrics.IsEnabled())
+	{
+		for (int i = 0; i < 2; i++)
+		{
+			if (recipients[i] > 0)
+				m_metrics.RecordSent(packets[i], encodings[i], recipients[i]);
+		}
+	}
+
+	if (shard.broadcastMessages.empty()) // No one to send to.
+		return;
+
+	for (int i = 0; i < 3; i++)
+	{
+		if (buffers[i])
+			buffers[i]->references.store(references[i], std::memory_order_relaxed);
+	}
+	m_interface->SendMessages((int)shard.broadcastMessages.size(), shard.broadcastMessages.data(), nullptr);
+}
+
+void BCNetServer::SendSnapshotOnShard(ServerShard &shard, uint32 sequence, bool reliable)
+{
+	BCNET_TRACE_SCOPE("SendSnapshotOnShard");
+	const std::shared_ptr<const Snapshot> snapshot = m_snapshots.Get(sequence);
+	if (!snapshot) // Already pushed out of the history by newer ones.
+		return;
+
+	// Most clients acknowledged the same snapshot, so each delta is only encoded once per baseline, encoding and compression.
+	struct EncodedSnapshot
+	{
+		uint32 baseline;
+		PacketEncoding encoding;
+		bool compression;
+		PooledPacket packet;
+		size_t size; // Before it was compressed.
+	};
+	std::vector<EncodedSnapshot> encoded;
+
+	for (const ClientInfo &client : shard.clients)
+	{
+		auto it = shard.snapshotAcks.find(client.id);
+		std::shared_ptr<const Snapshot> baseline = it != shard.snapshotAcks.end() ? m_snapshots.Get(it->second) : nullptr;
+		const uint32 baselineSequence = baseline ? baseline->sequence : 0; // 0 sends it in full.
+
+		auto found = std::find_if(encoded.begin(), encoded.end(),
+			[&](const EncodedSnapshot &other) { return other.baseline == baselineSequence && other.encoding == client.encoding && other.compression == client.compression; });
+		if (found == encoded.end())
+		{
+			PacketStreamWriter packetWriter(client.encoding);
+			packetWriter.Reserve(snapshot->data.GetSize() + 32);
+			packetWriter.WriteHeader((uint32_t)DefaultPacketID::PACKET_SNAPSHOT);
+			packetWriter.WriteRaw<uint32_t>(sequence);
+			packetWriter.WriteRaw<uint32_t>(baselineSequence);
+			if (!WriteDelta(packetWriter, baseline ? baseline->data.GetPacket() : Packet(), snapshot->data.GetPacket()))
+				return;
+
+			const Packet packet = packetWriter.GetPacket();
+			encoded.push_back({ baselineSequence, client.encoding, client.compression, PooledPacket(), packet.size });
+			if (!client.compression || !m_compressor.Compress(packet, encoded.back().packet))
+			{
+				encoded.back().packet.Allocate(packet.size);
+				memcpy(encoded.back().packet.GetData(), packet.data, packet.size);
+			}
+			found = encoded.end() - 1;
+		}
+
+		if (found->compression && m_metrics.IsEnabled()) // Already compressed, there's no header left to read when it's sent.
+			m_metrics.RecordSent((uint32_t)DefaultPacketID::PACKET_SNAPSHOT, found->size);
+		SendPacketToClient(client.id, found->packet, reliable);
+	}
+}
+
+bool BCNetServer::BatchPacket(ServerShard &shard, const ClientInfo &client, const Packet &packet, bool reliable, uint8_t sendFlags)
+{
+	MessageBatcher &batcher = shard.outboundBatches[client.id];
+	if (sendFlags != SEND_FLAG_NONE) // Urgent, send what came before it first so it doesn't get overtaken.
+	{
+		SendBatch(client, batcher, reliable);
+		return false;
+	}
+
+	const bool empty = batcher.IsEmpty();
+	if (!batcher.Add(packet, reliable, m_batchSize))
+	{
+		SendBatch(client, batcher, reliable); // Full, start another one.
+		if (!batcher.Add(packet, reliable, m_batchSize)) // Too big to batch.
+			return false;
+	}
+
+	if (empty)
+		shard.batchedConnections.push_back(client.id);
+	return true;
+}
+
+void BCNetServer::SendBatch(const ClientInfo &client, MessageBatcher &batcher, bool reliable)
+{
+	BCNET_TRACE_SCOPE("SendBatch");
+	PooledPacket batch;
+	if (!batcher.Build(reliable, batch))
+		return;
+
+	PooledPacket compressed; // Compressed as a whole, small packets compress better together.
+	if (client.compression)
+		m_compressor.Compress(batch.GetPacket(), compressed);
+
+	const Packet &sent = compressed ? compressed.GetPacket() : batch.GetPacket();
+	m_interface->SendMessageToConnection(client.id, sent.data, (uint32)sent.size, GetSendFlags(reliable, SEND_FLAG_NONE), nullptr);
+}
+
+void BCNetServer::FlushConnection(ServerShard &shard, uint32 clientID)
+{
+	const ClientInfo *client = FindClient(shard, clientID);
+	auto it = shard.outboundBatches.find(clientID);
+	if (client && it != shard.outboundBatches.end())
+	{
+		SendBatch(*client, it->second, true);
+		SendBatch(*client, it->second, false);
+	}
+
+	m_interface->FlushMessagesOnConnection(clientID); // Don't let Nagle's timer hold the tick back.
+}
+
+void BCNetServer::FlushBatches(ServerShard &shard)
+{
+	BCNET_TRACE_SCOPE("FlushBatches");
+	for (uint32 clientID : shard.batchedConnections)
+		FlushConnection(shard, clientID);
+	shard.batchedConnections.clear();
+}
+
+void BCNetServer::FlushMessagesOnConnection(uint32 clientID)
+{
+	if (m_shards.empty()) // Not running.
+		return;
+
+	ServerShard *shard = GetCurrentShard();
+	if (shard && FindClient(*shard, clientID))
+	{
+		FlushConnection(*shard, clientID);
+		return;
+	}
+
+	const unsigned int owner = GetClientShard(clientID);
+	if (owner < m_shards.size())
+		PushShardRequest(*m_shards[owner], MakeShardRequest(ShardRequest::Type::FLUSH, clientID));
+}
+
+void BCNetServer::FlushMessages()
+{
+	for (auto &shard : m_shards)
+		RouteShardRequest(*shard, MakeShardRequest(ShardRequest::Type::FLUSH, 0));
+}
+
+uint32 BCNetServer::BeginTransfer(uint32 clientID, const Packet &data, uint32 tag)
+{
+	OutgoingTransfer transfer;
+	transfer.info.tag = tag;
+	transfer.info.size = data.size;
+	transfer.data = (const uint8_t*)data.data;
+	return StartTransfer(clientID, std::move(transfer));
+}
+
+uint32 BCNetServer::BeginTransfer(uint32 clientID, const std::string &filePath, uint32 tag)
+{
+	std::unique_ptr<MappedFile> file = std::make_unique<MappedFile>();
+	if (!file->Open(filePath))
+	{
+		Log("Error: Could not open " + filePath + " to transfer it!");
+		return 0;
+	}
+
+	OutgoingTransfer transfer;
+	transfer.info.tag = tag;
+	transfer.info.size = file->GetSize();
+	transfer.data = file->GetData();
+	transfer.file = std::move(file);
+	return StartTransfer(clientID, std::move(transfer));
+}
+
+void BCNetServer::CancelTransfer(uint32 clientID, uint32 transferID, bool incoming)
+{
+	if (m_shards.empty()) // Not running.
+		return;
+
+	const unsigned int owner = GetClientShard(clientID);
+	if (owner >= m_shards.size()) // They're not connected.
+		return;
+
+	ShardRequest request = MakeShardRequest(ShardRequest::Type::CANCEL_TRANSFER, clientID);
+	request.sequence = transferID;
+	request.incoming = incoming;
+	RouteShardRequest(*m_shards[owner], std::move(request));
+}
+
+uint32 BCNetServer::StartTransfer(uint32 clientID, OutgoingTransfer &&transfer)
+{
+	if (m_shards.empty() || m_shouldQuit) // Not running.
+		return 0;
+
+	const unsigned int owner = GetClientShard(clientID);
+	if (owner >= m_shards.size()) // They're not connected.
+		return 0;
+
+	uint32 id = m_nextTransferID++;
+	if (id == 0) // Wrapped around, 0 means it didn't start.
+		id = m_nextTransferID++;
+	transfer.info.id = id;
+
+	ShardRequest request = MakeShardRequest(ShardRequest::Type::TRANSFER, clientID);
+	request.transfers = std::make_unique<TransferManager>();
+	request.transfers->Add(std::move(transfer));
+	RouteShardRequest(*m_shards[owner], std::move(request));
+	return id;
+}
+
+TransferManager &BCNetServer::GetTransfers(ServerShard &shard, uint32 clientID)
+{
+	std::unique_ptr<TransferManager> &transfers = shard.transfers[clientID];
+	if (!transfers)
+		transfers = std::make_unique<TransferManager>();
+	return *transfers;
+}
+
+bool BCNetServer::PumpTransfers(ServerShard &shard)
+{
+	BCNET_TRACE_SCOPE("PumpTransfers");
+	shard.closedTransfers.clear(); // Nothing further up is using them anymore.
+	if (shard.transfers.empty())
+		return false;
+
+	// Gathered first, the callbacks could start transfers to other clients.
+	shard.transferConnections.clear();
+	for (auto it = shard.transfers.begin(); it != shard.transfers.end(); )
+	{
+		if (it->second->IsEmpty()) // Nothing going on, it'll be made again if something starts.
+		{
+			it = shard.transfers.erase(it);
+			continue;
+		}
+
+		if (it->second->HasOutgoing())
+			shard.transferConnections.push_back(it->first);
+		it++;
+	}
+
+	bool sent = false;
+	for (uint32 clientID : shard.transferConnections)
+	{
+		auto it = shard.transfers.find(clientID);
+		const ClientInfo *client = FindClient(shard, clientID);
+		if (it == shard.transfers.end() || !client)
+			continue;
+
+		// Only top up what's waiting to go out, the rest waits for GameNetworkingSockets to drain it at the connection's send rate.
+		SteamNetConnectionRealTimeStatus_t status;
+		if (m_interface->GetConnectionRealTimeStatus(clientID, &status, 0, nullptr) != k_EResultOK)
+			continue;
+
+		const size_t pending = (size_t)status.m_cbPendingReliable + (size_t)status.m_cbPendingUnreliable;
+		if (pending >= m_transferWindow)
+			continue;
+
+		TransferManager *transfers = it->second.get(); // Stays alive through the pump even if a callback removes them, see closedTransfers.
+		ClientTransfers connection(*this, *client);
+		sent |= transfers->Pump(connection, client->encoding, m_transferWindow - pending, m_transferChunkSize);
+	}
+
+	return sent;
+}
+
+void BCNetServer::FailTransfers(ServerShard &shard, const ClientInfo &client)
+{
+	auto it = shard.transfers.find(client.id);
+	if (it == shard.transfers.end())
+		return;
+
+	shard.closedTransfers.push_back(std::move(it->second));
+	shard.transfers.erase(it);
+
+	ClientTransfers connection(*this, client);
+	shard.closedTransfers.back()->Fail(connection);
+}
+
+void BCNetServer::SampleStats(ServerShard &shard)
+{
+	BCNET_TRACE_SCOPE("SampleStats");
+	for (size_t i = 0; i < shard.clients.GetSize(); i++)
+	{
+		const uint32 clientID = shard.clients.begin()[i].id;
+
+		SteamNetConnectionRealTimeStatus_t status;
+		if (m_interface->GetConnectionRealTimeStatus(clientID, &status, 0, nullptr) != k_EResultOK)
+			continue; // Closing, they're removed once the state change comes through.
+
+		shard.stats.Store(shard.clients.GetHandle(i).index, clientID, MakeConnectionStats(status));
+	}
+}
+
+void BCNetServer::ClientTransfers::SendTransferPacket(const Packet &packet)
+{
+	m_server.SendPacketToClient(m_client.id, packet, true);
+}
+
+bool BCNetServer::ClientTransfers::OnTransferStarted(const TransferInfo &info, Packet &destination)
+{
+	if (m_server.m_transferStartedCallback)
+		return m_server.m_transferStartedCallback(m_client, info, destination); // Do callback.
+
+	return (bool)m_server.m_transferCompletedCallback; // Someone has to take it.
+}
+
+void BCNetServer::ClientTransfers::OnTransferChunk(const TransferInfo &info, const Packet &chunk)
+{
+	if (m_server.m_transferChunkCallback)
+		m_server.m_transferChunkCallback(m_client, info, chunk); // Do callback.
+}
+
+void BCNetServer::ClientTransfers::OnTransferProgress(const TransferInfo &info)
+{
+	if (m_server.m_transferProgressCallback)
+		m_server.m_transferProgressCallback(m_client, info); // Do callback.
+}
+
+void BCNetServer::ClientTransfers::OnTransferCompleted(const TransferInfo &info, TransferResult result, const Packet &data)
+{
+	if (m_server.m_transferCompletedCallback)
+		m_server.m_transferCompletedCallback(m_client, info, result, data); // Do callback.
+}
+
+void BCNetServer::SendServerMessage(const ClientInfo &client, const std::string &message)
+{
+	PacketStreamWriter packetWriter(client.encoding);
+	packetWriter.WriteHeader((uint32_t)DefaultPacketID::PACKET_SERVER);
+	packetWriter.WriteString(message);
+
+	SendPacketToClient(client.id, packetWriter.GetPacket());
+}
+
+void BCNetServer::BroadcastServerMessage(const std::string &message, uint32 excludeID)
+{
+	PacketStreamWriter standardWriter(PacketEncoding::STANDARD);
+	standardWriter.WriteHeader((uint32_t)DefaultPacketID::PACKET_SERVER);
+	standardWriter.WriteString(message);
+
+	PacketStreamWriter compactWriter(PacketEncoding::COMPACT);
+	compactWriter.WriteHeader((uint32_t)DefaultPacketID::PACKET_SERVER);
+	compactWriter.WriteString(message);
+
+	SendEncodedPacketToAllClients(standardWriter.GetPacket(), compactWriter.GetPacket(), excludeID);
+}
+
+bool BCNetServer::RenameClient(ClientInfo &client, const std::string &nick)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutexNickNames);
+
+		auto it = m_nickNames.find(nick);
+		if (it != m_nickNames.end())
+			return it->second == client.id; // Already theirs.
+
+		auto itOld = m_nickNames.find(client.nickName);
+		if (itOld != m_nickNames.end() && itOld->second == client.id)
+			m_nickNames.erase(itOld);
+		m_nickNames[nick] = client.id;
+	}
+
+	client.nickName = nick;
+	m_interface->SetConnectionName(client.id, nick.c_str());
+	return true;
+}
+
+void BCNetServer::RemoveClient(ServerShard &shard, uint32 clientID)
+{
+	const SlotHandle handle = GetClientHandle(shard, clientID, m_interface->GetConnectionUserData(clientID));
+	const ClientInfo *client = shard.clients.Get(handle);
+	if (!client)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutexNickNames);
+
+		auto it = m_nickNames.find(client->nickName);
+		if (it != m_nickNames.end() && it->second == clientID)
+			m_nickNames.erase(it);
+	}
+
+	const ClientInfo removed = *client;
+
+	shard.clients.Remove(handle);
+	shard.stats.Clear(handle.index);
+	shard.snapshotAcks.erase(clientID);
+	shard.outboundBatches.erase(clientID);
+	shard.revision++;
+	shard.load--;
+	m_clientCount--;
+
+	FailTransfers(shard, removed); // Last, the callbacks could do anything.
+}
+
+// Hands a client over to another shard, runs on the shard giving it up.
+void BCNetServer::MigrateClient(ServerShard &shard, ServerShard &target)
+{
+	if (shard.clients.IsEmpty())
+		return;
+
+	const SlotHandle handle = shard.clients.GetHandle(shard.clients.GetSize() - 1); // Whoever's last, it's the cheapest to remove.
+	const ClientInfo client = *shard.clients.Get(handle);
+
+	FlushConnection(shard, client.id); // Anything batched goes before whatever the target sends them.
+	shard.outboundBatches.erase(client.id);
+
+	uint32 acknowledged = 0;
+	auto it = shard.snapshotAcks.find(client.id);
+	if (it != shard.snapshotAcks.end())
+	{
+		acknowledged = it->second;
+		shard.snapshotAcks.erase(it);
+	}
+
+	std::unique_ptr<TransferManager> transfers;
+	auto transfersIt = shard.transfers.find(client.id);
+	if (transfersIt != shard.transfers.end())
+	{
+		transfers = std::move(transfersIt->second);
+		shard.transfers.erase(transfersIt);
+	}
+
+	shard.clients.Remove(handle);
+	shard.stats.Clear(handle.index); // The target has them from it's next tick.
+	shard.revision++;
+	shard.load--;
+	target.load++;
+
+	// Owned by the target from here, but without a slot until it picks up the hand over.
+	// Set before the hand over is queued so the target's own update always lands last.
+	SetClientUserData(target.index, client.id, SlotHandle());
+
+	// The target has to know about them before any of their messages show up in it's poll group.
+	ShardRequest request = MakeShardRequest(ShardRequest::Type::ADD_CLIENT, client.id, Packet(client.nickName.data(), client.nickName.size()));
+	request.encoding = client.encoding;
+	request.compression = client.compression;
+	request.batching = client.batching;
+	request.sequence = acknowledged;
+	request.transfers = std::move(transfers);
+	PushShardRequest(target, std::move(request));
+
+	m_interface->SetConnectionPollGroup(client.id, target.pollGroup); // Messages that haven't been received yet move with them.
+}
+
+bool BCNetServer::PollNetworkMessages(ServerShard &shard)
+{
+	BCNET_TRACE_SCOPE("PollNetworkMessages");
+	const bool batching = (bool)m_packetBatchReceivedCallback;
+	const bool offloading = m_handlerExecutor.IsRunning();
+	bool received = false;
+	shard.receiveMessages.resize(m_receiveBatchSize);
+
+	while (m_networking)
+	{
+		int numMsgs = m_interface->ReceiveMessagesOnPollGroup(shard.pollGroup, shard.receiveMessages.data(), (int)shard.receiveMessages.size()); // Get incoming packets.
+		if (numMsgs == 0)
+		{
+			break; // Break because no packets.
+		}
+		if (numMsgs < 0)
+		{
+			Log("Error whilst polling incoming messages");
+			m_networking = false;
+			break;
+		}
+		received = true;
+
+		if (batching || offloading) // Group the batch by connection, keeping the order each client's messages arrived in.
+		{
+			std::stable_sort(shard.receiveMessages.begin(), shard.receiveMessages.begin() + numMsgs,
+				[](const SteamNetworkingMessage_t *a, const SteamNetworkingMessage_t *b) { return a->m_conn < b->m_conn; });
+		}
+
+		ClientInfo *client = nullptr; // The client who sent the packet.
+		unsigned int revision = shard.revision;
+		bool drained = false; // Whether hand overs have been picked up since these were received.
+		for (int i = 0; i < numMsgs; i++)
+		{
+			ReceivedMessage message(shard.receiveMessages[i]); // Releases the message once nothing references it anymore.
+
+			if (revision != shard.revision) // Clients were added or removed, the cached pointer could have moved.
+			{
+				client = nullptr;
+				revision = shard.revision;
+			}
+
+			if (!client || client->id != message.GetConnection()) // Only look the client up when the sender changes.
+			{
+				client = shard.clients.Get(GetClientHandle(shard, message.GetConnection(), message.GetConnectionUserData())); // The slot is in the connection's user data, no searching.
+				if (!client) // Just moved over from another shard, pick up the hand over first.
+				{
+					if (!drained) // Their hand over was queued before any of these could arrive, once covers everyone in the batch.
+					{
+						drained = true;
+						DrainShardRequests(shard);
+						revision = shard.revision;
+					}
+					client = FindClient(shard, message.GetConnection()); // The user data the message came with is from before the hand over.
+					if (!client)
+						continue;
+				}
+			}
+
+			if (!message.GetSize()) // Packet isn't valid.
+				continue;
+
+			if (!client->batching || !MessageBatcher::IsBatch(message.GetPacket()))
+			{
+				HandleClientMessage(shard, *client, message, offloading, batching);
+				continue;
+			}
+
+			if (client->compression && PacketCompressor::IsCompressed(message.GetPacket()) && !m_compressor.Decompress(message)) // The whole batch was compressed.
+			{
+				Log("Dropped a corrupt compressed packet from " + client->nickName + ".");
+				continue;
+			}
+
+			if (!MessageBatcher::Unpack(message, shard.unbatchedMessages))
+			{
+				Log("Dropped a malformed batch from " + client->nickName + ".");
+				continue;
+			}
+
+			const uint32 clientID = client->id;
+			for (ReceivedMessage &unbatched : shard.unbatchedMessages) // Each one as if it came on it's own.
+			{
+				if (revision != shard.revision) // A handler kicked or moved them.
+				{
+					revision = shard.revision;
+					client = FindClient(shard, clientID);
+					if (!client)
+						break;
+				}
+
+				HandleClientMessage(shard, *client, unbatched, offloading, batching);
+			}
+			shard.unbatchedMessages.clear();
+		}
+
+		// Hand each client's messages over in one go.
+		for (size_t first = 0; first < shard.receiveBatch.size(); )
+		{
+			const uint32 clientID = shard.receiveBatch[first].GetConnection();
+
+			size_t last = first + 1;
+			while (last < shard.receiveBatch.size() && shard.receiveBatch[last].GetConnection() == clientID)
+				last++;
+
+			client = FindClient(shard, clientID);
+			if (client)
+			{
+				if (offloading)
+					PostClientMessages(*client, &shard.receiveBatch[first], last - first);
+				else
+					m_packetBatchReceivedCallback(*client, &shard.receiveBatch[first], last - first); // Do callback.
+			}
+
+			first = last;
+		}
+		shard.receiveBatch.clear();
+
+		if ((size_t)numMsgs < shard.receiveMessages.size()) // Drained everything that was waiting.
+			break;
+	}
+
+	return received;
+}
+
+void BCNetServer::HandleClientMessage(ServerShard &shard, ClientInfo &client, ReceivedMessage &message, bool offloading, bool batching)
+{
+	if (client.compression && PacketCompressor::IsCompressed(message.GetPacket()) && !m_compressor.Decompress(message)) // Swapped for the decompressed copy.
+	{
+		Log("Dropped a corrupt compressed packet from " + client.nickName + ".");
+		return;
+	}
+
+	Packet packet = message.GetPacket();
+
+	uint32_t id = 0;
+	PacketStreamReader packetReader(packet, 0, client.encoding);
+	packetReader.ReadHeader(id);
+
+	if (m_metrics.IsEnabled())
+		m_metrics.RecordReceived(id, packet.size);
+	HandlerTimer timer(m_metrics, id, message, GetMessagePing(message));
+
+	if (HandleDefaultPacket(client, (DefaultPacketID)id, packetReader))
+		return;
 
-	m_listenSocket = m_interface->CreateListenSocketIP(localAddr, 1, &options);
-	if (m_listenSocket == k_HSteamListenSocket_Invalid)
+	if (offloading) // The workers run the callbacks.
 	{
-		std::cout << "Failed to listen on port " << localAddr.m_port << std::endl;
-		std::cout << "Error: Invalid Listen Socket" << std::endl;
+		timer.Cancel(); // They time it themselves.
+		shard.receiveBatch.push_back(std::move(message));
 		return;
 	}
 
-	m_pollGroup = m_interface->CreatePollGroup();
-	if (m_pollGroup == k_HSteamNetPollGroup_Invalid)
+	if (DispatchPacket(client, id, packetReader))
+		return;
+
+	if (batching) // The batch callback takes it instead.
 	{
-		std::cout << "Failed to listen on port " << localAddr.m_port << std::endl;
-		std::cout << "Error: Invalid Poll Group" << std::endl;
+		shard.receiveBatch.push_back(std::move(message));
 		return;
 	}
 
-	Log("Server started..");
+	if (m_packetReceivedCallback)
+		m_packetReceivedCallback(client, packet); // Do callback.
+	if (m_messageReceivedCallback)
+		m_messageReceivedCallback(client, message); // Do callback.
+}
 
-	// Loop.
-	m_networking = true;
-	while (!m_shouldQuit)
+void BCNetServer::PostClientMessages(const ClientInfo &client, ReceivedMessage *messages, size_t count)
+{
+	std::vector<ReceivedMessage> job(std::make_move_iterator(messages), std::make_move_iterator(messages + count)); // One job per client per poll, not per message.
+
+	m_handlerExecutor.Post(client.id, [this, client, job = std::move(job)]() mutable
 	{
-		if (m_networking)
+		DispatchClientMessages(client, job.data(), job.size());
+	});
+}
+
+void BCNetServer::DispatchClientMessages(const ClientInfo &client, ReceivedMessage *messages, size_t count)
+{
+	BCNET_TRACE_SCOPE("Callbacks");
+	const bool batching = (bool)m_packetBatchReceivedCallback;
+	size_t batched = 0; // The ones the dispatcher didn't take are moved up to the front for the batch callback.
+	for (size_t i = 0; i < count; i++)
+	{
+		uint32_t id = 0;
+		PacketStreamReader packetReader(messages[i].GetPacket(), 0, client.encoding);
+		const bool readHeader = packetReader.ReadHeader(id);
+		HandlerTimer timer(m_metrics, id, messages[i], GetMessagePing(messages[i]));
+
+		if (m_packetDispatcher && readHeader && DispatchPacket(client, id, packetReader))
+			continue;
+
+		if (batching) // The batch callback takes it instead.
 		{
-			PollNetworkMessages();
-			PollConnectionStateChanges();
+			if (batched != i)
+				messages[batched] = std::move(messages[i]);
+			batched++;
+			continue;
 		}
-		HandleUserCommands();
-		m_networking = !m_shouldQuit;
-		std::this_thread::sleep_for(std::chrono::milliseconds(10)); // Might be fast?
-	}
 
-	// Quit.
-	Log("Closing all connections...");
-	for (auto [clientID, clientData] : m_connectedClients)
-	{
-		m_interface->CloseConnection(clientID, 0, "Server Shutdown", true);
+		if (m_packetReceivedCallback)
+			m_packetReceivedCallback(client, messages[i].GetPacket()); // Do callback.
+		if (m_messageReceivedCallback)
+			m_messageReceivedCallback(client, messages[i]); // Do callback.
 	}
-	m_connectedClients.clear();
-	m_clientCount = 0;
 
-	m_interface->CloseListenSocket(m_listenSocket);
-	m_listenSocket = k_HSteamListenSocket_Invalid;
+	if (batched > 0)
+		m_packetBatchReceivedCallback(client, messages, batched); // Do callback.
+}
 
-	m_interface->DestroyPollGroup(m_pollGroup);
-	m_pollGroup = k_HSteamNetPollGroup_Invalid;
+int BCNetServer::GetMessagePing(const ReceivedMessage &message) const
+{
+	if (!m_metrics.IsEnabled())
+		return 0;
 
-	std::this_thread::sleep_for(std::chrono::milliseconds(500)); // Wait a bit for all connections to close.
-	GameNetworkingSockets_Kill();
+	// The connection's user data says where it's stats are, see SetClientUserData.
+	const int64 userData = message.GetConnectionUserData();
+	const size_t shardIndex = (size_t)((uint64_t)userData >> USER_DATA_SHARD_SHIFT);
+	if (userData < 0 || shardIndex >= m_shards.size())
+		return 0;
 
-	Log("Server Shutting down..");
+	ConnectionStats stats;
+	return m_shards[shardIndex]->stats.Load((uint32_t)userData, message.GetConnection(), stats) ? stats.ping : 0;
 }
 
-void BCNetServer::PollNetworkMessages()
+// Hands a packet to the handler registered for it, returns true if there was one, even if the packet couldn't be decoded.
+bool BCNetServer::DispatchPacket(const ClientInfo &client, uint32_t id, PacketStreamReader &packetReader)
 {
-	while (m_networking)
-	{
-		ISteamNetworkingMessage *msg = nullptr;
+	ServerPacketDispatcher *dispatcher = m_packetDispatcher;
+	if (!dispatcher || !dispatcher->HasHandler(id))
+		return false;
 
-		int numMsgs = m_interface->ReceiveMessagesOnPollGroup(m_pollGroup, &msg, 1); // Get incoming packets.
-		if (numMsgs == 0)
+	if (!dispatcher->Dispatch(id, packetReader, client))
+		Log("Dropped a malformed packet (" + std::to_string(id) + ") from " + client.nickName + ".");
+
+	return true;
+}
+
+// Handles the packets the server deals with itself, returns true if the packet was handled.
+bool BCNetServer::HandleDefaultPacket(ClientInfo &client, DefaultPacketID id, PacketStreamReader &packetReader)
+{
+	switch (id)
+	{
+		case DefaultPacketID::PACKET_HANDSHAKE:
 		{
-			break; // Break because no packets.
-		}
-		if (numMsgs < 0)
+			uint8_t offered = (uint8_t)PacketEncoding::STANDARD;
+			packetReader.ReadRaw<uint8_t>(offered);
+
+			// Older clients stop after the encoding, or the compression.
+			uint8_t compressionOffered = 0;
+			uint32_t dictionaryID = 0;
+			uint8_t batchingOffered = 0;
+			packetReader.ReadRaw<uint8_t>(compressionOffered);
+			packetReader.ReadRaw<uint32_t>(dictionaryID);
+			packetReader.ReadRaw<uint8_t>(batchingOffered);
+			const bool wantsCompression = compressionOffered != 0;
+
+			const PacketEncoding agreed = (PacketEncoding)offered == PacketEncoding::COMPACT && m_packetEncoding == PacketEncoding::COMPACT ?
+				PacketEncoding::COMPACT : PacketEncoding::STANDARD;
+			const bool compression = agreed == PacketEncoding::COMPACT && wantsCompression && m_compressor.IsEnabled() &&
+				dictionaryID == m_compressor.GetDictionaryID(); // Compressed packets are flagged in the compact header, and need the same dictionary on both ends.
+
+			PacketStreamWriter packetWriter(PacketEncoding::STANDARD); // Always standard, they only switch once they've read it.
+			packetWriter.WriteHeader((uint32_t)DefaultPacketID::PACKET_HANDSHAKE);
+			packetWriter.WriteRaw<uint8_t>((uint8_t)agreed);
+			packetWriter.WriteRaw<uint8_t>(compression ? 1 : 0);
+			packetWriter.WriteRaw<uint8_t>(agreed == PacketEncoding::COMPACT ? 1 : 0); // Batched packets are flagged in the compact header too, we can unpack them.
+			SendPacketToClient(client.id, packetWriter.GetPacket());
+
+			client.encoding = agreed; // Everything they send after the handshake uses it.
+			client.compression = compression;
+			client.batching = agreed == PacketEncoding::COMPACT && batchingOffered != 0;
+		} return true;
+		case DefaultPacketID::PACKET_SNAPSHOT_ACK:
 		{
-			Log("Error whilst polling incoming messages");
-			m_networking = false;
-			break;
-		}
-		assert(numMsgs == 1 && msg);
+			ServerShard *shard = GetCurrentShard();
+			uint32_t sequence = 0;
+			if (!shard || !packetReader.ReadRaw<uint32_t>(sequence))
+				return true;
 
-		auto itClient = m_connectedClients.find(msg->m_conn); // The client who sent the packet.
-		assert(itClient != m_connectedClients.end());
+			if (sequence == 0) // They don't have the baseline they were sent, the next one goes in full.
+			{
+				uint32_t missing = 0;
+				auto it = shard->snapshotAcks.find(client.id);
+				if (packetReader.ReadRaw<uint32_t>(missing) && it != shard->snapshotAcks.end() && !IsNewerSnapshot(it->second, missing)) // Unless it's a late one and they've acknowledged a newer one since.
+					shard->snapshotAcks.erase(it);
+				return true;
+			}
 
-		if (msg->m_cbSize) // Packet is valid.
+			uint32 &acknowledged = shard->snapshotAcks[client.id];
+			if (acknowledged == 0 || IsNewerSnapshot(sequence, acknowledged)) // Acknowledgements aren't reliable, older ones can show up late.
+				acknowledged = sequence;
+		} return true;
+		case DefaultPacketID::PACKET_TRANSFER_BEGIN:
+		case DefaultPacketID::PACKET_TRANSFER_CHUNK:
+		case DefaultPacketID::PACKET_TRANSFER_END:
+		{
+			ServerShard *shard = GetCurrentShard();
+			if (!shard)
+				return true;
+
+			ClientTransfers connection(*this, client);
+			if (!GetTransfers(*shard, client.id).HandlePacket(connection, (uint32_t)id, packetReader, client.encoding))
+				Log("Dropped a malformed transfer packet from " + client.nickName + ".");
+		} return true;
+		case DefaultPacketID::PACKET_NICKNAME:
 		{
-			Packet packet(msg->m_pData, (size_t)msg->m_cbSize);
+			std::string message;
 
-			DefaultPacketID id;
-			PacketStreamReader packetReader(packet);
-			packetReader >> id;
-			
-			// Handle packet defaults.
-			switch (id)
+			std::string nickName;
+			packetReader >> nickName;
+			// TODO: Empty check doesn't really work properly.
+			if (!nickName.empty() || !std::all_of(nickName.begin(), nickName.end(), isspace)) // String isn't empty and string isn't just spaces.
 			{
-				case DefaultPacketID::PACKET_NICKNAME:
+				const std::string oldNickName = client.nickName;
+				if (nickName == oldNickName || !RenameClient(client, nickName)) // Checked and claimed in one go, clients on other shards could be after the same name.
 				{
-					Packet packet;
-					packet.Allocate(1024); // TODO: Could allocate less.
-
-					PacketStreamWriter packetWriter(packet);
-					packetWriter.WriteRaw<DefaultPacketID>(DefaultPacketID::PACKET_SERVER);
-
-					std::string nickName;
-					packetReader >> nickName;
-					// TODO: Empty check doesn't really work properly.
-					if (!nickName.empty() || !std::all_of(nickName.begin(), nickName.end(), isspace)) // String isn't empty and string isn't just spaces.
-					{
-						bool nickNameExists = false;
-						for (auto it = m_connectedClients.begin(); it != m_connectedClients.end(); it++)
-						{
-							if (it->second.nickName == nickName)
-							{
-								nickNameExists = true;
-								break;
-							}
-						}
-
-						if (nickNameExists)
-						{
-							packetWriter.WriteString(std::string("Set Nickname Failed: Another user already has this nickname!"));
-						}
-						else
-						{
-							std::string s(itClient->second.nickName + " is now " + nickName);
-							Log(s);
-							packetWriter.WriteString(s);
-
-							SetClientNickname(msg->m_conn, nickName);
-						}
-					}
-					else
-					{
-						packetWriter.WriteString(std::string("Set Nickname Failed: No Nickname Provided."));
-					}
-
-					SendPacketToAllClients(packetWriter.GetPacket()); // Tell other clients that their nickname has been changed.
-					packet.Release();
-				} continue;
-				case DefaultPacketID::PACKET_WHOSONLINE:
+					message = "Set Nickname Failed: Another user already has this nickname!";
+				}
+				else
 				{
-					std::string s = PrintConnectedUsers();
-					Packet packet;
-					packet.Allocate(1024);
-
-					PacketStreamWriter packetWriter(packet);
-					packetWriter.WriteRaw<DefaultPacketID>(DefaultPacketID::PACKET_SERVER);
-					packetWriter.WriteString(s);
-
-					SendPacketToClient(msg->m_conn, packet); // Tell client who's online.
-					packet.Release();
-				} continue;
+					message = oldNickName + " is now " + nickName;
+					Log(message);
+				}
+			}
+			else
+			{
+				message = "Set Nickname Failed: No Nickname Provided.";
 			}
 
-			if (m_packetReceivedCallback)
-				m_packetReceivedCallback(itClient->second, packet); // Do callback.
-		}
-
-		msg->Release(); // No longer needed.
+			BroadcastServerMessage(message); // Tell other clients that their nickname has been changed.
+		} return true;
+		case DefaultPacketID::PACKET_WHOSONLINE:
+		{
+			SendServerMessage(client, PrintConnectedUsers()); // Tell client who's online.
+		} return true;
+		default:
+		{
+		} return false;
 	}
 }
 
 void BCNetServer::PollConnectionStateChanges()
 {
+	BCNET_TRACE_SCOPE("RunCallbacks");
 	m_interface->RunCallbacks();
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutexStatusChanges);
+		m_handledStatusChanges.swap(m_statusChanges);
+	}
+	for (SteamNetConnectionStatusChangedCallback_t &change : m_handledStatusChanges) // In the order GameNetworkingSockets posted them.
+		OnSteamNetConnectionStatusChanged(&change);
+	m_handledStatusChanges.clear();
 }
 
 void BCNetServer::HandleUserCommands()
 {
+	BCNET_TRACE_SCOPE("HandleUserCommands");
 	std::string input;
 	while (!m_shouldQuit && GetNextCommand(input))
 	{	
@@ -407,6 +1745,8 @@ void BCNetServer::PushInputAsCommand(std::string input)
 	m_mutexCommandQueue.lock();
 	m_commandQueue.push(input);
 	m_mutexCommandQueue.unlock();
+
+	m_scheduler.Wake(); // Handle it now rather than next tick.
 }
 
 // Gathers all the commands into a string.
@@ -427,13 +1767,17 @@ std::string BCNetServer::PrintCommandList()
 // Gathers all the connected users into a string.
 std::string BCNetServer::PrintConnectedUsers()
 {
+	std::lock_guard<std::mutex> lock(m_mutexNickNames); // Every shard's clients are in here.
+
+	const size_t clientCount = m_nickNames.size();
+
 	std::stringstream ss;
-	ss << "Current Users [" << m_clientCount << "]: " << std::endl;
-	int i = 0;
-	for (auto [clientID, clientData] : m_connectedClients)
+	ss << "Current Users [" << clientCount << "]: " << std::endl;
+	size_t i = 0;
+	for (const auto &[nickName, clientID] : m_nickNames)
 	{
-		ss << clientData.nickName;
-		if (m_clientCount > 1 && i < m_clientCount - 1)
+		ss << nickName;
+		if (clientCount > 1 && i < clientCount - 1)
 			ss << ", ";
 		else
 			ss << " ";
@@ -442,54 +1786,197 @@ std::string BCNetServer::PrintConnectedUsers()
 	return ss.str();
 }
 
+bool BCNetServer::GetClientStats(uint32 clientID, ConnectionStats &stats)
+{
+	if (!m_networking)
+		return false;
+
+	const unsigned int shard = GetClientShard(clientID);
+	if (shard >= m_shards.size())
+		return false;
+
+	const uint32 index = (uint32)m_interface->GetConnectionUserData(clientID); // The slot, the shard checks it still belongs to them.
+	return m_shards[shard]->stats.Load(index, clientID, stats);
+}
+
+void BCNetServer::SetMetrics(bool enabled, const std::string &filePath, unsigned int intervalSeconds)
+{
+	m_metrics.SetExport(filePath, intervalSeconds);
+	m_metrics.SetEnabled(enabled);
+}
+
 void BCNetServer::SetClientNickname(uint32 clientID, const std::string &nick)
 {
-	m_connectedClients[clientID].nickName = nick;
-	m_interface->SetConnectionName(clientID, nick.c_str());
+	ServerShard *shard = GetCurrentShard();
+	if (!shard) // Let the network thread rename them.
+	{
+		if (!m_shards.empty())
+			PushShardRequest(*m_shards[0], MakeShardRequest(ShardRequest::Type::RENAME, clientID, Packet(nick.data(), nick.size())));
+		return;
+	}
+
+	ClientInfo *client = FindClient(*shard, clientID);
+	if (!client) // Belongs to another shard.
+	{
+		const unsigned int owner = GetClientShard(clientID);
+		if (owner < m_shards.size() && owner != shard->index)
+			PushShardRequest(*m_shards[owner], MakeShardRequest(ShardRequest::Type::RENAME, clientID, Packet(nick.data(), nick.size())));
+		return;
+	}
+
+	if (!RenameClient(*client, nick))
+		Log("Error: Could not rename client [" + std::to_string((int)clientID) + "] because " + nick + " is taken!");
+}
+
+void BCNetServer::SendPacketToClient(uint32 clientID, const Packet &packet, bool reliable, uint8_t sendFlags)
+{
+	BCNET_TRACE_SCOPE("SendPacketToClient");
+	ServerShard *shard = GetCurrentShard();
+	if (!shard) // Let the network thread send it.
+	{
+		if (!m_shards.empty())
+		{
+			ShardRequest request = MakeShardRequest(ShardRequest::Type::SEND, clientID, packet, reliable);
+			request.sendFlags = sendFlags;
+			PushShardRequest(*m_shards[0], std::move(request), m_batchSize == 0 || sendFlags != SEND_FLAG_NONE); // Batched packets can wait for the tick.
+		}
+		return;
+	}
+
+	PooledPacket compressed;
+	if (m_batchSize > 0 || m_metrics.IsEnabled() || m_compressor.ShouldCompress(packet))
+	{
+		const ClientInfo *client = FindClient(*shard, clientID);
+		const unsigned int owner = client ? shard->index : GetClientShard(clientID);
+		if (owner < m_shards.size() && owner != shard->index) // The shard that owns them keeps their batch and knows whether they take compressed packets.
+		{
+			ShardRequest request = MakeShardRequest(ShardRequest::Type::SEND, clientID, packet, reliable);
+			request.sendFlags = sendFlags;
+			PushShardRequest(*m_shards[owner], std::move(request), m_batchSize == 0 || sendFlags != SEND_FLAG_NONE);
+			return;
+		}
+
+		// The header's read in the encoding they agreed to. Only clients taking compressed packets can be sent one that's already compressed,
+		// like a shared snapshot which was counted before it was compressed, a standard header has no flags so it's first byte is part of the ID.
+		if (client && m_metrics.IsEnabled() && !(client->compression && PacketCompressor::IsCompressed(packet)))
+			m_metrics.RecordSent(packet, client->encoding);
+
+		if (client && client->batching && m_batchSize > 0 && BatchPacket(*shard, *client, packet, reliable, sendFlags)) // Goes out with the rest at the end of the tick.
+			return;
+
+		if (client && client->compression)
+			m_compressor.Compress(packet, compressed);
+	}
+
+	// Any shard can send to any connection, GameNetworkingSockets is thread safe.
+	const Packet &sent = compressed ? compressed.GetPacket() : packet;
+	EResult result = m_interface->SendMessageToConnection(clientID, sent.data, (uint32)sent.size, GetSendFlags(reliable, sendFlags), nullptr);
+}
+
+void BCNetServer::SendPacketToAllClients(const Packet &packet, uint32 excludeID, bool reliable, uint8_t sendFlags)
+{
+	SendEncodedPacketToAllClients(packet, packet, excludeID, reliable, sendFlags);
 }
 
-void BCNetServer::SendPacketToClient(uint32 clientID, const Packet &packet, bool reliable)
+void BCNetServer::SendEncodedPacketToAllClients(const Packet &standardPacket, const Packet &compactPacket, uint32 excludeID, bool reliable, uint8_t sendFlags)
 {
-	EResult result = m_interface->SendMessageToConnection(clientID, packet.data, (uint32)packet.size, reliable ? k_nSteamNetworkingSend_Reliable : k_nSteamNetworkingSend_Unreliable, nullptr);
+	const bool wake = m_batchSize == 0 || sendFlags != SEND_FLAG_NONE; // Batched packets can wait for the tick.
+
+	ServerShard *shard = GetCurrentShard();
+	if (!shard) // Let the network thread send it.
+	{
+		if (!m_shards.empty())
+		{
+			ShardRequest request = MakeBroadcastRequest(ShardRequest::Type::BROADCAST, standardPacket, compactPacket, excludeID, reliable);
+			request.sendFlags = sendFlags;
+			PushShardRequest(*m_shards[0], std::move(request), wake);
+		}
+		return;
+	}
+
+	for (auto &other : m_shards) // Every other shard sends to it's own clients.
+	{
+		if (other.get() != shard)
+		{
+			ShardRequest request = MakeBroadcastRequest(ShardRequest::Type::SHARD_BROADCAST, standardPacket, compactPacket, excludeID, reliable);
+			request.sendFlags = sendFlags;
+			PushShardRequest(*other, std::move(request), wake);
+		}
+	}
+
+	BroadcastOnShard(*shard, standardPacket, compactPacket, excludeID, reliable, sendFlags);
 }
 
-void BCNetServer::SendPacketToAllClients(const Packet &packet, uint32 excludeID, bool reliable)
+void BCNetServer::SendSnapshot(const Packet &snapshot, bool reliable)
 {
-	for (auto [clientID, clientData] : m_connectedClients)
+	if (m_shards.empty()) // Not running.
+		return;
+
+	if (snapshot.size > (size_t)k_cbMaxSteamNetworkingSocketsMessageSizeSend)
+	{
+		Log("Error: Could not send snapshot because it's bigger than " + std::to_string(k_cbMaxSteamNetworkingSocketsMessageSizeSend) + " bytes!");
+		return;
+	}
+
+	const uint32 sequence = m_snapshots.Push(snapshot);
+	for (auto &shard : m_shards) // Every shard encodes it for it's own clients.
 	{
-		if (clientID != excludeID)
-			SendPacketToClient(clientID, packet, reliable);
+		ShardRequest request = MakeShardRequest(ShardRequest::Type::SNAPSHOT, 0, Packet(), reliable);
+		request.sequence = sequence;
+		RouteShardRequest(*shard, std::move(request));
 	}
 }
 
 void BCNetServer::KickClient(uint32 clientID)
 {
-	auto it = m_connectedClients.find(clientID);
-	if (it == m_connectedClients.end())
+	ServerShard *shard = GetCurrentShard();
+	if (!shard) // Let the network thread kick them.
+	{
+		if (!m_shards.empty())
+			PushShardRequest(*m_shards[0], MakeShardRequest(ShardRequest::Type::KICK, clientID));
+		return;
+	}
+
+	const ClientInfo *client = FindClient(*shard, clientID);
+	if (!client)
 	{
+		const unsigned int owner = GetClientShard(clientID);
+		if (owner < m_shards.size() && owner != shard->index) // Belongs to another shard.
+		{
+			PushShardRequest(*m_shards[owner], MakeShardRequest(ShardRequest::Type::KICK, clientID));
+			return;
+		}
+
 		Log("Error: Could not kick client because ID [" + std::to_string((int)clientID) + "] is not connected!");
 		return;
 	}
 
-	Log("Kicked " + it->second.nickName + " [" + std::to_string((int)clientID) + "]");
+	Log("Kicked " + client->nickName + " [" + std::to_string((int)clientID) + "]");
 	m_interface->CloseConnection(clientID, 0, "Kicked by server", false);
 
-	m_connectedClients.erase(clientID);
-	m_clientCount--;
+	RemoveClient(*shard, clientID);
 }
 
 void BCNetServer::KickClient(const std::string &nickName)
 {
+	if (!GetCurrentShard()) // Let the network thread kick them.
+	{
+		if (!m_shards.empty())
+			PushShardRequest(*m_shards[0], MakeShardRequest(ShardRequest::Type::KICK_NICKNAME, 0, Packet(nickName.data(), nickName.size())));
+		return;
+	}
+
 	bool found = false;
 
 	HSteamNetConnection clientID;
-	for (auto it = m_connectedClients.begin(); it != m_connectedClients.end(); it++)
 	{
-		if (it->second.nickName == nickName) // There is a connection with that name.
+		std::lock_guard<std::mutex> lock(m_mutexNickNames);
+
+		auto it = m_nickNames.find(nickName);
+		if (it != m_nickNames.end()) // There is a connection with that name.
 		{
 			found = true;
-			clientID = it->first;
-			break;
+			clientID = it->second;
 		}
 	}
 
@@ -499,20 +1986,20 @@ void BCNetServer::KickClient(const std::string &nickName)
 		return;
 	}
 
-	Log("Kicked " + nickName + " [" + std::to_string((int)clientID) + "]");
-	m_interface->CloseConnection(clientID, 0, "Kicked by server", false);
-
-	m_connectedClients.erase(clientID);
-	m_clientCount--;
+	KickClient(clientID); // Handed to whichever shard owns them.
 }
 
 void BCNetServer::Log(std::string message)
 {
-	std::cout << message << std::endl;
+	{
+		std::lock_guard<std::mutex> lock(m_mutexOutputLog);
 
-	if ((m_outputLog.size() + 1) > m_maxOutputLog)
-		m_outputLog.pop(); // Removes oldest message.
-	m_outputLog.push(message); // Adds latest message.
+		std::cout << message << std::endl;
+
+		if ((m_outputLog.size() + 1) > m_maxOutputLog)
+			m_outputLog.pop(); // Removes oldest message.
+		m_outputLog.push(message); // Adds latest message.
+	}
 
 	if (m_outputLogCallback)
 		m_outputLogCallback(); // Do callback.
@@ -529,11 +2016,9 @@ void BCNetServer::OnSteamNetConnectionStatusChanged(SteamNetConnectionStatusChan
 		case k_ESteamNetworkingConnectionState_ProblemDetectedLocally:
 		{
 			// Handle client disconnection or local connection error.
+			const unsigned int owner = GetClientShard(pInfo->m_hConn);
 			if (pInfo->m_eOldState == k_ESteamNetworkingConnectionState_Connected) // Connection has been severed.
 			{
-				auto itClient = m_connectedClients.find(pInfo->m_hConn);
-				assert(itClient != m_connectedClients.end());
-
 				const char *debugAction;
 				if (pInfo->m_info.m_eState == k_ESteamNetworkingConnectionState_ProblemDetectedLocally)
 				{
@@ -546,22 +2031,6 @@ void BCNetServer::OnSteamNetConnectionStatusChanged(SteamNetConnectionStatusChan
 
 				Log("Connection " + std::string(pInfo->m_info.m_szConnectionDescription) + " " + std::string(debugAction) + ", " +
 					std::to_string(pInfo->m_info.m_eEndReason) + ": " + std::string(pInfo->m_info.m_szEndDebug));
-
-				Packet packet;
-				packet.Allocate(1024);
-
-				PacketStreamWriter packetWriter(packet);
-				packetWriter.WriteRaw<DefaultPacketID>(DefaultPacketID::PACKET_SERVER);
-				packetWriter.WriteString(std::string(itClient->second.nickName + " has left."));
-
-				SendPacketToAllClients(packetWriter.GetPacket(), pInfo->m_hConn); // Tell other clients that they have left.
-				packet.Release();
-
-				if (m_disconnectedCallback)
-					m_disconnectedCallback(itClient->second); // Do callback.
-
-				m_connectedClients.erase(itClient);
-				m_clientCount--;
 			}
 			else
 			{
@@ -569,81 +2038,75 @@ void BCNetServer::OnSteamNetConnectionStatusChanged(SteamNetConnectionStatusChan
 				assert(pInfo->m_eOldState == k_ESteamNetworkingConnectionState_Connecting);
 			}
 
-			m_interface->CloseConnection(pInfo->m_hConn, 0, nullptr, false);
+			if (owner >= m_shards.size()) // Never got as far as a shard.
+			{
+				m_interface->CloseConnection(pInfo->m_hConn, 0, nullptr, false);
+				break;
+			}
+
+			// The owning shard closes the connection once it's let go of them.
+			ShardRequest request = MakeShardRequest(ShardRequest::Type::REMOVE_CLIENT, pInfo->m_hConn);
+			request.announce = pInfo->m_eOldState == k_ESteamNetworkingConnectionState_Connected;
+			RouteShardRequest(*m_shards[owner], std::move(request));
 		} break;
 		case k_ESteamNetworkingConnectionState_Connecting:
 		{
 			// Handle incoming connections.
-			assert(m_connectedClients.find(pInfo->m_hConn) == m_connectedClients.end());
+			assert(GetClientShard(pInfo->m_hConn) >= m_shards.size());
 
 			Log("Incoming connection " + std::string(pInfo->m_info.m_szConnectionDescription));
 
-			if (m_interface->AcceptConnection(pInfo->m_hConn) != k_EResultOK)
+			if (pInfo->m_info.m_hListenSocket != k_HSteamListenSocket_Invalid && m_interface->AcceptConnection(pInfo->m_hConn) != k_EResultOK) // Loopback connections are already connected.
 			{
 				m_interface->CloseConnection(pInfo->m_hConn, 0, nullptr, false);
 				Log("Incoming connection failed. (was it already closed?)");
 				break;
 			}
 
-			if (!m_interface->SetConnectionPollGroup(pInfo->m_hConn, m_pollGroup))
+			ServerShard &shard = *m_shards[ChooseShard()];
+			if (!m_interface->SetConnectionPollGroup(pInfo->m_hConn, shard.pollGroup))
 			{
 				m_interface->CloseConnection(pInfo->m_hConn, 0, nullptr, false);
 				Log("Failed to set poll group on incoming connection.");
 				break;
 			}
 
-			if ((m_clientCount + 1) > m_maxClients) // Handle too many clients.
+			if ((m_clientCount + 1) > (int)m_maxClients) // Handle too many clients.
 			{
 				m_interface->CloseConnection(pInfo->m_hConn, 0, "Server is full!", false);
 				Log("Server is full!");
 				break;
 			}
 
-			auto &client = m_connectedClients[pInfo->m_hConn]; // Add client to map and get reference.
-
 			// Setup client defaults.
+			ClientInfo client;
 			client.id = pInfo->m_hConn;
 
-			std::string nick = ("User " + std::to_string(m_clientCount));
-			SetClientNickname(pInfo->m_hConn, nick);
+			for (int i = m_clientCount; ; i++) // Find a free default nickname.
+			{
+				if (RenameClient(client, "User " + std::to_string(i)))
+					break;
+			}
 
 			m_clientCount++;
+			shard.load++;
+			SetClientUserData(shard.index, pInfo->m_hConn, SlotHandle()); // The shard fills in the slot when it picks them up.
+			RouteShardRequest(shard, MakeShardRequest(ShardRequest::Type::ADD_CLIENT, client.id, Packet(client.nickName.data(), client.nickName.size())));
 
-			if (m_connectedCallback)
-				m_connectedCallback(client); // Do callback.
+			if (m_connectedCallback) // Ahead of any of their packets.
+				m_handlerExecutor.Post(pInfo->m_hConn, [this, client]() { m_connectedCallback(client); }); // Do callback.
 
 		} break;
 		case k_ESteamNetworkingConnectionState_Connected:
 		{
-			auto itClient = m_connectedClients.find(pInfo->m_hConn);
-			//assert(itClient != m_connectedClients.end());
-			if (itClient == m_connectedClients.end())
+			if (GetClientShard(pInfo->m_hConn) >= m_shards.size())
 				break;
 
 			// Handle on client connected.
 			Log("Client connected. " + std::string(pInfo->m_info.m_szConnectionDescription));
 
-			// Relay connection info.
-			std::string userList = PrintConnectedUsers();
-			Log(userList);
-
-			std::string peerText(itClient->second.nickName + " has connected!");
-
-			// Send who's currently connected to client.
-			Packet packet;
-			packet.Allocate(1024); // TODO: allocation could probably be less.
-			PacketStreamWriter packetWriter(packet);
-			packetWriter.WriteRaw<DefaultPacketID>(DefaultPacketID::PACKET_SERVER);
-			packetWriter.WriteString(userList);
-			SendPacketToClient(pInfo->m_hConn, packetWriter.GetPacket());
-
-			// Update peers on the new connection.
-			packet.Zero(); // Reuse instead of reallocating.
-			packetWriter = PacketStreamWriter(packet); // Reinit
-			packetWriter.WriteRaw<DefaultPacketID>(DefaultPacketID::PACKET_SERVER);
-			packetWriter.WriteString(peerText);
-			SendPacketToAllClients(packetWriter.GetPacket(), pInfo->m_hConn);
-			packet.Release();
+			// The owning shard knows their encoding, it sends the welcome.
+			RouteShardRequest(*m_shards[GetClientShard(pInfo->m_hConn)], MakeShardRequest(ShardRequest::Type::WELCOME, pInfo->m_hConn));
 		} break;
 		default:
 		{
@@ -653,7 +2116,35 @@ void BCNetServer::OnSteamNetConnectionStatusChanged(SteamNetConnectionStatusChan
 
 void BCNetServer::SteamNetConnectionStatusChangedCallback(SteamNetConnectionStatusChangedCallback_t *pInfo)
 {
-	s_callbackInstance->OnSteamNetConnectionStatusChanged(pInfo); // Handle callback.
+	s_callbackInstance->QueueStatusChange(*pInfo); // Handled by the main network thread, a client in the process could be the one running the callbacks.
+}
+
+void BCNetServer::QueueStatusChange(const SteamNetConnectionStatusChangedCallback_t &change)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutexStatusChanges);
+		m_statusChanges.push_back(change);
+	}
+	m_scheduler.Wake();
+}
+
+void BCNetServer::AcceptLoopbackClient(uint32 clientID)
+{
+	LoopbackRegistry::SetStatusCallback(clientID, BCNetServer::SteamNetConnectionStatusChangedCallback); // For when the client closes it's end.
+
+	// Socket pairs start out connected without a callback, so it's made up.
+	SteamNetConnectionStatusChangedCallback_t change;
+	memset(&change, 0, sizeof(change));
+	change.m_hConn = clientID;
+	m_interface->GetConnectionInfo(clientID, &change.m_info); // No listen socket, which is how it's told apart.
+
+	change.m_eOldState = k_ESteamNetworkingConnectionState_None;
+	change.m_info.m_eState = k_ESteamNetworkingConnectionState_Connecting;
+	QueueStatusChange(change);
+
+	change.m_eOldState = k_ESteamNetworkingConnectionState_Connecting;
+	change.m_info.m_eState = k_ESteamNetworkingConnectionState_Connected;
+	QueueStatusChange(change);
 }
 
 // Default commands.
@@ -718,3 +2209,132 @@ void BCNetServer::DoKickCommand(const std::string parameters) // /kick {-id [ID]
 		Log("Warning: Unknown parameter specified \"" + std::string(params[i]) + "\"");
 	}
 }
+
+void BCNetServer::DoStatsCommand(const std::string parameters) // /stats {-count [Count]} {-id [ID]}
+{
+	size_t count = 5;
+
+	int paramCount;
+	char *params[128];
+	ParseCommandParameters(parameters, &paramCount, params); // Get individual parameters.
+
+	for (int i = 0; i < paramCount; i++)
+	{
+		if (strcmp(params[i], "-count") == 0)
+		{
+			i++;
+			if (i >= paramCount || !StringIsNumber(params[i]))
+				continue;
+
+			count = (size_t)std::stoul(params[i]);
+			continue;
+		}
+		else if (strcmp(params[i], "-id") == 0) // Everything GameNetworkingSockets knows about the one connection.
+		{
+			i++;
+			if (i >= paramCount || !StringIsNumber(params[i]))
+				continue;
+
+			const uint32 id = (uint32)std::stoul(params[i]);
+			std::string details(4096, '\0');
+			int result = m_interface->GetDetailedConnectionStatus(id, &details[0], (int)details.size());
+			if (result > 0) // Too small, it says how much it needs.
+			{
+				details.assign((size_t)result, '\0');
+				result = m_interface->GetDetailedConnectionStatus(id, &details[0], (int)details.size());
+			}
+			if (result != 0)
+			{
+				Log("Error: No connection with ID " + std::to_string(id) + ".");
+				return;
+			}
+
+			details.resize(strlen(details.c_str()));
+			Log("Stats (ID: " + std::to_string(id) + "):");
+			Log(details);
+			return;
+		}
+
+		Log("Warning: Unknown parameter specified \"" + std::string(params[i]) + "\"");
+	}
+
+	// Straight from the shards' tables, the shards carry on while it's read.
+	std::vector<std::pair<uint32, ConnectionStats>> clients;
+	for (const auto &shard : m_shards)
+		shard->stats.ForEach([&clients](uint32_t clientID, const ConnectionStats &stats) { clients.emplace_back(clientID, stats); });
+
+	// Worst first, the longest queue is the link falling furthest behind, ping breaks ties between idle ones.
+	std::sort(clients.begin(), clients.end(), [](const std::pair<uint32, ConnectionStats> &a, const std::pair<uint32, ConnectionStats> &b)
+	{
+		if (a.second.queueTimeMicroseconds != b.second.queueTimeMicroseconds)
+			return a.second.queueTimeMicroseconds > b.second.queueTimeMicroseconds;
+		return a.second.ping > b.second.ping;
+	});
+	if (clients.size() > count)
+		clients.resize(count);
+
+	std::unordered_map<uint32, std::string> nickNames;
+	{
+		std::lock_guard<std::mutex> lock(m_mutexNickNames);
+		for (const auto &[nickName, clientID] : m_nickNames)
+			nickNames[clientID] = nickName;
+	}
+
+	Log("Connection Stats [" + std::to_string(clients.size()) + " of " + std::to_string(GetConnectedCount()) + "]:");
+	for (const auto &[clientID, stats] : clients)
+		Log("\t" + nickNames[clientID] + " (ID: " + std::to_string(clientID) + "): " + FormatConnectionStats(stats));
+}
+
+void BCNetServer::DoTraceCommand(const std::string parameters) // /trace {Duration} {-file [Path]}
+{
+	unsigned int milliseconds = 5000;
+	std::string path = "bcnet_trace_" + std::to_string((long long)time(nullptr)) + ".json";
+
+	int count;
+	char *params[128];
+	ParseCommandParameters(parameters, &count, params); // Get individual parameters.
+
+	for (int i = 0; i < count; i++)
+	{
+		if (strcmp(params[i], "-file") == 0)
+		{
+			i++;
+			if (i >= count)
+				continue;
+
+			path = params[i];
+			continue;
+		}
+		else if (ParseDuration(params[i], &milliseconds))
+		{
+			continue;
+		}
+
+		Log("Command usage: ");
+		Log("\t/trace [Duration, like 5s or 500ms] -file [Path]");
+		return;
+	}
+
+	if (m_tracing || !Tracer::Start())
+	{
+		Log("Error: Could not start tracing, a trace is already recording or tracing was compiled out.");
+		return;
+	}
+
+	m_tracing = true;
+	m_traceDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+	m_tracePath = path;
+	Log("Tracing for " + std::to_string(milliseconds) + "ms..");
+}
+
+void BCNetServer::UpdateTrace(bool finish)
+{
+	if (!m_tracing || (!finish && std::chrono::steady_clock::now() < m_traceDeadline))
+		return;
+
+	m_tracing = false;
+	if (Tracer::Stop(m_tracePath))
+		Log("Trace written to " + m_tracePath);
+	else
+		Log("Error: Could not write the trace to " + m_tracePath + ", or it was already stopped.");
+}
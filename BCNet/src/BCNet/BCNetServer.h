@@ -4,15 +4,35 @@
 
 #include <BCNet/IBCNetServer.h>
 #include <BCNet/BCNetPacket.h>
+#include <BCNet/BCNetMessage.h>
+#include <BCNet/BCNetPacketPool.h>
+
+#include "Misc/NetworkScheduler.h"
+#include "Misc/MPSCQueue.h"
+#include "Misc/HandlerExecutor.h"
+#include "Misc/SlotMap.h"
+#include "Misc/SnapshotHistory.h"
+#include "Misc/PacketCompressor.h"
+#include "Misc/MessageBatcher.h"
+#include "Misc/TransferManager.h"
+#include "Misc/StatsTable.h"
+#include "Misc/Tracer.h"
+#include "Misc/PacketMetrics.h"
 
 #include <string>
 #include <map>
+#include <unordered_map>
 #include <queue>
+#include <vector>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <memory>
+#include <chrono>
 
 // Foward Declare.
 struct SteamNetConnectionStatusChangedCallback_t;
+struct SteamNetworkingMessage_t;
 class ISteamNetworkingSockets;
 
 typedef unsigned int uint32;
@@ -30,17 +50,45 @@ namespace BCNet
 		virtual void Start(const int port = -1) override;
 		virtual void Stop() override;
 
+		virtual void SetConsoleInput(bool enabled) override { m_consoleInput = enabled; }
+		virtual void SetLoopbackOnly(bool enabled) override { m_loopbackOnly = enabled; }
+
 		virtual bool IsRunning() override { return !m_shouldQuit; }
 		virtual bool IsConnected() override { return m_networking; }
 
+		virtual void SetNetworkSchedule(NetworkScheduleMode mode, unsigned int tickRate = 100, unsigned int spinMicroseconds = 0) override;
+
 		virtual void SetMaxClients(unsigned int max) override { m_maxClients = max; }
-		virtual unsigned int GetConnectedCount() override { return m_clientCount; }
+		virtual unsigned int GetConnectedCount() override { return (unsigned int)m_clientCount.load(); }
+		virtual bool GetClientStats(uint32 clientID, ConnectionStats &stats) override;
 
 		virtual void SetConnectedCallback(const ServerConnectedCallback &callback) override;
 		virtual void SetDisconnectedCallback(const ServerDisconnectedCallback &callback) override;
 		virtual void SetPacketReceivedCallback(const ServerPacketReceivedCallback &callback) override;
+		virtual void SetMessageReceivedCallback(const ServerMessageReceivedCallback &callback) override;
+		virtual void SetPacketBatchReceivedCallback(const ServerPacketBatchReceivedCallback &callback) override;
+		virtual void SetPacketDispatcher(ServerPacketDispatcher *dispatcher) override;
+
+		virtual void SetReceiveBatchSize(unsigned int size) override { m_receiveBatchSize = size > 0 ? size : 1; }
+		virtual void SetHandlerThreads(unsigned int threadCount) override { m_handlerThreadCount = threadCount; }
+		virtual void SetShardCount(unsigned int count, ShardAssignment assignment = ShardAssignment::ROUND_ROBIN, bool rebalance = true) override;
+		virtual void SetPacketEncoding(PacketEncoding encoding) override { m_packetEncoding = encoding; }
+		virtual void SetCompression(bool enabled, unsigned int threshold = 128) override { m_compressor.SetEnabled(enabled, threshold); }
+		virtual void SetCompressionDictionary(const Packet &dictionary) override { m_compressor.SetDictionary(dictionary); }
+		virtual CompressionStats GetCompressionStats() override { return m_compressor.GetTotalStats(); }
+		virtual CompressionStats GetCompressionStats(uint32 packetID) override { return m_compressor.GetStats(packetID); }
 		virtual void SetOutputLogCallback(const ServerOutputLogCallback &callback) override;
 
+		virtual void SetTransferStartedCallback(const ServerTransferStartedCallback &callback) override;
+		virtual void SetTransferChunkCallback(const ServerTransferChunkCallback &callback) override;
+		virtual void SetTransferProgressCallback(const ServerTransferProgressCallback &callback) override;
+		virtual void SetTransferCompletedCallback(const ServerTransferCompletedCallback &callback) override;
+		virtual void SetTransferPacing(unsigned int chunkSize = 64 * 1024, unsigned int window = 256 * 1024) override;
+		virtual void SetMaxTransferSize(uint64_t maxSize = 64ull * 1024 * 1024, uint64_t maxIncoming = 256ull * 1024 * 1024) override;
+		virtual uint32 BeginTransfer(uint32 clientID, const Packet &data, uint32 tag = 0) override;
+		virtual uint32 BeginTransfer(uint32 clientID, const std::string &filePath, uint32 tag = 0) override;
+		virtual void CancelTransfer(uint32 clientID, uint32 transferID, bool incoming = false) override;
+
 		virtual std::string PrintCommandList() override;
 		virtual void AddCustomCommand(std::string command, ServerCommandCallback callback) override;
 
@@ -48,10 +96,25 @@ namespace BCNet
 
 		virtual std::string PrintConnectedUsers() override;
 
+		virtual bool StartTrace() override { return Tracer::Start(); }
+		virtual bool StopTrace(const std::string &filePath) override { return Tracer::Stop(filePath); }
+
+		virtual void SetMetrics(bool enabled, const std::string &filePath = "", unsigned int intervalSeconds = 10) override;
+		virtual void SetMetricsPacketName(uint32 packetID, const std::string &name) override { m_metrics.SetPacketName(packetID, name); }
+		virtual std::string GetMetrics() override { return m_metrics.Export("server"); }
+
 		virtual void SetClientNickname(uint32 clientID, const std::string &nick) override;
 
-		virtual void SendPacketToClient(uint32 clientID, const Packet &packet, bool reliable = true) override;
-		virtual void SendPacketToAllClients(const Packet &packet, uint32 excludeID = 0, bool reliable = true) override;
+		virtual void SendPacketToClient(uint32 clientID, const Packet &packet, bool reliable = true, uint8_t sendFlags = SEND_FLAG_NONE) override;
+		virtual void SendPacketToAllClients(const Packet &packet, uint32 excludeID = 0, bool reliable = true, uint8_t sendFlags = SEND_FLAG_NONE) override;
+		virtual void SendEncodedPacketToAllClients(const Packet &standardPacket, const Packet &compactPacket, uint32 excludeID = 0, bool reliable = true, uint8_t sendFlags = SEND_FLAG_NONE) override;
+
+		virtual void SetMessageBatching(bool enabled, unsigned int maxSize = 1200) override { m_batchSize = enabled ? maxSize : 0; }
+		virtual void FlushMessagesOnConnection(uint32 clientID) override;
+		virtual void FlushMessages() override;
+
+		virtual void SendSnapshot(const Packet &snapshot, bool reliable = false) override;
+		virtual void SetSnapshotHistory(unsigned int count) override { m_snapshots.SetCapacity(count); }
 
 		virtual void KickClient(uint32 clientID) override;
 		virtual void KickClient(const std::string &nickName) override;
@@ -63,12 +126,143 @@ namespace BCNet
 		virtual std::string GetLatestOutput() override;
 
 	private:
-		void DoNetworking(); // The main network thread function.
+		// Work for a shard's network thread, sends and kicks from other threads or clients handed over from another shard.
+		struct ShardRequest
+		{
+			enum class Type : unsigned char
+			{
+				SEND = 0,
+				BROADCAST, // Fans out to every shard.
+				SHARD_BROADCAST, // One shard's part of a broadcast.
+				KICK,
+				KICK_NICKNAME,
+				RENAME,
+				WELCOME, // Tells a newly connected client who's online and everyone else that they're here.
+				ADD_CLIENT, // Takes ownership of a client.
+				REMOVE_CLIENT, // The client's connection closed.
+				MIGRATE_CLIENT, // Hands one of the shard's clients over to another shard.
+				SNAPSHOT, // Sends a snapshot from the history to every client the shard owns.
+				FLUSH, // Sends a client's batched packets now, or every client's without a client ID.
+				TRANSFER, // Starts sending the transfers to a client.
+				CANCEL_TRANSFER
+			};
+
+			Type type = Type::SEND;
+			bool reliable = true;
+			uint8_t sendFlags = SEND_FLAG_NONE;
+			bool announce = false; // Whether a removal tells everyone the client left.
+			bool incoming = false; // Which way the transfer being cancelled is going.
+			uint32 clientID = 0; // Who to send to or kick, or who to exclude from a broadcast.
+			unsigned int shard = 0; // The shard to migrate to.
+			PacketEncoding encoding = PacketEncoding::STANDARD; // The encoding of a client being handed over.
+			bool compression = false; // Whether a client being handed over takes compressed packets.
+			bool batching = false; // Whether a client being handed over takes batched packets.
+			uint32 sequence = 0; // The snapshot to send, the last one a client being handed over acknowledged, or the transfer to cancel.
+			size_t compactOffset = 0; // Where the compact copy of a broadcast starts in the payload, 0 if both encodings share one copy.
+			PooledPacket payload; // A copy of the packet, or a nickname.
+			std::unique_ptr<TransferManager> transfers; // Transfers being started, or the transfers of a client being handed over.
+		};
+
+		// A poll group and the clients in it, drained by it's own network thread.
+		// Shard 0 runs on the main network thread, the others get a thread each.
+		struct ServerShard
+		{
+			BCNetServer *owner = nullptr;
+			unsigned int index = 0;
+			uint32 pollGroup = 0; // HSteamNetPollGroup
+			std::thread thread; // Unused by shard 0.
+
+			NetworkScheduler ownScheduler;
+			NetworkScheduler *scheduler = nullptr; // Shard 0 shares the server's.
+
+			MPSCQueue<ShardRequest> requests;
+			std::atomic<unsigned int> load{ 0 }; // Clients assigned to the shard, including ones still being handed over.
+
+			// Only touched by the shard's thread.
+			SlotMap<ClientInfo> clients; // Found through the slot handle in each connection's user data.
+			unsigned int revision = 0; // Bumped whenever clients are added or removed, so cached pointers know to look again.
+			std::vector<SteamNetworkingMessage_t *> receiveMessages; // Reused between polls.
+			std::vector<ReceivedMessage> receiveBatch; // Messages waiting for the batch callback.
+			std::vector<SteamNetworkingMessage_t *> broadcastMessages; // Reused between broadcasts.
+			std::vector<ReceivedMessage> unbatchedMessages; // Reused when unpacking batches.
+			std::unordered_map<uint32, MessageBatcher> outboundBatches; // <HSteamNetConnection, Packets waiting for the end of the tick>
+			std::vector<uint32> batchedConnections; // Connections with something batched this tick.
+			std::unordered_map<uint32, uint32> snapshotAcks; // <HSteamNetConnection, The last snapshot they acknowledged>
+			std::unordered_map<uint32, std::vector<ShardRequest>> arrivingRequests; // <HSteamNetConnection, Requests for a client still on their way to the shard, in order>
+			std::unordered_map<uint32, std::unique_ptr<TransferManager>> transfers; // <HSteamNetConnection, Transfers going either way>
+			std::vector<std::unique_ptr<TransferManager>> closedTransfers; // Kept until the end of the tick, a callback further up could still be using them.
+			std::vector<uint32> transferConnections; // Reused when pumping transfers.
+
+			StatsTable stats; // Each client's stats by slot index, written at the end of every tick and read from any thread.
+		};
+
+		// Runs a client's transfers through the server's transfer callbacks.
+		class ClientTransfers : public TransferConnection
+		{
+		public:
+			ClientTransfers(BCNetServer &server, const ClientInfo &client) : m_server(server), m_client(client) {}
+
+			virtual void SendTransferPacket(const Packet &packet) override;
+			virtual bool OnTransferStarted(const TransferInfo &info, Packet &destination) override;
+			virtual void OnTransferChunk(const TransferInfo &info, const Packet &chunk) override;
+			virtual void OnTransferProgress(const TransferInfo &info) override;
+			virtual void OnTransferCompleted(const TransferInfo &info, TransferResult result, const Packet &data) override;
+			virtual uint64_t GetMaxTransferSize() override { return m_server.m_maxTransferSize; }
+			virtual uint64_t GetMaxIncomingSize() override { return m_server.m_maxIncomingTransfers; }
+
+		private:
+			BCNetServer &m_server;
+			const ClientInfo m_client; // A copy, the callbacks could remove them.
+		};
 
-		void PollNetworkMessages(); // Handles incoming messages/packets.
+	private:
+		void DoNetworking(); // The main network thread function.
+		void DoShardNetworking(ServerShard &shard); // Network thread function for every other shard.
+
+		ServerShard *GetCurrentShard() const { return s_currentShard && s_currentShard->owner == this ? s_currentShard : nullptr; }
+		unsigned int GetClientShard(uint32 clientID); // Which shard owns the client, the shard count if no one does.
+		SlotHandle GetClientHandle(ServerShard &shard, uint32 clientID, int64_t userData); // Invalid unless the shard owns them.
+		ClientInfo *FindClient(ServerShard &shard, uint32 clientID); // Null unless the shard owns them.
+		unsigned int ChooseShard(); // Picks a shard for a new connection.
+		void RebalanceShards(); // Moves clients off busy shards.
+
+		ShardRequest MakeShardRequest(ShardRequest::Type type, uint32 clientID, const Packet &payload = Packet(), bool reliable = true);
+		ShardRequest MakeBroadcastRequest(ShardRequest::Type type, const Packet &standardPacket, const Packet &compactPacket, uint32 excludeID, bool reliable);
+		void RouteShardRequest(ServerShard &shard, ShardRequest &&request); // Handles it straight away on the shard's own thread, queues it otherwise.
+		void PushShardRequest(ServerShard &shard, ShardRequest &&request, bool wake = true); // Queues it and wakes the shard, unless it can wait for the next tick.
+		bool ForwardToOwner(ServerShard &shard, ShardRequest &request); // Sends a request on to the client's owner if it's moved, or holds it until they arrive, returns false if neither.
+		bool DrainShardRequests(ServerShard &shard); // Carries out queued requests, returns whether there were any.
+		void HandleShardRequest(ServerShard &shard, ShardRequest &request);
+
+		void BroadcastOnShard(ServerShard &shard, const Packet &standardPacket, const Packet &compactPacket, uint32 excludeID, bool reliable, uint8_t sendFlags); // Sends to every client the shard owns.
+		void SendSnapshotOnShard(ServerShard &shard, uint32 sequence, bool reliable); // Sends a snapshot to every client the shard owns, against their own baselines.
+		bool BatchPacket(ServerShard &shard, const ClientInfo &client, const Packet &packet, bool reliable, uint8_t sendFlags); // Returns false if it has to be sent on it's own.
+		void SendBatch(const ClientInfo &client, MessageBatcher &batcher, bool reliable);
+		void FlushConnection(ServerShard &shard, uint32 clientID); // Sends the client's batches and anything GameNetworkingSockets is holding back.
+		void FlushBatches(ServerShard &shard); // Sends every batch from this tick.
+		uint32 StartTransfer(uint32 clientID, OutgoingTransfer &&transfer); // Hands it to the shard that owns the client, returns it's ID.
+		TransferManager &GetTransfers(ServerShard &shard, uint32 clientID);
+		bool PumpTransfers(ServerShard &shard); // Sends as many chunks as each connection has room for, returns whether any were sent.
+		void FailTransfers(ServerShard &shard, const ClientInfo &client); // They've gone, everything going to or from them fails.
+		void SampleStats(ServerShard &shard); // Takes a snapshot of every client's connection stats.
+		void SendServerMessage(const ClientInfo &client, const std::string &message); // Sends a PACKET_SERVER message in the client's encoding.
+		void BroadcastServerMessage(const std::string &message, uint32 excludeID = 0); // Sends a PACKET_SERVER message to everyone in their encoding.
+		bool RenameClient(ClientInfo &client, const std::string &nick); // Returns false if someone else has the nickname.
+		void RemoveClient(ServerShard &shard, uint32 clientID); // Drops the client from the shard and the nickname index.
+		void SetClientUserData(unsigned int shard, uint32 clientID, SlotHandle handle); // Points the connection at it's owner.
+		void MigrateClient(ServerShard &shard, ServerShard &target);
+
+		bool PollNetworkMessages(ServerShard &shard); // Handles incoming messages/packets, returns whether anything was received.
 		void PollConnectionStateChanges(); // Handles connection state.
+		void PostClientMessages(const ClientInfo &client, ReceivedMessage *messages, size_t count); // Hands a client's messages to the handler workers.
+		void HandleClientMessage(ServerShard &shard, ClientInfo &client, ReceivedMessage &message, bool offloading, bool batching); // Runs the callbacks for one message, or queues it for the workers.
+		void DispatchClientMessages(const ClientInfo &client, ReceivedMessage *messages, size_t count); // Runs the callbacks for a client's messages.
+		bool HandleDefaultPacket(ClientInfo &client, DefaultPacketID id, PacketStreamReader &packetReader); // Handles packets the server deals with itself.
+		bool DispatchPacket(const ClientInfo &client, uint32_t id, PacketStreamReader &packetReader); // Hands a packet to it's handler, returns whether there was one.
+		int GetMessagePing(const ReceivedMessage &message) const; // The sender's last sampled ping, 0 while metrics are off or it hasn't been sampled.
 
 		void HandleUserCommands(); // Handles incoming commands.
+		void UpdateTrace(bool finish); // Writes out the trace /trace started once it's time is up, or straight away when finishing.
 		bool GetNextCommand(std::string &result);
 		// TODO: Should move into the utility header since it's the same in both the server and client classes.
 		void ParseCommand(const std::string &command, std::string *outCommand, std::string *outParams); // Utility.
@@ -76,15 +270,20 @@ namespace BCNet
 		// GameNetworkingSockets Callbacks.
 		void OnSteamNetConnectionStatusChanged(SteamNetConnectionStatusChangedCallback_t *pInfo); // Handles connection status.
 		static void SteamNetConnectionStatusChangedCallback(SteamNetConnectionStatusChangedCallback_t *pInfo);
+		void QueueStatusChange(const SteamNetConnectionStatusChangedCallback_t &change); // For the main network thread, from whichever thread ran the callbacks.
+		void AcceptLoopbackClient(uint32 clientID); // Goes through connecting and connected like any other connection.
 
 		// Default command implementations.
 		void DoQuitCommand(const std::string parameters);
 		void DoKickCommand(const std::string parameters);
+		void DoStatsCommand(const std::string parameters);
+		void DoTraceCommand(const std::string parameters);
 
 	private:
 		std::map<std::string, ServerCommandCallback> m_commandCallbacks;
 
 		std::queue<std::string> m_outputLog;
+		std::mutex m_mutexOutputLog; // Handler workers can log too.
 
 		std::mutex m_mutexCommandQueue; // Thread stuff.
 		std::queue<std::string> m_commandQueue;
@@ -92,25 +291,75 @@ namespace BCNet
 		std::thread m_networkThread; // Does networking stuff.
 		std::thread m_commandThread; // Does command stuff.
 
+		NetworkScheduler m_scheduler; // Paces the network thread.
+		NetworkScheduleMode m_scheduleMode = NetworkScheduleMode::FIXED_TICK; // For shards started later.
+		unsigned int m_scheduleTickRate = 100;
+		unsigned int m_scheduleSpin = 0;
+
+		std::vector<std::unique_ptr<ServerShard>> m_shards;
+		unsigned int m_shardCount = 1;
+		ShardAssignment m_shardAssignment = ShardAssignment::ROUND_ROBIN;
+		bool m_shardRebalance = true;
+		unsigned int m_nextShard = 0; // Round robin position.
+		std::chrono::steady_clock::time_point m_nextRebalance;
+
+		HandlerExecutor m_handlerExecutor; // Runs callbacks off the network thread.
+		unsigned int m_handlerThreadCount = 0;
+
 		ISteamNetworkingSockets *m_interface; // GameNetworkingSockets
 		uint32 m_listenSocket;
-		uint32 m_pollGroup;
 
 		unsigned int m_maxClients = 12;
-		std::map<uint32, ClientInfo> m_connectedClients; // <HSteamNetConnection, ClientInfo>
-		int m_clientCount = 0;
+		std::atomic<int> m_clientCount{ 0 };
+
+		std::mutex m_mutexNickNames; // Shared by every shard.
+		std::unordered_map<std::string, uint32> m_nickNames; // <Nickname, HSteamNetConnection>
 
 		ServerConnectedCallback m_connectedCallback;
 		ServerDisconnectedCallback m_disconnectedCallback;
 		ServerPacketReceivedCallback m_packetReceivedCallback;
+		ServerMessageReceivedCallback m_messageReceivedCallback;
+		ServerPacketBatchReceivedCallback m_packetBatchReceivedCallback;
+		ServerPacketDispatcher *m_packetDispatcher = nullptr;
+		ServerTransferStartedCallback m_transferStartedCallback;
+		ServerTransferChunkCallback m_transferChunkCallback;
+		ServerTransferProgressCallback m_transferProgressCallback;
+		ServerTransferCompletedCallback m_transferCompletedCallback;
 		ServerOutputLogCallback m_outputLogCallback;
 
 		unsigned int m_maxOutputLog = 12;
 
+		unsigned int m_receiveBatchSize = 256;
+		PacketEncoding m_packetEncoding = PacketEncoding::STANDARD; // What the server agrees to when a client asks.
+
+		SnapshotHistory m_snapshots; // Snapshots clients may still be encoded against.
+		PacketCompressor m_compressor;
+		unsigned int m_batchSize = 0; // The most bytes a batch can take, 0 when batching is off.
+		unsigned int m_transferChunkSize = TRANSFER_DEFAULT_CHUNK_SIZE;
+		unsigned int m_transferWindow = TRANSFER_DEFAULT_WINDOW; // The most bytes transfers let wait in a connection's send buffer.
+		uint64_t m_maxTransferSize = TRANSFER_DEFAULT_MAX_SIZE; // Incoming transfers bigger than this are refused.
+		uint64_t m_maxIncomingTransfers = TRANSFER_DEFAULT_MAX_INCOMING; // The most a client's incoming transfers can add up to.
+		std::atomic<uint32> m_nextTransferID{ 1 };
+
+		bool m_tracing = false; // Whether /trace is recording, only touched by the main network thread.
+		std::chrono::steady_clock::time_point m_traceDeadline;
+		std::string m_tracePath;
+
+		PacketMetrics m_metrics;
+
+		bool m_consoleInput = true; // Whether commands are read from the standard input.
+		bool m_loopbackOnly = false; // Whether only clients in the process can connect.
+
+		// Every client and server in the process shares GameNetworkingSockets' callbacks, so they can run on any of their threads.
+		std::mutex m_mutexStatusChanges;
+		std::vector<SteamNetConnectionStatusChangedCallback_t> m_statusChanges;
+		std::vector<SteamNetConnectionStatusChangedCallback_t> m_handledStatusChanges; // Swapped with the queue, only touched by the main network thread.
+
 		bool m_shouldQuit = false; // Whether the network thread is running.
 		bool m_networking = false; // Whether the server is running.
 
 		static BCNetServer *s_callbackInstance;
+		static thread_local ServerShard *s_currentShard; // The shard whose thread this is.
 
 	};
 
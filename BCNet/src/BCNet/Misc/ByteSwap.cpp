@@ -0,0 +1,127 @@
+#include "ByteSwap.h"
+#include "CpuFeatures.h"
+
+#include <string.h>
+
+using namespace BCNet;
+
+namespace
+{
+	// Scalar swaps, also used for whatever's left over after the vector kernels.
+	void SwapScalar(uint8_t *destination, const uint8_t *source, size_t elementSize, size_t count)
+	{
+		for (size_t i = 0; i < count; i++, destination += elementSize, source += elementSize)
+		{
+			switch (elementSize)
+			{
+				case 2:
+				{
+					uint16_t value;
+					memcpy(&value, source, sizeof(value));
+					value = (uint16_t)((value >> 8) | (value << 8));
+					memcpy(destination, &value, sizeof(value));
+				} break;
+				case 4:
+				{
+					uint32_t value;
+					memcpy(&value, source, sizeof(value));
+					value = ((value >> 24) & 0x000000FF) | ((value >> 8) & 0x0000FF00) | ((value << 8) & 0x00FF0000) | ((value << 24) & 0xFF000000);
+					memcpy(destination, &value, sizeof(value));
+				} break;
+				case 8:
+				{
+					uint64_t value;
+					memcpy(&value, source, sizeof(value));
+					value = ((value >> 56) & 0x00000000000000FFull) | ((value >> 40) & 0x000000000000FF00ull)
+						| ((value >> 24) & 0x0000000000FF0000ull) | ((value >> 8) & 0x00000000FF000000ull)
+						| ((value << 8) & 0x000000FF00000000ull) | ((value << 24) & 0x0000FF0000000000ull)
+						| ((value << 40) & 0x00FF000000000000ull) | ((value << 56) & 0xFF00000000000000ull);
+					memcpy(destination, &value, sizeof(value));
+				} break;
+				default: // Any other size, like 16 byte integers, reversed a pair of bytes at a time.
+				{
+					for (size_t low = 0, high = elementSize - 1; low < high; low++, high--)
+					{
+						const uint8_t first = source[low]; // Both read before either is written, the destination can be the source.
+						const uint8_t last = source[high];
+						destination[low] = last;
+						destination[high] = first;
+					}
+					if (elementSize % 2 == 1) // The middle byte stays where it is.
+						destination[elementSize / 2] = source[elementSize / 2];
+				} break;
+			}
+		}
+	}
+
+#ifdef BCNET_SIMD_X64
+	// Shuffle masks that reverse each 2, 4 or 8 byte element of a 16 byte lane.
+	alignas(16) const uint8_t SHUFFLE_MASKS[3][16] = {
+		{ 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 },
+		{ 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 },
+		{ 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8 }
+	};
+
+	const uint8_t *GetShuffleMask(size_t elementSize)
+	{
+		return SHUFFLE_MASKS[elementSize == 2 ? 0 : (elementSize == 4 ? 1 : 2)];
+	}
+
+	// Returns how many bytes were swapped, the rest is left for the scalar swap.
+	BCNET_TARGET("avx2")
+	size_t SwapAVX2(uint8_t *destination, const uint8_t *source, size_t elementSize, size_t size)
+	{
+		const __m128i lane = _mm_load_si128((const __m128i*)GetShuffleMask(elementSize));
+		const __m256i mask = _mm256_broadcastsi128_si256(lane);
+
+		size_t offset = 0;
+		for (; offset + 32 <= size; offset += 32)
+		{
+			const __m256i value = _mm256_loadu_si256((const __m256i*)(source + offset));
+			_mm256_storeu_si256((__m256i*)(destination + offset), _mm256_shuffle_epi8(value, mask));
+		}
+		return offset;
+	}
+
+	BCNET_TARGET("ssse3")
+	size_t SwapSSSE3(uint8_t *destination, const uint8_t *source, size_t elementSize, size_t size)
+	{
+		const __m128i mask = _mm_load_si128((const __m128i*)GetShuffleMask(elementSize));
+
+		size_t offset = 0;
+		for (; offset + 16 <= size; offset += 16)
+		{
+			const __m128i value = _mm_loadu_si128((const __m128i*)(source + offset));
+			_mm_storeu_si128((__m128i*)(destination + offset), _mm_shuffle_epi8(value, mask));
+		}
+		return offset;
+	}
+#endif
+}
+
+void BCNet::SwapBytes(void *destination, const void *source, size_t elementSize, size_t count)
+{
+	uint8_t *out = (uint8_t*)destination;
+	const uint8_t *in = (const uint8_t*)source;
+	const size_t size = elementSize * count;
+	size_t swapped = 0;
+
+	if (elementSize <= 1) // Nothing to swap.
+	{
+		if (out != in)
+			memcpy(out, in, size);
+		return;
+	}
+
+#ifdef BCNET_SIMD_X64
+	if (elementSize == 2 || elementSize == 4 || elementSize == 8)
+	{
+		if (HasAVX2())
+			swapped = SwapAVX2(out, in, elementSize, size);
+		if (HasSSSE3())
+			swapped += SwapSSSE3(out + swapped, in + swapped, elementSize, size - swapped);
+	}
+#endif
+
+	SwapScalar(out + swapped, in + swapped, elementSize, (size - swapped) / elementSize);
+}
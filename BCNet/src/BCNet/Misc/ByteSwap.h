@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace BCNet
+{
+	// Whether the host stores the lowest byte first.
+	inline bool IsLittleEndianHost()
+	{
+		const uint16_t value = 1;
+		return *(const uint8_t*)&value == 1;
+	}
+
+	// Reverses the bytes of every element while copying them, elements can be any size but only 2, 4 and 8 bytes get the vector kernels.
+	// The destination and source can be the same, but mustn't otherwise overlap.
+	// Uses AVX2 or SSSE3 kernels when the CPU has them, otherwise swaps one element at a time.
+	void SwapBytes(void *destination, const void *source, size_t elementSize, size_t count);
+
+}
@@ -0,0 +1,56 @@
+#include "CpuFeatures.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace BCNet;
+
+namespace
+{
+	struct CpuFeatures
+	{
+		bool ssse3 = false;
+		bool avx2 = false;
+
+		CpuFeatures()
+		{
+#if defined(BCNET_SIMD_X64) && defined(_MSC_VER)
+			int info[4];
+			__cpuid(info, 0);
+			const int maxLeaf = info[0];
+
+			__cpuid(info, 1);
+			ssse3 = (info[2] & (1 << 9)) != 0;
+			const bool osxsave = (info[2] & (1 << 27)) != 0;
+			const bool avx = (info[2] & (1 << 28)) != 0;
+
+			if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 0x6) == 0x6) // The OS has to save the YMM registers too.
+			{
+				__cpuidex(info, 7, 0);
+				avx2 = (info[1] & (1 << 5)) != 0;
+			}
+#elif defined(BCNET_SIMD_X64)
+			__builtin_cpu_init();
+			ssse3 = __builtin_cpu_supports("ssse3");
+			avx2 = __builtin_cpu_supports("avx2");
+#endif
+		}
+	};
+
+	const CpuFeatures &GetCpuFeatures()
+	{
+		static const CpuFeatures s_features; // Only checked once.
+		return s_features;
+	}
+}
+
+bool BCNet::HasSSSE3()
+{
+	return GetCpuFeatures().ssse3;
+}
+
+bool BCNet::HasAVX2()
+{
+	return GetCpuFeatures().avx2;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+// Which SIMD instruction sets the CPU has, checked once and cached.
+// Kernels using them are compiled with BCNET_TARGET so they can exist alongside the baseline build.
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define BCNET_SIMD_X64
+#include <immintrin.h>
+#endif
+
+// MSVC lets any function use any instruction set, GCC and Clang have to be told per function.
+#if defined(BCNET_SIMD_X64) && defined(__GNUC__)
+#define BCNET_TARGET(instructions) __attribute__((target(instructions)))
+#else
+#define BCNET_TARGET(instructions)
+#endif
+
+namespace BCNet
+{
+	bool HasSSSE3();
+	bool HasAVX2();
+
+}
@@ -0,0 +1,217 @@
+#include "DeltaCodec.h"
+#include "CpuFeatures.h"
+
+#include <string.h>
+#include <stdint.h>
+
+#include <steam/steamnetworkingtypes.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace BCNet;
+
+namespace
+{
+	// Unchanged runs shorter than this are cheaper to send as part of the changed bytes around them.
+	constexpr size_t MIN_UNCHANGED_RUN = 4;
+
+	// Changed bytes are XORed through a small buffer on their way into the stream.
+	constexpr size_t XOR_CHUNK_SIZE = 256;
+
+	inline unsigned int CountTrailingZeros(uint32_t value)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, value);
+		return (unsigned int)index;
+#else
+		return (unsigned int)__builtin_ctz(value);
+#endif
+	}
+
+	// The byte of the baseline at an offset, zero past it's end.
+	inline uint8_t BaselineByte(const Packet &baseline, size_t offset)
+	{
+		return offset < baseline.size ? baseline.As<uint8_t>()[offset] : 0;
+	}
+
+#ifdef BCNET_SIMD_X64
+	// Counts bytes from the start that are equal (or different) in both, 32 at a time.
+	// Returns where the run ends, or where the last full block ended so the narrower scans can finish the tail.
+	BCNET_TARGET("avx2")
+	size_t ScanAVX2(const uint8_t *a, const uint8_t *b, size_t size, bool equal)
+	{
+		size_t offset = 0;
+		for (; offset + 32 <= size; offset += 32)
+		{
+			const __m256i x = _mm256_loadu_si256((const __m256i*)(a + offset));
+			const __m256i y = _mm256_loadu_si256((const __m256i*)(b + offset));
+			const uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+			if (mask != (equal ? 0xFFFFFFFFu : 0u))
+				return offset + CountTrailingZeros(equal ? ~mask : mask);
+		}
+		return offset;
+	}
+
+	size_t ScanSSE2(const uint8_t *a, const uint8_t *b, size_t size, bool equal)
+	{
+		size_t offset = 0;
+		for (; offset + 16 <= size; offset += 16)
+		{
+			const __m128i x = _mm_loadu_si128((const __m128i*)(a + offset));
+			const __m128i y = _mm_loadu_si128((const __m128i*)(b + offset));
+			const uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x, y));
+			if (mask != (equal ? 0xFFFFu : 0u))
+				return offset + CountTrailingZeros(equal ? ~mask & 0xFFFF : mask);
+		}
+		return offset;
+	}
+#endif
+
+	// Counts how many bytes from the start are equal, or how many are different, in both.
+	size_t Scan(const uint8_t *a, const uint8_t *b, size_t size, bool equal)
+	{
+		size_t offset = 0;
+#ifdef BCNET_SIMD_X64
+		if (HasAVX2())
+			offset = ScanAVX2(a, b, size, equal);
+		offset += ScanSSE2(a + offset, b + offset, size - offset, equal); // Stops right away if the AVX2 scan found the spot.
+#endif
+		while (offset < size && (a[offset] == b[offset]) == equal)
+			offset++;
+		return offset;
+	}
+
+	// Counts unchanged bytes from the offset, comparing against zeroes past the end of the baseline.
+	size_t CountUnchanged(const Packet &baseline, const Packet &current, size_t offset)
+	{
+		const uint8_t *bytes = current.As<uint8_t>();
+		size_t count = 0;
+
+		if (offset < baseline.size)
+		{
+			const size_t overlap = (baseline.size < current.size ? baseline.size : current.size) - offset;
+			count = Scan(bytes + offset, baseline.As<uint8_t>() + offset, overlap, true);
+			if (count < overlap)
+				return count;
+		}
+
+		static const uint8_t s_zeroes[64] = {};
+		while (offset + count < current.size) // Past the baseline, unchanged means zero.
+		{
+			const size_t remaining = current.size - offset - count;
+			const size_t block = remaining < sizeof(s_zeroes) ? remaining : sizeof(s_zeroes);
+			const size_t zeroes = Scan(bytes + offset + count, s_zeroes, block, true);
+			count += zeroes;
+			if (zeroes < block)
+				break;
+		}
+		return count;
+	}
+
+	// Counts changed bytes from the offset, up to the next unchanged run worth splitting on.
+	size_t CountChanged(const Packet &baseline, const Packet &current, size_t offset)
+	{
+		const uint8_t *bytes = current.As<uint8_t>();
+		size_t end = offset;
+
+		while (end < current.size)
+		{
+			if (end < baseline.size)
+			{
+				const size_t overlap = (baseline.size < current.size ? baseline.size : current.size) - end;
+				end += Scan(bytes + end, baseline.As<uint8_t>() + end, overlap, false);
+			}
+			else
+			{
+				while (end < current.size && bytes[end] != 0)
+					end++;
+			}
+
+			if (end >= current.size)
+				break;
+
+			const size_t unchanged = CountUnchanged(baseline, current, end);
+			if (unchanged >= MIN_UNCHANGED_RUN || end + unchanged >= current.size) // Worth ending the changed run here.
+				break;
+			end += unchanged;
+		}
+		return end - offset;
+	}
+}
+
+bool BCNet::WriteDelta(PacketStreamWriter &writer, const Packet &baseline, const Packet &current)
+{
+	if (!writer.WriteVarUInt(current.size))
+		return false;
+
+	const uint8_t *bytes = current.As<uint8_t>();
+	size_t offset = 0;
+	while (offset < current.size)
+	{
+		const size_t unchanged = CountUnchanged(baseline, current, offset);
+		offset += unchanged;
+
+		const size_t changed = offset < current.size ? CountChanged(baseline, current, offset) : 0;
+		writer.WriteVarUInt(unchanged);
+		writer.WriteVarUInt(changed);
+
+		for (size_t written = 0; written < changed; ) // XOR them against the baseline on the way in.
+		{
+			uint8_t chunk[XOR_CHUNK_SIZE];
+			const size_t count = changed - written < XOR_CHUNK_SIZE ? changed - written : XOR_CHUNK_SIZE;
+			for (size_t i = 0; i < count; i++)
+				chunk[i] = bytes[offset + written + i] ^ BaselineByte(baseline, offset + written + i);
+
+			writer.WriteData((const char*)chunk, count);
+			written += count;
+		}
+		offset += changed;
+	}
+
+	return writer.IsStreamGood();
+}
+
+bool BCNet::ReadDelta(PacketStreamReader &reader, const Packet &baseline, PooledPacket &result)
+{
+	uint64_t size = 0;
+	if (!reader.ReadVarUInt(size) || size > (uint64_t)k_cbMaxSteamNetworkingSocketsMessageSizeSend) // Bigger than anything that could have been sent, don't let it make us allocate it.
+		return false;
+
+	result.Allocate((size_t)size);
+	uint8_t *bytes = (uint8_t*)result.GetData();
+
+	// Start from the baseline, zeroes past it's end.
+	const size_t copied = baseline.size < size ? baseline.size : (size_t)size;
+	if (copied > 0)
+		memcpy(bytes, baseline.data, copied);
+	if (copied < size)
+		memset(bytes + copied, 0, (size_t)size - copied);
+
+	size_t offset = 0;
+	while (offset < size)
+	{
+		uint64_t unchanged = 0, changed = 0;
+		if (!reader.ReadVarUInt(unchanged) || !reader.ReadVarUInt(changed))
+			return false;
+		if (unchanged > size - offset || changed > size - offset - unchanged) // Runs past the end.
+			return false;
+
+		offset += (size_t)unchanged;
+
+		const size_t position = reader.GetStreamPosition();
+		if (changed > reader.GetRemainingSize())
+			return false;
+
+		const uint8_t *xored = reader.GetPacket().As<uint8_t>() + position;
+		for (size_t i = 0; i < changed; i++)
+			bytes[offset + i] ^= xored[i];
+
+		reader.SetStreamPosition(position + (size_t)changed);
+		offset += (size_t)changed;
+	}
+
+	return true;
+}
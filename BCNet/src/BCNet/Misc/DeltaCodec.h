@@ -0,0 +1,19 @@
+#pragma once
+
+#include <BCNet/BCNetPacket.h>
+#include <BCNet/BCNetPacketPool.h>
+
+namespace BCNet
+{
+	// Encodes a buffer against a baseline, only the bytes that changed are written.
+	// The current bytes are XORed with the baseline (which counts as zeroes past it's end), so unchanged bytes become zero,
+	// then written as runs: [varint size] followed by [varint unchanged bytes][varint changed bytes][changed bytes XORed] pairs.
+	// Short unchanged runs are folded into the changed ones, a pair costs at least 2 bytes.
+	// Scanning for runs compares 16 or 32 bytes at a time with SSE2 or AVX2.
+	bool WriteDelta(PacketStreamWriter &writer, const Packet &baseline, const Packet &current);
+
+	// Rebuilds a buffer written by WriteDelta, the baseline has to be the same one it was written against.
+	// Fails without allocating anything if it claims to be bigger than GameNetworkingSockets' largest message.
+	bool ReadDelta(PacketStreamReader &reader, const Packet &baseline, PooledPacket &result);
+
+}
@@ -0,0 +1,182 @@
+#include "HandlerExecutor.h"
+#include "Tracer.h"
+
+#include <string>
+
+using namespace BCNet;
+
+namespace
+{
+	// Strands per worker, more strands means less chance of two busy clients sharing one.
+	constexpr size_t STRANDS_PER_WORKER = 16;
+
+	// How many jobs a worker runs from a strand before giving other strands a turn.
+	constexpr size_t STRAND_BATCH = 32;
+}
+
+HandlerExecutor::~HandlerExecutor()
+{
+	Stop();
+}
+
+void HandlerExecutor::Start(unsigned int threadCount)
+{
+	Stop();
+	if (threadCount == 0)
+		return;
+
+	m_stopping = false;
+	m_pending = 0;
+
+	m_strands.resize((size_t)threadCount * STRANDS_PER_WORKER);
+	for (auto &strand : m_strands)
+		strand = std::make_unique<Strand>();
+
+	m_workers.resize(threadCount);
+	for (auto &worker : m_workers)
+		worker = std::make_unique<Worker>();
+
+	for (size_t i = 0; i < m_workers.size(); i++) // Only start the threads once everything they could touch exists.
+		m_workers[i]->thread = std::thread([this, i]() { WorkerLoop(i); });
+}
+
+void HandlerExecutor::Stop()
+{
+	if (m_workers.empty())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_idleMutex);
+		m_stopping = true;
+	}
+	m_idleCondition.notify_all();
+
+	for (auto &worker : m_workers)
+	{
+		if (worker->thread.joinable())
+			worker->thread.join(); // Wait for the thread to finish execution.
+	}
+
+	m_workers.clear();
+	m_strands.clear();
+}
+
+void HandlerExecutor::Post(uint32 key, Job &&job)
+{
+	if (m_workers.empty()) // Not running, handle it inline like before.
+	{
+		job();
+		return;
+	}
+
+	const size_t strandIndex = key % m_strands.size();
+	Strand *strand = m_strands[strandIndex].get();
+
+	bool schedule = false;
+	{
+		std::lock_guard<std::mutex> lock(strand->mutex);
+		strand->jobs.push_back(std::move(job));
+		if (!strand->scheduled) // Idle strand, it needs putting in a run queue.
+		{
+			strand->scheduled = true;
+			schedule = true;
+		}
+	}
+
+	if (schedule)
+		Schedule(strandIndex % m_workers.size(), strand);
+}
+
+void HandlerExecutor::WorkerLoop(size_t index)
+{
+	Tracer::SetThreadName("Handler " + std::to_string(index));
+
+	while (true)
+	{
+		Strand *strand = TakeStrand(index);
+		if (strand)
+		{
+			RunStrand(index, strand);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_idleMutex);
+		if (m_stopping && m_pending.load() == 0) // Everything posted has been picked up.
+			break;
+		m_idleCondition.wait(lock, [this]() { return m_pending.load() > 0 || m_stopping; });
+	}
+}
+
+HandlerExecutor::Strand *HandlerExecutor::TakeStrand(size_t index)
+{
+	if (m_pending.load(std::memory_order_relaxed) == 0)
+		return nullptr;
+
+	for (size_t i = 0; i < m_workers.size(); i++)
+	{
+		Worker &worker = *m_workers[(index + i) % m_workers.size()];
+
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		if (worker.runQueue.empty())
+			continue;
+
+		Strand *strand;
+		if (i == 0) // Own queue, oldest first.
+		{
+			strand = worker.runQueue.front();
+			worker.runQueue.pop_front();
+		}
+		else // Stealing, take the newest so the owner keeps working through it's oldest.
+		{
+			strand = worker.runQueue.back();
+			worker.runQueue.pop_back();
+		}
+
+		m_pending--;
+		return strand;
+	}
+
+	return nullptr;
+}
+
+void HandlerExecutor::RunStrand(size_t index, Strand *strand)
+{
+	for (size_t i = 0; i < STRAND_BATCH; i++)
+	{
+		Job job;
+		{
+			std::lock_guard<std::mutex> lock(strand->mutex);
+			if (strand->jobs.empty())
+				break;
+			job = std::move(strand->jobs.front());
+			strand->jobs.pop_front();
+		}
+
+		job();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(strand->mutex);
+		if (strand->jobs.empty()) // Done, the next post schedules it again.
+		{
+			strand->scheduled = false;
+			return;
+		}
+	}
+
+	Schedule(index, strand); // More to do, go to the back of the queue so other strands get a turn.
+}
+
+void HandlerExecutor::Schedule(size_t index, Strand *strand)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_idleMutex); // So the notify can't slip in between a worker's check and it's wait.
+		m_pending++; // Counted before it's queued so it can never be taken before it's counted.
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_workers[index]->mutex);
+		m_workers[index]->runQueue.push_back(strand);
+	}
+	m_idleCondition.notify_one();
+}
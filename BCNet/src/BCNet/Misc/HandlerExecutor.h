@@ -0,0 +1,74 @@
+#pragma once
+
+#include <BCNet/Core/Common.h>
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+
+typedef unsigned int uint32;
+
+namespace BCNet
+{
+	// Runs packet handlers on a pool of worker threads so the network thread only has to do I/O.
+	// Jobs are posted with a key (the connection handle), jobs sharing a key run one at a time in the order they were posted.
+	// Keys are hashed onto strands, each strand belongs to a worker but idle workers steal strands from busy ones.
+	class HandlerExecutor
+	{
+	public:
+		using Job = std::function<void()>;
+
+	public:
+		HandlerExecutor() = default;
+		~HandlerExecutor();
+
+		HandlerExecutor(const HandlerExecutor &) = delete;
+		HandlerExecutor &operator=(const HandlerExecutor &) = delete;
+
+		void Start(unsigned int threadCount);
+		void Stop(); // Finishes every job that's already been posted, then joins the workers.
+
+		bool IsRunning() const { return !m_workers.empty(); }
+
+		// Can be called from any thread, runs the job straight away if the executor isn't running.
+		// Jobs with the same key only keep their order if they're posted from one thread at a time.
+		void Post(uint32 key, Job &&job);
+
+	private:
+		struct Strand
+		{
+			std::mutex mutex;
+			std::deque<Job> jobs;
+			bool scheduled = false; // Whether it's in a run queue or being run.
+		};
+
+		struct Worker
+		{
+			std::mutex mutex;
+			std::deque<Strand *> runQueue; // Owner takes from the front, thieves take from the back.
+			std::thread thread;
+		};
+
+	private:
+		void WorkerLoop(size_t index);
+		Strand *TakeStrand(size_t index); // Own queue first, then steals.
+		void RunStrand(size_t index, Strand *strand);
+		void Schedule(size_t index, Strand *strand);
+
+	private:
+		std::vector<std::unique_ptr<Strand>> m_strands;
+		std::vector<std::unique_ptr<Worker>> m_workers;
+
+		std::mutex m_idleMutex;
+		std::condition_variable m_idleCondition;
+		std::atomic<size_t> m_pending{ 0 }; // Strands waiting in a run queue.
+		std::atomic<bool> m_stopping{ false };
+
+	};
+
+}
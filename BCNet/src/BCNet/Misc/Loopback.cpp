@@ -0,0 +1,63 @@
+#include "Loopback.h"
+
+#include <unordered_map>
+#include <mutex>
+
+#include <steam/steamnetworkingsockets.h>
+#include <steam/isteamnetworkingutils.h>
+
+using namespace BCNet;
+
+namespace
+{
+	struct Listener
+	{
+		const void *owner;
+		LoopbackRegistry::AcceptCallback accept;
+	};
+
+	// Held while a server accepts, so it can't stop listening half way through a connection.
+	std::mutex s_mutexListeners;
+	std::unordered_map<int, Listener> s_listeners; // <Port, Listener>
+}
+
+bool LoopbackRegistry::Listen(int port, const void *owner, const AcceptCallback &accept)
+{
+	std::lock_guard<std::mutex> lock(s_mutexListeners);
+	return s_listeners.emplace(port, Listener{ owner, accept }).second;
+}
+
+void LoopbackRegistry::Close(int port, const void *owner)
+{
+	std::lock_guard<std::mutex> lock(s_mutexListeners);
+	auto it = s_listeners.find(port);
+	if (it != s_listeners.end() && it->second.owner == owner)
+		s_listeners.erase(it);
+}
+
+HSteamNetConnection LoopbackRegistry::Connect(int port, FnSteamNetConnectionStatusChanged callback, int64 userData)
+{
+	std::lock_guard<std::mutex> lock(s_mutexListeners);
+	auto it = s_listeners.find(port);
+	if (it == s_listeners.end())
+		return k_HSteamNetConnection_Invalid;
+
+	ISteamNetworkingSockets *sockets = SteamNetworkingSockets();
+	HSteamNetConnection clientConnection = k_HSteamNetConnection_Invalid;
+	HSteamNetConnection serverConnection = k_HSteamNetConnection_Invalid;
+	if (!sockets || !sockets->CreateSocketPair(&clientConnection, &serverConnection, false, nullptr, nullptr))
+		return k_HSteamNetConnection_Invalid;
+
+	// Set before the server can close it's end, which is the first callback the client's end could get.
+	SetStatusCallback(clientConnection, callback);
+	sockets->SetConnectionUserData(clientConnection, userData);
+
+	it->second.accept(serverConnection);
+	return clientConnection;
+}
+
+void LoopbackRegistry::SetStatusCallback(HSteamNetConnection connection, FnSteamNetConnectionStatusChanged callback)
+{
+	SteamNetworkingUtils()->SetConfigValue(k_ESteamNetworkingConfig_Callback_ConnectionStatusChanged, k_ESteamNetworkingConfig_Connection, connection,
+		k_ESteamNetworkingConfig_Ptr, &callback); // Takes a pointer to the pointer.
+}
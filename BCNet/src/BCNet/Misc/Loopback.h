@@ -0,0 +1,27 @@
+#pragma once
+
+#include <steam/steamnetworkingtypes.h>
+
+#include <functional>
+
+namespace BCNet
+{
+	// Servers in this process that clients in it can connect to by port without any sockets, see LOOPBACK_SERVER_ADDRESS.
+	// A connection is a GameNetworkingSockets socket pair, both ends start out connected and their messages never leave memory.
+	// Neither end gets a callback for connecting, so the server is handed it's end to accept and the client has to treat it's end as connected.
+	class LoopbackRegistry
+	{
+	public:
+		using AcceptCallback = std::function<void(HSteamNetConnection connection)>; // Called on the connecting client's thread.
+
+		static bool Listen(int port, const void *owner, const AcceptCallback &accept); // False if something else is already listening on the port.
+		static void Close(int port, const void *owner); // Only if it's still the owner's.
+
+		// Returns the client's end, with it's callback and user data already set so nothing can be missed, or an invalid connection if nothing's listening.
+		static HSteamNetConnection Connect(int port, FnSteamNetConnectionStatusChanged callback, int64 userData);
+
+		static void SetStatusCallback(HSteamNetConnection connection, FnSteamNetConnectionStatusChanged callback); // Socket pairs are made without one.
+
+	};
+
+}
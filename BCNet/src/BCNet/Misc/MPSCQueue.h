@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <utility>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace BCNet
+{
+	// Bounded lock-free queue, any amount of threads can push but only one thread may pop.
+	// Every cell carries a sequence number saying whether it's ready to be written or read,
+	// so producers only contend on a single atomic increment and never wait on each other.
+	template <typename T>
+	class MPSCQueue
+	{
+	public:
+		// The capacity is rounded up to a power of two.
+		explicit MPSCQueue(size_t capacity = 4096)
+		{
+			size_t size = 2;
+			while (size < capacity)
+				size <<= 1;
+
+			m_cells = std::make_unique<Cell[]>(size);
+			m_mask = size - 1;
+
+			for (size_t i = 0; i < size; i++)
+				m_cells[i].sequence.store(i, std::memory_order_relaxed);
+		}
+
+		MPSCQueue(const MPSCQueue &) = delete;
+		MPSCQueue &operator=(const MPSCQueue &) = delete;
+
+		// Can be called from any thread, returns false if the queue is full.
+		bool TryPush(T &&item)
+		{
+			size_t position = m_pushPosition.load(std::memory_order_relaxed);
+			Cell *cell;
+			for (;;)
+			{
+				cell = &m_cells[position & m_mask];
+				size_t sequence = cell->sequence.load(std::memory_order_acquire);
+				intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+
+				if (difference == 0) // Cell is free, try to claim it.
+				{
+					if (m_pushPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+						break;
+				}
+				else if (difference < 0) // Queue is full.
+				{
+					return false;
+				}
+				else // Another producer got there first.
+				{
+					position = m_pushPosition.load(std::memory_order_relaxed);
+				}
+			}
+
+			cell->item = std::move(item);
+			cell->sequence.store(position + 1, std::memory_order_release); // Publish to the consumer.
+			return true;
+		}
+
+		// Must only be called from the consuming thread, returns false if the queue is empty.
+		bool TryPop(T &item)
+		{
+			Cell *cell = &m_cells[m_popPosition & m_mask];
+			size_t sequence = cell->sequence.load(std::memory_order_acquire);
+			if ((intptr_t)sequence - (intptr_t)(m_popPosition + 1) < 0) // Nothing published yet.
+				return false;
+
+			item = std::move(cell->item);
+			cell->sequence.store(m_popPosition + m_mask + 1, std::memory_order_release); // Hand the cell back to the producers.
+			m_popPosition++;
+			return true;
+		}
+
+	private:
+		struct Cell
+		{
+			std::atomic<size_t> sequence;
+			T item;
+		};
+
+		std::unique_ptr<Cell[]> m_cells;
+		size_t m_mask = 0;
+
+		alignas(64) std::atomic<size_t> m_pushPosition{ 0 }; // Kept on their own cache lines so producers and the consumer don't fight over them.
+		alignas(64) size_t m_popPosition = 0;
+
+	};
+
+}
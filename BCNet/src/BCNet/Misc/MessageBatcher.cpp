@@ -0,0 +1,128 @@
+#include "MessageBatcher.h"
+
+#include <BCNet/BCNetSerialize.h>
+
+#include <string.h>
+
+#include <steam/steamnetworkingsockets.h>
+
+using namespace BCNet;
+
+namespace
+{
+	constexpr uint8_t BATCH_ID = (uint8_t)DefaultPacketID::PACKET_BATCH; // Fits in a single varint byte.
+}
+
+int BCNet::GetSendFlags(bool reliable, uint8_t sendFlags)
+{
+	int flags = reliable ? k_nSteamNetworkingSend_Reliable : k_nSteamNetworkingSend_Unreliable;
+	if (sendFlags & SEND_FLAG_NO_NAGLE)
+		flags |= k_nSteamNetworkingSend_NoNagle;
+	if (sendFlags & SEND_FLAG_NO_DELAY)
+		flags |= k_nSteamNetworkingSend_NoDelay | k_nSteamNetworkingSend_NoNagle;
+	return flags;
+}
+
+bool MessageBatcher::Add(const Packet &packet, bool reliable, size_t maxSize)
+{
+	Lane &lane = m_lanes[reliable];
+	if (packet.size == 0 || packet.size > UINT32_MAX)
+		return false;
+
+	const size_t lengthSize = GetSizeLength(packet.size, PacketEncoding::COMPACT);
+	if (GetBatchSize(lane.lengths.size() + 1, lane.lengthsSize + lengthSize, lane.data.size() + packet.size) > maxSize)
+		return false;
+
+	lane.data.insert(lane.data.end(), packet.As<uint8_t>(), packet.As<uint8_t>() + packet.size);
+	lane.lengths.push_back((uint32_t)packet.size);
+	lane.lengthsSize += lengthSize;
+	return true;
+}
+
+bool MessageBatcher::Build(bool reliable, PooledPacket &batch)
+{
+	Lane &lane = m_lanes[reliable];
+	if (lane.lengths.empty())
+		return false;
+
+	if (lane.lengths.size() == 1) // Nothing to batch it with, it goes as it is.
+	{
+		batch.Allocate(lane.data.size());
+		memcpy(batch.GetData(), lane.data.data(), lane.data.size());
+	}
+	else
+	{
+		batch.Allocate(GetBatchSize(lane.lengths.size(), lane.lengthsSize, lane.data.size()));
+		PacketStreamWriter packetWriter(batch.GetPacket(), 0, PacketEncoding::COMPACT);
+		packetWriter.WriteHeader(BATCH_ID, PACKET_FLAG_BATCHED);
+		packetWriter.WriteSize(lane.lengths.size());
+		for (uint32_t length : lane.lengths)
+			packetWriter.WriteSize(length);
+		packetWriter.WriteData((const char*)lane.data.data(), lane.data.size());
+	}
+
+	lane.data.clear();
+	lane.lengths.clear();
+	lane.lengthsSize = 0;
+	return true;
+}
+
+void MessageBatcher::Clear()
+{
+	for (Lane &lane : m_lanes)
+	{
+		lane.data.clear();
+		lane.lengths.clear();
+		lane.lengthsSize = 0;
+	}
+}
+
+bool MessageBatcher::IsBatch(const Packet &packet)
+{
+	return packet.size > 0 && (packet.As<const uint8_t>()[0] & PACKET_FLAG_BATCHED);
+}
+
+bool MessageBatcher::Unpack(const ReceivedMessage &message, std::vector<ReceivedMessage> &messages)
+{
+	uint32_t id = 0;
+	uint8_t flags = 0;
+	size_t count = 0;
+	PacketStreamReader packetReader(message.GetPacket(), 0, PacketEncoding::COMPACT);
+	if (!packetReader.ReadHeader(id, flags) || id != BATCH_ID || (flags & PACKET_FLAG_COMPRESSED) || !packetReader.ReadSize(count))
+		return false;
+
+	if (count > packetReader.GetRemainingSize()) // Every packet takes at least a byte for it's length, don't let it make us allocate more.
+		return false;
+
+	// Check the lengths add up to exactly what's left before handing anything out.
+	const size_t lengthsStart = packetReader.GetStreamPosition();
+	size_t total = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t length = 0;
+		if (!packetReader.ReadSize(length) || length == 0 || length > message.GetSize())
+			return false;
+		total += length;
+	}
+	if (total != packetReader.GetRemainingSize())
+		return false;
+
+	size_t offset = packetReader.GetStreamPosition();
+	packetReader.SetStreamPosition(lengthsStart);
+
+	messages.reserve(messages.size() + count);
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t length = 0;
+		packetReader.ReadSize(length);
+		messages.push_back(message.Slice(offset, length));
+		offset += length;
+	}
+
+	return true;
+}
+
+size_t MessageBatcher::GetBatchSize(size_t count, size_t lengthsSize, size_t dataSize)
+{
+	return 2 + GetSizeLength(count, PacketEncoding::COMPACT) + lengthsSize + dataSize; // The flags byte and ID first.
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <BCNet/Core/Common.h>
+#include <BCNet/BCNetPacket.h>
+#include <BCNet/BCNetPacketPool.h>
+#include <BCNet/BCNetMessage.h>
+
+#include <vector>
+
+#include <stdint.h>
+
+#define MESSAGE_BATCH_DEFAULT_SIZE 1200 // Fits in one datagram at GameNetworkingSockets' default MTU, with room for it's own headers.
+
+namespace BCNet
+{
+	// The GameNetworkingSockets send flags for a packet.
+	int GetSendFlags(bool reliable, uint8_t sendFlags);
+
+	// Packs the small packets sent to one connection over a tick into as few packets as possible, each small enough to go out in a single datagram.
+	// Reliable and unreliable packets are kept apart, they go out with different send flags.
+	// Only compactly encoded packets can be batched, a batch is a compact header with the batched flag followed by the number of packets,
+	// each packet's length, then the packets back to back. A batch of one is just the packet.
+	// Only touched by the thread that owns the connection.
+	class MessageBatcher
+	{
+	public:
+		// Adds a packet to the batch, returns false if it doesn't fit alongside what's already in there, or on it's own.
+		bool Add(const Packet &packet, bool reliable, size_t maxSize);
+
+		bool IsEmpty() const { return m_lanes[0].lengths.empty() && m_lanes[1].lengths.empty(); }
+		bool IsEmpty(bool reliable) const { return m_lanes[reliable].lengths.empty(); }
+
+		// Writes out the batched packets and empties the batch, returns false if there weren't any.
+		bool Build(bool reliable, PooledPacket &batch);
+
+		// Drops everything in the batch.
+		void Clear();
+
+		// Whether a compactly encoded packet has the batched flag.
+		static bool IsBatch(const Packet &packet);
+
+		// Splits a batch into the packets it holds, each one sharing the batch's buffer. Returns false if it's malformed.
+		static bool Unpack(const ReceivedMessage &message, std::vector<ReceivedMessage> &messages);
+
+	private:
+		struct Lane
+		{
+			std::vector<uint8_t> data; // The packets back to back.
+			std::vector<uint32_t> lengths;
+			size_t lengthsSize = 0; // The size of the lengths as they would be written.
+		};
+
+		static size_t GetBatchSize(size_t count, size_t lengthsSize, size_t dataSize);
+
+	private:
+		Lane m_lanes[2]; // Unreliable then reliable.
+
+	};
+
+}
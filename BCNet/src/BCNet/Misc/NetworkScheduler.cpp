@@ -0,0 +1,126 @@
+#include "NetworkScheduler.h"
+#include "Tracer.h"
+
+#include <thread>
+
+using namespace BCNet;
+
+namespace
+{
+	// The furthest from a deadline the scheduler can be asked to stop sleeping and start spinning, OS sleeps are rarely off by more.
+	constexpr unsigned int MAX_SPIN_MICROSECONDS = 2000;
+
+	// How long the adaptive mode keeps spinning after the last activity.
+	constexpr std::chrono::microseconds ADAPTIVE_SPIN_WINDOW(500);
+
+	// The first sleep the adaptive mode takes once it stops spinning, doubles every idle iteration.
+	constexpr std::chrono::microseconds ADAPTIVE_MIN_BACKOFF(100);
+}
+
+NetworkScheduler::NetworkScheduler()
+	: m_mode(NetworkScheduleMode::FIXED_TICK)
+	, m_tickRate(100)
+	, m_nextTick(Clock::now())
+	, m_lastActivity(Clock::now())
+	, m_backoff(ADAPTIVE_MIN_BACKOFF)
+{ }
+
+void NetworkScheduler::SetMode(NetworkScheduleMode mode, unsigned int tickRate, unsigned int spinMicroseconds)
+{
+	m_mode.store(mode, std::memory_order_relaxed);
+	m_tickRate.store(tickRate > 0 ? tickRate : 1, std::memory_order_relaxed);
+	m_spinMicroseconds.store(spinMicroseconds < MAX_SPIN_MICROSECONDS ? spinMicroseconds : MAX_SPIN_MICROSECONDS, std::memory_order_relaxed);
+	Wake(); // Don't leave the network thread waiting on the old schedule.
+}
+
+void NetworkScheduler::Wait(bool activity)
+{
+	BCNET_TRACE_SCOPE("Wait");
+	const Clock::time_point now = Clock::now();
+	const Clock::duration tick = std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)) / m_tickRate.load(std::memory_order_relaxed);
+
+	switch (m_mode.load(std::memory_order_relaxed))
+	{
+		case NetworkScheduleMode::FIXED_TICK:
+		{
+			if (now >= m_nextTick) // Only move on to the next tick once this one is over, a wake up doesn't reset the pacing.
+			{
+				m_nextTick += tick;
+				if (m_nextTick < now) // Fell behind, don't try to catch up with a burst of ticks.
+					m_nextTick = now + tick;
+			}
+
+			WaitUntil(m_nextTick);
+		} break;
+		case NetworkScheduleMode::ADAPTIVE:
+		{
+			if (activity)
+			{
+				m_lastActivity = now;
+				m_backoff = ADAPTIVE_MIN_BACKOFF;
+			}
+
+			if (now - m_lastActivity < ADAPTIVE_SPIN_WINDOW) // Stay hot for a moment, more is probably on the way.
+			{
+				ConsumeWake();
+				std::this_thread::yield();
+				break;
+			}
+
+			WaitUntil(now + m_backoff);
+
+			m_backoff *= 2; // Back off further while idle, up to one tick.
+			if (m_backoff > tick)
+				m_backoff = tick;
+		} break;
+		case NetworkScheduleMode::BUSY_POLL:
+		default:
+		{
+			ConsumeWake();
+		} break;
+	}
+}
+
+void NetworkScheduler::Wake()
+{
+	if (m_woken.exchange(true)) // Already woken, nothing else to do.
+		return;
+
+	if (m_sleeping.load()) // Only bother the condition variable if the network thread is actually asleep.
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex); // So the wake up can't slip in between the check and the wait.
+		}
+		m_condition.notify_one();
+	}
+}
+
+void NetworkScheduler::WaitUntil(Clock::time_point deadline)
+{
+	if (ConsumeWake())
+		return;
+
+	// Only spins if it was asked to, an idle thread spinning through every wait would keep a core busy for nothing.
+	const std::chrono::microseconds spin(m_spinMicroseconds.load(std::memory_order_relaxed));
+	if (deadline - Clock::now() > spin) // Sleep through the wait, or most of it.
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_sleeping.store(true);
+		m_condition.wait_until(lock, deadline - spin, [this]() { return m_woken.load(); });
+		m_sleeping.store(false);
+	}
+
+	while (Clock::now() < deadline) // Spin the rest for precise pacing, if there's any left.
+	{
+		if (m_woken.load(std::memory_order_acquire))
+			break;
+		std::this_thread::yield();
+	}
+
+	ConsumeWake();
+}
+
+bool NetworkScheduler::ConsumeWake()
+{
+	return m_woken.exchange(false, std::memory_order_acq_rel);
+}
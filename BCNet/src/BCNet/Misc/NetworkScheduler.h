@@ -0,0 +1,55 @@
+#pragma once
+
+#include <BCNet/Core/Common.h>
+#include <BCNet/Core/Types.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+
+namespace BCNet
+{
+	// Paces the network thread and lets other threads wake it up.
+	// Shared by the server and client, the network thread calls Wait() at the end of every iteration.
+	class NetworkScheduler
+	{
+	public:
+		using Clock = std::chrono::steady_clock;
+
+	public:
+		NetworkScheduler();
+
+		void SetMode(NetworkScheduleMode mode, unsigned int tickRate, unsigned int spinMicroseconds = 0); // Spinning is capped at 2ms.
+		NetworkScheduleMode GetMode() const { return m_mode.load(std::memory_order_relaxed); }
+
+		// Waits until the next iteration should run, or until woken up.
+		// activity should be true if the last iteration did any work.
+		void Wait(bool activity);
+
+		// Interrupts the wait, can be called from any thread.
+		// Only takes the lock if the network thread is actually asleep, so it's cheap to call on every send.
+		void Wake();
+
+	private:
+		void WaitUntil(Clock::time_point deadline); // Sleeps, then spins whatever's left of the spin window.
+		bool ConsumeWake();
+
+	private:
+		std::atomic<NetworkScheduleMode> m_mode;
+		std::atomic<unsigned int> m_tickRate;
+		std::atomic<unsigned int> m_spinMicroseconds{ 0 }; // How long before a deadline to stop sleeping, 0 never spins.
+
+		std::mutex m_mutex;
+		std::condition_variable m_condition;
+		std::atomic<bool> m_woken{ false };
+		std::atomic<bool> m_sleeping{ false };
+
+		// Only touched by the network thread.
+		Clock::time_point m_nextTick;
+		Clock::time_point m_lastActivity;
+		Clock::duration m_backoff;
+
+	};
+
+}
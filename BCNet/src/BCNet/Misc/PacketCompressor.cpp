@@ -0,0 +1,165 @@
+#include "PacketCompressor.h"
+
+#include <BCNet/BCNetCompression.h>
+
+#include <chrono>
+
+#include <string.h>
+
+#include <steam/steamnetworkingsockets.h>
+#include <steam/isteamnetworkingutils.h>
+
+using namespace BCNet;
+
+namespace
+{
+	constexpr size_t MAX_HEADER_SIZE = 16; // A flags byte and up to a 10 byte varint.
+
+	uint64_t GetNanosecondsSince(std::chrono::steady_clock::time_point start)
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+void PacketCompressor::SetEnabled(bool enabled, size_t threshold)
+{
+	m_enabled = enabled;
+	m_threshold = threshold;
+}
+
+void PacketCompressor::SetDictionary(const Packet &dictionary)
+{
+	m_dictionary.Allocate(dictionary.size);
+	if (dictionary.size > 0)
+		memcpy(m_dictionary.GetData(), dictionary.data, dictionary.size);
+
+	if (dictionary.size == 0)
+	{
+		m_dictionaryID = 0;
+		return;
+	}
+
+	uint32_t hash = 2166136261u; // FNV-1a.
+	const uint8_t *bytes = dictionary.As<const uint8_t>();
+	for (size_t i = 0; i < dictionary.size; i++)
+		hash = (hash ^ bytes[i]) * 16777619u;
+	m_dictionaryID = hash != 0 ? hash : 1; // 0 means no dictionary.
+}
+
+bool PacketCompressor::Compress(const Packet &packet, PooledPacket &compressed)
+{
+	if (!m_enabled || packet.size < m_threshold)
+		return false;
+
+	uint32_t id = 0;
+	uint8_t flags = 0;
+	PacketStreamReader packetReader(packet, 0, PacketEncoding::COMPACT);
+	if (!packetReader.ReadHeader(id, flags) || (flags & PACKET_FLAG_COMPRESSED))
+		return false;
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	Counters &counters = GetCounters(id);
+
+	const size_t headerSize = packetReader.GetStreamPosition();
+	const size_t payloadSize = packet.size - headerSize;
+
+	// Only worth sending if it comes out smaller, so the block never needs to be bigger than the packet.
+	compressed.Allocate(packet.size);
+	PacketStreamWriter packetWriter(compressed.GetPacket(), 0, PacketEncoding::COMPACT);
+	packetWriter.WriteHeader(id, flags | PACKET_FLAG_COMPRESSED);
+	packetWriter.WriteVarUInt(payloadSize);
+
+	const size_t position = packetWriter.GetStreamPosition();
+	size_t size = 0;
+	if (packetWriter.IsStreamGood() && position + 1 < packet.size)
+		size = BCNet::Compress(packet.As<const uint8_t>() + headerSize, payloadSize, (uint8_t*)compressed.GetData() + position, packet.size - 1 - position, m_dictionary.GetPacket());
+
+	counters.compressNanoseconds.fetch_add(GetNanosecondsSince(start), std::memory_order_relaxed);
+	if (size == 0) // Didn't get any smaller.
+	{
+		counters.skippedPackets.fetch_add(1, std::memory_order_relaxed);
+		compressed.Release();
+		return false;
+	}
+
+	compressed.Resize(position + size);
+	counters.compressedPackets.fetch_add(1, std::memory_order_relaxed);
+	counters.uncompressedBytes.fetch_add(payloadSize, std::memory_order_relaxed);
+	counters.compressedBytes.fetch_add(size, std::memory_order_relaxed);
+	return true;
+}
+
+bool PacketCompressor::IsCompressed(const Packet &packet)
+{
+	return packet.size > 0 && (packet.As<const uint8_t>()[0] & PACKET_FLAG_COMPRESSED);
+}
+
+bool PacketCompressor::Decompress(ReceivedMessage &message)
+{
+	uint32_t id = 0;
+	uint8_t flags = 0;
+	uint64_t payloadSize = 0;
+	PacketStreamReader packetReader(message.GetPacket(), 0, PacketEncoding::COMPACT);
+	if (!packetReader.ReadHeader(id, flags) || !packetReader.ReadVarUInt(payloadSize))
+		return false;
+
+	if (payloadSize > (uint64_t)k_cbMaxSteamNetworkingSocketsMessageSizeSend) // Bigger than anything that could have been sent, don't let it make us allocate it.
+		return false;
+
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// The header goes back the way it was, without the compressed flag.
+	uint8_t header[MAX_HEADER_SIZE];
+	PacketStreamWriter headerWriter(Packet(header, sizeof(header)), 0, PacketEncoding::COMPACT);
+	headerWriter.WriteHeader(id, flags & ~PACKET_FLAG_COMPRESSED);
+	const size_t headerSize = headerWriter.GetStreamPosition();
+
+	SteamNetworkingMessage_t *decompressed = SteamNetworkingUtils()->AllocateMessage((int)(headerSize + payloadSize));
+	memcpy(decompressed->m_pData, header, headerSize);
+
+	const size_t position = packetReader.GetStreamPosition();
+	if (!BCNet::Decompress(message.GetPacket().As<const uint8_t>() + position, message.GetSize() - position,
+		(uint8_t*)decompressed->m_pData + headerSize, (size_t)payloadSize, m_dictionary.GetPacket()))
+	{
+		decompressed->Release();
+		return false;
+	}
+
+	// Looks like it came straight from the connection.
+	decompressed->m_conn = message.GetConnection();
+	decompressed->m_nConnUserData = message.GetConnectionUserData();
+	decompressed->m_usecTimeReceived = message.GetTimeReceived();
+	decompressed->m_nMessageNumber = message.GetMessageNumber();
+	message = ReceivedMessage(decompressed);
+
+	Counters &counters = GetCounters(id);
+	counters.decompressedPackets.fetch_add(1, std::memory_order_relaxed);
+	counters.decompressNanoseconds.fetch_add(GetNanosecondsSince(start), std::memory_order_relaxed);
+	return true;
+}
+
+CompressionStats PacketCompressor::GetStats(uint32_t packetID) const
+{
+	CompressionStats stats;
+	AddCounters(stats, m_counters[packetID < STATS_PACKET_IDS ? packetID : STATS_PACKET_IDS - 1]);
+	return stats;
+}
+
+CompressionStats PacketCompressor::GetTotalStats() const
+{
+	CompressionStats stats;
+	for (const Counters &counters : m_counters)
+		AddCounters(stats, counters);
+	return stats;
+}
+
+void PacketCompressor::AddCounters(CompressionStats &stats, const Counters &counters)
+{
+	stats.compressedPackets += counters.compressedPackets.load(std::memory_order_relaxed);
+	stats.skippedPackets += counters.skippedPackets.load(std::memory_order_relaxed);
+	stats.uncompressedBytes += counters.uncompressedBytes.load(std::memory_order_relaxed);
+	stats.compressedBytes += counters.compressedBytes.load(std::memory_order_relaxed);
+	stats.compressNanoseconds += counters.compressNanoseconds.load(std::memory_order_relaxed);
+	stats.decompressedPackets += counters.decompressedPackets.load(std::memory_order_relaxed);
+	stats.decompressNanoseconds += counters.decompressNanoseconds.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <BCNet/Core/Common.h>
+#include <BCNet/Core/Types.h>
+#include <BCNet/BCNetPacket.h>
+#include <BCNet/BCNetPacketPool.h>
+#include <BCNet/BCNetMessage.h>
+
+#include <atomic>
+
+#include <stdint.h>
+
+namespace BCNet
+{
+	// Compresses and decompresses packets on their way through the connection, shared by the server and client.
+	// Only compactly encoded packets can be compressed, the header's flags say whether the payload is.
+	// A compressed packet keeps it's header, with the compressed flag, followed by the original payload size as a varint and the compressed payload.
+	// Compressing and decompressing can be done from any thread, the settings should be set before connecting.
+	class PacketCompressor
+	{
+	public:
+		static constexpr uint32_t STATS_PACKET_IDS = 256; // Packet IDs from the last one up share it's counters.
+
+	public:
+		void SetEnabled(bool enabled, size_t threshold);
+		bool IsEnabled() const { return m_enabled; }
+		bool ShouldCompress(const Packet &packet) const { return m_enabled && packet.size >= m_threshold; } // Whether it's worth trying, without looking at it.
+
+		void SetDictionary(const Packet &dictionary); // Copied, an empty packet means no dictionary.
+		uint32_t GetDictionaryID() const { return m_dictionaryID; } // A checksum of the dictionary, both ends have to have the same one, 0 without one.
+
+		// Compresses a compactly encoded packet if it's over the threshold and comes out smaller, returns false to send it as it is.
+		bool Compress(const Packet &packet, PooledPacket &compressed);
+
+		// Whether a compactly encoded packet has the compressed flag.
+		static bool IsCompressed(const Packet &packet);
+
+		// Swaps a compressed message for it's decompressed copy, returns false if it's corrupt.
+		bool Decompress(ReceivedMessage &message);
+
+		CompressionStats GetStats(uint32_t packetID) const;
+		CompressionStats GetTotalStats() const;
+
+	private:
+		struct Counters
+		{
+			std::atomic<uint64_t> compressedPackets{ 0 };
+			std::atomic<uint64_t> skippedPackets{ 0 };
+			std::atomic<uint64_t> uncompressedBytes{ 0 };
+			std::atomic<uint64_t> compressedBytes{ 0 };
+			std::atomic<uint64_t> compressNanoseconds{ 0 };
+			std::atomic<uint64_t> decompressedPackets{ 0 };
+			std::atomic<uint64_t> decompressNanoseconds{ 0 };
+		};
+
+		Counters &GetCounters(uint32_t packetID) { return m_counters[packetID < STATS_PACKET_IDS ? packetID : STATS_PACKET_IDS - 1]; }
+		static void AddCounters(CompressionStats &stats, const Counters &counters);
+
+	private:
+		bool m_enabled = false;
+		size_t m_threshold = 0;
+
+		PooledPacket m_dictionary;
+		uint32_t m_dictionaryID = 0;
+
+		Counters m_counters[STATS_PACKET_IDS];
+
+	};
+
+}
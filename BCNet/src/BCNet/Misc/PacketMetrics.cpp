@@ -0,0 +1,397 @@
+#include "PacketMetrics.h"
+
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <new>
+
+#include <stdio.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+#include <steam/steamnetworkingsockets.h>
+#include <steam/isteamnetworkingutils.h>
+
+using namespace BCNet;
+
+namespace
+{
+	std::atomic<uint64_t> s_nextInstance{ 1 };
+
+	// The calling thread's counters for the last metrics it recorded to.
+	struct ThreadCache
+	{
+		uint64_t instance = 0;
+		void *counters = nullptr;
+	};
+	thread_local ThreadCache t_cache;
+
+	constexpr double QUANTILES[] = { 0.5, 0.9, 0.99, 0.999 };
+
+	// Only the owning thread writes, so there's no need for an atomic add.
+	void Add(std::atomic<uint64_t> &counter, uint64_t value)
+	{
+		counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+	}
+
+	uint32_t GetHighestBit(uint64_t value) // Value must not be 0.
+	{
+		uint32_t bit = 0;
+		if (value >> 32) { value >>= 32; bit += 32; }
+		if (value >> 16) { value >>= 16; bit += 16; }
+		if (value >> 8) { value >>= 8; bit += 8; }
+		if (value >> 4) { value >>= 4; bit += 4; }
+		if (value >> 2) { value >>= 2; bit += 2; }
+		if (value >> 1) { bit += 1; }
+		return bit;
+	}
+
+	// Every thread's counts added together.
+	struct MergedHistogram
+	{
+		uint64_t buckets[Histogram::BUCKET_COUNT] = {};
+		uint64_t count = 0;
+		uint64_t sum = 0;
+
+		void Add(const Histogram &histogram)
+		{
+			for (uint32_t i = 0; i < Histogram::BUCKET_COUNT; i++)
+				buckets[i] += histogram.buckets[i].load(std::memory_order_relaxed);
+			count += histogram.count.load(std::memory_order_relaxed);
+			sum += histogram.sum.load(std::memory_order_relaxed);
+		}
+
+		uint64_t GetQuantile(double quantile) const
+		{
+			uint64_t total = 0;
+			for (uint32_t i = 0; i < Histogram::BUCKET_COUNT; i++)
+				total += buckets[i];
+			if (total == 0)
+				return 0;
+
+			const uint64_t target = (uint64_t)(quantile * (double)total + 0.5);
+			uint64_t seen = 0;
+			for (uint32_t i = 0; i < Histogram::BUCKET_COUNT; i++)
+			{
+				seen += buckets[i];
+				if (seen >= target && seen > 0)
+					return Histogram::GetBucketValue(i);
+			}
+			return Histogram::GetBucketValue(Histogram::BUCKET_COUNT - 1);
+		}
+	};
+
+	struct MergedCounters
+	{
+		uint64_t receivedPackets = 0;
+		uint64_t receivedBytes = 0;
+		uint64_t sentPackets = 0;
+		uint64_t sentBytes = 0;
+		MergedHistogram receivedSizes;
+		MergedHistogram sentSizes;
+		MergedHistogram handlerNanoseconds;
+		MergedHistogram latencyMicroseconds;
+	};
+
+	void WriteCounter(std::stringstream &ss, const char *name, const char *help, const std::vector<std::string> &labels, const std::vector<MergedCounters> &counters, uint64_t MergedCounters::*value)
+	{
+		ss << "# HELP " << name << " " << help << "\n";
+		ss << "# TYPE " << name << " counter\n";
+		for (size_t i = 0; i < counters.size(); i++)
+		{
+			if (!labels[i].empty())
+				ss << name << "{" << labels[i] << "} " << counters[i].*value << "\n";
+		}
+	}
+
+	void WriteSummary(std::stringstream &ss, const char *name, const char *help, const char *extraLabel, const std::vector<std::string> &labels,
+		const std::vector<MergedCounters> &counters, MergedHistogram MergedCounters::*histogram, double scale)
+	{
+		if (help)
+		{
+			ss << "# HELP " << name << " " << help << "\n";
+			ss << "# TYPE " << name << " summary\n";
+		}
+
+		for (size_t i = 0; i < counters.size(); i++)
+		{
+			const MergedHistogram &merged = counters[i].*histogram;
+			if (labels[i].empty() || merged.count == 0)
+				continue;
+
+			for (double quantile : QUANTILES)
+				ss << name << "{" << labels[i] << extraLabel << ",quantile=\"" << quantile << "\"} " << (double)merged.GetQuantile(quantile) * scale << "\n";
+			ss << name << "_sum{" << labels[i] << extraLabel << "} " << (double)merged.sum * scale << "\n";
+			ss << name << "_count{" << labels[i] << extraLabel << "} " << merged.count << "\n";
+		}
+	}
+}
+
+void Histogram::Record(uint64_t value, uint64_t times)
+{
+	Add(buckets[GetBucket(value)], times);
+	Add(count, times);
+	Add(sum, value * times);
+}
+
+uint32_t Histogram::GetBucket(uint64_t value)
+{
+	if (value < SUB_BUCKETS)
+		return (uint32_t)value;
+
+	const uint32_t bit = GetHighestBit(value);
+	if (bit >= 32) // Past the last power of two.
+		return BUCKET_COUNT - 1;
+
+	const uint32_t shift = bit - 4; // Keeps the top 4 bits under the highest one.
+	return SUB_BUCKETS + (bit - 4) * SUB_BUCKETS + (uint32_t)((value >> shift) & (SUB_BUCKETS - 1));
+}
+
+uint64_t Histogram::GetBucketValue(uint32_t bucket)
+{
+	if (bucket < SUB_BUCKETS)
+		return bucket;
+
+	const uint32_t shift = (bucket - SUB_BUCKETS) / SUB_BUCKETS;
+	const uint64_t lowest = (uint64_t)(SUB_BUCKETS + (bucket - SUB_BUCKETS) % SUB_BUCKETS) << shift;
+	return lowest + ((uint64_t)1 << shift) - 1;
+}
+
+PacketMetrics::PacketMetrics()
+	: m_instance(s_nextInstance.fetch_add(1, std::memory_order_relaxed))
+{
+	m_names[(uint32_t)DefaultPacketID::PACKET_TRANSFER_BEGIN] = "PACKET_TRANSFER_BEGIN";
+	m_names[(uint32_t)DefaultPacketID::PACKET_TRANSFER_CHUNK] = "PACKET_TRANSFER_CHUNK";
+	m_names[(uint32_t)DefaultPacketID::PACKET_TRANSFER_END] = "PACKET_TRANSFER_END";
+	m_names[(uint32_t)DefaultPacketID::PACKET_BATCH] = "PACKET_BATCH";
+	m_names[(uint32_t)DefaultPacketID::PACKET_SNAPSHOT] = "PACKET_SNAPSHOT";
+	m_names[(uint32_t)DefaultPacketID::PACKET_SNAPSHOT_ACK] = "PACKET_SNAPSHOT_ACK";
+	m_names[(uint32_t)DefaultPacketID::PACKET_HANDSHAKE] = "PACKET_HANDSHAKE";
+	m_names[(uint32_t)DefaultPacketID::PACKET_WHOSONLINE] = "PACKET_WHOSONLINE";
+	m_names[(uint32_t)DefaultPacketID::PACKET_NICKNAME] = "PACKET_NICKNAME";
+	m_names[(uint32_t)DefaultPacketID::PACKET_SERVER] = "PACKET_SERVER";
+}
+
+PacketMetrics::~PacketMetrics()
+{
+	for (auto &thread : m_threads)
+	{
+		for (std::atomic<PacketCounters *> &counters : thread->packets)
+			delete counters.load(std::memory_order_relaxed);
+	}
+}
+
+void PacketMetrics::SetExport(const std::string &filePath, unsigned int intervalSeconds)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_exportPath = filePath;
+	m_exportInterval.store(filePath.empty() ? 0 : (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::seconds(intervalSeconds > 0 ? intervalSeconds : 1)).count(),
+		std::memory_order_relaxed);
+}
+
+void PacketMetrics::SetPacketName(uint32_t packetID, const std::string &name)
+{
+	if (packetID >= PACKET_IDS - 1) // The last one's shared.
+		return;
+
+	std::string escaped; // It goes in a label value.
+	for (char c : name)
+	{
+		if (c == '"' || c == '\\')
+			escaped += '\\';
+		if (c != '\n')
+			escaped += c;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_names[packetID] = escaped;
+}
+
+void PacketMetrics::RecordReceived(uint32_t packetID, size_t size)
+{
+	PacketCounters *counters = GetCounters(packetID);
+	if (!counters)
+		return;
+
+	Add(counters->receivedPackets, 1);
+	Add(counters->receivedBytes, size);
+	counters->receivedSizes.Record(size);
+}
+
+void PacketMetrics::RecordSent(uint32_t packetID, size_t size, uint64_t times)
+{
+	PacketCounters *counters = GetCounters(packetID);
+	if (!counters)
+		return;
+
+	Add(counters->sentPackets, times);
+	Add(counters->sentBytes, size * times);
+	counters->sentSizes.Record(size, times);
+}
+
+void PacketMetrics::RecordSent(const Packet &packet, PacketEncoding encoding, uint64_t times)
+{
+	uint32_t packetID = 0;
+	PacketStreamReader packetReader(packet, 0, encoding);
+	if (packetReader.ReadHeader(packetID))
+		RecordSent(packetID, packet.size, times);
+}
+
+void PacketMetrics::RecordHandled(uint32_t packetID, uint64_t nanoseconds, int64_t latencyMicroseconds)
+{
+	PacketCounters *counters = GetCounters(packetID);
+	if (!counters)
+		return;
+
+	counters->handlerNanoseconds.Record(nanoseconds);
+	if (latencyMicroseconds >= 0)
+		counters->latencyMicroseconds.Record((uint64_t)latencyMicroseconds);
+}
+
+PacketMetrics::PacketCounters *PacketMetrics::GetCounters(uint32_t packetID)
+{
+	ThreadCounters *thread = (ThreadCounters*)t_cache.counters;
+	if (t_cache.instance != m_instance) // First time this thread's recorded here, or it recorded to other metrics since.
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		// A thread that's gone could have had the same ID, it's counters carry on with this one.
+		ThreadCounters *&found = m_threadCounters[std::this_thread::get_id()];
+		if (!found)
+		{
+			std::unique_ptr<ThreadCounters> created(new (std::nothrow) ThreadCounters());
+			if (!created)
+				return nullptr;
+
+			found = created.get();
+			m_threads.push_back(std::move(created));
+		}
+
+		thread = found;
+		t_cache.instance = m_instance;
+		t_cache.counters = thread;
+	}
+
+	std::atomic<PacketCounters *> &slot = thread->packets[packetID < PACKET_IDS ? packetID : PACKET_IDS - 1];
+	PacketCounters *counters = slot.load(std::memory_order_relaxed); // Only this thread writes it.
+	if (!counters)
+	{
+		counters = new (std::nothrow) PacketCounters();
+		slot.store(counters, std::memory_order_release); // Readers see it fully constructed.
+	}
+	return counters;
+}
+
+std::string PacketMetrics::Export(const char *role) const
+{
+	std::vector<MergedCounters> counters(PACKET_IDS);
+	std::vector<std::string> labels(PACKET_IDS); // Empty for packet IDs nothing was recorded for.
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (const auto &thread : m_threads)
+		{
+			for (uint32_t i = 0; i < PACKET_IDS; i++)
+			{
+				const PacketCounters *packet = thread->packets[i].load(std::memory_order_acquire);
+				if (!packet)
+					continue;
+
+				MergedCounters &merged = counters[i];
+				merged.receivedPackets += packet->receivedPackets.load(std::memory_order_relaxed);
+				merged.receivedBytes += packet->receivedBytes.load(std::memory_order_relaxed);
+				merged.sentPackets += packet->sentPackets.load(std::memory_order_relaxed);
+				merged.sentBytes += packet->sentBytes.load(std::memory_order_relaxed);
+				merged.receivedSizes.Add(packet->receivedSizes);
+				merged.sentSizes.Add(packet->sentSizes);
+				merged.handlerNanoseconds.Add(packet->handlerNanoseconds);
+				merged.latencyMicroseconds.Add(packet->latencyMicroseconds);
+
+				if (labels[i].empty())
+				{
+					labels[i] = "role=\"" + std::string(role) + "\",id=\"" + (i < PACKET_IDS - 1 ? std::to_string(i) : std::to_string(i) + "+") + "\"";
+					if (!m_names[i].empty())
+						labels[i] += ",packet=\"" + m_names[i] + "\"";
+				}
+			}
+		}
+	}
+
+	std::stringstream ss;
+	ss << std::setprecision(9);
+	WriteCounter(ss, "bcnet_packets_received_total", "Packets received, after unbatching.", labels, counters, &MergedCounters::receivedPackets);
+	WriteCounter(ss, "bcnet_packet_bytes_received_total", "Bytes received, after decompressing, including headers.", labels, counters, &MergedCounters::receivedBytes);
+	WriteCounter(ss, "bcnet_packets_sent_total", "Packets sent, once per connection they went to.", labels, counters, &MergedCounters::sentPackets);
+	WriteCounter(ss, "bcnet_packet_bytes_sent_total", "Bytes sent, before batching and compressing, including headers.", labels, counters, &MergedCounters::sentBytes);
+	WriteSummary(ss, "bcnet_packet_size_bytes", "Packet sizes, including headers.", ",direction=\"received\"", labels, counters, &MergedCounters::receivedSizes, 1.0);
+	WriteSummary(ss, "bcnet_packet_size_bytes", nullptr, ",direction=\"sent\"", labels, counters, &MergedCounters::sentSizes, 1.0);
+	WriteSummary(ss, "bcnet_handler_seconds", "Time spent handling a received packet, in the handler, callbacks or the library itself.", "", labels, counters, &MergedCounters::handlerNanoseconds, 1e-9);
+	WriteSummary(ss, "bcnet_latency_seconds", "Estimated one way latency, half the round trip plus the time from arriving to being handled.", "", labels, counters, &MergedCounters::latencyMicroseconds, 1e-6);
+	return ss.str();
+}
+
+void PacketMetrics::Update(const char *role, bool force)
+{
+	const int64_t interval = m_exportInterval.load(std::memory_order_relaxed);
+	if (interval == 0 || !IsEnabled())
+		return;
+
+	const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (now < m_nextExport && !force)
+		return;
+	m_nextExport = now + std::chrono::nanoseconds(interval);
+
+	std::string path;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		path = m_exportPath;
+	}
+	if (!path.empty())
+		WriteFile(path, role);
+}
+
+bool PacketMetrics::WriteFile(const std::string &filePath, const char *role) const
+{
+	const std::string temporaryPath = filePath + ".tmp";
+	{
+		std::ofstream file(temporaryPath, std::ios::out | std::ios::trunc);
+		if (!file.is_open())
+			return false;
+
+		file << Export(role);
+		if (!file.good())
+			return false;
+	}
+
+#ifdef _WIN32
+	return MoveFileExA(temporaryPath.c_str(), filePath.c_str(), MOVEFILE_REPLACE_EXISTING) != 0; // Rename won't replace a file on Windows.
+#else
+	return rename(temporaryPath.c_str(), filePath.c_str()) == 0; // Replaces it in one step.
+#endif
+}
+
+HandlerTimer::HandlerTimer(PacketMetrics &metrics, uint32_t packetID, const ReceivedMessage &message, int ping)
+	: m_metrics(metrics.IsEnabled() ? &metrics : nullptr), m_packetID(packetID)
+{
+	if (!m_metrics)
+		return;
+
+	const int64_t received = message.GetTimeReceived();
+	if (received > 0)
+	{
+		const int64_t waited = SteamNetworkingUtils()->GetLocalTimestamp() - received; // Same clock GameNetworkingSockets stamped it with.
+		m_latency = (waited > 0 ? waited : 0) + (ping > 0 ? (int64_t)ping * 500 : 0); // Half the round trip, in microseconds.
+	}
+	m_start = std::chrono::steady_clock::now();
+}
+
+HandlerTimer::~HandlerTimer()
+{
+	if (!m_metrics)
+		return;
+
+	const uint64_t nanoseconds = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+	m_metrics->RecordHandled(m_packetID, nanoseconds, m_latency);
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <BCNet/Core/Common.h>
+#include <BCNet/Core/Types.h>
+#include <BCNet/BCNetPacket.h>
+#include <BCNet/BCNetMessage.h>
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <chrono>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace BCNet
+{
+	// Counts values into log-linear buckets like HdrHistogram: values under 16 get a bucket each, above that each power of two
+	// is split into 16 buckets, so a value is never more than about 6% off the bucket it's counted in. Values past 2^32 share the last bucket.
+	// Only one thread writes a histogram, any thread can read it.
+	struct Histogram
+	{
+		static constexpr uint32_t SUB_BUCKETS = 16;
+		static constexpr uint32_t BUCKET_COUNT = SUB_BUCKETS + (32 - 4) * SUB_BUCKETS;
+
+		std::atomic<uint64_t> buckets[BUCKET_COUNT] = {};
+		std::atomic<uint64_t> count{ 0 };
+		std::atomic<uint64_t> sum{ 0 };
+
+		void Record(uint64_t value, uint64_t times = 1); // Only from the owning thread.
+
+		static uint32_t GetBucket(uint64_t value);
+		static uint64_t GetBucketValue(uint32_t bucket); // The highest value that lands in the bucket.
+	};
+
+	// Per packet ID counters and histograms for every packet sent and received, recorded from whichever thread handles the packet.
+	// Each thread records into it's own counters, allocated the first time it records each packet ID, so threads never contend,
+	// and a read adds every thread's counters together. Packet IDs from the last one up share it's counters.
+	class PacketMetrics
+	{
+	public:
+		static constexpr uint32_t PACKET_IDS = 256;
+
+		PacketMetrics();
+		PacketMetrics(const PacketMetrics &) = delete;
+		PacketMetrics &operator=(const PacketMetrics &) = delete;
+		~PacketMetrics();
+
+		void SetEnabled(bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+		bool IsEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+		void SetExport(const std::string &filePath, unsigned int intervalSeconds); // An empty path stops the periodic export.
+		void SetPacketName(uint32_t packetID, const std::string &name);
+
+		void RecordReceived(uint32_t packetID, size_t size);
+		void RecordSent(uint32_t packetID, size_t size, uint64_t times = 1); // Once per connection it goes to.
+		void RecordSent(const Packet &packet, PacketEncoding encoding, uint64_t times = 1); // Reads the packet ID from the header.
+		void RecordHandled(uint32_t packetID, uint64_t nanoseconds, int64_t latencyMicroseconds); // A negative latency wasn't measured.
+
+		std::string Export(const char *role) const; // Prometheus text format.
+		void Update(const char *role, bool force = false); // Writes the export file once the interval is up, or straight away when forced, from the network thread.
+		bool WriteFile(const std::string &filePath, const char *role) const; // Written next to it then moved over it, so readers never see half a file.
+
+	private:
+		struct PacketCounters
+		{
+			std::atomic<uint64_t> receivedPackets{ 0 };
+			std::atomic<uint64_t> receivedBytes{ 0 };
+			std::atomic<uint64_t> sentPackets{ 0 };
+			std::atomic<uint64_t> sentBytes{ 0 };
+			Histogram receivedSizes;
+			Histogram sentSizes;
+			Histogram handlerNanoseconds;
+			Histogram latencyMicroseconds;
+		};
+
+		struct ThreadCounters
+		{
+			std::atomic<PacketCounters *> packets[PACKET_IDS] = {};
+		};
+
+		PacketCounters *GetCounters(uint32_t packetID); // The calling thread's, null if they couldn't be allocated.
+
+	private:
+		const uint64_t m_instance; // Tells apart the metrics a thread has cached counters for.
+		std::atomic<bool> m_enabled{ false };
+
+		mutable std::mutex m_mutex; // Guards everything below, recording only takes it the first time a thread records.
+		std::vector<std::unique_ptr<ThreadCounters>> m_threads;
+		std::unordered_map<std::thread::id, ThreadCounters *> m_threadCounters;
+		std::string m_names[PACKET_IDS];
+		std::string m_exportPath;
+
+		std::atomic<int64_t> m_exportInterval{ 0 }; // Nanoseconds, 0 when it isn't exporting.
+		std::chrono::steady_clock::time_point m_nextExport; // Only touched by the thread calling Update().
+
+	};
+
+	// Times handling a packet from construction to destruction and records it along with the packet's latency, does nothing while metrics are off.
+	// The latency is how long the message waited here after arriving plus half the round trip, there's no shared clock to measure the wire with.
+	class HandlerTimer
+	{
+	public:
+		HandlerTimer(PacketMetrics &metrics, uint32_t packetID, const ReceivedMessage &message, int ping);
+		HandlerTimer(const HandlerTimer &) = delete;
+		HandlerTimer &operator=(const HandlerTimer &) = delete;
+		~HandlerTimer();
+
+		void Cancel() { m_metrics = nullptr; } // Handled somewhere else after all.
+
+	private:
+		PacketMetrics *m_metrics; // Null when it isn't measuring.
+		uint32_t m_packetID;
+		int64_t m_latency = -1;
+		std::chrono::steady_clock::time_point m_start;
+	};
+
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <type_traits>
+
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace BCNet
+{
+	// Holds a value one thread writes and any thread can read without locking.
+	// The sequence is odd while a write is under way, readers copy the value and try again if the sequence moved while they were copying.
+	// The value is kept as relaxed atomic words rather than plain memory so a read racing a write is a retry rather than a data race.
+	// Only one thread may write, and the value has to be trivially copyable.
+	template <typename T>
+	class SeqLock
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "SeqLock values are copied a word at a time.");
+
+	public:
+		SeqLock() { Store(T()); }
+
+		void Store(const T &value)
+		{
+			uint64_t words[WORD_COUNT] = {};
+			memcpy(words, &value, sizeof(T));
+
+			const uint32_t sequence = m_sequence.load(std::memory_order_relaxed);
+			m_sequence.store(sequence + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release); // Readers see the odd sequence before any of the new words.
+
+			for (size_t i = 0; i < WORD_COUNT; i++)
+				m_words[i].store(words[i], std::memory_order_relaxed);
+
+			m_sequence.store(sequence + 2, std::memory_order_release);
+		}
+
+		T Load() const
+		{
+			uint64_t words[WORD_COUNT];
+			uint32_t before, after;
+			do
+			{
+				before = m_sequence.load(std::memory_order_acquire);
+				for (size_t i = 0; i < WORD_COUNT; i++)
+					words[i] = m_words[i].load(std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_acquire); // The words are read before the sequence is checked again.
+				after = m_sequence.load(std::memory_order_relaxed);
+			} while ((before & 1) != 0 || before != after); // Mid write, or written while copying.
+
+			T value;
+			memcpy(&value, words, sizeof(T));
+			return value;
+		}
+
+	private:
+		static constexpr size_t WORD_COUNT = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+		std::atomic<uint32_t> m_sequence{ 0 };
+		std::atomic<uint64_t> m_words[WORD_COUNT];
+
+	};
+
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace BCNet
+{
+	// Refers to a value in a slot map, goes stale once the value is removed even if the slot is reused.
+	struct SlotHandle
+	{
+		static constexpr uint32_t INVALID_INDEX = 0xFFFFFFFF;
+
+		uint32_t index = INVALID_INDEX;
+		uint16_t generation = 0;
+
+		bool IsValid() const { return index != INVALID_INDEX; }
+	};
+
+	// Values are kept packed together in one array so iterating them doesn't chase pointers,
+	// handles go through a slot table to find them, so lookups, inserts and removes are all constant time.
+	// Removing moves the last value into the hole, so pointers to values only last until the map is changed.
+	template <typename T>
+	class SlotMap
+	{
+	public:
+		SlotHandle Insert(T &&value)
+		{
+			uint32_t index;
+			if (m_freeHead != SlotHandle::INVALID_INDEX) // Reuse a slot.
+			{
+				index = m_freeHead;
+				m_freeHead = m_slots[index].dense;
+			}
+			else
+			{
+				index = (uint32_t)m_slots.size();
+				m_slots.push_back(Slot());
+			}
+
+			Slot &slot = m_slots[index];
+			slot.dense = (uint32_t)m_values.size();
+
+			m_values.push_back(std::move(value));
+			m_denseToSlot.push_back(index);
+
+			SlotHandle handle;
+			handle.index = index;
+			handle.generation = slot.generation;
+			return handle;
+		}
+
+		bool Remove(SlotHandle handle)
+		{
+			if (!Get(handle))
+				return false;
+
+			Slot &slot = m_slots[handle.index];
+			const uint32_t dense = slot.dense;
+			const uint32_t last = (uint32_t)m_values.size() - 1;
+
+			if (dense != last) // Fill the hole with the last value.
+			{
+				m_values[dense] = std::move(m_values[last]);
+				m_denseToSlot[dense] = m_denseToSlot[last];
+				m_slots[m_denseToSlot[dense]].dense = dense;
+			}
+			m_values.pop_back();
+			m_denseToSlot.pop_back();
+
+			slot.generation++; // Anyone still holding the handle finds nothing.
+			slot.dense = m_freeHead;
+			m_freeHead = handle.index;
+			return true;
+		}
+
+		T *Get(SlotHandle handle)
+		{
+			if (handle.index >= m_slots.size())
+				return nullptr;
+
+			const Slot &slot = m_slots[handle.index];
+			if (slot.generation != handle.generation || slot.dense >= m_values.size() || m_denseToSlot[slot.dense] != handle.index) // Stale or free.
+				return nullptr;
+			return &m_values[slot.dense];
+		}
+
+		// The handle of the value at a position in the packed array.
+		SlotHandle GetHandle(size_t dense) const
+		{
+			SlotHandle handle;
+			handle.index = m_denseToSlot[dense];
+			handle.generation = m_slots[handle.index].generation;
+			return handle;
+		}
+
+		void Clear()
+		{
+			for (size_t i = 0; i < m_values.size(); i++)
+			{
+				Slot &slot = m_slots[m_denseToSlot[i]];
+				slot.generation++;
+				slot.dense = m_freeHead;
+				m_freeHead = m_denseToSlot[i];
+			}
+			m_values.clear();
+			m_denseToSlot.clear();
+		}
+
+		size_t GetSize() const { return m_values.size(); }
+		bool IsEmpty() const { return m_values.empty(); }
+
+		T *begin() { return m_values.data(); }
+		T *end() { return m_values.data() + m_values.size(); }
+		const T *begin() const { return m_values.data(); }
+		const T *end() const { return m_values.data() + m_values.size(); }
+
+	private:
+		struct Slot
+		{
+			uint32_t dense = 0; // Where the value is, or the next free slot while it's free.
+			uint16_t generation = 0;
+		};
+
+		std::vector<T> m_values;
+		std::vector<uint32_t> m_denseToSlot;
+		std::vector<Slot> m_slots;
+		uint32_t m_freeHead = SlotHandle::INVALID_INDEX;
+
+	};
+
+}
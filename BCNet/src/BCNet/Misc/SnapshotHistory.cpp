@@ -0,0 +1,82 @@
+#include "SnapshotHistory.h"
+
+#include <string.h>
+
+using namespace BCNet;
+
+SnapshotHistory::SnapshotHistory(size_t capacity)
+	: m_snapshots(capacity > 0 ? capacity : 1)
+{ }
+
+void SnapshotHistory::SetCapacity(size_t capacity)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_snapshots.assign(capacity > 0 ? capacity : 1, nullptr); // The sequence carries on, acknowledgements of old snapshots mustn't match new ones.
+}
+
+size_t SnapshotHistory::GetCapacity() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_snapshots.size();
+}
+
+uint32_t SnapshotHistory::Push(const Packet &data)
+{
+	std::shared_ptr<Snapshot> snapshot = std::make_shared<Snapshot>();
+	snapshot->data.Allocate(data.size); // Copied outside the lock.
+	if (data.size > 0)
+		memcpy(snapshot->data.GetData(), data.data, data.size);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_latest++;
+	if (m_latest == 0) // Wrapped around, 0 means no snapshot.
+		m_latest++;
+
+	snapshot->sequence = m_latest;
+	m_snapshots[m_latest % m_snapshots.size()] = std::move(snapshot);
+	return m_latest;
+}
+
+void SnapshotHistory::Insert(uint32_t sequence, PooledPacket &&data)
+{
+	if (sequence == 0)
+		return;
+
+	std::shared_ptr<Snapshot> snapshot = std::make_shared<Snapshot>();
+	snapshot->sequence = sequence;
+	snapshot->data = std::move(data);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_snapshots[sequence % m_snapshots.size()] = std::move(snapshot);
+	if (m_latest == 0 || IsNewerSnapshot(sequence, m_latest))
+		m_latest = sequence;
+}
+
+std::shared_ptr<const Snapshot> SnapshotHistory::Get(uint32_t sequence) const
+{
+	if (sequence == 0)
+		return nullptr;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	const std::shared_ptr<const Snapshot> &snapshot = m_snapshots[sequence % m_snapshots.size()];
+	return snapshot && snapshot->sequence == sequence ? snapshot : nullptr; // The slot could have been reused since.
+}
+
+uint32_t SnapshotHistory::GetLatestSequence() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_latest;
+}
+
+void SnapshotHistory::Clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for (std::shared_ptr<const Snapshot> &snapshot : m_snapshots)
+		snapshot.reset();
+	m_latest = 0;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <BCNet/Core/Common.h>
+#include <BCNet/BCNetPacket.h>
+#include <BCNet/BCNetPacketPool.h>
+
+#include <memory>
+#include <vector>
+#include <mutex>
+
+#include <stdint.h>
+
+namespace BCNet
+{
+	// A state snapshot and it's sequence number, 0 is never used so it can mean "no snapshot".
+	struct Snapshot
+	{
+		uint32_t sequence = 0;
+		PooledPacket data;
+	};
+
+	// Whether sequence a came after sequence b, allowing for the sequence wrapping around.
+	inline bool IsNewerSnapshot(uint32_t a, uint32_t b)
+	{
+		return (int32_t)(a - b) > 0;
+	}
+
+	// The last few snapshots sent or received, kept around to encode or decode deltas against.
+	// Snapshots are shared out so they stay alive while in use even if they fall out of the history.
+	// Can be used from any thread.
+	class SnapshotHistory
+	{
+	public:
+		static constexpr size_t DEFAULT_CAPACITY = 32;
+
+	public:
+		explicit SnapshotHistory(size_t capacity = DEFAULT_CAPACITY);
+
+		void SetCapacity(size_t capacity); // Drops the snapshots kept so far.
+		size_t GetCapacity() const;
+
+		uint32_t Push(const Packet &data); // Copies the data in as the next snapshot, returns it's sequence.
+		void Insert(uint32_t sequence, PooledPacket &&data); // Adds a snapshot that was numbered elsewhere.
+
+		std::shared_ptr<const Snapshot> Get(uint32_t sequence) const; // Null if it's not in the history anymore.
+		uint32_t GetLatestSequence() const; // 0 if nothing has been added yet.
+
+		void Clear(); // Drops the snapshots and starts the sequence over.
+
+	private:
+		mutable std::mutex m_mutex;
+		std::vector<std::shared_ptr<const Snapshot>> m_snapshots; // Indexed by sequence modulo the capacity.
+		uint32_t m_latest = 0;
+
+	};
+
+}
@@ -0,0 +1,112 @@
+#include "StatsTable.h"
+
+#include <sstream>
+#include <iomanip>
+#include <new>
+
+#include <steam/steamnetworkingsockets.h>
+
+using namespace BCNet;
+
+ConnectionStats BCNet::MakeConnectionStats(const SteamNetConnectionRealTimeStatus_t &status)
+{
+	ConnectionStats stats;
+	stats.ping = status.m_nPing;
+	stats.localQuality = status.m_flConnectionQualityLocal;
+	stats.remoteQuality = status.m_flConnectionQualityRemote;
+	stats.outPacketsPerSecond = status.m_flOutPacketsPerSec;
+	stats.outBytesPerSecond = status.m_flOutBytesPerSec;
+	stats.inPacketsPerSecond = status.m_flInPacketsPerSec;
+	stats.inBytesPerSecond = status.m_flInBytesPerSec;
+	stats.sendRateBytesPerSecond = status.m_nSendRateBytesPerSecond;
+	stats.pendingReliableBytes = status.m_cbPendingReliable;
+	stats.pendingUnreliableBytes = status.m_cbPendingUnreliable;
+	stats.sentUnackedReliableBytes = status.m_cbSentUnackedReliable;
+	stats.queueTimeMicroseconds = status.m_usecQueueTime;
+	return stats;
+}
+
+std::string BCNet::FormatConnectionStats(const ConnectionStats &stats)
+{
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(1);
+	ss << "ping " << stats.ping << "ms, quality " << std::setprecision(2) << stats.localQuality << "/" << stats.remoteQuality << std::setprecision(1);
+	ss << ", out " << stats.outBytesPerSecond / 1024.0f << " KB/s (" << stats.outPacketsPerSecond << " pkt/s)";
+	ss << ", in " << stats.inBytesPerSecond / 1024.0f << " KB/s (" << stats.inPacketsPerSecond << " pkt/s)";
+	ss << ", rate " << stats.sendRateBytesPerSecond / 1024 << " KB/s";
+	ss << ", pending " << stats.pendingReliableBytes << "/" << stats.pendingUnreliableBytes << " B, unacked " << stats.sentUnackedReliableBytes << " B";
+	ss << ", queue " << stats.queueTimeMicroseconds / 1000.0 << "ms";
+	return ss.str();
+}
+
+StatsTable::~StatsTable()
+{
+	for (std::atomic<Page *> &page : m_pages)
+		delete page.load(std::memory_order_relaxed);
+}
+
+void StatsTable::Store(uint32_t index, uint32_t connection, const ConnectionStats &stats)
+{
+	SeqLock<ConnectionStatsEntry> *entry = GetEntry(index, true);
+	if (!entry)
+		return;
+
+	ConnectionStatsEntry value;
+	value.connection = connection;
+	value.stats = stats;
+	entry->Store(value);
+}
+
+void StatsTable::Clear(uint32_t index)
+{
+	SeqLock<ConnectionStatsEntry> *entry = GetEntry(index, false);
+	if (entry)
+		entry->Store(ConnectionStatsEntry());
+}
+
+bool StatsTable::Load(uint32_t index, uint32_t connection, ConnectionStats &stats) const
+{
+	const SeqLock<ConnectionStatsEntry> *entry = GetEntry(index);
+	if (!entry)
+		return false;
+
+	const ConnectionStatsEntry value = entry->Load();
+	if (value.connection == 0 || value.connection != connection) // Empty, or the slot's been reused.
+		return false;
+
+	stats = value.stats;
+	return true;
+}
+
+SeqLock<ConnectionStatsEntry> *StatsTable::GetEntry(uint32_t index, bool create)
+{
+	const uint32_t pageIndex = index / PAGE_SIZE;
+	if (pageIndex >= MAX_PAGES)
+		return nullptr;
+
+	Page *page = m_pages[pageIndex].load(std::memory_order_relaxed); // Only this thread writes them.
+	if (!page)
+	{
+		if (!create)
+			return nullptr;
+
+		page = new (std::nothrow) Page();
+		if (!page)
+			return nullptr;
+
+		m_pages[pageIndex].store(page, std::memory_order_release); // Readers see it fully constructed.
+		if (pageIndex >= m_pageCount.load(std::memory_order_relaxed))
+			m_pageCount.store(pageIndex + 1, std::memory_order_release);
+	}
+	return &page->entries[index % PAGE_SIZE];
+}
+
+const SeqLock<ConnectionStatsEntry> *StatsTable::GetEntry(uint32_t index) const
+{
+	const uint32_t pageIndex = index / PAGE_SIZE;
+	if (pageIndex >= MAX_PAGES)
+		return nullptr;
+
+	const Page *page = m_pages[pageIndex].load(std::memory_order_acquire);
+	return page ? &page->entries[index % PAGE_SIZE] : nullptr;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <BCNet/Core/Common.h>
+#include <BCNet/Core/Types.h>
+
+#include "SeqLock.h"
+
+#include <string>
+#include <atomic>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Foward Declare.
+struct SteamNetConnectionRealTimeStatus_t;
+
+namespace BCNet
+{
+	// One connection's latest stats, the connection is 0 when there aren't any.
+	struct ConnectionStatsEntry
+	{
+		uint32_t connection = 0; // HSteamNetConnection
+		ConnectionStats stats;
+	};
+
+	ConnectionStats MakeConnectionStats(const SteamNetConnectionRealTimeStatus_t &status);
+	std::string FormatConnectionStats(const ConnectionStats &stats); // One line for the console.
+
+	// The latest stats of every client a shard owns, written by the shard's thread and read from any thread without locking.
+	// Entries are found by the client's slot index and live in pages that are never moved or freed until the table is,
+	// so readers never wait on the shard, they only retry if they catch an entry part way through being written.
+	class StatsTable
+	{
+	public:
+		static constexpr uint32_t PAGE_SIZE = 256;
+		static constexpr uint32_t MAX_PAGES = 1024; // Slots past this many pages aren't tracked.
+
+		StatsTable() = default;
+		StatsTable(const StatsTable &) = delete;
+		StatsTable &operator=(const StatsTable &) = delete;
+		~StatsTable();
+
+		void Store(uint32_t index, uint32_t connection, const ConnectionStats &stats); // Only from the owning thread.
+		void Clear(uint32_t index); // Only from the owning thread, once the slot's client is gone.
+
+		bool Load(uint32_t index, uint32_t connection, ConnectionStats &stats) const; // Returns false unless the slot holds that connection's stats.
+
+		// Calls back with every connection that has stats, from any thread.
+		template <typename Callback>
+		void ForEach(Callback &&callback) const
+		{
+			const uint32_t pageCount = m_pageCount.load(std::memory_order_acquire);
+			for (uint32_t i = 0; i < pageCount; i++)
+			{
+				const Page *page = m_pages[i].load(std::memory_order_acquire);
+				if (!page)
+					continue;
+
+				for (uint32_t j = 0; j < PAGE_SIZE; j++)
+				{
+					const ConnectionStatsEntry entry = page->entries[j].Load();
+					if (entry.connection != 0)
+						callback(entry.connection, entry.stats);
+				}
+			}
+		}
+
+	private:
+		struct Page
+		{
+			SeqLock<ConnectionStatsEntry> entries[PAGE_SIZE];
+		};
+
+		SeqLock<ConnectionStatsEntry> *GetEntry(uint32_t index, bool create);
+		const SeqLock<ConnectionStatsEntry> *GetEntry(uint32_t index) const;
+
+	private:
+		std::atomic<Page *> m_pages[MAX_PAGES] = {};
+		std::atomic<uint32_t> m_pageCount{ 0 }; // One past the last page allocated, so ForEach() doesn't look at them all.
+
+	};
+
+}
@@ -0,0 +1,238 @@
+#include "Tracer.h"
+
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <new>
+
+using namespace BCNet;
+
+namespace
+{
+	constexpr size_t BUFFER_CAPACITY = 1 << 16; // Events kept per thread, the oldest are overwritten once it's full.
+
+	// Written with relaxed stores so the writer can read them while the owner overwrites them, it checks the head afterwards to see if it did.
+	struct TraceSlot
+	{
+		std::atomic<const char *> name{ nullptr };
+		std::atomic<uint64_t> start{ 0 };
+		std::atomic<uint64_t> end{ 0 };
+	};
+
+	struct TraceBuffer
+	{
+		TraceSlot slots[BUFFER_CAPACITY];
+		std::atomic<uint64_t> head{ 0 }; // Events ever recorded, the next one goes in head % BUFFER_CAPACITY.
+
+		// Guarded by the registry's mutex.
+		uint32_t threadID = 0;
+		std::string threadName;
+		bool inUse = false; // Whether a thread still owns it.
+	};
+
+	struct TraceRegistry
+	{
+		std::mutex mutex;
+		std::vector<std::unique_ptr<TraceBuffer>> buffers; // Never freed, a thread that's gone can still have events in the trace.
+		uint32_t nextThreadID = 1;
+
+		uint64_t startTicks = 0;
+		std::chrono::steady_clock::time_point startTime;
+	};
+
+	TraceRegistry &GetRegistry()
+	{
+		static TraceRegistry registry; // Constructed on first use, threads can record during static initialization.
+		return registry;
+	}
+
+	// The calling thread's buffer, handed back for another thread to use once it exits.
+	struct ThreadTrace
+	{
+		TraceBuffer *buffer = nullptr;
+		std::string name;
+
+		~ThreadTrace()
+		{
+			if (!buffer)
+				return;
+
+			TraceRegistry &registry = GetRegistry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			buffer->inUse = false;
+		}
+	};
+
+	thread_local ThreadTrace t_thread;
+
+	TraceBuffer *AcquireBuffer()
+	{
+		TraceRegistry &registry = GetRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+
+		TraceBuffer *buffer = nullptr;
+		if (!Tracer::IsRecording()) // While recording, a finished thread's events are left for the trace.
+		{
+			for (auto &other : registry.buffers)
+			{
+				if (!other->inUse)
+				{
+					buffer = other.get();
+					break;
+				}
+			}
+		}
+
+		if (!buffer)
+		{
+			std::unique_ptr<TraceBuffer> created(new (std::nothrow) TraceBuffer());
+			if (!created) // Goes without.
+				return nullptr;
+
+			buffer = created.get();
+			registry.buffers.push_back(std::move(created));
+		}
+
+		buffer->inUse = true;
+		buffer->threadID = registry.nextThreadID++;
+		buffer->threadName = t_thread.name.empty() ? "Thread " + std::to_string(buffer->threadID) : t_thread.name;
+		t_thread.buffer = buffer;
+		return buffer;
+	}
+
+	void WriteEscaped(std::ofstream &file, const char *text)
+	{
+		for (; *text; text++)
+		{
+			if (*text == '"' || *text == '\\')
+				file << '\\';
+			if ((unsigned char)*text >= 0x20)
+				file << *text;
+		}
+	}
+}
+
+std::atomic<bool> Tracer::s_recording{ false };
+
+bool Tracer::Start()
+{
+#if BCNET_TRACING
+	TraceRegistry &registry = GetRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	if (s_recording.load(std::memory_order_relaxed))
+		return false;
+
+	registry.startTime = std::chrono::steady_clock::now();
+	registry.startTicks = Now();
+	s_recording.store(true, std::memory_order_relaxed);
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool Tracer::Stop(const std::string &filePath)
+{
+	TraceRegistry &registry = GetRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	if (!s_recording.load(std::memory_order_relaxed))
+		return false;
+
+	s_recording.store(false, std::memory_order_relaxed);
+	const uint64_t stopTicks = Now();
+	const std::chrono::steady_clock::time_point stopTime = std::chrono::steady_clock::now();
+
+	// Ticks to microseconds, measured over the whole recording against the steady clock.
+	const double elapsed = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(stopTime - registry.startTime).count() / 1000.0;
+	const double microsecondsPerTick = stopTicks > registry.startTicks ? elapsed / (double)(stopTicks - registry.startTicks) : 0.0;
+
+	std::ofstream file(filePath, std::ios::out | std::ios::trunc);
+	if (!file.is_open())
+		return false;
+
+	file << std::fixed << std::setprecision(3);
+	file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+
+	bool first = true;
+	struct Event
+	{
+		const char *name;
+		uint64_t start;
+		uint64_t end;
+	};
+	std::vector<Event> events;
+	for (auto &buffer : registry.buffers)
+	{
+		// Copied out first, anything the owner could have overwritten while it was copied is dropped.
+		const uint64_t head = buffer->head.load(std::memory_order_acquire);
+		const uint64_t begin = head > BUFFER_CAPACITY ? head - BUFFER_CAPACITY : 0;
+
+		events.clear();
+		for (uint64_t i = begin; i < head; i++)
+		{
+			const TraceSlot &slot = buffer->slots[i % BUFFER_CAPACITY];
+			events.push_back({ slot.name.load(std::memory_order_relaxed), slot.start.load(std::memory_order_relaxed), slot.end.load(std::memory_order_relaxed) });
+		}
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		const uint64_t after = buffer->head.load(std::memory_order_relaxed);
+		const uint64_t valid = after >= BUFFER_CAPACITY ? after - BUFFER_CAPACITY + 1 : 0; // The slot being written next could be any of the ones before this.
+
+		bool named = false;
+		for (uint64_t i = begin; i < head; i++)
+		{
+			const Event &event = events[(size_t)(i - begin)];
+			if (i < valid || !event.name || event.start < registry.startTicks || event.end > stopTicks || event.end < event.start)
+				continue;
+
+			if (!named) // Only threads with something in the trace get a name.
+			{
+				file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadID << ",\"args\":{\"name\":\"";
+				WriteEscaped(file, buffer->threadName.c_str());
+				file << "\"}}";
+				first = false;
+				named = true;
+			}
+
+			file << ",\n{\"name\":\"";
+			WriteEscaped(file, event.name);
+			file << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadID;
+			file << ",\"ts\":" << (double)(event.start - registry.startTicks) * microsecondsPerTick;
+			file << ",\"dur\":" << (double)(event.end - event.start) * microsecondsPerTick << "}";
+		}
+	}
+
+	file << "\n]}\n";
+	return file.good();
+}
+
+void Tracer::SetThreadName(const std::string &name)
+{
+	t_thread.name = name;
+	if (!t_thread.buffer)
+		return;
+
+	TraceRegistry &registry = GetRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	t_thread.buffer->threadName = name;
+}
+
+void Tracer::Record(const char *name, uint64_t start, uint64_t end)
+{
+	TraceBuffer *buffer = t_thread.buffer;
+	if (!buffer)
+	{
+		buffer = AcquireBuffer(); // Once per thread.
+		if (!buffer)
+			return;
+	}
+
+	const uint64_t head = buffer->head.load(std::memory_order_relaxed); // Only this thread writes it.
+	TraceSlot &slot = buffer->slots[head % BUFFER_CAPACITY];
+	slot.name.store(name, std::memory_order_relaxed);
+	slot.start.store(start, std::memory_order_relaxed);
+	slot.end.store(end, std::memory_order_relaxed);
+	buffer->head.store(head + 1, std::memory_order_release);
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <string>
+#include <atomic>
+#include <chrono>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+// Trace markers are compiled in unless this is set to 0, when they're compiled in but not recording they cost one relaxed load.
+#ifndef BCNET_TRACING
+#define BCNET_TRACING 1
+#endif
+
+#if BCNET_TRACING
+#define BCNET_TRACE_CONCAT_INNER(a, b) a##b
+#define BCNET_TRACE_CONCAT(a, b) BCNET_TRACE_CONCAT_INNER(a, b)
+// Records how long the rest of the enclosing scope takes, the name has to be a string literal.
+#define BCNET_TRACE_SCOPE(name) ::BCNet::TraceScope BCNET_TRACE_CONCAT(traceScope, __LINE__)(name)
+#else
+#define BCNET_TRACE_SCOPE(name)
+#endif
+
+namespace BCNet
+{
+	// Records scoped events from every thread into per thread ring buffers, and writes them out as Chrome trace JSON,
+	// which chrome://tracing and Perfetto both open.
+	// Each thread only ever writes to it's own buffer, an event is a few relaxed stores and a release of the buffer's head,
+	// so recording never locks or waits on another thread. A buffer is only allocated once it's thread records something.
+	// Timestamps are raw CPU timestamp counter ticks where there is one, converted to time when the trace is written.
+	class Tracer
+	{
+	public:
+		static bool Start(); // Starts recording, returns false if it already is or tracing was compiled out.
+		static bool Stop(const std::string &filePath); // Stops recording and writes what was recorded, returns false if it wasn't recording or the file couldn't be written.
+
+		static bool IsRecording() { return s_recording.load(std::memory_order_relaxed); }
+
+		static void SetThreadName(const std::string &name); // What the calling thread is called in the trace.
+
+		static void Record(const char *name, uint64_t start, uint64_t end); // From the calling thread, in Now() ticks.
+
+		static uint64_t Now()
+		{
+#if defined(_M_X64) || defined(__x86_64__)
+			return __rdtsc();
+#else
+			return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+		}
+
+	private:
+		static std::atomic<bool> s_recording;
+
+	};
+
+	// Times the scope it's declared in, see BCNET_TRACE_SCOPE.
+	class TraceScope
+	{
+	public:
+		explicit TraceScope(const char *name) : m_name(name), m_start(Tracer::IsRecording() ? Tracer::Now() : 0) {}
+		TraceScope(const TraceScope &) = delete;
+		TraceScope &operator=(const TraceScope &) = delete;
+		~TraceScope()
+		{
+			if (m_start != 0) // Started while recording, finished even if it's stopped since, the writer leaves it out.
+				Tracer::Record(m_name, m_start, Tracer::Now());
+		}
+
+	private:
+		const char *m_name;
+		uint64_t m_start;
+	};
+
+}
@@ -0,0 +1,428 @@
+#include "TransferManager.h"
+
+#include <algorithm>
+#include <new>
+
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace BCNet;
+
+namespace
+{
+	constexpr size_t CHUNK_HEADER_SIZE = 32; // The packet header, ID and offset, with room to spare.
+}
+
+// -------------------------- MAPPEDFILE
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const std::string &path)
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || (uint64_t)size.QuadPart > SIZE_MAX)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	m_file = file;
+	m_size = (uint64_t)size.QuadPart;
+	if (m_size == 0) // Nothing to map.
+		return true;
+
+	m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping)
+		m_data = (const uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+	const int file = open(path.c_str(), O_RDONLY);
+	if (file < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(file, &info) != 0 || !S_ISREG(info.st_mode) || (uint64_t)info.st_size > SIZE_MAX)
+	{
+		close(file);
+		return false;
+	}
+
+	m_size = (uint64_t)info.st_size;
+	if (m_size > 0)
+	{
+		void *data = mmap(nullptr, (size_t)m_size, PROT_READ, MAP_PRIVATE, file, 0);
+		if (data != MAP_FAILED)
+		{
+			m_data = (const uint8_t*)data;
+			madvise(data, (size_t)m_size, MADV_SEQUENTIAL); // It's read front to back, read ahead.
+		}
+	}
+	close(file); // The mapping keeps it open.
+
+	if (m_size == 0)
+		return true;
+#endif
+
+	if (!m_data)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (m_data)
+		UnmapViewOfFile(m_data);
+	if (m_mapping)
+		CloseHandle(m_mapping);
+	if (m_file)
+		CloseHandle(m_file);
+	m_mapping = nullptr;
+	m_file = nullptr;
+#else
+	if (m_data)
+		munmap((void*)m_data, (size_t)m_size);
+#endif
+
+	m_data = nullptr;
+	m_size = 0;
+}
+
+// -------------------------- TRANSFERMANAGER
+void TransferManager::Add(OutgoingTransfer &&transfer)
+{
+	m_outgoing.push_back(std::move(transfer));
+}
+
+void TransferManager::Merge(TransferManager &other)
+{
+	for (OutgoingTransfer &transfer : other.m_outgoing)
+		m_outgoing.push_back(std::move(transfer));
+	m_sent.insert(m_sent.end(), other.m_sent.begin(), other.m_sent.end());
+	for (auto &[id, transfer] : other.m_incoming)
+		m_incoming.emplace(id, std::move(transfer));
+
+	other.m_outgoing.clear();
+	other.m_sent.clear();
+	other.m_incoming.clear();
+}
+
+bool TransferManager::Pump(TransferConnection &connection, PacketEncoding encoding, size_t budget, size_t chunkSize)
+{
+	bool sent = false;
+	chunkSize = std::clamp<size_t>(chunkSize, 1, TRANSFER_MAX_CHUNK_SIZE);
+
+	while (!m_outgoing.empty() && budget > 0)
+	{
+		OutgoingTransfer &transfer = m_outgoing.front();
+		if (!transfer.begun)
+		{
+			PacketStreamWriter packetWriter(encoding);
+			packetWriter.WriteHeader((uint32_t)DefaultPacketID::PACKET_TRANSFER_BEGIN);
+			packetWriter.WriteRaw<uint32_t>(transfer.info.id);
+			packetWriter.WriteRaw<uint32_t>(transfer.info.tag);
+			packetWriter.WriteRaw<uint64_t>(transfer.info.size);
+			connection.SendTransferPacket(packetWriter.GetPacket());
+
+			transfer.begun = true;
+			sent = true;
+		}
+
+		const uint64_t previous = transfer.info.transferred;
+		while (transfer.info.transferred < transfer.info.size && budget > 0)
+		{
+			const size_t size = (size_t)std::min<uint64_t>(chunkSize, transfer.info.size - transfer.info.transferred);
+
+			PacketStreamWriter packetWriter(encoding);
+			packetWriter.Reserve(CHUNK_HEADER_SIZE + size);
+			packetWriter.WriteHeader((uint32_t)DefaultPacketID::PACKET_TRANSFER_CHUNK, PACKET_FLAG_FRAGMENTED);
+			packetWriter.WriteRaw<uint32_t>(transfer.info.id);
+			packetWriter.WriteRaw<uint64_t>(transfer.info.transferred);
+			packetWriter.WriteData((const char*)transfer.data + transfer.info.transferred, size); // Only this chunk's pages of a mapped file are read in.
+			connection.SendTransferPacket(packetWriter.GetPacket());
+
+			transfer.info.transferred += size;
+			budget = size < budget ? budget - size : 0;
+			sent = true;
+		}
+
+		// Copied, the callback could start or cancel transfers.
+		const TransferInfo info = transfer.info;
+		const bool finished = info.transferred == info.size;
+		if (finished) // Nothing left to read, the file can be closed while the receiver catches up.
+		{
+			m_sent.push_back(info);
+			m_outgoing.pop_front();
+		}
+
+		if (info.transferred != previous)
+			connection.OnTransferProgress(info);
+
+		if (!finished) // Out of budget.
+			break;
+	}
+
+	return sent;
+}
+
+bool TransferManager::IsTransferPacket(uint32_t packetID)
+{
+	return packetID == (uint32_t)DefaultPacketID::PACKET_TRANSFER_BEGIN || packetID == (uint32_t)DefaultPacketID::PACKET_TRANSFER_CHUNK ||
+		packetID == (uint32_t)DefaultPacketID::PACKET_TRANSFER_END;
+}
+
+bool TransferManager::HandlePacket(TransferConnection &connection, uint32_t packetID, PacketStreamReader &packetReader, PacketEncoding encoding)
+{
+	switch ((DefaultPacketID)packetID)
+	{
+		case DefaultPacketID::PACKET_TRANSFER_BEGIN:
+			return HandleBegin(connection, packetReader, encoding);
+		case DefaultPacketID::PACKET_TRANSFER_CHUNK:
+			return HandleChunk(connection, packetReader, encoding);
+		case DefaultPacketID::PACKET_TRANSFER_END:
+			return HandleEnd(connection, packetReader);
+		default:
+			return false;
+	}
+}
+
+bool TransferManager::HandleBegin(TransferConnection &connection, PacketStreamReader &packetReader, PacketEncoding encoding)
+{
+	TransferInfo info;
+	info.incoming = true;
+	if (!packetReader.ReadRaw<uint32_t>(info.id) || !packetReader.ReadRaw<uint32_t>(info.tag) || !packetReader.ReadRaw<uint64_t>(info.size))
+		return false;
+
+	if (m_incoming.count(info.id)) // Still receiving one with that ID.
+		return false;
+
+	uint64_t incomingSize = 0;
+	for (const auto &incoming : m_incoming)
+		incomingSize += incoming.second.info.size;
+
+	// Refused before anything is asked for or allocated, the size is whatever the sender says it is.
+	const uint64_t maxIncomingSize = connection.GetMaxIncomingSize();
+	if (info.size > connection.GetMaxTransferSize() || incomingSize > maxIncomingSize || info.size > maxIncomingSize - incomingSize)
+	{
+		SendEnd(connection, info.id, TransferResult::REFUSED, true, encoding);
+		return true;
+	}
+
+	Packet destination;
+	if (!connection.OnTransferStarted(info, destination))
+	{
+		SendEnd(connection, info.id, TransferResult::REFUSED, true, encoding);
+		return true;
+	}
+
+	IncomingTransfer transfer;
+	transfer.info = info;
+	if (destination.data)
+	{
+		if (destination.size < info.size) // Wouldn't fit.
+		{
+			SendEnd(connection, info.id, TransferResult::FAILED, true, encoding);
+			connection.OnTransferCompleted(info, TransferResult::FAILED, Packet());
+			return true;
+		}
+		transfer.destination = Packet(destination, (size_t)info.size);
+	}
+	else if (info.size > 0)
+	{
+		if (info.size <= SIZE_MAX)
+			transfer.storage.reset(new (std::nothrow) uint8_t[(size_t)info.size]); // Allocated once, chunks are copied straight into place.
+		if (!transfer.storage)
+		{
+			SendEnd(connection, info.id, TransferResult::FAILED, true, encoding);
+			connection.OnTransferCompleted(info, TransferResult::FAILED, Packet());
+			return true;
+		}
+		transfer.destination = Packet(transfer.storage.get(), (size_t)info.size);
+	}
+
+	if (info.size == 0) // Nothing to wait for.
+	{
+		SendEnd(connection, info.id, TransferResult::COMPLETED, true, encoding);
+		connection.OnTransferCompleted(info, TransferResult::COMPLETED, transfer.destination);
+		return true;
+	}
+
+	m_incoming.emplace(info.id, std::move(transfer));
+	return true;
+}
+
+bool TransferManager::HandleChunk(TransferConnection &connection, PacketStreamReader &packetReader, PacketEncoding encoding)
+{
+	uint32_t id = 0;
+	uint64_t offset = 0;
+	if (!packetReader.ReadRaw<uint32_t>(id) || !packetReader.ReadRaw<uint64_t>(offset))
+		return false;
+
+	auto it = m_incoming.find(id);
+	if (it == m_incoming.end()) // Refused or cancelled, the rest of it was already on the way.
+		return true;
+
+	const size_t size = packetReader.GetRemainingSize();
+	Packet chunk;
+	if (size == 0 || offset != it->second.info.transferred || size > it->second.info.size - offset || !packetReader.ReadView(chunk, size))
+	{
+		const TransferInfo info = it->second.info;
+		m_incoming.erase(it);
+		SendEnd(connection, id, TransferResult::FAILED, true, encoding);
+		connection.OnTransferCompleted(info, TransferResult::FAILED, Packet());
+		return false;
+	}
+
+	IncomingTransfer &transfer = it->second;
+	uint8_t *place = transfer.destination.As<uint8_t>() + offset;
+	memcpy(place, chunk.data, size);
+	transfer.info.transferred += size;
+
+	const TransferInfo info = transfer.info;
+	if (info.transferred == info.size)
+	{
+		IncomingTransfer finished = std::move(transfer); // Kept until the callbacks are done with it.
+		m_incoming.erase(it);
+
+		SendEnd(connection, id, TransferResult::COMPLETED, true, encoding);
+		connection.OnTransferChunk(info, Packet(place, size));
+		connection.OnTransferProgress(info);
+		connection.OnTransferCompleted(info, TransferResult::COMPLETED, finished.destination);
+		return true;
+	}
+
+	connection.OnTransferChunk(info, Packet(place, size)); // The transfer is looked up again after each, the callbacks could cancel it.
+	if (m_incoming.count(id))
+		connection.OnTransferProgress(info);
+	return true;
+}
+
+bool TransferManager::HandleEnd(TransferConnection &connection, PacketStreamReader &packetReader)
+{
+	uint32_t id = 0;
+	uint8_t result = 0, receiving = 0;
+	if (!packetReader.ReadRaw<uint32_t>(id) || !packetReader.ReadRaw<uint8_t>(result) || !packetReader.ReadRaw<uint8_t>(receiving) ||
+		result > (uint8_t)TransferResult::FAILED)
+		return false;
+
+	TransferInfo info;
+	if (receiving) // They were receiving it, it's one of ours.
+	{
+		if (!TakeOutgoing(id, info))
+			return true; // Cancelled on this end first.
+	}
+	else
+	{
+		auto it = m_incoming.find(id);
+		if (it == m_incoming.end())
+			return true;
+
+		info = it->second.info;
+		m_incoming.erase(it);
+
+		if ((TransferResult)result == TransferResult::COMPLETED) // Only the receiver knows when it's done.
+			result = (uint8_t)TransferResult::FAILED;
+	}
+
+	connection.OnTransferCompleted(info, (TransferResult)result, Packet());
+	return true;
+}
+
+bool TransferManager::Cancel(TransferConnection &connection, uint32_t id, bool incoming, PacketEncoding encoding)
+{
+	TransferInfo info;
+	if (incoming)
+	{
+		auto it = m_incoming.find(id);
+		if (it == m_incoming.end())
+			return false;
+
+		info = it->second.info;
+		m_incoming.erase(it);
+	}
+	else
+	{
+		auto it = std::find_if(m_outgoing.begin(), m_outgoing.end(), [id](const OutgoingTransfer &transfer) { return transfer.info.id == id; });
+		if (it != m_outgoing.end() && !it->begun) // The receiver never heard about it.
+		{
+			info = it->info;
+			m_outgoing.erase(it);
+			connection.OnTransferCompleted(info, TransferResult::CANCELLED, Packet());
+			return true;
+		}
+
+		if (!TakeOutgoing(id, info))
+			return false;
+	}
+
+	SendEnd(connection, id, TransferResult::CANCELLED, incoming, encoding);
+	connection.OnTransferCompleted(info, TransferResult::CANCELLED, Packet());
+	return true;
+}
+
+void TransferManager::Fail(TransferConnection &connection)
+{
+	// Emptied before any callbacks, which could add more.
+	std::vector<TransferInfo> failed;
+	for (const OutgoingTransfer &transfer : m_outgoing)
+		failed.push_back(transfer.info);
+	failed.insert(failed.end(), m_sent.begin(), m_sent.end());
+	for (const auto &[id, transfer] : m_incoming)
+		failed.push_back(transfer.info);
+
+	m_outgoing.clear();
+	m_sent.clear();
+	m_incoming.clear();
+
+	for (const TransferInfo &info : failed)
+		connection.OnTransferCompleted(info, TransferResult::FAILED, Packet());
+}
+
+void TransferManager::SendEnd(TransferConnection &connection, uint32_t id, TransferResult result, bool incoming, PacketEncoding encoding)
+{
+	PacketStreamWriter packetWriter(encoding);
+	packetWriter.WriteHeader((uint32_t)DefaultPacketID::PACKET_TRANSFER_END);
+	packetWriter.WriteRaw<uint32_t>(id);
+	packetWriter.WriteRaw<uint8_t>((uint8_t)result);
+	packetWriter.WriteRaw<uint8_t>(incoming ? 1 : 0);
+	connection.SendTransferPacket(packetWriter.GetPacket());
+}
+
+bool TransferManager::TakeOutgoing(uint32_t id, TransferInfo &info)
+{
+	auto sent = std::find_if(m_sent.begin(), m_sent.end(), [id](const TransferInfo &other) { return other.id == id; });
+	if (sent != m_sent.end())
+	{
+		info = *sent;
+		m_sent.erase(sent);
+		return true;
+	}
+
+	auto it = std::find_if(m_outgoing.begin(), m_outgoing.end(), [id](const OutgoingTransfer &transfer) { return transfer.info.id == id; });
+	if (it == m_outgoing.end())
+		return false;
+
+	info = it->info;
+	m_outgoing.erase(it);
+	return true;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <BCNet/Core/Common.h>
+#include <BCNet/Core/Types.h>
+#include <BCNet/BCNetPacket.h>
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+
+#include <stdint.h>
+
+#define TRANSFER_DEFAULT_CHUNK_SIZE (64 * 1024)
+#define TRANSFER_DEFAULT_WINDOW (256 * 1024) // Half of GameNetworkingSockets' default send buffer, the rest is left for everything else.
+#define TRANSFER_MAX_CHUNK_SIZE (448 * 1024) // Leaves room under GameNetworkingSockets' 512KB message limit for the chunk's header.
+#define TRANSFER_DEFAULT_MAX_SIZE (64ull * 1024 * 1024)
+#define TRANSFER_DEFAULT_MAX_INCOMING (256ull * 1024 * 1024)
+
+namespace BCNet
+{
+	// A read only view of a whole file, mapped into memory rather than read onto the heap, the OS pages it in as it's read.
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		MappedFile(const MappedFile &) = delete;
+		MappedFile &operator=(const MappedFile &) = delete;
+		~MappedFile();
+
+		bool Open(const std::string &path); // Returns false if it can't be opened or mapped.
+		void Close();
+
+		const uint8_t *GetData() const { return m_data; } // Null for an empty file.
+		uint64_t GetSize() const { return m_size; }
+
+	private:
+		const uint8_t *m_data = nullptr;
+		uint64_t m_size = 0;
+#ifdef _WIN32
+		void *m_file = nullptr; // HANDLE
+		void *m_mapping = nullptr; // HANDLE
+#endif
+	};
+
+	// A transfer waiting to be sent, or part way through being sent.
+	struct OutgoingTransfer
+	{
+		TransferInfo info;
+		const uint8_t *data = nullptr; // The application's buffer, or the mapped file.
+		std::unique_ptr<MappedFile> file; // Kept open until every chunk is sent.
+		bool begun = false; // Whether the receiver has been told about it.
+	};
+
+	// What a TransferManager needs from whichever end of the connection it belongs to.
+	class TransferConnection
+	{
+	public:
+		virtual ~TransferConnection() = default;
+
+		virtual void SendTransferPacket(const Packet &packet) = 0; // Sent reliably.
+		virtual bool OnTransferStarted(const TransferInfo &info, Packet &destination) = 0; // Returns false to refuse it, an empty destination gets one allocated.
+		virtual void OnTransferChunk(const TransferInfo &info, const Packet &chunk) = 0;
+		virtual void OnTransferProgress(const TransferInfo &info) = 0;
+		virtual void OnTransferCompleted(const TransferInfo &info, TransferResult result, const Packet &data) = 0;
+		virtual uint64_t GetMaxTransferSize() = 0; // Incoming transfers bigger than this are refused.
+		virtual uint64_t GetMaxIncomingSize() = 0; // The most the incoming transfers on the connection can add up to.
+	};
+
+	// The transfers going both ways over one connection, splitting outgoing payloads into chunks and reassembling incoming ones in place.
+	// Outgoing transfers are sent one at a time in the order they were started, each pump only adds as much as the budget the owner
+	// works out from the connection's pending bytes, so they never fill GameNetworkingSockets' send buffer and other packets aren't stuck behind them.
+	// Everything is sent reliably, so it arrives in order:
+	//	PACKET_TRANSFER_BEGIN: ID, tag, size.
+	//	PACKET_TRANSFER_CHUNK: ID, offset, then the chunk up to the end of the packet.
+	//	PACKET_TRANSFER_END: ID, result, whether the end sending it was receiving the transfer. The receiver sends one once it has everything.
+	// Callbacks can start and cancel transfers on the same connection, but the manager has to outlive the call it's making them from.
+	// Only touched by the thread that owns the connection.
+	class TransferManager
+	{
+	public:
+		void Add(OutgoingTransfer &&transfer); // Sent after any that were added before it.
+		void Merge(TransferManager &other); // Takes over the other's transfers, like when the connection changes threads.
+
+		bool HasOutgoing() const { return !m_outgoing.empty(); } // Whether there are chunks left to send.
+		bool IsEmpty() const { return m_outgoing.empty() && m_sent.empty() && m_incoming.empty(); }
+
+		// Sends chunks until the budget is spent, returns whether anything was sent.
+		bool Pump(TransferConnection &connection, PacketEncoding encoding, size_t budget, size_t chunkSize);
+
+		// Handles a transfer packet, the reader should be right after the header. Returns false if it was malformed.
+		bool HandlePacket(TransferConnection &connection, uint32_t packetID, PacketStreamReader &packetReader, PacketEncoding encoding);
+		static bool IsTransferPacket(uint32_t packetID);
+
+		// Ends a transfer going either way and tells the other end, returns false if there isn't one.
+		bool Cancel(TransferConnection &connection, uint32_t id, bool incoming, PacketEncoding encoding);
+
+		// Ends every transfer without telling the other end, for when the connection has closed.
+		void Fail(TransferConnection &connection);
+
+	private:
+		// One being received.
+		struct IncomingTransfer
+		{
+			TransferInfo info;
+			Packet destination; // Where it's reassembled.
+			std::unique_ptr<uint8_t[]> storage; // Allocated up front when the application doesn't give a destination.
+		};
+
+		bool HandleBegin(TransferConnection &connection, PacketStreamReader &packetReader, PacketEncoding encoding);
+		bool HandleChunk(TransferConnection &connection, PacketStreamReader &packetReader, PacketEncoding encoding);
+		bool HandleEnd(TransferConnection &connection, PacketStreamReader &packetReader);
+
+		void SendEnd(TransferConnection &connection, uint32_t id, TransferResult result, bool incoming, PacketEncoding encoding);
+		bool TakeOutgoing(uint32_t id, TransferInfo &info); // Removes an outgoing transfer, returns false if there isn't one.
+
+	private:
+		std::deque<OutgoingTransfer> m_outgoing; // Still sending, the front one is being sent.
+		std::vector<TransferInfo> m_sent; // Every chunk sent, waiting for the receiver to say it's all there.
+		std::unordered_map<uint32_t, IncomingTransfer> m_incoming; // <Transfer ID, Transfer>
+
+	};
+
+}
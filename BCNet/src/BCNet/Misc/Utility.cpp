@@ -1,7 +1,61 @@
 #include "Utility.h"
 
+#include <algorithm>
+#include <cctype>
+#include <mutex>
+
+#include <steam/steamnetworkingsockets.h>
+
+namespace
+{
+	std::mutex s_mutexNetworkingSockets;
+	unsigned int s_networkingSocketsUsers = 0;
+}
+
 // Returns whether the string is purely a number or not, no other characters at all.
 extern "C" BCNET_API bool BCNet::StringIsNumber(const std::string &str)
 {
 	return !str.empty() && std::find_if(str.begin(), str.end(), [](unsigned char c) { return !std::isdigit(c); }) == str.end();
 }
+
+// Reads a duration with an optional unit, seconds if there isn't one.
+bool BCNet::ParseDuration(const std::string &str, unsigned int *outMilliseconds)
+{
+	const size_t digits = (size_t)(std::find_if(str.begin(), str.end(), [](unsigned char c) { return !std::isdigit(c); }) - str.begin());
+	if (digits == 0 || digits > 9) // Nothing to read, or too long to fit once it's in milliseconds.
+		return false;
+
+	const unsigned int value = (unsigned int)std::stoul(str.substr(0, digits));
+	const std::string unit = str.substr(digits);
+	if ((unit.empty() || unit == "s") && value < 4000000) // Still fits once it's in milliseconds.
+		*outMilliseconds = value * 1000;
+	else if (unit == "ms")
+		*outMilliseconds = value;
+	else
+		return false;
+	return true;
+}
+
+bool BCNet::InitNetworkingSockets()
+{
+	std::lock_guard<std::mutex> lock(s_mutexNetworkingSockets);
+	if (s_networkingSocketsUsers == 0)
+	{
+		SteamDatagramErrMsg msg;
+		if (!GameNetworkingSockets_Init(nullptr, msg))
+			return false;
+	}
+
+	s_networkingSocketsUsers++;
+	return true;
+}
+
+void BCNet::KillNetworkingSockets()
+{
+	std::lock_guard<std::mutex> lock(s_mutexNetworkingSockets);
+	if (s_networkingSocketsUsers == 0)
+		return;
+
+	if (--s_networkingSocketsUsers == 0)
+		GameNetworkingSockets_Kill();
+}
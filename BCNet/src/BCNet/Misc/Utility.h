@@ -10,4 +10,11 @@ namespace BCNet
 {
 	extern "C" bool BCNET_API StringIsNumber(const std::string &str);
 
+	bool ParseDuration(const std::string &str, unsigned int *outMilliseconds); // "5s", "250ms", or just a number of seconds.
+
+	// GameNetworkingSockets is one library for the whole process, these count every client and server using it,
+	// so the last one to finish kills it rather than the first.
+	bool InitNetworkingSockets();
+	void KillNetworkingSockets();
+
 }
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+#include <stdint.h>
+
+// Small helpers shared by the benchmarks.
+namespace Bench
+{
+	using Clock = std::chrono::steady_clock;
+
+	// What one benchmark measured.
+	struct Result
+	{
+		std::string name;
+		double bitsPerValue = 0.0;
+		double encodeNs = 0.0; // Per value.
+		double decodeNs = 0.0; // Per value.
+		double maxError = 0.0; // Biggest error seen.
+		double errorBound = 0.0; // Biggest error allowed by the encoding.
+	};
+
+	// What one network scenario measured, with a server and it's clients all in this process.
+	struct NetworkResult
+	{
+		std::string scenario;
+		unsigned int clients = 0;
+		size_t messageSize = 0; // The payload for transfers.
+		uint64_t messages = 0; // Delivered, or connections made for the connect storm.
+		uint64_t bytes = 0; // Delivered.
+		double seconds = 0.0;
+		double messagesPerSecond = 0.0;
+		double megabytesPerSecond = 0.0;
+		double latencyP50Us = 0.0; // Round trips for echo, until the server has all of it for transfers, until connected for connects, one way for the rest.
+		double latencyP90Us = 0.0;
+		double latencyP99Us = 0.0;
+		double latencyP999Us = 0.0;
+		double latencyMaxUs = 0.0;
+		bool completed = true; // False if it timed out or something failed, the numbers are whatever it got to.
+	};
+
+	// What the network scenarios run with, each scenario runs once for every client count and message size.
+	struct NetworkOptions
+	{
+		std::vector<std::string> scenarios = { "echo", "broadcast", "flood", "transfer", "connect" };
+		std::vector<unsigned int> clientCounts = { 1, 8, 32 };
+		std::vector<size_t> messageSizes = { 32, 256, 1024 };
+		size_t transferSize = 4 * 1024 * 1024; // Transfers use this instead of the message sizes.
+		double seconds = 2.0; // How long each run goes for.
+		int port = 27100;
+		bool udp = false; // Through the local network instead of in-memory socket pairs.
+	};
+
+	// Keeps the optimizer from throwing away work whose result is otherwise unused.
+	// The value's address escapes through a volatile pointer, and the barrier makes the compiler assume it's read through it.
+	template <typename T>
+	inline void DoNotOptimize(const T &value)
+	{
+#if defined(_MSC_VER) && !defined(__clang__)
+		static const void *volatile s_sink;
+		s_sink = &value;
+		_ReadWriteBarrier();
+#else
+		asm volatile("" : : "r,m"(value) : "memory");
+#endif
+	}
+
+	// Nanoseconds per value between two points in time.
+	inline double NsPerValue(Clock::time_point start, Clock::time_point end, size_t count)
+	{
+		return std::chrono::duration<double, std::nano>(end - start).count() / (double)count;
+	}
+
+	// Fills in the latency percentiles from the samples, in microseconds, sorting them on the way.
+	inline void SetLatencies(NetworkResult &result, std::vector<double> &samples)
+	{
+		if (samples.empty())
+			return;
+
+		std::sort(samples.begin(), samples.end());
+		auto percentile = [&](double fraction) { return samples[std::min(samples.size() - 1, (size_t)(fraction * (double)samples.size()))]; };
+		result.latencyP50Us = percentile(0.5);
+		result.latencyP90Us = percentile(0.9);
+		result.latencyP99Us = percentile(0.99);
+		result.latencyP999Us = percentile(0.999);
+		result.latencyMaxUs = samples.back();
+	}
+
+	// Benchmark suites.
+	void RunQuantizeBenchmarks(std::vector<Result> &results);
+	void RunNetworkBenchmarks(const NetworkOptions &options, std::vector<NetworkResult> &results);
+
+}
@@ -0,0 +1,539 @@
+#include "Bench.h"
+
+#include <BCNet/IBCNetServer.h>
+#include <BCNet/IBCNetClient.h>
+#include <BCNet/BCNetPacket.h>
+
+#include <iostream>
+#include <streambuf>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+	enum class BenchPacketID : uint32_t
+	{
+		PACKET_ECHO = 1 + DEFAULT_PACKETS_COUNT, // Sent straight back by the server.
+		PACKET_BROADCAST, // Sent to every client by the server.
+		PACKET_FLOOD // Sent to the server as fast as it takes them.
+	};
+
+	constexpr double CONNECT_TIMEOUT = 10.0; // Seconds to wait for every client to connect or disconnect.
+	constexpr double DRAIN_TIMEOUT = 10.0; // Seconds to wait for whatever's still in flight once a run is over.
+	constexpr uint64_t BROADCAST_WINDOW = 64; // Broadcasts allowed in flight before the server holds off.
+	constexpr uint64_t FLOOD_WINDOW = 256; // Messages allowed in flight per client before the clients hold off.
+
+	// Stands in for std::cout while a run goes, the server and clients log every connection to it.
+	struct NullBuffer : std::streambuf
+	{
+		int overflow(int c) override { return c; }
+	};
+
+	// Nanoseconds on the steady clock, every peer is in this process so they share it.
+	int64_t Now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(Bench::Clock::now().time_since_epoch()).count();
+	}
+
+	double MicrosecondsSince(int64_t start)
+	{
+		return (double)(Now() - start) / 1000.0;
+	}
+
+	double SecondsSince(int64_t start)
+	{
+		return (double)(Now() - start) / 1e9;
+	}
+
+	// Waits until the condition holds, false if it didn't within the timeout.
+	// Yielding is for waits that are over in microseconds, where sleeping would hold the run back.
+	template <typename Condition>
+	bool WaitFor(Condition condition, double seconds, bool yield = false)
+	{
+		const int64_t start = Now();
+		while (!condition())
+		{
+			if (SecondsSince(start) >= seconds)
+				return false;
+
+			if (yield)
+				std::this_thread::yield();
+			else
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		return true;
+	}
+
+	// Writes a packet padded out to the size, stamped with when it was written.
+	void WriteBenchPacket(BCNet::PacketStreamWriter &writer, BenchPacketID id, size_t size)
+	{
+		writer.Reset();
+		writer.WriteHeader((uint32_t)id);
+		writer.WriteRaw<int64_t>(Now());
+		if (size > writer.GetSize())
+			writer.WriteZero(size - writer.GetSize());
+	}
+
+	// Reads the stamp back out, false if it isn't the packet expected.
+	bool ReadBenchPacket(const BCNet::Packet &packet, BCNet::PacketEncoding encoding, BenchPacketID id, int64_t &sentAt)
+	{
+		BCNet::PacketStreamReader reader(packet, 0, encoding);
+
+		uint32_t packetID = 0;
+		if (!reader.ReadHeader(packetID) || packetID != (uint32_t)id)
+			return false;
+		return reader.ReadRaw<int64_t>(sentAt);
+	}
+
+	// A server and it's clients, all in this process and connected over socket pairs, or over UDP to 127.0.0.1.
+	// Callbacks have to be set before it starts, every client is driven through commands so nothing touches them off their network thread.
+	class Session
+	{
+	public:
+		struct Client
+		{
+			BCNet::IBCNetClient *client = nullptr;
+			std::vector<double> latencies; // Microseconds, only touched from the client's callbacks while it runs.
+			std::vector<double> connectLatencies; // Microseconds, the same.
+			uint64_t messages = 0; // The same.
+			int64_t sentAt = 0; // When it's message in flight went out.
+			int64_t connectStarted = 0;
+			bool connected = false;
+		};
+
+		Session(const Bench::NetworkOptions &options, unsigned int clientCount)
+			: m_port(options.port), m_address(options.udp ? "127.0.0.1" : LOOPBACK_SERVER_ADDRESS), m_clients(clientCount)
+		{
+			m_server = BCNet::InitServer();
+			m_server->SetConsoleInput(false);
+			m_server->SetLoopbackOnly(!options.udp);
+			m_server->SetMaxClients(clientCount);
+			m_server->SetNetworkSchedule(BCNet::NetworkScheduleMode::ADAPTIVE);
+			m_server->SetConnectedCallback([this](const BCNet::ClientInfo &) { m_serverClients++; });
+			m_server->SetDisconnectedCallback([this](const BCNet::ClientInfo &) { m_serverClients--; });
+
+			for (Client &client : m_clients)
+			{
+				client.client = BCNet::InitClient();
+				client.client->SetConsoleInput(false);
+				client.client->SetNetworkSchedule(BCNet::NetworkScheduleMode::ADAPTIVE);
+				client.client->SetConnectedCallback([this, &client]()
+				{
+					client.connectLatencies.push_back(MicrosecondsSince(client.connectStarted));
+					client.connected = true;
+					m_connected++;
+				});
+				client.client->SetDisconnectedCallback([this, &client]()
+				{
+					if (!client.connected)
+						return;
+					client.connected = false;
+					m_connected--;
+				});
+			}
+		}
+		Session(const Session &) = delete;
+		Session &operator=(const Session &) = delete;
+		~Session() { Stop(); }
+
+		// Starts everything and connects every client, false if they couldn't all connect.
+		bool Start()
+		{
+			m_server->Start(m_port);
+			if (!WaitFor([&]() { return m_server->IsConnected(); }, CONNECT_TIMEOUT))
+				return false;
+
+			for (Client &client : m_clients)
+				client.client->Start();
+			return Connect();
+		}
+
+		bool Connect()
+		{
+			const std::string command = "/connect " + m_address + " " + std::to_string(m_port);
+			for (Client &client : m_clients)
+			{
+				client.connectStarted = Now(); // Seen by the network thread through the command queue.
+				client.client->PushInputAsCommand(command);
+			}
+			return WaitFor([&]() { return m_connected == m_clients.size() && m_serverClients == m_clients.size(); }, CONNECT_TIMEOUT);
+		}
+
+		bool Disconnect()
+		{
+			for (Client &client : m_clients)
+				client.client->PushInputAsCommand("/disconnect");
+			return WaitFor([&]() { return m_connected == 0 && m_serverClients == 0; }, CONNECT_TIMEOUT);
+		}
+
+		// Disconnects and shuts everything down, after this every client's results can be read.
+		void Stop()
+		{
+			if (!m_server)
+				return;
+
+			Disconnect(); // From their network threads, so the callbacks never run on this one.
+			for (Client &client : m_clients)
+			{
+				client.client->Stop();
+				delete client.client;
+				client.client = nullptr;
+			}
+
+			m_server->PushInputAsCommand("/quit");
+			m_server->Stop();
+			delete m_server; // Waits for the network thread to see the quit.
+			m_server = nullptr;
+		}
+
+		BCNet::IBCNetServer *GetServer() { return m_server; }
+		std::vector<Client> &GetClients() { return m_clients; }
+
+	private:
+		const int m_port;
+		const std::string m_address;
+
+		BCNet::IBCNetServer *m_server = nullptr;
+		std::vector<Client> m_clients;
+
+		std::atomic<size_t> m_serverClients{ 0 }; // Connected as far as the server knows.
+		std::atomic<size_t> m_connected{ 0 }; // Connected as far as the clients know.
+	};
+
+	void SendBenchPacket(BCNet::IBCNetClient &client, BenchPacketID id, size_t size)
+	{
+		BCNet::PacketStreamWriter writer(client.GetPacketEncoding());
+		WriteBenchPacket(writer, id, size);
+		client.SendPacketToServer(writer.GetPacket());
+	}
+
+	Bench::NetworkResult MakeResult(const std::string &scenario, unsigned int clientCount, size_t messageSize)
+	{
+		Bench::NetworkResult result;
+		result.scenario = scenario;
+		result.clients = clientCount;
+		result.messageSize = messageSize;
+		return result;
+	}
+
+	// Fills in the rates and latencies once the messages and bytes are counted.
+	void Finish(Bench::NetworkResult &result, double seconds, std::vector<double> &latencies)
+	{
+		result.seconds = seconds;
+		if (seconds > 0.0)
+		{
+			result.messagesPerSecond = (double)result.messages / seconds;
+			result.megabytesPerSecond = (double)result.bytes / seconds / (1024.0 * 1024.0);
+		}
+		Bench::SetLatencies(result, latencies);
+	}
+
+	// Adds up what every client counted.
+	void GatherClients(Session &session, Bench::NetworkResult &result, std::vector<double> &latencies)
+	{
+		for (Session::Client &client : session.GetClients())
+		{
+			result.messages += client.messages;
+			latencies.insert(latencies.end(), client.latencies.begin(), client.latencies.end());
+		}
+	}
+
+	// Every client keeps one message in flight, the server sends each straight back and the client sends the next once it's back.
+	Bench::NetworkResult RunEcho(const Bench::NetworkOptions &options, unsigned int clientCount, size_t messageSize)
+	{
+		Bench::NetworkResult result = MakeResult("echo", clientCount, messageSize);
+		std::atomic<bool> running{ false };
+
+		Session session(options, clientCount);
+		BCNet::IBCNetServer *server = session.GetServer();
+		server->SetPacketReceivedCallback([server](const BCNet::ClientInfo &client, const BCNet::Packet packet) { server->SendPacketToClient(client.id, packet); });
+		for (Session::Client &client : session.GetClients())
+		{
+			client.client->SetPacketReceivedCallback([&running, &client, messageSize](const BCNet::Packet packet)
+			{
+				int64_t sentAt = 0;
+				if (!running || !ReadBenchPacket(packet, client.client->GetPacketEncoding(), BenchPacketID::PACKET_ECHO, sentAt))
+					return;
+
+				client.latencies.push_back(MicrosecondsSince(sentAt));
+				client.messages++;
+				SendBenchPacket(*client.client, BenchPacketID::PACKET_ECHO, messageSize);
+			});
+		}
+
+		if (!session.Start())
+		{
+			result.completed = false;
+			return result;
+		}
+
+		running = true;
+		const int64_t start = Now();
+		for (Session::Client &client : session.GetClients())
+			SendBenchPacket(*client.client, BenchPacketID::PACKET_ECHO, messageSize);
+
+		std::this_thread::sleep_for(std::chrono::duration<double>(options.seconds));
+		running = false;
+		const double seconds = SecondsSince(start);
+		session.Stop();
+
+		std::vector<double> latencies;
+		GatherClients(session, result, latencies);
+		result.bytes = result.messages * messageSize * 2; // There and back.
+		Finish(result, seconds, latencies);
+		return result;
+	}
+
+	// The server broadcasts to every client as fast as they take them.
+	Bench::NetworkResult RunBroadcast(const Bench::NetworkOptions &options, unsigned int clientCount, size_t messageSize)
+	{
+		Bench::NetworkResult result = MakeResult("broadcast", clientCount, messageSize);
+		std::atomic<uint64_t> received{ 0 };
+
+		Session session(options, clientCount);
+		for (Session::Client &client : session.GetClients())
+		{
+			client.client->SetPacketReceivedCallback([&received, &client](const BCNet::Packet packet)
+			{
+				int64_t sentAt = 0;
+				if (!ReadBenchPacket(packet, client.client->GetPacketEncoding(), BenchPacketID::PACKET_BROADCAST, sentAt))
+					return;
+
+				client.latencies.push_back(MicrosecondsSince(sentAt));
+				client.messages++;
+				received++;
+			});
+		}
+
+		if (!session.Start())
+		{
+			result.completed = false;
+			return result;
+		}
+
+		BCNet::PacketStreamWriter writer;
+		uint64_t sent = 0;
+		const int64_t start = Now();
+		while (SecondsSince(start) < options.seconds)
+		{
+			if (!WaitFor([&]() { return sent * clientCount - received < BROADCAST_WINDOW * clientCount; }, DRAIN_TIMEOUT, true))
+				break;
+
+			WriteBenchPacket(writer, BenchPacketID::PACKET_BROADCAST, messageSize);
+			session.GetServer()->SendPacketToAllClients(writer.GetPacket());
+			sent++;
+		}
+		result.completed = WaitFor([&]() { return received == sent * clientCount; }, DRAIN_TIMEOUT);
+		const double seconds = SecondsSince(start);
+		session.Stop();
+
+		std::vector<double> latencies;
+		GatherClients(session, result, latencies);
+		result.bytes = result.messages * messageSize;
+		Finish(result, seconds, latencies);
+		return result;
+	}
+
+	// Every client sends to the server as fast as it takes them, in turn.
+	Bench::NetworkResult RunFlood(const Bench::NetworkOptions &options, unsigned int clientCount, size_t messageSize)
+	{
+		Bench::NetworkResult result = MakeResult("flood", clientCount, messageSize);
+		std::atomic<uint64_t> received{ 0 };
+		std::mutex mutexLatencies; // In case the server hands packets to more than one thread.
+		std::vector<double> latencies;
+
+		Session session(options, clientCount);
+		session.GetServer()->SetPacketReceivedCallback([&](const BCNet::ClientInfo &client, const BCNet::Packet packet)
+		{
+			int64_t sentAt = 0;
+			if (!ReadBenchPacket(packet, client.encoding, BenchPacketID::PACKET_FLOOD, sentAt))
+				return;
+
+			const double latency = MicrosecondsSince(sentAt);
+			{
+				std::lock_guard<std::mutex> lock(mutexLatencies);
+				latencies.push_back(latency);
+			}
+			received++;
+		});
+
+		if (!session.Start())
+		{
+			result.completed = false;
+			return result;
+		}
+
+		std::vector<Session::Client> &clients = session.GetClients();
+		uint64_t sent = 0;
+		const int64_t start = Now();
+		while (SecondsSince(start) < options.seconds)
+		{
+			if (!WaitFor([&]() { return sent - received < FLOOD_WINDOW * clientCount; }, DRAIN_TIMEOUT, true))
+				break;
+
+			SendBenchPacket(*clients[sent % clientCount].client, BenchPacketID::PACKET_FLOOD, messageSize);
+			sent++;
+		}
+		result.completed = WaitFor([&]() { return received == sent; }, DRAIN_TIMEOUT);
+		const double seconds = SecondsSince(start);
+		session.Stop();
+
+		result.messages = received;
+		result.bytes = result.messages * messageSize;
+		Finish(result, seconds, latencies);
+		return result;
+	}
+
+	// Every client keeps one transfer of the payload going to the server, starting the next once the server has all of it.
+	Bench::NetworkResult RunTransfer(const Bench::NetworkOptions &options, unsigned int clientCount)
+	{
+		Bench::NetworkResult result = MakeResult("transfer", clientCount, options.transferSize);
+		std::atomic<bool> running{ false };
+		std::atomic<bool> failed{ false };
+		std::atomic<int64_t> outstanding{ 0 };
+
+		std::vector<uint8_t> data(options.transferSize);
+		for (size_t i = 0; i < data.size(); i++)
+			data[i] = (uint8_t)(i * 31 + (i >> 11)); // Something other than zeroes, in case anything on the way compresses it.
+		const BCNet::Packet payload(data.data(), data.size());
+
+		auto beginTransfer = [&](Session::Client &client)
+		{
+			outstanding++;
+			client.sentAt = Now();
+			if (client.client->BeginTransfer(payload) == 0)
+			{
+				outstanding--;
+				failed = true;
+			}
+		};
+
+		Session session(options, clientCount);
+		session.GetServer()->SetTransferCompletedCallback([](const BCNet::ClientInfo &, const BCNet::TransferInfo &, BCNet::TransferResult, const BCNet::Packet) {}); // Transfers are only accepted with somewhere to hand them to.
+		for (Session::Client &client : session.GetClients())
+		{
+			client.client->SetTransferCompletedCallback([&running, &failed, &outstanding, &beginTransfer, &client](const BCNet::TransferInfo &info, BCNet::TransferResult transferResult, const BCNet::Packet)
+			{
+				if (info.incoming)
+					return;
+
+				if (transferResult == BCNet::TransferResult::COMPLETED)
+				{
+					client.latencies.push_back(MicrosecondsSince(client.sentAt));
+					client.messages++;
+				}
+				else
+				{
+					failed = true;
+				}
+
+				if (running && !failed)
+					beginTransfer(client);
+				outstanding--; // Only after the next one's counted, so it never reads as drained in between.
+			});
+		}
+
+		if (!session.Start())
+		{
+			result.completed = false;
+			return result;
+		}
+
+		running = true;
+		const int64_t start = Now();
+		for (Session::Client &client : session.GetClients())
+			beginTransfer(client);
+
+		WaitFor([&]() { return SecondsSince(start) >= options.seconds || failed; }, options.seconds + 1.0);
+		running = false;
+		result.completed = WaitFor([&]() { return outstanding == 0; }, DRAIN_TIMEOUT) && !failed;
+		const double seconds = SecondsSince(start);
+		session.Stop();
+
+		std::vector<double> latencies;
+		GatherClients(session, result, latencies);
+		result.bytes = result.messages * options.transferSize;
+		Finish(result, seconds, latencies);
+		return result;
+	}
+
+	// Every client connects and disconnects together, over and over.
+	Bench::NetworkResult RunConnect(const Bench::NetworkOptions &options, unsigned int clientCount)
+	{
+		Bench::NetworkResult result = MakeResult("connect", clientCount, 0);
+
+		Session session(options, clientCount);
+		if (!session.Start())
+		{
+			result.completed = false;
+			return result;
+		}
+
+		const int64_t start = Now();
+		uint64_t rounds = 0;
+		while (SecondsSince(start) < options.seconds)
+		{
+			if (!session.Disconnect() || !session.Connect())
+			{
+				result.completed = false;
+				break;
+			}
+			rounds++;
+		}
+		const double seconds = SecondsSince(start);
+		session.Stop();
+
+		std::vector<double> latencies;
+		for (Session::Client &client : session.GetClients()) // Leaving out the first connect, it was before the clock started.
+		{
+			if (client.connectLatencies.size() > 1)
+				latencies.insert(latencies.end(), client.connectLatencies.begin() + 1, client.connectLatencies.end());
+		}
+		result.messages = rounds * clientCount;
+		Finish(result, seconds, latencies);
+		return result;
+	}
+
+	Bench::NetworkResult RunScenario(const Bench::NetworkOptions &options, const std::string &scenario, unsigned int clientCount, size_t messageSize)
+	{
+		if (scenario == "echo")
+			return RunEcho(options, clientCount, messageSize);
+		if (scenario == "broadcast")
+			return RunBroadcast(options, clientCount, messageSize);
+		if (scenario == "flood")
+			return RunFlood(options, clientCount, messageSize);
+		if (scenario == "transfer")
+			return RunTransfer(options, clientCount);
+		return RunConnect(options, clientCount);
+	}
+}
+
+void Bench::RunNetworkBenchmarks(const NetworkOptions &options, std::vector<NetworkResult> &results)
+{
+	NullBuffer nullBuffer;
+	for (const std::string &scenario : options.scenarios)
+	{
+		// Transfers and connects don't send messages of their own, so they only run once per client count.
+		const bool sized = scenario == "echo" || scenario == "broadcast" || scenario == "flood";
+		const std::vector<size_t> sizes = sized ? options.messageSizes : std::vector<size_t>{ scenario == "transfer" ? options.transferSize : 0 };
+
+		for (unsigned int clientCount : options.clientCounts)
+		{
+			for (size_t size : sizes)
+			{
+				std::cout << "  " << scenario << ", " << clientCount << (clientCount == 1 ? " client" : " clients");
+				if (size > 0)
+					std::cout << ", " << size << " bytes";
+				std::cout << "..." << std::endl;
+
+				std::streambuf *output = std::cout.rdbuf(&nullBuffer); // Nothing else is running while it's swapped.
+				results.push_back(RunScenario(options, scenario, clientCount, size));
+				std::cout.rdbuf(output);
+
+				if (!results.back().completed)
+					std::cout << "  Warning: " << scenario << " didn't complete, it's numbers are partial." << std::endl;
+			}
+		}
+	}
+}
@@ -0,0 +1,189 @@
+#include "Bench.h"
+
+#include <BCNet/BCNetPacket.h>
+#include <BCNet/BCNetBitStream.h>
+#include <BCNet/BCNetQuantize.h>
+
+#include <algorithm>
+#include <random>
+#include <cmath>
+
+namespace
+{
+	constexpr size_t VALUE_COUNT = 1000000;
+	constexpr float WORLD_SIZE = 1000.0f; // Positions are within +-WORLD_SIZE.
+
+	struct Vector2 { float x, y; };
+	struct Vector3 { float x, y, z; };
+	struct Quaternion { float x, y, z, w; };
+
+	// Encodes every value into a bit stream, decodes them back and measures both along with the worst error.
+	// encode(writer, index) writes a value, decode(reader, index) reads it back and returns it's error.
+	template <typename Encode, typename Decode>
+	Bench::Result RunBitStreamBenchmark(const std::string &name, size_t count, Encode encode, Decode decode)
+	{
+		Bench::Result result;
+		result.name = name;
+
+		BCNet::PacketStreamWriter packetWriter;
+		packetWriter.Reserve(count * 16);
+
+		Bench::Clock::time_point start = Bench::Clock::now();
+		{
+			BCNet::BitStreamWriter bitWriter(packetWriter);
+			for (size_t i = 0; i < count; i++)
+				encode(bitWriter, i);
+		}
+		Bench::Clock::time_point end = Bench::Clock::now();
+		result.encodeNs = Bench::NsPerValue(start, end, count);
+		result.bitsPerValue = packetWriter.GetSize() * 8.0 / (double)count;
+
+		BCNet::PacketStreamReader packetReader(packetWriter.GetPacket());
+		BCNet::BitStreamReader bitReader(packetReader);
+
+		double maxError = 0.0;
+		start = Bench::Clock::now();
+		for (size_t i = 0; i < count; i++)
+			maxError = std::max(maxError, (double)decode(bitReader, i));
+		end = Bench::Clock::now();
+		result.decodeNs = Bench::NsPerValue(start, end, count);
+		result.maxError = maxError;
+
+		return result;
+	}
+
+	Quaternion RandomRotation(std::mt19937 &random)
+	{
+		std::normal_distribution<float> distribution;
+		Quaternion quaternion = { distribution(random), distribution(random), distribution(random), distribution(random) };
+		const float length = sqrtf(quaternion.x * quaternion.x + quaternion.y * quaternion.y + quaternion.z * quaternion.z + quaternion.w * quaternion.w);
+		quaternion = { quaternion.x / length, quaternion.y / length, quaternion.z / length, quaternion.w / length };
+		return quaternion;
+	}
+
+	// The error between two rotations, q and -q are the same rotation.
+	float RotationError(const Quaternion &a, const Quaternion &b)
+	{
+		const float dot = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+		const float sign = dot < 0.0f ? -1.0f : 1.0f;
+		return std::max({ fabsf(a.x - b.x * sign), fabsf(a.y - b.y * sign), fabsf(a.z - b.z * sign), fabsf(a.w - b.w * sign) });
+	}
+}
+
+void Bench::RunQuantizeBenchmarks(std::vector<Result> &results)
+{
+	std::mt19937 random(5456);
+	std::uniform_real_distribution<float> positions(-WORLD_SIZE, WORLD_SIZE);
+
+	std::vector<float> scalars(VALUE_COUNT);
+	for (float &scalar : scalars)
+		scalar = positions(random);
+
+	std::vector<Vector3> vectors(VALUE_COUNT);
+	for (Vector3 &vector : vectors)
+		vector = { positions(random), positions(random), positions(random) };
+
+	std::vector<Quaternion> rotations(VALUE_COUNT);
+	for (Quaternion &rotation : rotations)
+		rotation = RandomRotation(random);
+
+	// Raw floats through the byte stream, what games send today.
+	{
+		Result result;
+		result.name = "Raw float (WriteRaw)";
+
+		BCNet::PacketStreamWriter packetWriter;
+		packetWriter.Reserve(VALUE_COUNT * sizeof(float));
+
+		Clock::time_point start = Clock::now();
+		for (size_t i = 0; i < VALUE_COUNT; i++)
+			packetWriter.WriteRaw<float>(scalars[i]);
+		Clock::time_point end = Clock::now();
+		result.encodeNs = NsPerValue(start, end, VALUE_COUNT);
+		result.bitsPerValue = packetWriter.GetSize() * 8.0 / (double)VALUE_COUNT;
+
+		BCNet::PacketStreamReader packetReader(packetWriter.GetPacket());
+		float sum = 0.0f;
+		start = Clock::now();
+		for (size_t i = 0; i < VALUE_COUNT; i++)
+		{
+			float value = 0.0f;
+			packetReader.ReadRaw<float>(value);
+			sum += value;
+		}
+		end = Clock::now();
+		DoNotOptimize(sum);
+		result.decodeNs = NsPerValue(start, end, VALUE_COUNT);
+
+		results.push_back(result);
+	}
+
+	// Scalars at a few bit budgets.
+	for (unsigned int bits : { 12u, 16u, 20u })
+	{
+		const BCNet::FloatQuantizer quantizer(-WORLD_SIZE, WORLD_SIZE, bits);
+		Result result = RunBitStreamBenchmark("Scalar " + std::to_string(bits) + " bits", VALUE_COUNT,
+			[&](BCNet::BitStreamWriter &writer, size_t i) { quantizer.Write(writer, scalars[i]); },
+			[&](BCNet::BitStreamReader &reader, size_t i) { float value = 0.0f; quantizer.Read(reader, value); return fabsf(value - scalars[i]); });
+		result.errorBound = quantizer.GetMaxError();
+		results.push_back(result);
+	}
+
+	// Scalars to a precision, the bits are picked for it.
+	{
+		const BCNet::FloatQuantizer quantizer = BCNet::FloatQuantizer::FromPrecision(-WORLD_SIZE, WORLD_SIZE, 0.01f);
+		Result result = RunBitStreamBenchmark("Scalar 0.01 precision", VALUE_COUNT,
+			[&](BCNet::BitStreamWriter &writer, size_t i) { quantizer.Write(writer, scalars[i]); },
+			[&](BCNet::BitStreamReader &reader, size_t i) { float value = 0.0f; quantizer.Read(reader, value); return fabsf(value - scalars[i]); });
+		result.errorBound = quantizer.GetMaxError();
+		results.push_back(result);
+	}
+
+	// Vectors, timed per vector.
+	{
+		const BCNet::FloatQuantizer quantizer(-WORLD_SIZE, WORLD_SIZE, 16);
+		Result result = RunBitStreamBenchmark("Vector2 16 bits", VALUE_COUNT,
+			[&](BCNet::BitStreamWriter &writer, size_t i) { quantizer.WriteVector2(writer, Vector2{ vectors[i].x, vectors[i].y }); },
+			[&](BCNet::BitStreamReader &reader, size_t i)
+			{
+				Vector2 value = {};
+				quantizer.ReadVector2(reader, value);
+				return std::max(fabsf(value.x - vectors[i].x), fabsf(value.y - vectors[i].y));
+			});
+		result.errorBound = quantizer.GetMaxError();
+		results.push_back(result);
+	}
+	{
+		const BCNet::FloatQuantizer quantizer(-WORLD_SIZE, WORLD_SIZE, 16);
+		Result result = RunBitStreamBenchmark("Vector3 16 bits", VALUE_COUNT,
+			[&](BCNet::BitStreamWriter &writer, size_t i) { quantizer.WriteVector3(writer, vectors[i]); },
+			[&](BCNet::BitStreamReader &reader, size_t i)
+			{
+				Vector3 value = {};
+				quantizer.ReadVector3(reader, value);
+				return std::max({ fabsf(value.x - vectors[i].x), fabsf(value.y - vectors[i].y), fabsf(value.z - vectors[i].z) });
+			});
+		result.errorBound = quantizer.GetMaxError();
+		results.push_back(result);
+	}
+
+	// Smallest three quaternions.
+	for (unsigned int bits : { 9u, 12u })
+	{
+		const BCNet::QuaternionQuantizer quantizer(bits);
+		Result result = RunBitStreamBenchmark("Quaternion " + std::to_string(bits) + " bits", VALUE_COUNT,
+			[&](BCNet::BitStreamWriter &writer, size_t i) { quantizer.WriteQuaternion(writer, rotations[i]); },
+			[&](BCNet::BitStreamReader &reader, size_t i) { Quaternion value = {}; quantizer.ReadQuaternion(reader, value); return RotationError(value, rotations[i]); });
+		result.errorBound = quantizer.GetMaxError();
+		results.push_back(result);
+	}
+
+	// Half floats, the error is relative to the value.
+	{
+		Result result = RunBitStreamBenchmark("Half float (relative)", VALUE_COUNT,
+			[&](BCNet::BitStreamWriter &writer, size_t i) { BCNet::WriteHalf(writer, scalars[i]); },
+			[&](BCNet::BitStreamReader &reader, size_t i) { float value = 0.0f; BCNet::ReadHalf(reader, value); return fabsf(value - scalars[i]) / std::max(fabsf(scalars[i]), 6.1035156e-5f); });
+		result.errorBound = 1.0 / 2048.0; // Half of the 10 bit mantissa's last place.
+		results.push_back(result);
+	}
+}
@@ -0,0 +1,264 @@
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <stdlib.h>
+
+#include "Bench.h"
+
+namespace
+{
+	const char *NETWORK_SCENARIOS[] = { "echo", "broadcast", "flood", "transfer", "connect" };
+
+	void PrintUsage()
+	{
+		std::cout << "Usage: BCNetBench [options]" << std::endl;
+		std::cout << "\t--scenario [Names]      Comma separated, any of quantize, echo, broadcast, flood, transfer, connect, network or all (default)." << std::endl;
+		std::cout << "\t--clients [Counts]      Comma separated client counts for the network scenarios (default 1,8,32)." << std::endl;
+		std::cout << "\t--size [Bytes]          Comma separated message sizes for echo, broadcast and flood (default 32,256,1024)." << std::endl;
+		std::cout << "\t--transfer-size [Bytes] Payload for the transfer scenario (default 4194304)." << std::endl;
+		std::cout << "\t--duration [Seconds]    How long each network run goes for (default 2)." << std::endl;
+		std::cout << "\t--port [Port]           The port the server listens on (default 27100)." << std::endl;
+		std::cout << "\t--udp                   Connect over UDP to 127.0.0.1 instead of in-memory socket pairs." << std::endl;
+		std::cout << "\t--json [Path]           Also writes every result to a JSON file." << std::endl;
+	}
+
+	std::vector<std::string> SplitList(const std::string &list)
+	{
+		std::vector<std::string> items;
+		std::stringstream stream(list);
+		std::string item;
+		while (std::getline(stream, item, ','))
+		{
+			if (!item.empty())
+				items.push_back(item);
+		}
+		return items;
+	}
+
+	bool IsNetworkScenario(const std::string &name)
+	{
+		for (const char *scenario : NETWORK_SCENARIOS)
+		{
+			if (name == scenario)
+				return true;
+		}
+		return false;
+	}
+
+	std::string Escape(const std::string &text)
+	{
+		std::string escaped;
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\')
+				escaped += '\\';
+			if ((unsigned char)c >= 0x20)
+				escaped += c;
+		}
+		return escaped;
+	}
+
+	bool WriteJson(const std::string &filePath, const std::vector<Bench::Result> &results, const std::vector<Bench::NetworkResult> &networkResults, const Bench::NetworkOptions &options)
+	{
+		std::ofstream file(filePath, std::ios::out | std::ios::trunc);
+		if (!file.is_open())
+			return false;
+
+		file << std::setprecision(9);
+		file << "{\n\t\"quantize\": [";
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			const Bench::Result &result = results[i];
+			file << (i == 0 ? "\n" : ",\n") << "\t\t{ \"name\": \"" << Escape(result.name) << "\""
+				<< ", \"bitsPerValue\": " << result.bitsPerValue
+				<< ", \"encodeNs\": " << result.encodeNs
+				<< ", \"decodeNs\": " << result.decodeNs
+				<< ", \"maxError\": " << result.maxError
+				<< ", \"errorBound\": " << result.errorBound << " }";
+		}
+		file << (results.empty() ? "],\n" : "\n\t],\n");
+
+		file << "\t\"network\": {\n\t\t\"transport\": \"" << (options.udp ? "udp" : "loopback") << "\",\n\t\t\"results\": [";
+		for (size_t i = 0; i < networkResults.size(); i++)
+		{
+			const Bench::NetworkResult &result = networkResults[i];
+			file << (i == 0 ? "\n" : ",\n") << "\t\t\t{ \"scenario\": \"" << Escape(result.scenario) << "\""
+				<< ", \"clients\": " << result.clients
+				<< ", \"messageSize\": " << result.messageSize
+				<< ", \"messages\": " << result.messages
+				<< ", \"bytes\": " << result.bytes
+				<< ", \"seconds\": " << result.seconds
+				<< ", \"messagesPerSecond\": " << result.messagesPerSecond
+				<< ", \"megabytesPerSecond\": " << result.megabytesPerSecond
+				<< ", \"latencyUs\": { \"p50\": " << result.latencyP50Us << ", \"p90\": " << result.latencyP90Us << ", \"p99\": " << result.latencyP99Us
+				<< ", \"p999\": " << result.latencyP999Us << ", \"max\": " << result.latencyMaxUs << " }"
+				<< ", \"completed\": " << (result.completed ? "true" : "false") << " }";
+		}
+		file << (networkResults.empty() ? "]\n" : "\n\t\t]\n") << "\t}\n}\n";
+		return file.good();
+	}
+}
+
+int main(int argc, char **argv)
+{
+	Bench::NetworkOptions options;
+	bool runQuantize = true;
+	std::string jsonPath;
+
+	// Parse the arguments.
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string argument = argv[i];
+		const bool hasValue = i + 1 < argc;
+		if (argument == "--help" || argument == "-h")
+		{
+			PrintUsage();
+			return 0;
+		}
+		else if (argument == "--udp")
+		{
+			options.udp = true;
+		}
+		else if (!hasValue)
+		{
+			std::cout << "Error: Unknown option or missing value for " << argument << "." << std::endl;
+			PrintUsage();
+			return 1;
+		}
+		else if (argument == "--scenario")
+		{
+			runQuantize = false;
+			options.scenarios.clear();
+			for (const std::string &name : SplitList(argv[++i]))
+			{
+				if (name == "all" || name == "network")
+				{
+					runQuantize = runQuantize || name == "all";
+					options.scenarios.assign(std::begin(NETWORK_SCENARIOS), std::end(NETWORK_SCENARIOS));
+				}
+				else if (name == "quantize")
+				{
+					runQuantize = true;
+				}
+				else if (IsNetworkScenario(name))
+				{
+					if (std::find(options.scenarios.begin(), options.scenarios.end(), name) == options.scenarios.end())
+						options.scenarios.push_back(name);
+				}
+				else
+				{
+					std::cout << "Error: Unknown scenario " << name << "." << std::endl;
+					PrintUsage();
+					return 1;
+				}
+			}
+		}
+		else if (argument == "--clients")
+		{
+			options.clientCounts.clear();
+			for (const std::string &count : SplitList(argv[++i]))
+				options.clientCounts.push_back((unsigned int)std::max(1, atoi(count.c_str())));
+		}
+		else if (argument == "--size")
+		{
+			options.messageSizes.clear();
+			for (const std::string &size : SplitList(argv[++i]))
+				options.messageSizes.push_back((size_t)std::max(1ll, atoll(size.c_str())));
+		}
+		else if (argument == "--transfer-size")
+		{
+			options.transferSize = (size_t)std::max(1ll, atoll(argv[++i]));
+		}
+		else if (argument == "--duration")
+		{
+			options.seconds = std::max(0.1, atof(argv[++i]));
+		}
+		else if (argument == "--port")
+		{
+			options.port = atoi(argv[++i]);
+		}
+		else if (argument == "--json")
+		{
+			jsonPath = argv[++i];
+		}
+		else
+		{
+			std::cout << "Error: Unknown option " << argument << "." << std::endl;
+			PrintUsage();
+			return 1;
+		}
+	}
+
+	std::vector<Bench::Result> results;
+	std::vector<Bench::NetworkResult> networkResults;
+
+	if (runQuantize)
+	{
+		std::cout << "Running quantization benchmarks..." << std::endl;
+		Bench::RunQuantizeBenchmarks(results);
+	}
+
+	if (!options.scenarios.empty())
+	{
+		std::cout << "Running network benchmarks over " << (options.udp ? "UDP" : "loopback") << "..." << std::endl;
+		Bench::RunNetworkBenchmarks(options, networkResults);
+	}
+
+	// Print the results.
+	if (!results.empty())
+	{
+		std::cout << std::endl;
+		std::cout << std::left << std::setw(28) << "Benchmark" << std::right
+			<< std::setw(10) << "Bits" << std::setw(14) << "Encode ns" << std::setw(14) << "Decode ns"
+			<< std::setw(16) << "Max Error" << std::setw(16) << "Error Bound" << std::endl;
+
+		for (const Bench::Result &result : results)
+		{
+			std::cout << std::left << std::setw(28) << result.name << std::right << std::fixed
+				<< std::setw(10) << std::setprecision(1) << result.bitsPerValue
+				<< std::setw(14) << std::setprecision(2) << result.encodeNs
+				<< std::setw(14) << std::setprecision(2) << result.decodeNs
+				<< std::setw(16) << std::scientific << std::setprecision(3) << result.maxError
+				<< std::setw(16) << result.errorBound << std::endl;
+		}
+	}
+
+	if (!networkResults.empty())
+	{
+		std::cout << std::endl;
+		std::cout << std::left << std::setw(12) << "Scenario" << std::right
+			<< std::setw(9) << "Clients" << std::setw(10) << "Size" << std::setw(14) << "Msgs/s" << std::setw(10) << "MB/s"
+			<< std::setw(12) << "p50 us" << std::setw(12) << "p99 us" << std::setw(12) << "p99.9 us" << std::setw(12) << "Max us" << std::endl;
+
+		for (const Bench::NetworkResult &result : networkResults)
+		{
+			std::cout << std::left << std::setw(12) << result.scenario << std::right << std::fixed << std::setprecision(1)
+				<< std::setw(9) << result.clients
+				<< std::setw(10) << result.messageSize
+				<< std::setw(14) << result.messagesPerSecond
+				<< std::setw(10) << result.megabytesPerSecond
+				<< std::setw(12) << result.latencyP50Us
+				<< std::setw(12) << result.latencyP99Us
+				<< std::setw(12) << result.latencyP999Us
+				<< std::setw(12) << result.latencyMaxUs
+				<< (result.completed ? "" : "  (incomplete)") << std::endl;
+		}
+	}
+
+	if (!jsonPath.empty())
+	{
+		if (!WriteJson(jsonPath, results, networkResults, options))
+		{
+			std::cout << "Error: Could not write " << jsonPath << "!" << std::endl;
+			return 1;
+		}
+		std::cout << std::endl << "Wrote results to " << jsonPath << std::endl;
+	}
+
+	return 0;
+}
@@ -63,6 +63,8 @@ bool Game::Start()
 	// Setup application.
 	srand((unsigned int)time(nullptr)); // Set random seed.
 
+	RegisterPacketHandlers();
+	m_networkClient->SetPacketDispatcher(&m_packetDispatcher);
 	m_networkClient->SetPacketReceivedCallback(BIND_CLIENT_PACKET_RECEIVED_CALLBACK(Game::PacketReceived));
 	m_networkClient->SetOutputLogCallback(BIND_CLIENT_OUTPUT_LOG_CALLBACK(Game::OutputLog));
 
@@ -141,36 +143,22 @@ void Game::Draw()
 	}
 }
 
-void Game::PacketReceived(const BCNet::Packet packet)
+void Game::RegisterPacketHandlers()
 {
-	BCNet::PacketStreamReader packetReader(packet);
-
-	PacketID id; 
-	packetReader >> id;
-
-	switch (id)
+	m_packetDispatcher.RegisterHandler<std::string>((uint32_t)BCNet::DefaultPacketID::PACKET_SERVER, [this](const std::string &message) // Need this to see messages from server.
 	{
-		case (PacketID)BCNet::DefaultPacketID::PACKET_SERVER: // Need this to see messages from server.
-		{
-			// Print packet.
-			std::string message;
-			packetReader >> message;
+		m_networkClient->Log(message);
+	});
 
-			m_networkClient->Log(message);
-		} break;
-		case PacketID::PACKET_TEXT_MESSAGE: // Chat message.
-		{
-			// Print packet.
-			std::string message;
-			packetReader >> message;
+	m_packetDispatcher.RegisterHandler<TextMessage>((uint32_t)PacketID::PACKET_TEXT_MESSAGE, [this](const TextMessage &message) // Chat message.
+	{
+		m_networkClient->Log(message.text);
+	});
+}
 
-			m_networkClient->Log(message);
-		} break;
-		default:
-		{
-			std::cout << "Warning: Unhandled Packet" << std::endl;
-		} return;
-	}
+void Game::PacketReceived(const BCNet::Packet packet)
+{
+	std::cout << "Warning: Unhandled Packet" << std::endl;
 }
 
 void Game::OutputLog()
@@ -198,14 +186,11 @@ void Game::DoEchoCommand(const std::string parameters)
 	char *params[128];
 	BCNet::ParseCommandParameters(parameters, &count, params); // Get individual parameters.
 
-	const char *message = params[0];
-	std::string s(message);
-
-	BCNet::Packet packet;
-	packet.Allocate(1024);
+	TextMessage message = { params[0] };
 
-	BCNet::PacketStreamWriter packetWriter(packet);
-	packetWriter << PacketID::PACKET_TEXT_MESSAGE << s;
+	BCNet::PacketStreamWriter packetWriter;
+	packetWriter << PacketID::PACKET_TEXT_MESSAGE;
+	BCNet::Serialize(packetWriter, message);
 
 	m_networkClient->SendPacketToServer(packetWriter.GetPacket());
 }
@@ -6,6 +6,7 @@
 #include <string>
 
 #include <BCNet/IBCNetClient.h>
+#include <BCNet/BCNetDispatch.h>
 #include <raylib.h>
 
 class Game
@@ -27,13 +28,15 @@ protected:
 	static unsigned int GetWindowHeight() { return m_windowHeight; }
 
 private:
-	void PacketReceived(const BCNet::Packet packet); // Packet received callback.
+	void RegisterPacketHandlers();
+	void PacketReceived(const BCNet::Packet packet); // Packet received callback, only gets packets without a handler.
 	void OutputLog(); // Output log callback.
 
 	void DoEchoCommand(const std::string parameters); // Echo command implementation.
 
 protected:
 	BCNet::IBCNetClient *m_networkClient = nullptr;
+	BCNet::ClientPacketDispatcher m_packetDispatcher;
 
 	static unsigned int m_windowWidth;
 	static unsigned int m_windowHeight;
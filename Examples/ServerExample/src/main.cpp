@@ -5,46 +5,30 @@
 
 #include <BCNet/IBCNetServer.h>
 #include <BCNet/BCNetUtil.h>
+#include <BCNet/BCNetDispatch.h>
 
 BCNet::IBCNetServer *g_server;
+BCNet::ServerPacketDispatcher g_packetDispatcher;
 
-void PacketReceived(const BCNet::ClientInfo &clientData, const BCNet::Packet packet) // Packet received callback.
+void TextMessageReceived(const BCNet::ClientInfo &clientData, const TextMessage &message) // PACKET_TEXT_MESSAGE handler.
 {
-	BCNet::PacketStreamReader packetReader(packet);
-
-	PacketID id;
-	packetReader >> id;
-
-	switch (id)
-	{
-		case PacketID::PACKET_TEXT_MESSAGE:
-		{
-			// Print packet.
-			char temp[1024];
-
-			std::string message;
-			packetReader >> message;
-			const char *msg = message.c_str();
-
-			sprintf_s(temp, "[%s]: %s", clientData.nickName.c_str(), msg);
-			g_server->Log(temp);
-			std::string s(temp);
+	// Print packet.
+	char temp[1024];
+	sprintf_s(temp, "[%s]: %s", clientData.nickName.c_str(), message.text.c_str());
+	g_server->Log(temp);
 
-			BCNet::Packet packet;
-			packet.Allocate(1024);
+	TextMessage broadcast = { temp };
 
-			BCNet::PacketStreamWriter packetWriter(packet);
-			packetWriter << PacketID::PACKET_TEXT_MESSAGE << s;
+	BCNet::PacketStreamWriter packetWriter;
+	packetWriter << PacketID::PACKET_TEXT_MESSAGE;
+	BCNet::Serialize(packetWriter, broadcast);
 
-			g_server->SendPacketToAllClients(packetWriter.GetPacket());
+	g_server->SendPacketToAllClients(packetWriter.GetPacket());
+}
 
-			packet.Release();
-		} break;
-		default:
-		{
-			std::cout << "Warning: Unhandled Packet" << std::endl;
-		} return;
-	}
+void PacketReceived(const BCNet::ClientInfo &clientData, const BCNet::Packet packet) // Packet received callback, only gets packets without a handler.
+{
+	std::cout << "Warning: Unhandled Packet" << std::endl;
 }
 
 void DoEchoCommand(const std::string parameters) // Echo command implementation.
@@ -63,19 +47,15 @@ void DoEchoCommand(const std::string parameters) // Echo command implementation.
 	char temp[1024];
 	const char *message = params[0];
 	sprintf_s(temp, "[%s]: %s", "Server", message);
-	std::string s(temp);
+	TextMessage textMessage = { temp };
 
-	g_server->Log(s);
+	g_server->Log(textMessage.text);
 
-	BCNet::Packet packet;
-	packet.Allocate(1024);
-
-	BCNet::PacketStreamWriter packetWriter(packet);
-	packetWriter << PacketID::PACKET_TEXT_MESSAGE << s;
+	BCNet::PacketStreamWriter packetWriter;
+	packetWriter << PacketID::PACKET_TEXT_MESSAGE;
+	BCNet::Serialize(packetWriter, textMessage);
 	
 	g_server->SendPacketToAllClients(packetWriter.GetPacket()); // Send message to all connected clients.
-
-	packet.Release();
 }
 
 // ----------------- Entry point.
@@ -83,6 +63,10 @@ int main()
 {
 	g_server = BCNet::InitServer();
 
+	// Setup packet handlers.
+	g_packetDispatcher.RegisterHandler<(uint32_t)PacketID::PACKET_TEXT_MESSAGE, &TextMessageReceived>();
+	g_server->SetPacketDispatcher(&g_packetDispatcher);
+
 	// Setup callbacks.
 	g_server->SetPacketReceivedCallback(PacketReceived);
 
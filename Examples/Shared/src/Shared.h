@@ -1,6 +1,9 @@
 #pragma once
 
 #include <BCNet/BCNetPacket.h>
+#include <BCNet/BCNetSerialize.h>
+
+#include <string>
 
 enum class PacketID : int
 {
@@ -9,3 +12,10 @@ enum class PacketID : int
 
 	PACKET_COUNT
 };
+
+struct TextMessage // PACKET_TEXT_MESSAGE
+{
+	std::string text;
+
+	BCNET_SERIALIZABLE(TextMessage, text)
+};